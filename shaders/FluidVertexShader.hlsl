@@ -44,7 +44,8 @@ VertexShaderOutput main(VertexInput IN)
         // Interpolate between green and red
         OUT.DiffColor.xyz = lerp(float3(0, 1, 0), float3(1, 0, 0), (VelMag - 0.5) * 2);
     }
-    OUT.PosVS = mul(MVPBuffer.MV, IN.Position + float4(Particle.Position.xyz, 0));
+    // Removed particles waiting for compaction have Position.w = 0, collapse their sphere to a point
+    OUT.PosVS = mul(MVPBuffer.MV, float4(IN.Position.xyz * Particle.Position.w, IN.Position.w) + float4(Particle.Position.xyz, 0));
     OUT.NormalVS = normalize(mul(MVPBuffer.MV, IN.Normal));
     OUT.Position = mul(MVPBuffer.P, OUT.PosVS);
     return OUT;
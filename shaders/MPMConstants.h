@@ -0,0 +1,4 @@
+#pragma once
+
+// Constants the MPM shaders share with the C++ side, plain defines that HLSL and C++ include alike
+#define MOUSE_GRAB_RADIUS 0.75f
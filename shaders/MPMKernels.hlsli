@@ -0,0 +1,286 @@
+#pragma once
+
+// Bodies of the MPMSolver.hlsl kernels, one particle or grid cell per call. The shader's entry points call them with
+// its buffers, GPUReferenceSolver compiles this header as C++ and runs them on the thread pool, and the 2D CPU solver
+// transfers through the per node functions. Functions are inline, which HLSL accepts as well, so more than one C++
+// file can include it
+#include "MPMConstants.h"
+#include "Portability.hlsli"
+
+#ifndef __HLSL_VERSION
+namespace MPMShaders
+{
+using namespace HLSL;
+#endif
+
+#define IDENTITY_MATRIX float4x4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1)
+
+#define EOS_STIFFNESS 80000.0f
+#define EOS_POWER 7
+#define DYNAMIC_VISCOSITY 0.0f
+// Grid momentum and mass are accumulated as integers scaled by this, so P2G can use integer atomics
+#define GRID_FIXED_POINT_SCALE 100000.0f
+
+struct SceneData
+{
+    float3 MousePosition;
+    bool MouseDown;
+};
+
+struct ParticleRenderData
+{
+    float4 Position;
+    float4 Velocity;
+};
+
+struct ParticlePhysicsData
+{
+    matrix C;
+    matrix DeformGradient;
+    float Mass;
+    float InitialVolume;
+    float J;
+    float PlasticJ;
+};
+
+struct FluidParameters
+{
+    uint NumParticles;
+    uint GridResolution;
+    uint NumGridCells;
+    float Dx;
+    float InvDx;
+    float ElasticMu;
+    float ElasticLamda;
+    float DeltaTime;
+    float GridSize;
+    float Padding1, Padding2, Padding3;
+};
+
+struct GridCell
+{
+    float4 VelocityMass;
+    int4 IntVelocityMass;
+};
+
+inline float4x4 inverse(float4x4 m)
+{
+    float n11 = m[0][0], n12 = m[1][0], n13 = m[2][0], n14 = m[3][0];
+    float n21 = m[0][1], n22 = m[1][1], n23 = m[2][1], n24 = m[3][1];
+    float n31 = m[0][2], n32 = m[1][2], n33 = m[2][2], n34 = m[3][2];
+    float n41 = m[0][3], n42 = m[1][3], n43 = m[2][3], n44 = m[3][3];
+
+    float t11 = n23 * n34 * n42 - n24 * n33 * n42 + n24 * n32 * n43 - n22 * n34 * n43 - n23 * n32 * n44 + n22 * n33 * n44;
+    float t12 = n14 * n33 * n42 - n13 * n34 * n42 - n14 * n32 * n43 + n12 * n34 * n43 + n13 * n32 * n44 - n12 * n33 * n44;
+    float t13 = n13 * n24 * n42 - n14 * n23 * n42 + n14 * n22 * n43 - n12 * n24 * n43 - n13 * n22 * n44 + n12 * n23 * n44;
+    float t14 = n14 * n23 * n32 - n13 * n24 * n32 - n14 * n22 * n33 + n12 * n24 * n33 + n13 * n22 * n34 - n12 * n23 * n34;
+
+    float det = n11 * t11 + n21 * t12 + n31 * t13 + n41 * t14;
+    float idet = 1.0f / det;
+
+    // Built in one go rather than by element writes, which the C++ matrix doesn't support
+    return float4x4(
+        t11 * idet,
+        (n24 * n33 * n41 - n23 * n34 * n41 - n24 * n31 * n43 + n21 * n34 * n43 + n23 * n31 * n44 - n21 * n33 * n44) * idet,
+        (n22 * n34 * n41 - n24 * n32 * n41 + n24 * n31 * n42 - n21 * n34 * n42 - n22 * n31 * n44 + n21 * n32 * n44) * idet,
+        (n23 * n32 * n41 - n22 * n33 * n41 - n23 * n31 * n42 + n21 * n33 * n42 + n22 * n31 * n43 - n21 * n32 * n43) * idet,
+
+        t12 * idet,
+        (n13 * n34 * n41 - n14 * n33 * n41 + n14 * n31 * n43 - n11 * n34 * n43 - n13 * n31 * n44 + n11 * n33 * n44) * idet,
+        (n14 * n32 * n41 - n12 * n34 * n41 - n14 * n31 * n42 + n11 * n34 * n42 + n12 * n31 * n44 - n11 * n32 * n44) * idet,
+        (n12 * n33 * n41 - n13 * n32 * n41 + n13 * n31 * n42 - n11 * n33 * n42 - n12 * n31 * n43 + n11 * n32 * n43) * idet,
+
+        t13 * idet,
+        (n14 * n23 * n41 - n13 * n24 * n41 - n14 * n21 * n43 + n11 * n24 * n43 + n13 * n21 * n44 - n11 * n23 * n44) * idet,
+        (n12 * n24 * n41 - n14 * n22 * n41 + n14 * n21 * n42 - n11 * n24 * n42 - n12 * n21 * n44 + n11 * n22 * n44) * idet,
+        (n13 * n22 * n41 - n12 * n23 * n41 - n13 * n21 * n42 + n11 * n23 * n42 + n12 * n21 * n43 - n11 * n22 * n43) * idet,
+
+        t14 * idet,
+        (n13 * n24 * n31 - n14 * n23 * n31 + n14 * n21 * n33 - n11 * n24 * n33 - n13 * n21 * n34 + n11 * n23 * n34) * idet,
+        (n14 * n22 * n31 - n12 * n24 * n31 - n14 * n21 * n32 + n11 * n24 * n32 + n12 * n21 * n34 - n11 * n22 * n34) * idet,
+        (n12 * n23 * n31 - n13 * n22 * n31 + n13 * n21 * n32 - n11 * n23 * n32 - n12 * n21 * n33 + n11 * n22 * n33) * idet);
+}
+
+inline matrix outerProduct(float4 B, float4 A)
+{
+    return float4x4(
+        A.x * B.x, A.x * B.y, A.x * B.z, A.x * B.w,
+        A.y * B.x, A.y * B.y, A.y * B.z, A.y * B.w,
+        A.z * B.x, A.z * B.y, A.z * B.z, A.z * B.w,
+        A.w * B.x, A.w * B.y, A.w * B.z, A.w * B.w);
+}
+
+inline matrix NeoHookeanStress(ParticlePhysicsData PhysicsData, HLSL_IN(FluidParameters) Fluid)
+{
+    float Volume = determinant(PhysicsData.DeformGradient);
+
+    matrix DeformTranspose = transpose(PhysicsData.DeformGradient);
+    matrix DeformTransposeInverse = inverse(DeformTranspose);
+
+    matrix P = ((PhysicsData.DeformGradient - DeformTransposeInverse) * Fluid.ElasticMu) + (DeformTransposeInverse * (Fluid.ElasticLamda * log(Volume)));
+
+    return (P * DeformTranspose) * -(PhysicsData.InitialVolume * 4 * Fluid.InvDx * Fluid.InvDx);
+}
+
+inline matrix ConstitutiveStress(ParticlePhysicsData PhysicsData, HLSL_IN(FluidParameters) Fluid)
+{
+    float Pressure = max(0.0f, EOS_STIFFNESS * (pow(PhysicsData.J, -EOS_POWER) - 1.0f));
+    matrix Stress = float4x4(
+        -Pressure, 0.0f, 0.0f, 0.0f,
+        0.0f, -Pressure, 0.0f, 0.0f,
+        0.0f, 0.0f, -Pressure, 0.0f,
+        0.0f, 0.0f, 0.0f, -Pressure);
+    return -PhysicsData.InitialVolume * Stress * 4.0f * Fluid.InvDx * Fluid.DeltaTime;
+}
+
+inline float3 ApplyMouseInteraction(float4 Position, HLSL_IN(SceneData) Scene)
+{
+    if (Scene.MouseDown)
+    {
+        float3 ToMouse = Scene.MousePosition - Position.xyz;
+        float Distance = length(ToMouse);
+        if (Distance < MOUSE_GRAB_RADIUS)
+        {
+            float NormalizationFactor = pow(Distance / MOUSE_GRAB_RADIUS, 8);
+            return normalize(ToMouse) * 0.1f * NormalizationFactor;
+        }
+    }
+    return float3(0.0f, 0.0f, 0.0f);
+}
+
+// Momentum and mass one grid node gets from a particle. Affine is the APIC term C * Mass plus the stress impulse,
+// CellDistance the node's offset from the particle in world units and w of Momentum is ignored
+inline float4 ParticleToNode(matrix Affine, float4 Momentum, float Mass, float4 CellDistance, float Weight)
+{
+    return float4((Momentum + mul(Affine, CellDistance)).xyz, Mass) * Weight;
+}
+
+// Adds a node's weighted velocity to a particle's, and its moment to B = sum of Velocity * CellDistance^T, which APIC C
+// is B * D^-1 of. C comes out as the velocity gradient, C[i][j] = dv_i / dx_j
+inline void NodeToParticle(float4 WeightedVelocity, float4 CellDistance, HLSL_INOUT(float4) Velocity, HLSL_INOUT(matrix) B)
+{
+    B += outerProduct(CellDistance, WeightedVelocity);
+    Velocity.xyz += WeightedVelocity.xyz;
+}
+
+inline void GridToParticleKernel(uint Index, HLSL_RW_BUFFER(ParticleRenderData) Particles, HLSL_RW_BUFFER(ParticlePhysicsData) ParticleData, HLSL_RW_BUFFER(GridCell) Grid, HLSL_IN(FluidParameters) Fluid, HLSL_IN(SceneData) Scene)
+{
+    ParticleRenderData Particle = Particles[Index];
+    int3 CellIndex = int3((Particle.Position.xyz * Fluid.InvDx) - 0.5f);
+    float3 CellDifference = (Particle.Position.xyz * Fluid.InvDx) - float3(CellIndex);
+
+    // Precalculate quadratic weight coefficients
+    float3 Weights[3];
+    Weights[0] = pow(1.5f - CellDifference, 2) * 0.5f;
+    Weights[1] = 0.75f - pow(CellDifference - 1.0f, 2);
+    Weights[2] = pow(CellDifference - 0.5f, 2) * 0.5f;
+
+    matrix B = float4x4(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+    float4 Velocity = float4(0.0f, 0.0f, 0.0f, 0.0f);
+    for (int x = 0; x < 3; x++)
+    {
+        for (int y = 0; y < 3; y++)
+        {
+            for (int z = 0; z < 3; z++)
+            {
+                float Weight = Weights[x].x * Weights[y].y * Weights[z].z;
+
+                float4 CellDistance = float4(x - CellDifference.x, y - CellDifference.y, z - CellDifference.z, 0.0f) * Fluid.Dx;
+
+                int GridIndex = ((CellIndex.x + x) * Fluid.GridResolution + CellIndex.y + y) * Fluid.GridResolution + CellIndex.z + z;
+                NodeToParticle(Grid[GridIndex].VelocityMass * Weight, CellDistance, Velocity, B);
+            }
+        }
+    }
+    Particles[Index].Velocity = Velocity;
+    ParticleData[Index].C = B * 4 * Fluid.InvDx;
+
+    Particles[Index].Position += Particles[Index].Velocity * Fluid.DeltaTime;
+
+    Particles[Index].Position.x = min(max(Particles[Index].Position.x, Fluid.Dx), Fluid.GridSize - 2 * Fluid.Dx);
+    Particles[Index].Position.y = min(max(Particles[Index].Position.y, Fluid.Dx), Fluid.GridSize - 2 * Fluid.Dx);
+    Particles[Index].Position.z = min(max(Particles[Index].Position.z, Fluid.Dx), Fluid.GridSize - 2 * Fluid.Dx);
+
+    ParticleData[Index].C = (IDENTITY_MATRIX + (ParticleData[Index].C * Fluid.DeltaTime));
+    ParticleData[Index].J = ParticleData[Index].J * (ParticleData[Index].C[0][0] + ParticleData[Index].C[1][1] + ParticleData[Index].C[2][2] - 2);
+    Particles[Index].Velocity.xyz += ApplyMouseInteraction(Particles[Index].Position, Scene);
+}
+
+inline void GridUpdateKernel(uint Index, HLSL_RW_BUFFER(GridCell) Grid, HLSL_IN(FluidParameters) Fluid)
+{
+    Grid[Index].VelocityMass = float4(Grid[Index].IntVelocityMass) / GRID_FIXED_POINT_SCALE;
+    float4 Gravity = float4(0.0f, -9.8f * Fluid.DeltaTime, 0.0f, 0.0f);
+    if (Grid[Index].VelocityMass.w > 0.00000001)
+    {
+        Grid[Index].VelocityMass.xyz /= Grid[Index].VelocityMass.w;
+
+        // Apply Gravity
+        Grid[Index].VelocityMass += Gravity;
+
+        // Apply Boundary Conditions
+        int Resolution = int(Fluid.GridResolution);
+        int X = Index / (Fluid.GridResolution * Fluid.GridResolution);
+        int Y = (Index / Fluid.GridResolution) % Fluid.GridResolution;
+        int Z = Index % Fluid.GridResolution;
+
+        if (X < 2 || X > Resolution - 2)
+        {
+            Grid[Index].VelocityMass.x *= 0.001f;
+        }
+
+        if (Y < 2 || Y > Resolution - 2)
+        {
+            Grid[Index].VelocityMass.y *= 0.001f;
+        }
+
+        if (Z < 2 || Z > Resolution - 2)
+        {
+            Grid[Index].VelocityMass.z = 0.0f;
+        }
+    }
+}
+
+inline void ParticleToGridKernel(uint Index, HLSL_RW_BUFFER(ParticleRenderData) Particles, HLSL_RW_BUFFER(ParticlePhysicsData) ParticleData, HLSL_RW_BUFFER(GridCell) Grid, HLSL_IN(FluidParameters) Fluid)
+{
+    ParticleRenderData Particle = Particles[Index];
+    matrix Affine = ConstitutiveStress(ParticleData[Index], Fluid) + (ParticleData[Index].C * ParticleData[Index].Mass);
+    int3 CellIndex = int3((Particle.Position.xyz * Fluid.InvDx) - 0.5f);
+    float3 CellDifference = (Particle.Position.xyz * Fluid.InvDx) - float3(CellIndex);
+
+    // Precalculate quadratic weight coefficients
+    float3 Weights[3];
+    Weights[0] = pow(1.5f - CellDifference, 2) * 0.5f;
+    Weights[1] = 0.75f - pow(CellDifference - 1.0f, 2);
+    Weights[2] = pow(CellDifference - 0.5f, 2) * 0.5f;
+
+    for (int x = 0; x < 3; x++)
+    {
+        for (int y = 0; y < 3; y++)
+        {
+            for (int z = 0; z < 3; z++)
+            {
+                float Weight = Weights[x].x * Weights[y].y * Weights[z].z;
+
+                float4 CellDistance = float4(x - CellDifference.x, y - CellDifference.y, z - CellDifference.z, 0.0f) * Fluid.Dx;
+
+                int GridIndex = ((CellIndex.x + x) * Fluid.GridResolution + CellIndex.y + y) * Fluid.GridResolution + CellIndex.z + z;
+
+                int4 IntVelocityAddition = int4(ParticleToNode(Affine, Particle.Velocity * ParticleData[Index].Mass, ParticleData[Index].Mass, CellDistance, Weight) * GRID_FIXED_POINT_SCALE);
+                InterlockedAdd(Grid[GridIndex].IntVelocityMass.x, IntVelocityAddition.x);
+                InterlockedAdd(Grid[GridIndex].IntVelocityMass.y, IntVelocityAddition.y);
+                InterlockedAdd(Grid[GridIndex].IntVelocityMass.z, IntVelocityAddition.z);
+                InterlockedAdd(Grid[GridIndex].IntVelocityMass.w, IntVelocityAddition.w);
+            }
+        }
+    }
+}
+
+inline void ClearGridKernel(uint Index, HLSL_RW_BUFFER(GridCell) Grid)
+{
+    Grid[Index].VelocityMass = float4(0.0f, 0.0f, 0.0f, 0.0f);
+    Grid[Index].IntVelocityMass = int4(0, 0, 0, 0);
+}
+
+#ifndef __HLSL_VERSION
+}
+#endif
@@ -0,0 +1,247 @@
+#pragma once
+
+// Lets a shader header compile as C++ as well as HLSL, see MPMKernels.hlsli. Shared code sticks to the subset
+// below: float3/float4/int3/int4/float4x4 with component wise arithmetic, .xyz on a float4, m[Row][Column] reads of a
+// matrix, explicit conversions between int and float vectors, and buffers, constant buffers and inout parameters
+// passed through the HLSL_* parameter macros instead of read as globals
+
+#ifdef __HLSL_VERSION
+
+#define HLSL_IN(Type) Type
+#define HLSL_INOUT(Type) inout Type
+#define HLSL_RW_BUFFER(Type) RWStructuredBuffer<Type>
+
+#else
+
+#include <atomic>
+#include <cmath>
+#include <stdint.h>
+
+#define HLSL_IN(Type) const Type&
+#define HLSL_INOUT(Type) Type&
+#define HLSL_RW_BUFFER(Type) Type*
+
+namespace HLSL
+{
+    typedef uint32_t uint;
+
+    struct float3;
+
+    struct int3
+    {
+        int x, y, z;
+
+        int3() = default;
+        constexpr int3(int X, int Y, int Z)
+            : x(X), y(Y), z(Z)
+        {
+        }
+        // Truncates like the HLSL cast
+        explicit int3(const float3& V);
+    };
+
+    struct float3
+    {
+        float x, y, z;
+
+        float3() = default;
+        constexpr float3(float X, float Y, float Z)
+            : x(X), y(Y), z(Z)
+        {
+        }
+        explicit constexpr float3(const int3& V)
+            : x(float(V.x)), y(float(V.y)), z(float(V.z))
+        {
+        }
+    };
+
+    inline int3::int3(const float3& V)
+        : x(int(V.x)), y(int(V.y)), z(int(V.z))
+    {
+    }
+
+    struct float4;
+
+    struct int4
+    {
+        int x, y, z, w;
+
+        int4() = default;
+        constexpr int4(int X, int Y, int Z, int W)
+            : x(X), y(Y), z(Z), w(W)
+        {
+        }
+        explicit int4(const float4& V);
+    };
+
+    // Same layout as Math::Vec4, xyz aliases the first three components
+    struct float4
+    {
+        union
+        {
+            struct
+            {
+                float x, y, z, w;
+            };
+            float3 xyz;
+        };
+
+        float4() = default;
+        constexpr float4(float X, float Y, float Z, float W)
+            : x(X), y(Y), z(Z), w(W)
+        {
+        }
+        constexpr float4(const float3& XYZ, float W)
+            : x(XYZ.x), y(XYZ.y), z(XYZ.z), w(W)
+        {
+        }
+        explicit constexpr float4(const int4& V)
+            : x(float(V.x)), y(float(V.y)), z(float(V.z)), w(float(V.w))
+        {
+        }
+
+        float operator[](int Component) const
+        {
+            return (&x)[Component];
+        }
+    };
+
+    inline int4::int4(const float4& V)
+        : x(int(V.x)), y(int(V.y)), z(int(V.z)), w(int(V.w))
+    {
+    }
+
+    // Stored column major like Math::Matrix4x4 and the GPU buffers, so a buffer of either can be read as the other.
+    // The constructor takes rows as in HLSL and m[Row][Column] reads element (Row, Column)
+    struct float4x4
+    {
+        float Columns[4][4];
+
+        float4x4() = default;
+        constexpr float4x4(float m00, float m01, float m02, float m03, float m10, float m11, float m12, float m13, float m20, float m21, float m22, float m23, float m30, float m31, float m32, float m33)
+            : Columns{{m00, m10, m20, m30}, {m01, m11, m21, m31}, {m02, m12, m22, m32}, {m03, m13, m23, m33}}
+        {
+        }
+
+        float4 operator[](int Row) const
+        {
+            return float4(Columns[0][Row], Columns[1][Row], Columns[2][Row], Columns[3][Row]);
+        }
+    };
+    typedef float4x4 matrix;
+
+    inline float3 operator+(const float3& A, const float3& B) { return float3(A.x + B.x, A.y + B.y, A.z + B.z); }
+    inline float3 operator-(const float3& A, const float3& B) { return float3(A.x - B.x, A.y - B.y, A.z - B.z); }
+    inline float3 operator*(const float3& A, const float3& B) { return float3(A.x * B.x, A.y * B.y, A.z * B.z); }
+    inline float3 operator+(const float3& A, float B) { return float3(A.x + B, A.y + B, A.z + B); }
+    inline float3 operator-(const float3& A, float B) { return float3(A.x - B, A.y - B, A.z - B); }
+    inline float3 operator-(float A, const float3& B) { return float3(A - B.x, A - B.y, A - B.z); }
+    inline float3 operator*(const float3& A, float B) { return float3(A.x * B, A.y * B, A.z * B); }
+    inline float3 operator*(float A, const float3& B) { return B * A; }
+    inline float3 operator/(const float3& A, float B) { return float3(A.x / B, A.y / B, A.z / B); }
+    inline float3& operator+=(float3& A, const float3& B) { return A = A + B; }
+    inline float3& operator-=(float3& A, const float3& B) { return A = A - B; }
+    inline float3& operator*=(float3& A, float B) { return A = A * B; }
+    inline float3& operator/=(float3& A, float B) { return A = A / B; }
+
+    inline float4 operator+(const float4& A, const float4& B) { return float4(A.x + B.x, A.y + B.y, A.z + B.z, A.w + B.w); }
+    inline float4 operator-(const float4& A, const float4& B) { return float4(A.x - B.x, A.y - B.y, A.z - B.z, A.w - B.w); }
+    inline float4 operator*(const float4& A, const float4& B) { return float4(A.x * B.x, A.y * B.y, A.z * B.z, A.w * B.w); }
+    inline float4 operator*(const float4& A, float B) { return float4(A.x * B, A.y * B, A.z * B, A.w * B); }
+    inline float4 operator*(float A, const float4& B) { return B * A; }
+    inline float4 operator/(const float4& A, float B) { return float4(A.x / B, A.y / B, A.z / B, A.w / B); }
+    inline float4& operator+=(float4& A, const float4& B) { return A = A + B; }
+    inline float4& operator-=(float4& A, const float4& B) { return A = A - B; }
+    inline float4& operator*=(float4& A, float B) { return A = A * B; }
+    inline float4& operator/=(float4& A, float B) { return A = A / B; }
+
+    // Matrix operators are component wise as in HLSL, mul is the matrix product
+    inline float4x4 operator+(const float4x4& A, const float4x4& B)
+    {
+        float4x4 Result;
+        for (int i = 0; i < 16; i++)
+        {
+            Result.Columns[i / 4][i % 4] = A.Columns[i / 4][i % 4] + B.Columns[i / 4][i % 4];
+        }
+        return Result;
+    }
+    inline float4x4 operator-(const float4x4& A, const float4x4& B)
+    {
+        float4x4 Result;
+        for (int i = 0; i < 16; i++)
+        {
+            Result.Columns[i / 4][i % 4] = A.Columns[i / 4][i % 4] - B.Columns[i / 4][i % 4];
+        }
+        return Result;
+    }
+    inline float4x4 operator*(const float4x4& A, const float4x4& B)
+    {
+        float4x4 Result;
+        for (int i = 0; i < 16; i++)
+        {
+            Result.Columns[i / 4][i % 4] = A.Columns[i / 4][i % 4] * B.Columns[i / 4][i % 4];
+        }
+        return Result;
+    }
+    inline float4x4 operator*(const float4x4& A, float B)
+    {
+        float4x4 Result;
+        for (int i = 0; i < 16; i++)
+        {
+            Result.Columns[i / 4][i % 4] = A.Columns[i / 4][i % 4] * B;
+        }
+        return Result;
+    }
+    inline float4x4 operator*(float A, const float4x4& B) { return B * A; }
+    inline float4x4& operator+=(float4x4& A, const float4x4& B) { return A = A + B; }
+
+    // Scalar pow, log and sqrt come from <cmath>
+    inline float min(float A, float B) { return A < B ? A : B; }
+    inline float max(float A, float B) { return A > B ? A : B; }
+    inline float3 pow(const float3& V, float Power) { return float3(std::pow(V.x, Power), std::pow(V.y, Power), std::pow(V.z, Power)); }
+    inline float dot(const float3& A, const float3& B) { return A.x * B.x + A.y * B.y + A.z * B.z; }
+    inline float length(const float3& V) { return std::sqrt(dot(V, V)); }
+    inline float3 normalize(const float3& V) { return V / length(V); }
+
+    inline float4 mul(const float4x4& M, const float4& V)
+    {
+        float4 Result(0.0f, 0.0f, 0.0f, 0.0f);
+        const float Components[4] = {V.x, V.y, V.z, V.w};
+        for (int Column = 0; Column < 4; Column++)
+        {
+            Result += float4(M.Columns[Column][0], M.Columns[Column][1], M.Columns[Column][2], M.Columns[Column][3]) * Components[Column];
+        }
+        return Result;
+    }
+
+    inline float4x4 transpose(const float4x4& M)
+    {
+        float4x4 Result;
+        for (int i = 0; i < 16; i++)
+        {
+            Result.Columns[i / 4][i % 4] = M.Columns[i % 4][i / 4];
+        }
+        return Result;
+    }
+
+    inline float determinant(const float4x4& M)
+    {
+        // Expansion along the first row, the minors' 2x2 determinants built from the bottom two rows
+        const float (&c)[4][4] = M.Columns;
+        float A2323 = c[2][2] * c[3][3] - c[3][2] * c[2][3];
+        float A1323 = c[1][2] * c[3][3] - c[3][2] * c[1][3];
+        float A1223 = c[1][2] * c[2][3] - c[2][2] * c[1][3];
+        float A0323 = c[0][2] * c[3][3] - c[3][2] * c[0][3];
+        float A0223 = c[0][2] * c[2][3] - c[2][2] * c[0][3];
+        float A0123 = c[0][2] * c[1][3] - c[1][2] * c[0][3];
+        return c[0][0] * (c[1][1] * A2323 - c[2][1] * A1323 + c[3][1] * A1223) - c[1][0] * (c[0][1] * A2323 - c[2][1] * A0323 + c[3][1] * A0223) + c[2][0] * (c[0][1] * A1323 - c[1][1] * A0323 + c[3][1] * A0123) - c[3][0] * (c[0][1] * A1223 - c[1][1] * A0223 + c[2][1] * A0123);
+    }
+
+    // Atomic on the CPU as on the GPU, P2G dispatches scatter from many threads
+    inline void InterlockedAdd(int& Destination, int Value)
+    {
+        std::atomic_ref<int>(Destination).fetch_add(Value, std::memory_order_relaxed);
+    }
+}
+
+#endif
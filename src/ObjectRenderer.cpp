@@ -1,6 +1,7 @@
 #include "ObjectRenderer.h"
 
 #include "Renderer.h"
+#include "ShaderCompiler.h"
 #include <d3d12.h>
 
 ObjectRenderer::ObjectRenderer()
@@ -11,6 +12,16 @@ ObjectRenderer::~ObjectRenderer()
 {
 }
 
+void ObjectRenderer::RecompileShaders(ShaderCompiler& Compiler) const
+{
+    std::vector<ShaderDesc> Shaders;
+    GetShaders(Shaders);
+    for (const ShaderDesc& Shader : Shaders)
+    {
+        Compiler.CompileShaderAsync(Shader, true);
+    }
+}
+
 void ObjectRenderer::ApplyRotation(const Math::Matrix& Transform)
 {
     Rotation = Math::Multiply(Transform, Rotation);
@@ -12,6 +12,7 @@ typedef Microsoft::WRL::ComPtr<ID3D12Device2> ID3D12DevicePtr;
 
 class Renderer;
 class ShaderCompiler;
+struct ShaderDesc;
 
 class ObjectRenderer
 {
@@ -30,8 +31,16 @@ public:
     void SetTranslation(const Math::Vec4& Transform);
     Math::Matrix GetModelMatrix();
 
+    // May run off the main thread while the object is drawn, so pipeline states other than the returned one are only
+    // built here and put in use by ApplyPipelineStates
     virtual Microsoft::WRL::ComPtr<ID3D12PipelineState> CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler) = 0;
-    virtual void RecompileShaders(ShaderCompiler& Compiler) = 0;
+    // Called between frames with the GPU idle
+    virtual void ApplyPipelineStates() {};
+    // Every shader the object's pipeline states are built from
+    virtual void GetShaders(std::vector<ShaderDesc>& Shaders) const = 0;
+    // Queues compiles of every shader the object uses and returns without waiting, CreatePipelineStateObject then
+    // waits for them
+    void RecompileShaders(ShaderCompiler& Compiler) const;
 
 protected:
     D3D_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1,6 +1,10 @@
 #include "Scene.h"
 
 #include "ObjectRenderer.h"
+#include "ShaderCompiler.h"
+
+#include <algorithm>
+#include <future>
 
 Scene::Scene(ID3D12DevicePtr Device, ShaderCompiler& Compiler)
     : D3D12Device(Device), Compiler(Compiler)
@@ -16,9 +20,12 @@ void Scene::AddObject(ObjectRenderer* Object)
     }
     else
     {
+        // Gets all of the object's shaders compiling at once, building the pipeline state then waits for them
+        Object->RecompileShaders(Compiler);
         RenderGroup Group = {
             Object->CreatePipelineStateObject(D3D12Device, Compiler),
             {Object}};
+        Object->ApplyPipelineStates();
         RenderGroups.insert({TypeIndex, Group});
     }
 }
@@ -36,14 +43,77 @@ void Scene::HandleKeyPress(uint64_t wParam, bool isRepeat)
 
 void Scene::ReloadShaders()
 {
+    std::lock_guard<std::mutex> Lock(ReloadMutex);
+    // Queue every group's shaders before building any pipeline state, so they all compile at once
     for (auto& [typeID, renderGroup] : RenderGroups)
     {
         if (!renderGroup.Objects.empty())
         {
             renderGroup.Objects[0]->RecompileShaders(Compiler);
-            RenderGroups[typeID].PipelineStateObject = renderGroup.Objects[0]->CreatePipelineStateObject(D3D12Device, Compiler);
         }
     }
+    for (auto& [typeID, renderGroup] : RenderGroups)
+    {
+        if (!renderGroup.Objects.empty())
+        {
+            renderGroup.PipelineStateObject = renderGroup.Objects[0]->CreatePipelineStateObject(D3D12Device, Compiler);
+            renderGroup.Objects[0]->ApplyPipelineStates();
+        }
+    }
+    // Older than what was just built
+    ReloadedPipelineStates.clear();
+}
+
+bool Scene::ReloadChangedShaders()
+{
+    std::vector<ShaderDesc> ChangedShaders = Compiler.FindChangedShaders();
+    std::vector<std::shared_future<bool>> Compiles;
+    for (const ShaderDesc& Shader : ChangedShaders)
+    {
+        Compiles.push_back(Compiler.CompileShaderAsync(Shader, false));
+    }
+    // A shader that fails to compile keeps its last good version, so its pipeline states are left alone
+    std::vector<ShaderDesc> ReloadedShaders;
+    for (size_t i = 0; i < Compiles.size(); i++)
+    {
+        if (Compiles[i].get())
+        {
+            ReloadedShaders.push_back(ChangedShaders[i]);
+        }
+    }
+    if (ReloadedShaders.empty())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> Lock(ReloadMutex);
+    for (auto& [typeID, renderGroup] : RenderGroups)
+    {
+        if (renderGroup.Objects.empty())
+        {
+            continue;
+        }
+        std::vector<ShaderDesc> GroupShaders;
+        renderGroup.Objects[0]->GetShaders(GroupShaders);
+        if (std::any_of(GroupShaders.begin(), GroupShaders.end(), [&ReloadedShaders](const ShaderDesc& Shader)
+                        { return std::find(ReloadedShaders.begin(), ReloadedShaders.end(), Shader) != ReloadedShaders.end(); }))
+        {
+            ReloadedPipelineStates[typeID] = renderGroup.Objects[0]->CreatePipelineStateObject(D3D12Device, Compiler);
+        }
+    }
+    return !ReloadedPipelineStates.empty();
+}
+
+void Scene::ApplyReloadedShaders()
+{
+    std::lock_guard<std::mutex> Lock(ReloadMutex);
+    for (auto& [typeID, PipelineState] : ReloadedPipelineStates)
+    {
+        RenderGroup& Group = RenderGroups.at(typeID);
+        Group.PipelineStateObject = PipelineState;
+        Group.Objects[0]->ApplyPipelineStates();
+    }
+    ReloadedPipelineStates.clear();
 }
 
 void Scene::Update(double DeltaTime)
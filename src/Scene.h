@@ -1,6 +1,7 @@
 
 #include "util/3DMath.h"
 #include <d3d12.h>
+#include <mutex>
 #include <typeindex>
 #include <unordered_map>
 #include <vector>
@@ -23,7 +24,14 @@ public:
     Scene(ID3D12DevicePtr Device, ShaderCompiler& Compiler);
 
     void AddObject(ObjectRenderer* Object);
+    // Recompiles every shader and rebuilds every pipeline state, waiting for both
     void ReloadShaders();
+    // Recompiles only the shaders whose files changed on disk and rebuilds the pipeline states of the groups using
+    // them, without touching the ones in use. Meant for a background thread, returns true if ApplyReloadedShaders has
+    // anything to swap in
+    bool ReloadChangedShaders();
+    // Swaps in what ReloadChangedShaders built, between frames and with the GPU idle
+    void ApplyReloadedShaders();
 
     void HandleKeyPress(uint64_t wParam, bool isRepeat);
 
@@ -34,4 +42,9 @@ private:
     ID3D12DevicePtr D3D12Device;
     ShaderCompiler& Compiler;
     std::unordered_map<std::type_index, RenderGroup> RenderGroups;
+
+    // Rebuilt group pipeline states waiting for ApplyReloadedShaders. The lock also keeps reloads from building the
+    // objects' own pipeline states at the same time
+    std::unordered_map<std::type_index, Microsoft::WRL::ComPtr<ID3D12PipelineState>> ReloadedPipelineStates;
+    std::mutex ReloadMutex;
 };
\ No newline at end of file
@@ -3,18 +3,143 @@
 #include "dxc/dxcapi.h"
 #include "util/RenderUtils.h"
 
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+// Forwards to DXC's default include handler and keeps every file it loads, in the order they are loaded, with the
+// contents the compiler saw
+class RecordingIncludeHandler : public IDxcIncludeHandler
+{
+public:
+    struct Include
+    {
+        std::filesystem::path Path;
+        std::vector<uint8_t> Contents;
+    };
+
+    RecordingIncludeHandler(IDxcIncludeHandler* DefaultHandler)
+        : DefaultHandler(DefaultHandler)
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE LoadSource(LPCWSTR FileName, IDxcBlob** IncludeSource) override
+    {
+        HRESULT HResult = DefaultHandler->LoadSource(FileName, IncludeSource);
+        if (SUCCEEDED(HResult) && *IncludeSource)
+        {
+            std::filesystem::path Path = std::filesystem::path(FileName).lexically_normal();
+            if (std::none_of(Includes.begin(), Includes.end(), [&Path](const Include& Entry)
+                             { return Entry.Path == Path; }))
+            {
+                const uint8_t* Data = static_cast<const uint8_t*>((*IncludeSource)->GetBufferPointer());
+                Includes.push_back({Path, std::vector<uint8_t>(Data, Data + (*IncludeSource)->GetBufferSize())});
+            }
+        }
+        return HResult;
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID Id, void** Object) override
+    {
+        if (Id == __uuidof(IDxcIncludeHandler) || Id == __uuidof(IUnknown))
+        {
+            *Object = static_cast<IDxcIncludeHandler*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *Object = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    // Lives on the stack for the length of one compile, so the count is only kept for COM's sake
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return ++RefCount;
+    }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        return --RefCount;
+    }
+
+    std::vector<Include> Includes;
+
+private:
+    IDxcIncludeHandler* DefaultHandler;
+    ULONG RefCount = 1;
+};
+
+static bool ReadShaderFile(LPCWSTR FileName, std::vector<uint8_t>& Data)
+{
+    HANDLE ReadHandle = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    while (ReadHandle == INVALID_HANDLE_VALUE)
+    {
+        if (GetLastError() != ERROR_SHARING_VIOLATION)
+        {
+            RenderUtils::CreateDialogOnLastError();
+            return false;
+        }
+        ReadHandle = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    };
+    LARGE_INTEGER FileSize;
+    if (!GetFileSizeEx(ReadHandle, &FileSize))
+    {
+        RenderUtils::CreateDialogOnLastError();
+        CloseHandle(ReadHandle);
+        return false;
+    }
+    Data.resize(FileSize.QuadPart);
+    DWORD BytesRead;
+    if (!ReadFile(ReadHandle, Data.data(), FileSize.QuadPart, &BytesRead, NULL))
+    {
+        RenderUtils::CreateDialogOnLastError();
+        CloseHandle(ReadHandle);
+        return false;
+    }
+    CloseHandle(ReadHandle);
+    Data.resize(BytesRead);
+    return true;
+}
+
+// Key of the compiled shader in the cache, covering the source and the contents of every include
+static uint64_t GetContentKey(uint64_t ShaderKey, const std::vector<uint8_t>& Source, const std::vector<RecordingIncludeHandler::Include>& Includes)
+{
+    uint64_t Key = ShaderCache::Hash(Source.data(), Source.size(), ShaderKey);
+    for (const RecordingIncludeHandler::Include& Entry : Includes)
+    {
+        std::wstring Path = Entry.Path.wstring();
+        Key = ShaderCache::Hash(Path.data(), Path.size() * sizeof(wchar_t), Key);
+        Key = ShaderCache::Hash(Entry.Contents.data(), Entry.Contents.size(), Key);
+    }
+    return Key;
+}
+
 ShaderCompiler::ShaderCompiler()
 {
-    DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&DxcUtils));
-    DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&DxcCompiler));
+    // A new compiler invalidates the whole cache
+    Microsoft::WRL::ComPtr<IDxcCompiler3> DxcCompiler;
+    Microsoft::WRL::ComPtr<IDxcVersionInfo> VersionInfo;
+    UINT32 Version[2] = {0, 0};
+    if (SUCCEEDED(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&DxcCompiler))) && SUCCEEDED(DxcCompiler.As(&VersionInfo)))
+    {
+        VersionInfo->GetVersion(&Version[0], &Version[1]);
+    }
+    CompilerVersionKey = ShaderCache::Hash(Version, sizeof(Version));
 
-    for (int i = 0; i < SHADER_COMPILATION_THREADS; i++)
+    uint32_t NumThreads = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+    for (uint32_t i = 0; i < NumThreads; i++)
     {
-        WorkerThreads.emplace_back(std::thread(&ShaderCompiler::CompilationThreadRunner, this));
+        WorkerThreads.emplace_back(&ShaderCompiler::CompilationThreadRunner, this);
     }
 }
+
 ShaderCompiler::~ShaderCompiler()
 {
+    {
+        std::lock_guard<std::mutex> Lock(QueueMutex);
+        Stopping = true;
+    }
     WorkCV.notify_all();
     for (auto& Thread : WorkerThreads)
     {
@@ -24,116 +149,239 @@ ShaderCompiler::~ShaderCompiler()
 
 Microsoft::WRL::ComPtr<ID3DBlob> ShaderCompiler::GetShader(const ShaderDesc& ShaderDesc)
 {
-    std::lock_guard<std::recursive_mutex> Lock(LastKnownGoodMutex);
-    if (auto LastKnownGood = LastKnownGoodShaders.find(ShaderDesc.FileName); LastKnownGood != LastKnownGoodShaders.end())
+    uint64_t ShaderKey = GetShaderKey(ShaderDesc);
+    std::shared_future<bool> Pending;
     {
-        return LastKnownGood->second;
+        std::lock_guard<std::mutex> Lock(QueueMutex);
+        if (auto Job = InFlight.find(ShaderKey); Job != InFlight.end())
+        {
+            // Errors of a shader someone waits on should show
+            if (!Job->second->Started)
+            {
+                Job->second->ErrorOnFail = true;
+            }
+            Pending = Job->second->Result;
+        }
     }
-    if (CompileShaderFromFile(ShaderDesc, true))
+    if (!Pending.valid())
     {
-        return LastKnownGoodShaders[ShaderDesc.FileName];
+        if (Microsoft::WRL::ComPtr<ID3DBlob> LastKnownGood = FindLastKnownGood(ShaderKey))
+        {
+            return LastKnownGood;
+        }
+        Pending = CompileShaderAsync(ShaderDesc, true);
     }
-    return nullptr;
+    Pending.wait();
+    return FindLastKnownGood(ShaderKey);
 }
 
-void ShaderCompiler::CompileShader(const ShaderDesc& Desc, std::function<void(bool)> Completion, bool ErrorOnFail)
+std::shared_future<bool> ShaderCompiler::CompileShaderAsync(const ShaderDesc& Desc, bool ErrorOnFail)
 {
-    CompileWorkItem WorkItem = {
-        Desc,
-        ErrorOnFail,
-        Completion};
-
+    uint64_t ShaderKey = GetShaderKey(Desc);
     std::lock_guard<std::mutex> Lock(QueueMutex);
-    WorkQueue.push(WorkItem);
-    WorkCV.notify_one();
-}
+    // A compile that started may have read the file before the change this request is for, so only join queued ones
+    if (auto Queued = InFlight.find(ShaderKey); Queued != InFlight.end() && !Queued->second->Started)
+    {
+        Queued->second->ErrorOnFail = Queued->second->ErrorOnFail || ErrorOnFail;
+        return Queued->second->Result;
+    }
 
-void ShaderCompiler::CompileShaderNonAsync(const ShaderDesc& Desc, bool ErrorOnFail)
-{
-    CompileShaderFromFile(Desc, ErrorOnFail);
+    std::shared_ptr<CompileJob> Job = std::make_shared<CompileJob>();
+    Job->Desc = Desc;
+    Job->ShaderKey = ShaderKey;
+    Job->ErrorOnFail = ErrorOnFail;
+    Job->Result = Job->Promise.get_future().share();
+    InFlight[ShaderKey] = Job;
+    WorkQueue.push_back(Job);
+    WorkCV.notify_one();
+    return Job->Result;
 }
 
 void ShaderCompiler::CompilationThreadRunner()
 {
-    CompileWorkItem WorkItem;
+    Microsoft::WRL::ComPtr<IDxcUtils> DxcUtils;
+    Microsoft::WRL::ComPtr<IDxcCompiler3> DxcCompiler;
+    DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&DxcUtils));
+    DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&DxcCompiler));
+
     while (true)
     {
-        // Grab work if available
-        std::unique_lock<std::mutex> QueueLock(QueueMutex);
-        if (!WorkQueue.empty())
-        {
-            WorkItem = WorkQueue.front();
-            WorkQueue.pop();
-            QueueLock.unlock();
-
-            // Work work
-            WorkItem.Completion(CompileShaderFromFile(WorkItem.Desc, WorkItem.ErrorOnFail));
-
-            // Continue to churn through work if there is work to do
-            continue;
-        }
-        else
+        std::shared_ptr<CompileJob> Job;
+        bool ErrorOnFail;
         {
-            QueueLock.unlock();
+            std::unique_lock<std::mutex> Lock(QueueMutex);
+            WorkCV.wait(Lock, [this]()
+                        { return Stopping || !WorkQueue.empty(); });
+            // Queued work is finished before shutting down, so no future is left without a result
+            if (WorkQueue.empty())
+            {
+                return;
+            }
+            Job = WorkQueue.front();
+            WorkQueue.pop_front();
+            Job->Started = true;
+            ErrorOnFail = Job->ErrorOnFail;
         }
 
-        // Wait for more work
-        std::unique_lock<std::mutex> CVLock(CVMutex);
-        WorkCV.wait(CVLock);
+        bool Compiled = CompileShaderFromFile(Job->Desc, DxcUtils.Get(), DxcCompiler.Get(), ErrorOnFail);
 
-        // If we were notified and there is no work that means we are done
         {
-            std::lock_guard<std::mutex> QueueLock(QueueMutex);
-            if (WorkQueue.empty())
+            std::lock_guard<std::mutex> Lock(QueueMutex);
+            if (auto Latest = InFlight.find(Job->ShaderKey); Latest != InFlight.end() && Latest->second == Job)
             {
-                return;
+                InFlight.erase(Latest);
             }
         }
+        Job->Promise.set_value(Compiled);
     }
 }
 
-bool ShaderCompiler::CompileShaderFromFile(const ShaderDesc& ShaderDesc, bool ErrorOnFail)
+Microsoft::WRL::ComPtr<ID3DBlob> ShaderCompiler::FindLastKnownGood(uint64_t ShaderKey)
 {
-    Microsoft::WRL::ComPtr<IDxcIncludeHandler> IncludeHandler;
-    DxcUtils->CreateDefaultIncludeHandler(&IncludeHandler);
+    std::lock_guard<std::mutex> Lock(LastKnownGoodMutex);
+    if (auto LastKnownGood = LastKnownGoodShaders.find(ShaderKey); LastKnownGood != LastKnownGoodShaders.end())
+    {
+        return LastKnownGood->second;
+    }
+    return nullptr;
+}
 
-    HANDLE ReadHandle = CreateFileW(ShaderDesc.FileName, GENERIC_READ, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    while (ReadHandle == INVALID_HANDLE_VALUE)
+std::vector<ShaderDesc> ShaderCompiler::FindChangedShaders()
+{
+    std::lock_guard<std::mutex> Lock(DependencyMutex);
+    std::vector<uint64_t> ChangedKeys;
+    for (auto& [Path, File] : TrackedFiles)
     {
-        if (GetLastError() != ERROR_SHARING_VIOLATION)
+        std::error_code Error;
+        std::filesystem::file_time_type WriteTime = std::filesystem::last_write_time(Path, Error);
+        // A file that is missing mid save shows up on the next change
+        if (Error || WriteTime == File.WriteTime)
         {
-            RenderUtils::CreateDialogOnLastError();
-            return false;
+            continue;
         }
-        ReadHandle = CreateFileW(ShaderDesc.FileName, GENERIC_READ, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    };
-    LARGE_INTEGER FileSize;
-    if (!GetFileSizeEx(ReadHandle, &FileSize))
+        File.WriteTime = WriteTime;
+        for (uint64_t ShaderKey : File.Dependents)
+        {
+            if (std::find(ChangedKeys.begin(), ChangedKeys.end(), ShaderKey) == ChangedKeys.end())
+            {
+                ChangedKeys.push_back(ShaderKey);
+            }
+        }
+    }
+
+    std::vector<ShaderDesc> ChangedShaders;
+    for (uint64_t ShaderKey : ChangedKeys)
     {
-        RenderUtils::CreateDialogOnLastError();
-        return false;
+        ChangedShaders.push_back(TrackedShaders[ShaderKey]);
     }
-    char* FileData = new char[FileSize.QuadPart];
-    DWORD BytesRead;
-    if (!ReadFile(ReadHandle, FileData, FileSize.QuadPart, &BytesRead, NULL))
+    return ChangedShaders;
+}
+
+void ShaderCompiler::TrackDependencies(uint64_t ShaderKey, const ShaderDesc& Desc, const std::vector<std::filesystem::path>& Includes)
+{
+    std::vector<std::filesystem::path> Files = {Desc.FileName};
+    Files.insert(Files.end(), Includes.begin(), Includes.end());
+
+    std::lock_guard<std::mutex> Lock(DependencyMutex);
+    TrackedShaders[ShaderKey] = Desc;
+    for (const std::filesystem::path& File : Files)
     {
-        RenderUtils::CreateDialogOnLastError();
-        delete[] FileData;
-        return false;
+        std::error_code Error;
+        std::filesystem::path Path = std::filesystem::absolute(File, Error).lexically_normal();
+        auto [Tracked, Inserted] = TrackedFiles.try_emplace(Path);
+        // Only a file seen for the first time takes its write time here, a change since then is FindChangedShaders' to
+        // report
+        if (Inserted)
+        {
+            Tracked->second.WriteTime = std::filesystem::last_write_time(Path, Error);
+        }
+        std::vector<uint64_t>& Dependents = Tracked->second.Dependents;
+        if (std::find(Dependents.begin(), Dependents.end(), ShaderKey) == Dependents.end())
+        {
+            Dependents.push_back(ShaderKey);
+        }
     }
-    CloseHandle(ReadHandle);
-    Microsoft::WRL::ComPtr<IDxcBlobEncoding> SourceBlob;
-    DxcUtils->CreateBlob(FileData, BytesRead, DXC_CP_ACP, &SourceBlob);
-    DxcBuffer SourceBuffer = {SourceBlob->GetBufferPointer(), SourceBlob->GetBufferSize(), DXC_CP_ACP};
+}
 
-    LPCWSTR CompileArgs[] = {
+std::vector<LPCWSTR> ShaderCompiler::GetCompileArgs(const ShaderDesc& ShaderDesc) const
+{
+    return {
         ShaderDesc.FileName,
         L"-E", ShaderDesc.EntryPoint,
         L"-T", ShaderDesc.Target,
         L"-Zs"};
+}
+
+uint64_t ShaderCompiler::GetShaderKey(const ShaderDesc& ShaderDesc) const
+{
+    uint64_t Key = CompilerVersionKey;
+    for (LPCWSTR Arg : GetCompileArgs(ShaderDesc))
+    {
+        // Hash the terminators too, so arguments can't run into each other
+        Key = ShaderCache::Hash(Arg, (wcslen(Arg) + 1) * sizeof(wchar_t), Key);
+    }
+    return Key;
+}
+
+bool ShaderCompiler::CompileShaderFromFile(const ShaderDesc& ShaderDesc, IDxcUtils* DxcUtils, IDxcCompiler3* DxcCompiler, bool ErrorOnFail)
+{
+    std::vector<uint8_t> Source;
+    if (!ReadShaderFile(ShaderDesc.FileName, Source))
+    {
+        return false;
+    }
+    const uint64_t ShaderKey = GetShaderKey(ShaderDesc);
+
+    // The include list of the last compile finds the files to hash. Includes can only change through a change to the
+    // source or one of them, and either already changes the key
+    std::vector<std::filesystem::path> IncludePaths;
+    if (Cache.LoadIncludes(ShaderKey, IncludePaths))
+    {
+        std::vector<RecordingIncludeHandler::Include> Includes;
+        bool IncludesFound = true;
+        for (const std::filesystem::path& Path : IncludePaths)
+        {
+            std::ifstream File(Path, std::ios::binary);
+            if (!File)
+            {
+                IncludesFound = false;
+                break;
+            }
+            Includes.push_back({Path, std::vector<uint8_t>(std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>())});
+        }
+
+        std::vector<uint8_t> CachedShader;
+        if (IncludesFound && Cache.Load(GetContentKey(ShaderKey, Source, Includes), CachedShader))
+        {
+            Microsoft::WRL::ComPtr<IDxcBlobEncoding> CachedBlob;
+            Microsoft::WRL::ComPtr<ID3DBlob> ShaderBlob;
+            if (SUCCEEDED(DxcUtils->CreateBlob(CachedShader.data(), static_cast<UINT32>(CachedShader.size()), DXC_CP_ACP, &CachedBlob)) && SUCCEEDED(CachedBlob.As(&ShaderBlob)))
+            {
+                TrackDependencies(ShaderKey, ShaderDesc, IncludePaths);
+                std::lock_guard<std::mutex> Lock(LastKnownGoodMutex);
+                LastKnownGoodShaders[ShaderKey] = ShaderBlob;
+                return true;
+            }
+        }
+    }
+
+    Microsoft::WRL::ComPtr<IDxcIncludeHandler> DefaultIncludeHandler;
+    DxcUtils->CreateDefaultIncludeHandler(&DefaultIncludeHandler);
+    RecordingIncludeHandler IncludeHandler(DefaultIncludeHandler.Get());
+
+    DxcBuffer SourceBuffer = {Source.data(), Source.size(), DXC_CP_ACP};
+    std::vector<LPCWSTR> CompileArgs = GetCompileArgs(ShaderDesc);
 
     Microsoft::WRL::ComPtr<IDxcResult> CompileResult;
-    DxcCompiler->Compile(&SourceBuffer, CompileArgs, _countof(CompileArgs), IncludeHandler.Get(), IID_PPV_ARGS(&CompileResult));
+    DxcCompiler->Compile(&SourceBuffer, CompileArgs.data(), static_cast<UINT32>(CompileArgs.size()), &IncludeHandler, IID_PPV_ARGS(&CompileResult));
+
+    IncludePaths.clear();
+    for (const RecordingIncludeHandler::Include& Entry : IncludeHandler.Includes)
+    {
+        IncludePaths.push_back(Entry.Path);
+    }
+    // Failed compiles too, so fixing the error in an include reloads the shader
+    TrackDependencies(ShaderKey, ShaderDesc, IncludePaths);
 
     Microsoft::WRL::ComPtr<IDxcBlobUtf8> ErrorBlob;
     CompileResult->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&ErrorBlob), nullptr);
@@ -162,8 +410,10 @@ bool ShaderCompiler::CompileShaderFromFile(const ShaderDesc& ShaderDesc, bool Er
     Microsoft::WRL::ComPtr<IDxcBlobWide> ShaderName;
     CompileResult->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&ShaderBlob), ShaderName.GetAddressOf());
 
-    std::lock_guard<std::recursive_mutex> Lock(LastKnownGoodMutex);
-    LastKnownGoodShaders[ShaderDesc.FileName] = ShaderBlob;
-    delete[] FileData;
+    Cache.Store(GetContentKey(ShaderKey, Source, IncludeHandler.Includes), ShaderBlob->GetBufferPointer(), ShaderBlob->GetBufferSize());
+    Cache.StoreIncludes(ShaderKey, IncludePaths);
+
+    std::lock_guard<std::mutex> Lock(LastKnownGoodMutex);
+    LastKnownGoodShaders[ShaderKey] = ShaderBlob;
     return true;
-}
\ No newline at end of file
+}
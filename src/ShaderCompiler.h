@@ -1,16 +1,21 @@
 #pragma once
 
+#include "util/ShaderCache.h"
 #include <condition_variable>
 #include <d3d12.h>
-#include <functional>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <stdint.h>
 #include <thread>
 #include <unordered_map>
+#include <vector>
+#include <wchar.h>
 #include <wrl.h>
 
-#define SHADER_COMPILATION_THREADS 2
-
 class IDxcUtils;
 class IDxcCompiler3;
 
@@ -19,38 +24,78 @@ struct ShaderDesc
     LPCWSTR FileName;
     LPCWSTR Target;
     LPCWSTR EntryPoint = L"main";
-};
 
-struct CompileWorkItem
-{
-    ShaderDesc Desc;
-    bool ErrorOnFail;
-    std::function<void(bool)> Completion;
+    bool operator==(const ShaderDesc& Other) const
+    {
+        return wcscmp(FileName, Other.FileName) == 0 && wcscmp(Target, Other.Target) == 0 && wcscmp(EntryPoint, Other.EntryPoint) == 0;
+    }
 };
 
+// Compiles shaders on a thread per core. Everything goes through CompileShaderAsync, which hands back a future, so a
+// caller queues all the shaders it needs first and only then waits on them. Requests for a shader that is queued but
+// not started yet share that compile
 class ShaderCompiler
 {
 public:
     ShaderCompiler();
     ~ShaderCompiler();
 
+    // Last good compile of the shader. Waits for a compile of it that is queued or running, and compiles it if there
+    // never was one, showing any errors
     Microsoft::WRL::ComPtr<ID3DBlob> GetShader(const ShaderDesc& ShaderDesc);
-    void CompileShader(const ShaderDesc& Desc, std::function<void(bool)> Completion, bool ErrorOnFail = false);
-    void CompileShaderNonAsync(const ShaderDesc& Desc, bool ErrorOnFail = false);
+    // Recompiles the shader (or takes it from the cache), the future turns true once GetShader returns the new result.
+    // On failure the last good compile is kept
+    std::shared_future<bool> CompileShaderAsync(const ShaderDesc& Desc, bool ErrorOnFail = false);
+
+    // Shaders whose source or one of whose includes was written since the last call, going by the write times of the
+    // files every compile and cache hit recorded. Only shaders that were compiled at least once are known
+    std::vector<ShaderDesc> FindChangedShaders();
 
 private:
-    bool CompileShaderFromFile(const ShaderDesc& ShaderDesc, bool ErrorOnFail = false);
+    struct CompileJob
+    {
+        ShaderDesc Desc;
+        uint64_t ShaderKey;
+        bool ErrorOnFail;
+        bool Started = false;
+        std::promise<bool> Promise;
+        std::shared_future<bool> Result;
+    };
+
+    // Each thread has its own compiler, DXC's aren't meant to be shared between threads
     void CompilationThreadRunner();
+    // Takes the shader from the cache if its source and includes haven't changed, compiles and caches it otherwise
+    bool CompileShaderFromFile(const ShaderDesc& ShaderDesc, IDxcUtils* DxcUtils, IDxcCompiler3* DxcCompiler, bool ErrorOnFail = false);
+    std::vector<LPCWSTR> GetCompileArgs(const ShaderDesc& ShaderDesc) const;
+    // Identifies a shader independently of its source: compiler version, file, entry point, target and arguments
+    uint64_t GetShaderKey(const ShaderDesc& ShaderDesc) const;
+    Microsoft::WRL::ComPtr<ID3DBlob> FindLastKnownGood(uint64_t ShaderKey);
+    // Adds the shader as a dependent of its source and of each include
+    void TrackDependencies(uint64_t ShaderKey, const ShaderDesc& Desc, const std::vector<std::filesystem::path>& Includes);
+
     std::vector<std::thread> WorkerThreads;
     std::condition_variable WorkCV;
-    std::mutex CVMutex;
-
-    std::queue<CompileWorkItem> WorkQueue;
     std::mutex QueueMutex;
+    bool Stopping = false;
+    std::deque<std::shared_ptr<CompileJob>> WorkQueue;
+    // Latest job of every shader still queued or running
+    std::unordered_map<uint64_t, std::shared_ptr<CompileJob>> InFlight;
 
-    Microsoft::WRL::ComPtr<IDxcUtils> DxcUtils;
-    Microsoft::WRL::ComPtr<IDxcCompiler3> DxcCompiler;
+    uint64_t CompilerVersionKey = 0;
+    ShaderCache Cache;
 
-    std::unordered_map<LPCWSTR, Microsoft::WRL::ComPtr<ID3DBlob>> LastKnownGoodShaders;
-    std::recursive_mutex LastKnownGoodMutex;
-};
\ No newline at end of file
+    // Keyed by GetShaderKey, so entry points of one file don't replace each other
+    std::unordered_map<uint64_t, Microsoft::WRL::ComPtr<ID3DBlob>> LastKnownGoodShaders;
+    std::mutex LastKnownGoodMutex;
+
+    struct TrackedFile
+    {
+        std::filesystem::file_time_type WriteTime;
+        // Shader keys of every shader that loaded the file. A file a shader stops including keeps it as a dependent,
+        // which at worst costs a cache hit
+        std::vector<uint64_t> Dependents;
+    };
+    std::map<std::filesystem::path, TrackedFile> TrackedFiles;
+    std::unordered_map<uint64_t, ShaderDesc> TrackedShaders;
+    std::mutex DependencyMutex;
+};
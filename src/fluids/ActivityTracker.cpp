@@ -0,0 +1,152 @@
+#include "fluids/ActivityTracker.h"
+
+#include <algorithm>
+
+ActivityTracker::ActivityTracker(int GridResolution, float InvDx, const ActivityParameters& Params)
+    : Params(Params), GridResolution(GridResolution), BlocksPerAxis((GridResolution + SLEEP_BLOCK_SIZE - 1) / SLEEP_BLOCK_SIZE), InvDx(InvDx)
+{
+    Reset();
+}
+
+void ActivityTracker::Reset()
+{
+    Blocks = std::vector<BlockState>(BlocksPerAxis * BlocksPerAxis);
+    Dormant = std::vector<uint8_t>(BlocksPerAxis * BlocksPerAxis, 0);
+    StateChanged = true;
+}
+
+int ActivityTracker::GetBlockIndex(const Math::Vec4& Position) const
+{
+    int X = std::clamp(int(Position.x * InvDx) / SLEEP_BLOCK_SIZE, 0, BlocksPerAxis - 1);
+    int Y = std::clamp(int(Position.y * InvDx) / SLEEP_BLOCK_SIZE, 0, BlocksPerAxis - 1);
+    return X * BlocksPerAxis + Y;
+}
+
+bool ActivityTracker::IsAsleep(int Block) const
+{
+    return Blocks[Block].Asleep;
+}
+
+bool ActivityTracker::IsCellDormant(int X, int Y) const
+{
+    return Dormant[(X / SLEEP_BLOCK_SIZE) * BlocksPerAxis + Y / SLEEP_BLOCK_SIZE];
+}
+
+void ActivityTracker::RecordParticle(int Block, float SpeedSq, float StrainRateSq)
+{
+    BlockState& State = Blocks[Block];
+    if (State.Asleep)
+    {
+        State.WakeRequested = true;
+    }
+    State.MaxSpeedSq = std::max(State.MaxSpeedSq, SpeedSq);
+    State.MaxStrainRateSq = std::max(State.MaxStrainRateSq, StrainRateSq);
+}
+
+void ActivityTracker::Disturb(const Math::Vec4& Min, const Math::Vec4& Max)
+{
+    int MinX = std::clamp(int(Min.x * InvDx) / SLEEP_BLOCK_SIZE, 0, BlocksPerAxis - 1);
+    int MinY = std::clamp(int(Min.y * InvDx) / SLEEP_BLOCK_SIZE, 0, BlocksPerAxis - 1);
+    int MaxX = std::clamp(int(Max.x * InvDx) / SLEEP_BLOCK_SIZE, 0, BlocksPerAxis - 1);
+    int MaxY = std::clamp(int(Max.y * InvDx) / SLEEP_BLOCK_SIZE, 0, BlocksPerAxis - 1);
+    for (int X = MinX; X <= MaxX; X++)
+    {
+        for (int Y = MinY; Y <= MaxY; Y++)
+        {
+            Wake(X, Y);
+        }
+    }
+}
+
+void ActivityTracker::Wake(int BlockX, int BlockY)
+{
+    if (BlockX < 0 || BlockY < 0 || BlockX >= BlocksPerAxis || BlockY >= BlocksPerAxis)
+    {
+        return;
+    }
+    BlockState& State = Blocks[BlockX * BlocksPerAxis + BlockY];
+    State.QuietSteps = 0;
+    if (State.Asleep)
+    {
+        State.Asleep = false;
+        StateChanged = true;
+    }
+}
+
+bool ActivityTracker::EndStep()
+{
+    float SleepVelocitySq = Params.SleepVelocity * Params.SleepVelocity;
+    float SleepStrainRateSq = Params.SleepStrainRate * Params.SleepStrainRate;
+    float WakeVelocitySq = Params.WakeVelocity * Params.WakeVelocity;
+
+    for (int X = 0; X < BlocksPerAxis; X++)
+    {
+        for (int Y = 0; Y < BlocksPerAxis; Y++)
+        {
+            BlockState& State = Blocks[X * BlocksPerAxis + Y];
+            if (State.WakeRequested)
+            {
+                State.WakeRequested = false;
+                Wake(X, Y);
+            }
+            if (State.Asleep)
+            {
+                continue;
+            }
+
+            if (State.MaxSpeedSq > WakeVelocitySq)
+            {
+                for (int OffsetX = -1; OffsetX <= 1; OffsetX++)
+                {
+                    for (int OffsetY = -1; OffsetY <= 1; OffsetY++)
+                    {
+                        Wake(X + OffsetX, Y + OffsetY);
+                    }
+                }
+            }
+
+            if (State.MaxSpeedSq < SleepVelocitySq && State.MaxStrainRateSq < SleepStrainRateSq)
+            {
+                if (++State.QuietSteps >= Params.SleepSteps)
+                {
+                    State.Asleep = true;
+                    StateChanged = true;
+                }
+            }
+            else
+            {
+                State.QuietSteps = 0;
+            }
+            State.MaxSpeedSq = 0.0f;
+            State.MaxStrainRateSq = 0.0f;
+        }
+    }
+
+    if (!StateChanged)
+    {
+        return false;
+    }
+
+    for (int X = 0; X < BlocksPerAxis; X++)
+    {
+        for (int Y = 0; Y < BlocksPerAxis; Y++)
+        {
+            bool AllAsleep = true;
+            for (int OffsetX = -1; OffsetX <= 1 && AllAsleep; OffsetX++)
+            {
+                for (int OffsetY = -1; OffsetY <= 1 && AllAsleep; OffsetY++)
+                {
+                    int NeighbourX = X + OffsetX;
+                    int NeighbourY = Y + OffsetY;
+                    if (NeighbourX >= 0 && NeighbourY >= 0 && NeighbourX < BlocksPerAxis && NeighbourY < BlocksPerAxis)
+                    {
+                        AllAsleep = Blocks[NeighbourX * BlocksPerAxis + NeighbourY].Asleep;
+                    }
+                }
+            }
+            Dormant[X * BlocksPerAxis + Y] = AllAsleep;
+        }
+    }
+    StateChanged = false;
+    return true;
+}
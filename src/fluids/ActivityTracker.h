@@ -0,0 +1,64 @@
+#pragma once
+
+#include "util/3DMath.h"
+#include <stdint.h>
+#include <vector>
+
+// Grid cells per side of a sleep block
+#define SLEEP_BLOCK_SIZE 8
+
+struct ActivityParameters
+{
+    // A block may fall asleep once every particle in it is slower than this
+    float SleepVelocity = 0.02f;
+    // ...and the norm of every particle's velocity gradient (C) is below this
+    float SleepStrainRate = 0.05f;
+    // Awake blocks with a particle faster than this wake their neighbours
+    float WakeVelocity = 0.1f;
+    // Number of consecutive quiet steps before a block goes to sleep
+    uint32_t SleepSteps = 60;
+};
+
+// Tracks per block activity of the (2D) CPU grid so settled regions can be skipped.
+// Sleeping blocks keep their particles frozen and their grid contribution cached by the solver
+class ActivityTracker
+{
+public:
+    ActivityTracker(int GridResolution, float InvDx, const ActivityParameters& Params = ActivityParameters());
+
+    void Reset();
+
+    int GetBlockIndex(const Math::Vec4& Position) const;
+    bool IsAsleep(int Block) const;
+    // True when the cell's block and all of its neighbours sleep, meaning no awake particle can touch the cell
+    bool IsCellDormant(int X, int Y) const;
+
+    // Records the motion of an awake particle after G2P. Landing in a sleeping block wakes it
+    void RecordParticle(int Block, float SpeedSq, float StrainRateSq);
+    // Wakes every block overlapping the box, e.g. around a collider or the mouse
+    void Disturb(const Math::Vec4& Min, const Math::Vec4& Max);
+
+    // Advances the sleep counters, returns whether any block changed state since the last call
+    bool EndStep();
+
+private:
+    void Wake(int BlockX, int BlockY);
+
+    struct BlockState
+    {
+        float MaxSpeedSq = 0.0f;
+        float MaxStrainRateSq = 0.0f;
+        uint32_t QuietSteps = 0;
+        bool Asleep = false;
+        bool WakeRequested = false;
+    };
+
+    ActivityParameters Params;
+    int GridResolution;
+    int BlocksPerAxis;
+    float InvDx;
+    bool StateChanged = false;
+    std::vector<BlockState> Blocks;
+    // Per block flag, set when the block and its eight neighbours all sleep
+    std::vector<uint8_t> Dormant;
+};
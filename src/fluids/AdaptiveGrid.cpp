@@ -0,0 +1,403 @@
+#include "fluids/AdaptiveGrid.h"
+
+#include "fluids/MPMKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    typedef MPMKernels::BSpline<MPMKernels::QuadraticSpline, float> Spline;
+
+    uint64_t CellKey(int32_t X, int32_t Y)
+    {
+        return (uint64_t(uint32_t(X)) << 32) | uint32_t(Y);
+    }
+}
+
+AdaptiveGrid::AdaptiveGrid(int GridResolution, float GridSize, const AdaptiveGridParameters& Params)
+    : Params(Params), Size(GridSize)
+{
+    // The roots are the coarsest cells, so they have to tile the uniform grid
+    while (this->Params.CoarserLevels > 0 && GridResolution % (1 << this->Params.CoarserLevels) != 0)
+    {
+        this->Params.CoarserLevels--;
+    }
+    MaxLevel = this->Params.FinerLevels + this->Params.CoarserLevels;
+    FinestResolution = GridResolution << this->Params.FinerLevels;
+    RootsPerSide = FinestResolution >> MaxLevel;
+    UniformDx = Size / GridResolution;
+    FinestDx = Size / FinestResolution;
+    InvFinestDx = 1.0f / FinestDx;
+    Occupied.resize(MaxLevel + 1);
+}
+
+Math::Vec4& AdaptiveGrid::GetNode(uint32_t Node)
+{
+    return Nodes[Node];
+}
+
+const Math::Vec4& AdaptiveGrid::GetNode(uint32_t Node) const
+{
+    return Nodes[Node];
+}
+
+Math::Vec4& AdaptiveGrid::GetNodeImpulse(uint32_t Node)
+{
+    return Impulses[Node];
+}
+
+const Math::Vec4& AdaptiveGrid::GetNodePosition(uint32_t Node) const
+{
+    return NodePositions[Node];
+}
+
+uint32_t AdaptiveGrid::GetNumLeaves() const
+{
+    return NumLeaves;
+}
+
+uint32_t AdaptiveGrid::GetNumNodes() const
+{
+    return static_cast<uint32_t>(Nodes.size());
+}
+
+bool AdaptiveGrid::IsOccupied(uint32_t Level, int32_t X, int32_t Y) const
+{
+    return Occupied[Level].count(CellKey(X, Y)) > 0;
+}
+
+void AdaptiveGrid::Build(const std::vector<ParticleRenderData>& Particles, const std::vector<uint32_t>& Indices)
+{
+    for (std::unordered_set<uint64_t>& Cells : Occupied)
+    {
+        Cells.clear();
+    }
+    for (uint32_t ParticleIndex : Indices)
+    {
+        int32_t X = std::clamp(static_cast<int32_t>(Particles[ParticleIndex].Position.x * InvFinestDx), 0, FinestResolution - 1);
+        int32_t Y = std::clamp(static_cast<int32_t>(Particles[ParticleIndex].Position.y * InvFinestDx), 0, FinestResolution - 1);
+        for (uint32_t Level = 0; Level <= MaxLevel; Level++)
+        {
+            Occupied[Level].insert(CellKey(X >> Level, Y >> Level));
+        }
+    }
+
+    Tree.clear();
+    for (int32_t X = 0; X < RootsPerSide; X++)
+    {
+        for (int32_t Y = 0; Y < RootsPerSide; Y++)
+        {
+            TreeNode Root;
+            Root.X = X << MaxLevel;
+            Root.Y = Y << MaxLevel;
+            Root.Level = MaxLevel;
+            Tree.push_back(Root);
+        }
+    }
+    // Children are appended behind their parents, so one pass refines top down
+    for (size_t Index = 0; Index < Tree.size(); Index++)
+    {
+        if (Tree[Index].Level > 0 && ShouldRefine(Tree[Index]))
+        {
+            Split(static_cast<int32_t>(Index));
+        }
+    }
+    Balance();
+
+    PointIds.clear();
+    ConstraintStart.assign(1, 0);
+    ConstraintNodes.clear();
+    ConstraintWeights.clear();
+    NodePositions.clear();
+    NumLeaves = 0;
+    for (size_t Index = 0; Index < Tree.size(); Index++)
+    {
+        if (Tree[Index].FirstChild >= 0)
+        {
+            continue;
+        }
+        NumLeaves++;
+        uint32_t Level = Tree[Index].Level;
+        if (!IsOccupied(Level, Tree[Index].X >> Level, Tree[Index].Y >> Level))
+        {
+            continue;
+        }
+        // A particle's stencil starts on the lattice point before or on its leaf's lower corner
+        for (int32_t I = 0; I < ADAPTIVE_LATTICE_SIDE; I++)
+        {
+            for (int32_t J = 0; J < ADAPTIVE_LATTICE_SIDE; J++)
+            {
+                int32_t X, Y;
+                GetLatticePoint(Level, (Tree[Index].X >> Level) - 1 + I, (Tree[Index].Y >> Level) - 1 + J, X, Y);
+                Tree[Index].Points[I][J] = ResolvePoint(X, Y);
+            }
+        }
+    }
+    Nodes.assign(NodePositions.size(), Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f));
+    Impulses.assign(NodePositions.size(), Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+bool AdaptiveGrid::ShouldRefine(const TreeNode& Node) const
+{
+    int32_t CellX = Node.X >> Node.Level;
+    int32_t CellY = Node.Y >> Node.Level;
+    if (!IsOccupied(Node.Level, CellX, CellY))
+    {
+        return false;
+    }
+
+    int32_t Side = 1 << Node.Level;
+    int32_t Band = static_cast<int32_t>(std::ceil(Params.WallBand * (1 << Params.FinerLevels)));
+    if (Node.X < Band || Node.Y < Band || Node.X + Side > FinestResolution - Band || Node.Y + Side > FinestResolution - Band)
+    {
+        return true;
+    }
+
+    // Next to an empty cell of the same size means near the free surface
+    for (int OffsetX = -1; OffsetX <= 1; OffsetX++)
+    {
+        for (int OffsetY = -1; OffsetY <= 1; OffsetY++)
+        {
+            if (!IsOccupied(Node.Level, CellX + OffsetX, CellY + OffsetY))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void AdaptiveGrid::Split(int32_t Index)
+{
+    TreeNode Parent = Tree[Index];
+    int32_t Half = 1 << (Parent.Level - 1);
+    Tree[Index].FirstChild = static_cast<int32_t>(Tree.size());
+    for (int Child = 0; Child < 4; Child++)
+    {
+        TreeNode Node;
+        Node.X = Parent.X + (Child >> 1) * Half;
+        Node.Y = Parent.Y + (Child & 1) * Half;
+        Node.Level = Parent.Level - 1;
+        Tree.push_back(Node);
+    }
+}
+
+void AdaptiveGrid::Balance()
+{
+    // Split any leaf more than one level coarser than a neighbouring leaf, until none is left
+    bool Changed = true;
+    while (Changed)
+    {
+        Changed = false;
+        for (size_t Index = 0; Index < Tree.size(); Index++)
+        {
+            if (Tree[Index].FirstChild >= 0)
+            {
+                continue;
+            }
+            int32_t Side = 1 << Tree[Index].Level;
+            for (int OffsetX = -1; OffsetX <= 1; OffsetX++)
+            {
+                for (int OffsetY = -1; OffsetY <= 1; OffsetY++)
+                {
+                    int32_t X = Tree[Index].X + OffsetX * Side;
+                    int32_t Y = Tree[Index].Y + OffsetY * Side;
+                    if (X < 0 || Y < 0 || X >= FinestResolution || Y >= FinestResolution)
+                    {
+                        continue;
+                    }
+                    int32_t Neighbour = FindLeaf(X, Y);
+                    if (Tree[Neighbour].Level > Tree[Index].Level + 1)
+                    {
+                        Split(Neighbour);
+                        Changed = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+int32_t AdaptiveGrid::FindLeaf(int32_t X, int32_t Y) const
+{
+    int32_t Index = (X >> MaxLevel) * RootsPerSide + (Y >> MaxLevel);
+    while (Tree[Index].FirstChild >= 0)
+    {
+        uint32_t ChildLevel = Tree[Index].Level - 1;
+        Index = Tree[Index].FirstChild + ((X >> ChildLevel) & 1) * 2 + ((Y >> ChildLevel) & 1);
+    }
+    return Index;
+}
+
+void AdaptiveGrid::GetLatticePoint(uint32_t Level, int32_t I, int32_t J, int32_t& X, int32_t& Y) const
+{
+    X = std::clamp(I << Level, 0, FinestResolution);
+    Y = std::clamp(J << Level, 0, FinestResolution);
+}
+
+uint32_t AdaptiveGrid::ResolvePoint(int32_t X, int32_t Y)
+{
+    uint64_t Key = CellKey(X, Y);
+    auto Found = PointIds.find(Key);
+    if (Found != PointIds.end())
+    {
+        return Found->second;
+    }
+
+    uint32_t Id = static_cast<uint32_t>(ConstraintStart.size() - 1);
+    // The point is interpolated when it lies inside a leaf around it or inside one of its edges
+    for (int Around = 0; Around < 4; Around++)
+    {
+        int32_t CellX = X - 1 + (Around >> 1);
+        int32_t CellY = Y - 1 + (Around & 1);
+        if (CellX < 0 || CellY < 0 || CellX >= FinestResolution || CellY >= FinestResolution)
+        {
+            continue;
+        }
+        const TreeNode& Leaf = Tree[FindLeaf(CellX, CellY)];
+        int32_t Side = 1 << Leaf.Level;
+        bool OnVerticalEdge = X == Leaf.X || X == Leaf.X + Side;
+        bool OnHorizontalEdge = Y == Leaf.Y || Y == Leaf.Y + Side;
+        if (OnVerticalEdge && OnHorizontalEdge)
+        {
+            continue;
+        }
+
+        // Bilinear over the leaf's corners, which may be interpolated themselves. On an edge only its two ends count
+        float LocalX = float(X - Leaf.X) / Side;
+        float LocalY = float(Y - Leaf.Y) / Side;
+        uint32_t MergedNodes[ADAPTIVE_STENCIL_SIZE];
+        float MergedWeights[ADAPTIVE_STENCIL_SIZE];
+        uint32_t Count = 0;
+        for (int Corner = 0; Corner < 4; Corner++)
+        {
+            float CornerWeight = ((Corner >> 1) ? LocalX : 1.0f - LocalX) * ((Corner & 1) ? LocalY : 1.0f - LocalY);
+            if (CornerWeight == 0.0f)
+            {
+                continue;
+            }
+            uint32_t CornerId = ResolvePoint(Leaf.X + (Corner >> 1) * Side, Leaf.Y + (Corner & 1) * Side);
+            for (uint32_t Entry = ConstraintStart[CornerId]; Entry < ConstraintStart[CornerId + 1]; Entry++)
+            {
+                uint32_t Slot = 0;
+                while (Slot < Count && MergedNodes[Slot] != ConstraintNodes[Entry])
+                {
+                    Slot++;
+                }
+                if (Slot == Count)
+                {
+                    if (Count == ADAPTIVE_STENCIL_SIZE)
+                    {
+                        continue;
+                    }
+                    MergedNodes[Count] = ConstraintNodes[Entry];
+                    MergedWeights[Count++] = 0.0f;
+                }
+                MergedWeights[Slot] += CornerWeight * ConstraintWeights[Entry];
+            }
+        }
+
+        Id = static_cast<uint32_t>(ConstraintStart.size() - 1);
+        ConstraintNodes.insert(ConstraintNodes.end(), MergedNodes, MergedNodes + Count);
+        ConstraintWeights.insert(ConstraintWeights.end(), MergedWeights, MergedWeights + Count);
+        ConstraintStart.push_back(static_cast<uint32_t>(ConstraintNodes.size()));
+        PointIds[Key] = Id;
+        return Id;
+    }
+
+    // A corner of every leaf around it is a real node
+    ConstraintNodes.push_back(static_cast<uint32_t>(NodePositions.size()));
+    ConstraintWeights.push_back(1.0f);
+    ConstraintStart.push_back(static_cast<uint32_t>(ConstraintNodes.size()));
+    NodePositions.push_back(Math::Vec4(X * FinestDx, Y * FinestDx, 0.0f, 0.0f));
+    PointIds[Key] = Id;
+    return Id;
+}
+
+void AdaptiveGrid::GetStencil(const Math::Vec4& Position, AdaptiveStencil& Out) const
+{
+    float GridX = Position.x * InvFinestDx;
+    float GridY = Position.y * InvFinestDx;
+    const TreeNode& Leaf = Tree[FindLeaf(std::clamp(static_cast<int32_t>(GridX), 0, FinestResolution - 1), std::clamp(static_cast<int32_t>(GridY), 0, FinestResolution - 1))];
+    int32_t Side = 1 << Leaf.Level;
+    float InvCellSize = 1.0f / (Side * FinestDx);
+    // Quadratic weights on the lattice of the leaf's level
+    float LatticeX = GridX / Side;
+    float LatticeY = GridY / Side;
+    int32_t BaseI = Spline::Base(LatticeX);
+    int32_t BaseJ = Spline::Base(LatticeY);
+    float WeightsX[Spline::Width], GradientsX[Spline::Width];
+    float WeightsY[Spline::Width], GradientsY[Spline::Width];
+    Spline::Evaluate(LatticeX - BaseI, WeightsX, GradientsX);
+    Spline::Evaluate(LatticeY - BaseJ, WeightsY, GradientsY);
+
+    // The base is the leaf's lower corner or the lattice point before it
+    int32_t OffsetI = std::clamp(BaseI - (Leaf.X >> Leaf.Level) + 1, 0, 1);
+    int32_t OffsetJ = std::clamp(BaseJ - (Leaf.Y >> Leaf.Level) + 1, 0, 1);
+
+    Out.Count = 0;
+    for (int I = 0; I < Spline::Width; I++)
+    {
+        for (int J = 0; J < Spline::Width; J++)
+        {
+            float PointWeight = WeightsX[I] * WeightsY[J];
+            Math::Vec4 PointGradient(GradientsX[I] * WeightsY[J] * InvCellSize, WeightsX[I] * GradientsY[J] * InvCellSize, 0.0f, 0.0f);
+            uint32_t Id = Leaf.Points[OffsetI + I][OffsetJ + J];
+            for (uint32_t Entry = ConstraintStart[Id]; Entry < ConstraintStart[Id + 1]; Entry++)
+            {
+                uint32_t Slot = 0;
+                while (Slot < Out.Count && Out.Nodes[Slot] != ConstraintNodes[Entry])
+                {
+                    Slot++;
+                }
+                if (Slot == Out.Count)
+                {
+                    if (Out.Count == ADAPTIVE_STENCIL_SIZE)
+                    {
+                        continue;
+                    }
+                    Out.Nodes[Slot] = ConstraintNodes[Entry];
+                    Out.Weights[Slot] = 0.0f;
+                    Out.Gradients[Slot] = Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+                    Out.Count++;
+                }
+                Out.Weights[Slot] += PointWeight * ConstraintWeights[Entry];
+                Out.Gradients[Slot] += PointGradient * ConstraintWeights[Entry];
+            }
+        }
+    }
+}
+
+void AdaptiveGrid::UpdateNodes(float DeltaTime)
+{
+    Math::Vec4 Gravity = Math::Vec4(0.0f, -9.8f * DeltaTime, 0.0f, 0.0f);
+    // Same wall layers as the uniform grid, which zeroes its first and last two nodes
+    float MinWall = 2.0f * UniformDx - 0.5f * FinestDx;
+    float MaxWall = Size - MinWall;
+    for (size_t Node = 0; Node < Nodes.size(); Node++)
+    {
+        Math::Vec4& VelocityMass = Nodes[Node];
+        if (VelocityMass.w <= 0.00001f)
+        {
+            // Stress may reach a node without mass, it must not feed the gathered velocity gradient
+            VelocityMass = Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+            continue;
+        }
+        float InvMass = 1.0f / VelocityMass.w;
+        VelocityMass.x = (VelocityMass.x + Impulses[Node].x) * InvMass;
+        VelocityMass.y = (VelocityMass.y + Impulses[Node].y) * InvMass;
+        VelocityMass.z = (VelocityMass.z + Impulses[Node].z) * InvMass;
+        VelocityMass += Gravity;
+
+        const Math::Vec4& Position = NodePositions[Node];
+        if (Position.x < MinWall || Position.x > MaxWall)
+        {
+            VelocityMass.x = 0.0f;
+        }
+        if (Position.y < MinWall || Position.y > MaxWall)
+        {
+            VelocityMass.y = 0.0f;
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "fluids/IFluidSolver.h"
+#include "util/3DMath.h"
+#include <stdint.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Upper bound on the nodes one particle transfers with, its 3x3 lattice points or the nodes the ones that aren't nodes
+// are interpolated from
+#define ADAPTIVE_STENCIL_SIZE 32
+// Lattice points along each axis the stencils of a leaf's particles can reach, the quadratic spline's three plus one
+#define ADAPTIVE_LATTICE_SIDE 4
+
+struct AdaptiveGridParameters
+{
+    // Levels of halving below the uniform grid's cell size near the free surface and the walls. Finer cells need
+    // proportionally more particles and smaller timesteps
+    uint32_t FinerLevels = 0;
+    // Levels of doubling above it in the bulk of the material
+    uint32_t CoarserLevels = 2;
+    // Occupied cells within this many uniform grid cells of a wall are kept at the finest level
+    float WallBand = 4.0f;
+};
+
+struct AdaptiveStencil
+{
+    uint32_t Count = 0;
+    uint32_t Nodes[ADAPTIVE_STENCIL_SIZE];
+    float Weights[ADAPTIVE_STENCIL_SIZE];
+    // Weight gradients in world units
+    Math::Vec4 Gradients[ADAPTIVE_STENCIL_SIZE];
+};
+
+// Quadtree grid for the (2D) CPU solver, fine near the free surface and the walls and coarse in the bulk of the
+// material. Particles transfer with the uniform grid's quadratic B-spline weights, on the lattice of their leaf's size
+// around them. A lattice point that isn't a corner of every leaf around it, hanging on the edge of a coarser leaf or
+// lying inside one, is not a degree of freedom. Its weight goes to the corners of that leaf bilinearly, so the weights
+// stay a partition of unity and reproduce linear fields across level boundaries. The tree is 2:1 balanced and rebuilt
+// from the particles every step, and only the lattices of leaves holding particles get nodes, so memory follows the
+// material rather than the domain
+class AdaptiveGrid
+{
+public:
+    AdaptiveGrid(int GridResolution, float GridSize, const AdaptiveGridParameters& Params);
+
+    // Rebuilds the tree and its nodes around the given particles and clears the node values
+    void Build(const std::vector<ParticleRenderData>& Particles, const std::vector<uint32_t>& Indices);
+
+    // Nodes a particle inside the built tree transfers with
+    void GetStencil(const Math::Vec4& Position, AdaptiveStencil& Out) const;
+
+    // xyz = momentum before UpdateNodes and velocity after, w = mass, like GridCell
+    Math::Vec4& GetNode(uint32_t Node);
+    const Math::Vec4& GetNode(uint32_t Node) const;
+    // Stress impulse, kept apart from the momentum until UpdateNodes
+    Math::Vec4& GetNodeImpulse(uint32_t Node);
+    const Math::Vec4& GetNodePosition(uint32_t Node) const;
+
+    // Turns the scattered momentum and impulses into velocity, adds gravity and applies the wall boundaries
+    void UpdateNodes(float DeltaTime);
+
+    uint32_t GetNumLeaves() const;
+    uint32_t GetNumNodes() const;
+
+private:
+    struct TreeNode
+    {
+        // Origin and size in finest cells, size is 1 << Level
+        int32_t X, Y;
+        uint32_t Level;
+        int32_t FirstChild = -1;
+        // Constraint of every lattice point its particles' stencils can reach, starting one point before its lower
+        // corner along each axis. Only set on leaves holding particles
+        uint32_t Points[ADAPTIVE_LATTICE_SIDE][ADAPTIVE_LATTICE_SIDE];
+    };
+
+    void Split(int32_t Index);
+    bool ShouldRefine(const TreeNode& Node) const;
+    void Balance();
+    int32_t FindLeaf(int32_t X, int32_t Y) const;
+    bool IsOccupied(uint32_t Level, int32_t X, int32_t Y) const;
+    // Point I, J of the lattice of a level in finest cells, clamped to the domain
+    void GetLatticePoint(uint32_t Level, int32_t I, int32_t J, int32_t& X, int32_t& Y) const;
+    // Resolves a lattice point to the nodes its value is interpolated from, creating them on first use
+    uint32_t ResolvePoint(int32_t X, int32_t Y);
+
+    AdaptiveGridParameters Params;
+    float Size;
+    float FinestDx;
+    float InvFinestDx;
+    float UniformDx;
+    int32_t FinestResolution;
+    int32_t RootsPerSide;
+    uint32_t MaxLevel;
+
+    std::vector<TreeNode> Tree;
+    uint32_t NumLeaves = 0;
+    // Cells holding particles at every level, keyed by their coordinates at that level
+    std::vector<std::unordered_set<uint64_t>> Occupied;
+
+    // Constraint of every resolved lattice point as a list of (node, weight), CSR style
+    std::unordered_map<uint64_t, uint32_t> PointIds;
+    std::vector<uint32_t> ConstraintStart;
+    std::vector<uint32_t> ConstraintNodes;
+    std::vector<float> ConstraintWeights;
+
+    std::vector<Math::Vec4> Nodes;
+    std::vector<Math::Vec4> Impulses;
+    std::vector<Math::Vec4> NodePositions;
+};
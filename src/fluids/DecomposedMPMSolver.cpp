@@ -0,0 +1,488 @@
+#include "fluids/DecomposedMPMSolver.h"
+
+#include "fluids/ParticlePool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+// Columns past a particle's base column its quadratic stencil reaches
+#define HALO_COLUMNS 2
+// Room a subdomain keeps for particles migrating in, as a fraction of the ones it starts with. The pool doubles should
+// it still run out
+#define MIGRATION_HEADROOM 0.25f
+
+namespace
+{
+ActivityParameters NeverSleep()
+{
+    ActivityParameters Params;
+    Params.SleepSteps = UINT32_MAX;
+    return Params;
+}
+}
+
+MPMSubdomain::MPMSubdomain(std::unique_ptr<IHaloTransport> Transport, const std::vector<ParticleRenderData>& Share, MPMSolver::FluidParameters FluidParams, MaterialModel Model, const DecompositionParameters& Params)
+    : Transport(std::move(Transport)), Params(Params), GridResolution(FluidParams.GridResolution), InvDx(FluidParams.InvDx), Activity(FluidParams.GridResolution, FluidParams.InvDx, NeverSleep())
+{
+    Rank = this->Transport->GetRank();
+    NumRanks = this->Transport->GetNumRanks();
+
+    // Every rank computes the same split from the same totals
+    Bounds = ComputeBounds(SumColumnCounts(CountColumns(Share)), NumRanks);
+    DistributeShare(Share);
+
+    FluidParams.NumParticles = static_cast<int>(Particles.size());
+    Solver = std::make_unique<MPMSolver>(Particles, FluidParams, Model);
+    Solver->ReserveParticles(static_cast<uint32_t>(Particles.size() * (1.0f + MIGRATION_HEADROOM)), Particles);
+    Solver->ShareActivityTracker(&Activity);
+
+    ResizeWindow();
+    Outgoing.resize(NumRanks);
+}
+
+void MPMSubdomain::Step(float DeltaTime)
+{
+    Solver->BeginStep(Particles, DeltaTime);
+
+    std::fill(Grid.begin(), Grid.end(), GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+    Solver->ScatterToGrid(Particles, Grid.data(), GetBegin(), WindowEnd - GetBegin(), DeltaTime);
+    ExchangeGhostMass();
+
+    // The halo is replaced by the neighbour's updated velocities, and the padding past the far wall is a wall at rest
+    Solver->UpdateGridColumns(Grid.data(), GetBegin(), GetBegin(), GetEnd(), DeltaTime);
+    std::fill(Grid.end() - CPU_GRID_PADDING(GridResolution), Grid.end(), GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+    ExchangeGhostVelocities();
+
+    Solver->GatherFromGrid(Particles, Grid.data(), GetBegin(), DeltaTime);
+    Activity.EndStep();
+
+    // Every rank counts the same steps, so they all rebalance together
+    if (Params.RebalanceInterval > 0 && NumRanks > 1 && ++StepsSinceRebalance >= Params.RebalanceInterval)
+    {
+        StepsSinceRebalance = 0;
+        Rebalance();
+        ResizeWindow();
+        MigrateParticles(true);
+    }
+    else
+    {
+        MigrateParticles(false);
+    }
+}
+
+const std::vector<ParticleRenderData>& MPMSubdomain::GetParticles() const
+{
+    return Particles;
+}
+
+int MPMSubdomain::GetBegin() const
+{
+    return Bounds[Rank];
+}
+
+int MPMSubdomain::GetEnd() const
+{
+    return Bounds[Rank + 1];
+}
+
+std::vector<int> MPMSubdomain::ComputeBounds(const std::vector<uint32_t>& ColumnCounts, uint32_t NumRanks)
+{
+    const int NumColumns = static_cast<int>(ColumnCounts.size());
+    uint64_t Total = 0;
+    for (uint32_t Count : ColumnCounts)
+    {
+        Total += Count;
+    }
+
+    std::vector<int> Edges(NumRanks + 1);
+    Edges[0] = 0;
+    Edges[NumRanks] = NumColumns;
+    int Column = 0;
+    uint64_t Prefix = 0;
+    for (uint32_t Edge = 1; Edge < NumRanks; Edge++)
+    {
+        // Leave every slab at least MIN_SLAB_COLUMNS wide, including the ones still to come
+        const uint64_t Target = Total * Edge / NumRanks;
+        const int MinColumn = Edges[Edge - 1] + MIN_SLAB_COLUMNS;
+        const int MaxColumn = NumColumns - static_cast<int>(NumRanks - Edge) * MIN_SLAB_COLUMNS;
+        while (Column < MaxColumn && (Column < MinColumn || Prefix < Target))
+        {
+            Prefix += ColumnCounts[Column];
+            Column++;
+        }
+        Edges[Edge] = Column;
+    }
+    return Edges;
+}
+
+int MPMSubdomain::GetColumn(const Math::Vec4& Position) const
+{
+    return std::clamp(static_cast<int>(Position.x * InvDx - 0.5f), 0, GridResolution - 1);
+}
+
+uint32_t MPMSubdomain::GetOwner(int Column) const
+{
+    uint32_t Owner = static_cast<uint32_t>(std::upper_bound(Bounds.begin(), Bounds.end(), Column) - Bounds.begin()) - 1;
+    return std::min(Owner, NumRanks - 1);
+}
+
+void MPMSubdomain::ResizeWindow()
+{
+    // The last slab has no right neighbour and so no halo
+    WindowEnd = std::min(GetEnd() + HALO_COLUMNS, GridResolution);
+    Grid.resize(static_cast<size_t>(WindowEnd - GetBegin()) * GridResolution + CPU_GRID_PADDING(GridResolution));
+}
+
+std::vector<uint32_t> MPMSubdomain::CountColumns(const std::vector<ParticleRenderData>& Source) const
+{
+    std::vector<uint32_t> Counts(GridResolution, 0);
+    for (const ParticleRenderData& Particle : Source)
+    {
+        if (ParticlePool::IsAlive(Particle))
+        {
+            Counts[GetColumn(Particle.Position)]++;
+        }
+    }
+    return Counts;
+}
+
+std::vector<uint32_t> MPMSubdomain::SumColumnCounts(const std::vector<uint32_t>& Counts)
+{
+    for (uint32_t Other = 0; Other < NumRanks; Other++)
+    {
+        if (Other != Rank)
+        {
+            Transport->Send(Other, HistogramTag, Counts.data(), Counts.size() * sizeof(uint32_t));
+        }
+    }
+
+    std::vector<uint32_t> Total = Counts;
+    for (uint32_t Other = 0; Other < NumRanks; Other++)
+    {
+        if (Other == Rank)
+        {
+            continue;
+        }
+        Transport->Receive(Other, HistogramTag, Incoming);
+        const uint32_t* OtherCounts = reinterpret_cast<const uint32_t*>(Incoming.data());
+        for (size_t Column = 0; Column < Total.size(); Column++)
+        {
+            Total[Column] += OtherCounts[Column];
+        }
+    }
+    return Total;
+}
+
+void MPMSubdomain::DistributeShare(const std::vector<ParticleRenderData>& Share)
+{
+    std::vector<std::vector<ParticleRenderData>> Owned(NumRanks);
+    for (const ParticleRenderData& Particle : Share)
+    {
+        if (ParticlePool::IsAlive(Particle))
+        {
+            Owned[GetOwner(GetColumn(Particle.Position))].push_back(Particle);
+        }
+    }
+    Particles = std::move(Owned[Rank]);
+    for (uint32_t Other = 0; Other < NumRanks; Other++)
+    {
+        if (Other != Rank)
+        {
+            Transport->Send(Other, DistributionTag, Owned[Other].data(), Owned[Other].size() * sizeof(ParticleRenderData));
+            // Gone as soon as it is sent, the share never has to be held twice
+            std::vector<ParticleRenderData>().swap(Owned[Other]);
+        }
+    }
+    for (uint32_t Other = 0; Other < NumRanks; Other++)
+    {
+        if (Other == Rank)
+        {
+            continue;
+        }
+        Transport->Receive(Other, DistributionTag, Incoming);
+        const ParticleRenderData* Arrivals = reinterpret_cast<const ParticleRenderData*>(Incoming.data());
+        Particles.insert(Particles.end(), Arrivals, Arrivals + Incoming.size() / sizeof(ParticleRenderData));
+    }
+
+    // In the same order however the particles were shared out, so a run doesn't depend on the split. Sorted along x the
+    // particles of a column are also next to each other in memory
+    std::sort(Particles.begin(), Particles.end(), [](const ParticleRenderData& A, const ParticleRenderData& B) {
+        return std::tie(A.Position.x, A.Position.y, A.Position.z, A.Velocity.x, A.Velocity.y, A.Velocity.z) < std::tie(B.Position.x, B.Position.y, B.Position.z, B.Velocity.x, B.Velocity.y, B.Velocity.z);
+    });
+}
+
+void MPMSubdomain::ExchangeGhostMass()
+{
+    // Our particles near End scattered into the right neighbour's first columns, the left neighbour's into ours
+    const size_t HaloCells = static_cast<size_t>(HALO_COLUMNS) * GridResolution;
+    if (Rank + 1 < NumRanks)
+    {
+        Transport->Send(Rank + 1, GhostMassTag, &Grid[(GetEnd() - GetBegin()) * GridResolution], HaloCells * sizeof(GridCell));
+    }
+    if (Rank > 0)
+    {
+        Transport->Receive(Rank - 1, GhostMassTag, Incoming);
+        const GridCell* Ghosts = reinterpret_cast<const GridCell*>(Incoming.data());
+        GridCell* Target = Grid.data();
+        for (size_t i = 0; i < HaloCells; i++)
+        {
+            Target[i].VelocityMass.w += Ghosts[i].VelocityMass.w;
+            Target[i].VelocityMass += Ghosts[i].VelocityMass;
+        }
+    }
+}
+
+void MPMSubdomain::ExchangeGhostVelocities()
+{
+    // Our first columns now hold every particle's mass, the copy past End only held ours
+    const size_t HaloCells = static_cast<size_t>(HALO_COLUMNS) * GridResolution;
+    if (Rank > 0)
+    {
+        Transport->Send(Rank - 1, GhostVelocityTag, Grid.data(), HaloCells * sizeof(GridCell));
+    }
+    if (Rank + 1 < NumRanks)
+    {
+        Transport->Receive(Rank + 1, GhostVelocityTag, Incoming);
+        std::memcpy(&Grid[(GetEnd() - GetBegin()) * GridResolution], Incoming.data(), HaloCells * sizeof(GridCell));
+    }
+}
+
+void MPMSubdomain::MigrateParticles(bool ToAllRanks)
+{
+    if (NumRanks == 1)
+    {
+        return;
+    }
+
+    for (std::vector<MigratingParticle>& List : Outgoing)
+    {
+        List.clear();
+    }
+    for (uint32_t Index = 0; Index < Particles.size(); Index++)
+    {
+        if (!ParticlePool::IsAlive(Particles[Index]))
+        {
+            continue;
+        }
+        uint32_t Owner = GetOwner(GetColumn(Particles[Index].Position));
+        if (Owner == Rank)
+        {
+            continue;
+        }
+        // Between rebalances particles only ever reach a neighbour, see below
+        uint32_t Destination = ToAllRanks ? Owner : (Owner < Rank ? Rank - 1 : Rank + 1);
+        Outgoing[Destination].push_back({Particles[Index], Solver->GetParticleData(Index)});
+        Solver->RemoveParticle(Index, Particles);
+    }
+
+    // Every rank that may send to us does so, even with nothing to send, so we know when all particles arrived
+    auto IsPeer = [&](uint32_t Other)
+    {
+        return Other != Rank && (ToAllRanks || Other + 1 == Rank || Other == Rank + 1);
+    };
+    for (uint32_t Other = 0; Other < NumRanks; Other++)
+    {
+        if (IsPeer(Other))
+        {
+            Transport->Send(Other, MigrationTag, Outgoing[Other].data(), Outgoing[Other].size() * sizeof(MigratingParticle));
+        }
+    }
+    for (uint32_t Other = 0; Other < NumRanks; Other++)
+    {
+        if (!IsPeer(Other))
+        {
+            continue;
+        }
+        Transport->Receive(Other, MigrationTag, Incoming);
+        const MigratingParticle* Arrivals = reinterpret_cast<const MigratingParticle*>(Incoming.data());
+        const size_t NumArrivals = Incoming.size() / sizeof(MigratingParticle);
+        for (size_t i = 0; i < NumArrivals; i++)
+        {
+            ParticleRenderData Arrival = Arrivals[i].Render;
+            if (GetOwner(GetColumn(Arrival.Position)) != Rank)
+            {
+                // Only a particle crossing a whole slab in one step, far faster than the solver is stable at, lands
+                // past us. It is held at our edge, our grid covers no more than the slab and its halo
+                Arrival.Position.x = std::clamp(Arrival.Position.x, (GetBegin() + 0.501f) / InvDx, (GetEnd() + 0.499f) / InvDx);
+            }
+            if (!Solver->InsertParticle(Particles, Arrival, Arrivals[i].Physics))
+            {
+                // Full, grow the pool the way a vector would
+                Solver->ReserveParticles(std::max<uint32_t>(static_cast<uint32_t>(Particles.size()) * 2, 64), Particles);
+                Solver->InsertParticle(Particles, Arrival, Arrivals[i].Physics);
+            }
+        }
+    }
+}
+
+void MPMSubdomain::Rebalance()
+{
+    // Every rank computes the same new edges from the same totals
+    Bounds = ComputeBounds(SumColumnCounts(CountColumns(Particles)), NumRanks);
+}
+
+DecomposedMPMSolver::DecomposedMPMSolver(std::vector<ParticleRenderData>& Particles, const MPMSolver::FluidParameters& FluidParams, MaterialModel Model, const DecompositionParameters& Params)
+    : SourceParticles(&Particles), FluidValues(FluidParams), Material(Model), Params(Params)
+{
+    // Every slab needs room for the halo of its left neighbour
+    this->Params.NumSubdomains = std::clamp(Params.NumSubdomains, 1u, FluidParams.GridResolution / MIN_SLAB_COLUMNS);
+    CreateSubdomains();
+}
+
+DecomposedMPMSolver::~DecomposedMPMSolver()
+{
+    StopRankThreads();
+}
+
+#ifdef _WIN32
+void DecomposedMPMSolver::Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList)
+{
+    // The owner restored the particles, split them again from scratch
+    CreateSubdomains();
+}
+#endif
+
+void DecomposedMPMSolver::CreateSubdomains()
+{
+    // The transports point into the hub, so the subdomains go first, and the threads stepping them before that
+    StopRankThreads();
+    Subdomains.clear();
+    Hub = std::make_unique<LocalHaloHub>(Params.NumSubdomains);
+
+    // The subdomains exchange their shares while they are constructed, so each is built on a thread of its own
+    const std::vector<ParticleRenderData>& Source = *SourceParticles;
+    Subdomains.resize(Params.NumSubdomains);
+    std::vector<std::thread> Builders;
+    for (uint32_t Rank = 0; Rank < Params.NumSubdomains; Rank++)
+    {
+        Builders.emplace_back([&, Rank]() {
+            std::vector<ParticleRenderData> Share(Source.begin() + Source.size() * Rank / Params.NumSubdomains, Source.begin() + Source.size() * (Rank + 1) / Params.NumSubdomains);
+            Subdomains[Rank] = std::make_unique<MPMSubdomain>(Hub->CreateTransport(Rank), Share, FluidValues, Material, Params);
+        });
+    }
+    for (std::thread& Builder : Builders)
+    {
+        Builder.join();
+    }
+    StartRankThreads();
+}
+
+void DecomposedMPMSolver::StartRankThreads()
+{
+    // Receives block until the sender gets there, so every subdomain needs a thread of its own rather than a pool worker
+    StopRanks = false;
+    for (uint32_t Rank = 1; Rank < Subdomains.size(); Rank++)
+    {
+        RankThreads.emplace_back(&DecomposedMPMSolver::RankLoop, this, Rank);
+    }
+}
+
+void DecomposedMPMSolver::StopRankThreads()
+{
+    {
+        std::lock_guard<std::mutex> Lock(StepMutex);
+        StopRanks = true;
+    }
+    StepStarted.notify_all();
+    for (std::thread& Thread : RankThreads)
+    {
+        Thread.join();
+    }
+    RankThreads.clear();
+}
+
+void DecomposedMPMSolver::RankLoop(uint32_t Rank)
+{
+    uint64_t StepsDone = 0;
+    while (true)
+    {
+        float DeltaTime;
+        {
+            std::unique_lock<std::mutex> Lock(StepMutex);
+            StepStarted.wait(Lock, [&]()
+                             { return StopRanks || StepCount != StepsDone; });
+            if (StopRanks)
+            {
+                return;
+            }
+            StepsDone = StepCount;
+            DeltaTime = StepDeltaTime;
+        }
+
+        Subdomains[Rank]->Step(DeltaTime);
+
+        std::lock_guard<std::mutex> Lock(StepMutex);
+        if (--RanksStepping == 0)
+        {
+            StepFinished.notify_one();
+        }
+    }
+}
+
+void DecomposedMPMSolver::CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    {
+        std::lock_guard<std::mutex> Lock(StepMutex);
+        StepDeltaTime = DeltaTime;
+        RanksStepping = static_cast<uint32_t>(RankThreads.size());
+        StepCount++;
+    }
+    StepStarted.notify_all();
+    Subdomains[0]->Step(DeltaTime);
+    {
+        std::unique_lock<std::mutex> Lock(StepMutex);
+        StepFinished.wait(Lock, [&]()
+                          { return RanksStepping == 0; });
+    }
+
+    size_t Count = 0;
+    for (const std::unique_ptr<MPMSubdomain>& Subdomain : Subdomains)
+    {
+        for (const ParticleRenderData& Particle : Subdomain->GetParticles())
+        {
+            if (!ParticlePool::IsAlive(Particle))
+            {
+                continue;
+            }
+            if (Count < Particles.size())
+            {
+                Particles[Count] = Particle;
+            }
+            else
+            {
+                Particles.push_back(Particle);
+            }
+            Count++;
+        }
+    }
+    // Pad with dead particles so the rendered count stays the same
+    for (; Count < Particles.size(); Count++)
+    {
+        Particles[Count] = {Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f), Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)};
+    }
+}
+
+#ifdef _WIN32
+void DecomposedMPMSolver::GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer)
+{
+}
+
+void DecomposedMPMSolver::CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler)
+{
+}
+
+void DecomposedMPMSolver::CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation)
+{
+}
+#endif
+
+uint32_t DecomposedMPMSolver::GetNumSubdomains() const
+{
+    return static_cast<uint32_t>(Subdomains.size());
+}
+
+const MPMSubdomain& DecomposedMPMSolver::GetSubdomain(uint32_t Index) const
+{
+    return *Subdomains[Index];
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "fluids/ActivityTracker.h"
+#include "fluids/HaloTransport.h"
+#include "fluids/IFluidSolver.h"
+#include "fluids/MPMSolver.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Narrowest slab a subdomain may own. Particles write two columns past their base column, which must land in the
+// next subdomain rather than the one after it
+#define MIN_SLAB_COLUMNS 2
+
+struct DecompositionParameters
+{
+    // Number of subdomains, each a slab of grid columns
+    uint32_t NumSubdomains = 4;
+    // Steps between moving the slab edges so every subdomain holds about the same number of particles, 0 keeps the
+    // initial split
+    uint32_t RebalanceInterval = 100;
+};
+
+// One rank of a decomposed (2D) CPU MPM run. Owns the particles whose base grid column lies in its slab [Begin, End)
+// and steps them with its own MPMSolver on a grid of just the slab and the two halo columns past it. Each step the
+// partial mass of the halo goes to the right neighbour and the updated velocities of its first two columns come back,
+// then particles that left the slab migrate. Everything else goes through the transport, so ranks can run as threads
+// or as separate processes, and no rank ever holds more than its slab
+class MPMSubdomain
+{
+public:
+    // Every rank is given a share of the initial particles, split any way. The ranks agree on the slabs from their
+    // column counts and hand each particle to its owner, so all of them have to be constructed at the same time
+    MPMSubdomain(std::unique_ptr<IHaloTransport> Transport, const std::vector<ParticleRenderData>& Share, MPMSolver::FluidParameters FluidParams, MaterialModel Model, const DecompositionParameters& Params);
+
+    void Step(float DeltaTime);
+
+    // Dead particles are holes left by migration
+    const std::vector<ParticleRenderData>& GetParticles() const;
+    int GetBegin() const;
+    int GetEnd() const;
+
+    // Splits the columns into slabs holding about the same number of particles. Returns NumRanks + 1 edges
+    static std::vector<int> ComputeBounds(const std::vector<uint32_t>& ColumnCounts, uint32_t NumRanks);
+
+private:
+    struct MigratingParticle
+    {
+        ParticleRenderData Render;
+        ParticlePhysicsData Physics;
+    };
+
+    int GetColumn(const Math::Vec4& Position) const;
+    uint32_t GetOwner(int Column) const;
+    std::vector<uint32_t> CountColumns(const std::vector<ParticleRenderData>& Source) const;
+    // All-gather of the column counts of every rank, summed
+    std::vector<uint32_t> SumColumnCounts(const std::vector<uint32_t>& Counts);
+    // Hands every particle of the share to the rank owning its column
+    void DistributeShare(const std::vector<ParticleRenderData>& Share);
+
+    // Sizes the grid to the slab and its halo, after the slab changed
+    void ResizeWindow();
+    void ExchangeGhostMass();
+    void ExchangeGhostVelocities();
+    // Sends every particle outside the slab towards its owner. Between rebalances particles move less than a cell per
+    // step, so only the neighbours are involved
+    void MigrateParticles(bool ToAllRanks);
+    void Rebalance();
+
+    std::unique_ptr<IHaloTransport> Transport;
+    uint32_t Rank;
+    uint32_t NumRanks;
+    DecompositionParameters Params;
+    int GridResolution;
+    float InvDx;
+
+    // Sleeping would need the activity of the neighbours' particles, so the tracker is shared with the solver only to
+    // keep it from sleeping on its own
+    ActivityTracker Activity;
+    std::unique_ptr<MPMSolver> Solver;
+    std::vector<ParticleRenderData> Particles;
+    // Columns [GetBegin(), WindowEnd) of the grid, plus CPU_GRID_PADDING
+    std::vector<GridCell> Grid;
+    int WindowEnd = 0;
+    // Slab edges of every rank
+    std::vector<int> Bounds;
+    uint32_t StepsSinceRebalance = 0;
+
+    // Scratch
+    std::vector<std::vector<MigratingParticle>> Outgoing;
+    std::vector<uint8_t> Incoming;
+};
+
+// Steps the CPU MPM solver as several subdomains, one thread each, talking through a LocalHaloHub. Each subdomain
+// starts from a contiguous share of the particles. The threads live as long as the subdomains and wait between steps.
+// The particles of all subdomains are gathered into the render array after every step
+class DecomposedMPMSolver : public IFluidSolver
+{
+public:
+    // Keeps a pointer to Particles, which are redistributed from there on Reset
+    DecomposedMPMSolver(std::vector<ParticleRenderData>& Particles, const MPMSolver::FluidParameters& FluidParams, MaterialModel Model, const DecompositionParameters& Params);
+    ~DecomposedMPMSolver();
+
+#ifdef _WIN32
+    virtual void Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList) override;
+#endif
+    virtual void CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime) override;
+#ifdef _WIN32
+    virtual void GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer) override;
+
+    virtual void CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler) override;
+    virtual void CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation) override;
+#endif
+
+    uint32_t GetNumSubdomains() const;
+    const MPMSubdomain& GetSubdomain(uint32_t Index) const;
+
+private:
+    void CreateSubdomains();
+    // Ranks past the first step on threads of their own, rank 0 on the caller's
+    void StartRankThreads();
+    void StopRankThreads();
+    void RankLoop(uint32_t Rank);
+
+    std::vector<ParticleRenderData>* SourceParticles;
+    MPMSolver::FluidParameters FluidValues;
+    MaterialModel Material;
+    DecompositionParameters Params;
+
+    std::unique_ptr<LocalHaloHub> Hub;
+    std::vector<std::unique_ptr<MPMSubdomain>> Subdomains;
+
+    std::vector<std::thread> RankThreads;
+    std::mutex StepMutex;
+    std::condition_variable StepStarted;
+    std::condition_variable StepFinished;
+    // Counts the steps handed to the rank threads, a thread steps whenever it changes
+    uint64_t StepCount = 0;
+    float StepDeltaTime = 0.0f;
+    uint32_t RanksStepping = 0;
+    bool StopRanks = false;
+};
@@ -0,0 +1,224 @@
+#include "fluids/DecomposedRun.h"
+
+#include "fluids/HaloTransport.h"
+#include "fluids/ParticlePool.h"
+#include "util/ChildProcess.h"
+#include "util/SharedMemory.h"
+#include "util/Socket.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+// Arguments after DECOMPOSED_RANK_OPTION: transport, rank, then the parameters in declaration order. The transport is
+// SHARED_MEMORY_PREFIX and the segment name, or SOCKET_PREFIX and the endpoints separated by commas
+#define NUM_RANK_ARGUMENTS 7
+#define SHARED_MEMORY_PREFIX "shm:"
+#define SOCKET_PREFIX "tcp:"
+
+std::vector<ParticleRenderData> CreateDecomposedScene(uint32_t NumParticles, uint32_t Rank, uint32_t NumRanks)
+{
+    const uint32_t Side = std::max<uint32_t>(static_cast<uint32_t>(std::ceil(std::sqrt(double(NumParticles)))), 1);
+    const uint32_t FirstColumn = static_cast<uint32_t>(uint64_t(Side) * Rank / NumRanks);
+    const uint32_t EndColumn = static_cast<uint32_t>(uint64_t(Side) * (Rank + 1) / NumRanks);
+    std::vector<ParticleRenderData> Particles;
+    for (uint32_t Row = 0; Row < Side; Row++)
+    {
+        for (uint32_t Column = FirstColumn; Column < EndColumn && uint64_t(Row) * Side + Column < NumParticles; Column++)
+        {
+            float U = (float(Column) + 0.5f) / float(Side);
+            float V = (float(Row) + 0.5f) / float(Side);
+            Particles.push_back({Math::Vec4(0.3f + 0.4f * U, 0.1f + 0.4f * V, 0.5f), Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+        }
+    }
+    return Particles;
+}
+
+MPMSolver::FluidParameters GetDecomposedFluidParameters()
+{
+    // FluidParameters: NumParticles, Resolution, Lambda, Mu, Timestep, Size
+    return {0, 64, 40.0f, 20.0f, DECOMPOSED_RUN_TIMESTEP, 1.0f};
+}
+
+std::filesystem::path GetRankOutputPath(const std::filesystem::path& OutputPath, uint32_t Rank)
+{
+    std::filesystem::path Path = OutputPath;
+    Path += "." + std::to_string(Rank);
+    return Path;
+}
+
+std::vector<std::string> GetLoopbackEndpoints(uint32_t NumRanks)
+{
+    // All held until every port is picked, so they differ. Another process could still take one before the rank does
+    std::vector<Socket> Listeners(NumRanks);
+    std::vector<std::string> Endpoints;
+    for (Socket& Listener : Listeners)
+    {
+        if (!Listener.Listen(0, 1))
+        {
+            return {};
+        }
+        Endpoints.push_back("127.0.0.1:" + std::to_string(Listener.GetPort()));
+    }
+    return Endpoints;
+}
+
+std::vector<std::string> GetDecomposedRankArguments(const DecomposedRunParameters& Params, uint32_t Rank, const std::string& SegmentName)
+{
+    std::string Transport = SHARED_MEMORY_PREFIX + SegmentName;
+    if (!Params.Endpoints.empty())
+    {
+        Transport = SOCKET_PREFIX;
+        for (size_t Index = 0; Index < Params.Endpoints.size(); Index++)
+        {
+            Transport += (Index > 0 ? "," : "") + Params.Endpoints[Index];
+        }
+    }
+    return {Transport, std::to_string(Rank), std::to_string(Params.NumRanks), std::to_string(Params.NumParticles), std::to_string(Params.NumSteps), std::to_string(Params.RebalanceInterval), Params.OutputPath.string()};
+}
+
+bool LaunchDecomposedRun(const std::filesystem::path& Executable, const DecomposedRunParameters& RunParams)
+{
+    DecomposedRunParameters Params = RunParams;
+    const uint32_t MaxRanks = GetDecomposedFluidParameters().GridResolution / MIN_SLAB_COLUMNS;
+    Params.NumRanks = std::clamp(Params.NumRanks, 1u, MaxRanks);
+    if (!Params.Endpoints.empty())
+    {
+        Params.NumRanks = static_cast<uint32_t>(Params.Endpoints.size());
+        if (Params.NumRanks > MaxRanks)
+        {
+            return false;
+        }
+    }
+
+    // Named after this process and run, so runs never share memory
+    static std::atomic<uint32_t> NumLaunches = 0;
+    const std::string Name = "FluidSimHalo-" + std::to_string(ChildProcess::GetCurrentId()) + "-" + std::to_string(NumLaunches++);
+    SharedMemory Segment;
+    if (Params.Endpoints.empty())
+    {
+        if (!Segment.Create(Name, SharedMemoryHaloTransport::GetSegmentSize(Params.NumRanks)))
+        {
+            return false;
+        }
+        SharedMemoryHaloTransport::InitializeSegment(Segment.GetData(), Params.NumRanks);
+    }
+
+    // Destroying them kills the ranks still running
+    std::vector<ChildProcess> Ranks(Params.NumRanks);
+    for (uint32_t Rank = 0; Rank < Params.NumRanks; Rank++)
+    {
+        std::vector<std::string> Args = GetDecomposedRankArguments(Params, Rank, Name);
+        Args.insert(Args.begin(), DECOMPOSED_RANK_OPTION);
+        if (!Ranks[Rank].Start(Executable, Args))
+        {
+            return false;
+        }
+    }
+
+    std::vector<bool> Exited(Params.NumRanks, false);
+    for (uint32_t NumExited = 0; NumExited < Params.NumRanks;)
+    {
+        for (uint32_t Rank = 0; Rank < Params.NumRanks; Rank++)
+        {
+            int ExitCode;
+            if (Exited[Rank] || !Ranks[Rank].HasExited(ExitCode))
+            {
+                continue;
+            }
+            if (ExitCode != 0)
+            {
+                return false;
+            }
+            Exited[Rank] = true;
+            NumExited++;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // One file in rank order, as the particles of the slabs from left to right
+    std::ofstream Output(Params.OutputPath, std::ios::binary);
+    for (uint32_t Rank = 0; Rank < Params.NumRanks; Rank++)
+    {
+        const std::filesystem::path RankPath = GetRankOutputPath(Params.OutputPath, Rank);
+        {
+            std::ifstream RankOutput(RankPath, std::ios::binary);
+            if (!RankOutput || !(Output << RankOutput.rdbuf()))
+            {
+                return false;
+            }
+        }
+        std::error_code Ignored;
+        std::filesystem::remove(RankPath, Ignored);
+    }
+    return static_cast<bool>(Output.flush());
+}
+
+int RunDecomposedRank(const std::vector<std::string>& Args)
+{
+    if (Args.size() != NUM_RANK_ARGUMENTS)
+    {
+        return 1;
+    }
+    std::istringstream ArgStream(Args[1] + " " + Args[2] + " " + Args[3] + " " + Args[4] + " " + Args[5]);
+    uint32_t Rank;
+    DecomposedRunParameters Params;
+    if (!(ArgStream >> Rank >> Params.NumRanks >> Params.NumParticles >> Params.NumSteps >> Params.RebalanceInterval) || Rank >= Params.NumRanks)
+    {
+        return 1;
+    }
+    Params.OutputPath = Args[6];
+
+    // Unmapped last, after the transport finished sending
+    SharedMemory Segment;
+    std::unique_ptr<IHaloTransport> Transport;
+    const std::string& TransportArg = Args[0];
+    if (TransportArg.rfind(SHARED_MEMORY_PREFIX, 0) == 0)
+    {
+        if (!Segment.Open(TransportArg.substr(strlen(SHARED_MEMORY_PREFIX)), SharedMemoryHaloTransport::GetSegmentSize(Params.NumRanks)))
+        {
+            return 1;
+        }
+        Transport = std::make_unique<SharedMemoryHaloTransport>(Segment.GetData(), Rank);
+    }
+    else if (TransportArg.rfind(SOCKET_PREFIX, 0) == 0)
+    {
+        std::istringstream EndpointStream(TransportArg.substr(strlen(SOCKET_PREFIX)));
+        for (std::string Endpoint; std::getline(EndpointStream, Endpoint, ',');)
+        {
+            Params.Endpoints.push_back(Endpoint);
+        }
+        if (Params.Endpoints.size() != Params.NumRanks)
+        {
+            return 1;
+        }
+        Transport = SocketHaloTransport::Connect(Params.Endpoints, Rank, std::chrono::milliseconds(DECOMPOSED_CONNECT_TIMEOUT_MS));
+    }
+    if (!Transport)
+    {
+        return 1;
+    }
+
+    DecompositionParameters Decomposition;
+    Decomposition.NumSubdomains = Params.NumRanks;
+    Decomposition.RebalanceInterval = Params.RebalanceInterval;
+    std::vector<ParticleRenderData> Particles;
+    {
+        MPMSubdomain Subdomain(std::move(Transport), CreateDecomposedScene(Params.NumParticles, Rank, Params.NumRanks), GetDecomposedFluidParameters(), JellyMaterial, Decomposition);
+        for (uint32_t Step = 0; Step < Params.NumSteps; Step++)
+        {
+            Subdomain.Step(DECOMPOSED_RUN_TIMESTEP);
+        }
+        std::copy_if(Subdomain.GetParticles().begin(), Subdomain.GetParticles().end(), std::back_inserter(Particles), ParticlePool::IsAlive);
+    }
+
+    std::ofstream Output(GetRankOutputPath(Params.OutputPath, Rank), std::ios::binary);
+    Output.write(reinterpret_cast<const char*>(Particles.data()), Particles.size() * sizeof(ParticleRenderData));
+    return Output ? 0 : 1;
+}
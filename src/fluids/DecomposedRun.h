@@ -0,0 +1,49 @@
+#pragma once
+
+#include "fluids/DecomposedMPMSolver.h"
+#include <filesystem>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Option an executable has to hand the rest of its arguments to RunDecomposedRank on
+#define DECOMPOSED_RANK_OPTION "--decomposed-rank"
+#define DECOMPOSED_RUN_TIMESTEP 0.002f
+
+// How long a rank waits for the others to start listening on their endpoints
+#define DECOMPOSED_CONNECT_TIMEOUT_MS 120000
+
+// Decomposed run of a jelly block with one process per rank. The ranks talk through a SharedMemoryHaloTransport, or a
+// SocketHaloTransport when they are given endpoints, which lets them run on several machines
+struct DecomposedRunParameters
+{
+    uint32_t NumRanks = 4;
+    uint32_t NumParticles = 10000;
+    uint32_t NumSteps = 1000;
+    uint32_t RebalanceInterval = 100;
+    // Every rank writes the live particles of its slab after the last step to GetRankOutputPath of this, as raw
+    // ParticleRenderData. LaunchDecomposedRun joins them here in rank order
+    std::filesystem::path OutputPath;
+    // "host:port" of every rank to talk over TCP, as many as there are ranks. Empty for shared memory
+    std::vector<std::string> Endpoints;
+};
+
+// Square lattice of jelly over the same box the batch and out-of-core runs use. A rank of NumRanks creates only its
+// strip of the lattice's columns, no process of a run holds the whole scene
+std::vector<ParticleRenderData> CreateDecomposedScene(uint32_t NumParticles, uint32_t Rank = 0, uint32_t NumRanks = 1);
+MPMSolver::FluidParameters GetDecomposedFluidParameters();
+std::filesystem::path GetRankOutputPath(const std::filesystem::path& OutputPath, uint32_t Rank);
+// Endpoints on this machine for a run over TCP, on ports free when asked
+std::vector<std::string> GetLoopbackEndpoints(uint32_t NumRanks);
+
+// Arguments after DECOMPOSED_RANK_OPTION that start one rank of a run, on this machine or another one
+std::vector<std::string> GetDecomposedRankArguments(const DecomposedRunParameters& Params, uint32_t Rank, const std::string& SegmentName);
+
+// Creates the shared memory unless there are endpoints and starts Executable once per rank with DECOMPOSED_RANK_OPTION
+// and the rank's arguments, then waits for all of them and joins their output. The rank count is clamped like
+// DecomposedMPMSolver's, with endpoints it is their count and must fit. A rank failing stops the others, as they would
+// wait on it forever. Returns false if any rank failed or couldn't be started
+bool LaunchDecomposedRun(const std::filesystem::path& Executable, const DecomposedRunParameters& Params);
+
+// Steps one rank, Args being what follows DECOMPOSED_RANK_OPTION. Returns the process exit code, 0 on success
+int RunDecomposedRank(const std::vector<std::string>& Args);
@@ -0,0 +1,191 @@
+#include "fluids/EnsembleRunner.h"
+
+#include "fluids/MPMSolver.h"
+#include "util/ThreadPool.h"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+EnsembleRunner::EnsembleRunner(const EnsembleParameters& Params)
+    : Params(Params)
+{
+}
+
+void EnsembleRunner::AddRun(const EnsembleRun& Run)
+{
+    Runs.push_back(Run);
+}
+
+bool EnsembleRunner::LoadRuns(const std::filesystem::path& Path)
+{
+    std::ifstream File(Path);
+    if (!File)
+    {
+        return false;
+    }
+
+    std::string Line;
+    while (std::getline(File, Line))
+    {
+        std::istringstream Fields(Line);
+        EnsembleRun Run;
+        if (!(Fields >> Run.Name) || Run.Name[0] == '#')
+        {
+            continue;
+        }
+        if (!(Fields >> Run.NumParticles >> Run.ElasticMu >> Run.ElasticLamda >> Run.DeltaTime >> Run.NumSteps))
+        {
+            return false;
+        }
+
+        std::string Material;
+        if (Fields >> Material)
+        {
+            if (Material == "jelly")
+            {
+                Run.Material = JellyMaterial;
+            }
+            else if (Material == "snow")
+            {
+                Run.Material = SnowMaterial;
+            }
+            else if (Material == "sand")
+            {
+                Run.Material = SandMaterial;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        Runs.push_back(Run);
+    }
+    return true;
+}
+
+void EnsembleRunner::RunAll()
+{
+    if (Runs.empty())
+    {
+        return;
+    }
+    std::filesystem::create_directories(Params.OutputDirectory);
+    NextRun = 0;
+    NumDiverged = 0;
+
+    const uint32_t NumHardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    uint32_t NumWorkers = Params.NumWorkers > 0 ? Params.NumWorkers : NumHardwareThreads;
+    NumWorkers = std::min(NumWorkers, static_cast<uint32_t>(Runs.size()));
+    // Workers on every core keep them all busy, the pool would only make the runs queue up behind each other
+    const bool Serial = NumWorkers >= NumHardwareThreads;
+
+    std::vector<std::thread> Workers;
+    for (uint32_t Worker = 0; Worker < NumWorkers; Worker++)
+    {
+        Workers.emplace_back(&EnsembleRunner::WorkerLoop, this, Worker, Serial);
+    }
+    for (std::thread& Worker : Workers)
+    {
+        Worker.join();
+    }
+}
+
+uint32_t EnsembleRunner::GetNumRuns() const
+{
+    return static_cast<uint32_t>(Runs.size());
+}
+
+uint32_t EnsembleRunner::GetNumDiverged() const
+{
+    return NumDiverged;
+}
+
+void EnsembleRunner::WorkerLoop(uint32_t Worker, bool Serial)
+{
+    if (Params.PinWorkers)
+    {
+        uint32_t Core = (Params.FirstCore + Worker) % std::max(std::thread::hardware_concurrency(), 1u);
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (Core % (sizeof(DWORD_PTR) * 8)));
+    }
+    ThreadPool::RunSerially(Serial);
+
+    WorkerMemory Memory;
+    uint32_t RunIndex;
+    while ((RunIndex = NextRun.fetch_add(1)) < Runs.size())
+    {
+        if (!Simulate(Runs[RunIndex], Memory))
+        {
+            NumDiverged++;
+        }
+    }
+}
+
+bool EnsembleRunner::Simulate(const EnsembleRun& Run, WorkerMemory& Memory) const
+{
+    // Square lattice over the spawn box in the solver's (2D) plane
+    std::vector<ParticleRenderData>& Particles = Memory.Particles;
+    Particles.clear();
+    const int Side = std::max(static_cast<int>(std::ceil(std::sqrt(float(Run.NumParticles)))), 1);
+    for (int i = 0; i < Run.NumParticles; i++)
+    {
+        float U = (float(i % Side) + 0.5f) / float(Side);
+        float V = (float(i / Side) + 0.5f) / float(Side);
+        Math::Vec4 Position(Run.SpawnMin.x + (Run.SpawnMax.x - Run.SpawnMin.x) * U, Run.SpawnMin.y + (Run.SpawnMax.y - Run.SpawnMin.y) * V, Run.SpawnMin.z);
+        Particles.push_back({Position * Run.GridSize, Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+    }
+
+    // FluidParameters:              NumParticles, Resolution, Lambda, Mu, Timestep, Size
+    MPMSolver::FluidParameters FluidParams = {Run.NumParticles, Run.GridResolution, Run.ElasticLamda, Run.ElasticMu, Run.DeltaTime, Run.GridSize};
+    // The last run's solver is gone, rewinding keeps the memory so a run no bigger than it allocates nothing
+    Memory.Arenas.RunArena.Reset();
+    Memory.Arenas.StepArena.Reset();
+    MPMSolver Solver(Particles, FluidParams, Run.Material, &Memory.Arenas);
+
+    std::ofstream File(Params.OutputDirectory / (Run.Name + ".txt"));
+    File << "# Step Time KineticEnergy CenterX CenterY MaxSpeed\n";
+    const float Dx = Run.GridSize / float(Run.GridResolution);
+    char Line[256];
+    for (uint32_t Step = 1; Step <= Run.NumSteps; Step++)
+    {
+        Solver.CPUSolve(Particles, Run.DeltaTime);
+
+        double KineticEnergy = 0.0;
+        double CenterX = 0.0;
+        double CenterY = 0.0;
+        float MaxSpeedSq = 0.0f;
+        for (const ParticleRenderData& Particle : Particles)
+        {
+            float SpeedSq = Particle.Velocity.Dot(Particle.Velocity);
+            KineticEnergy += 0.5 * SpeedSq;
+            CenterX += Particle.Position.x;
+            CenterY += Particle.Position.y;
+            MaxSpeedSq = std::max(MaxSpeedSq, SpeedSq);
+        }
+
+        // Stop once the state turns to NaN or a particle outruns the grid, which it soon does after that. The next
+        // transfer would index outside the grid
+        if (!std::isfinite(KineticEnergy) || !(std::sqrt(MaxSpeedSq) * Run.DeltaTime < Dx))
+        {
+            std::snprintf(Line, sizeof(Line), "# Diverged at step %u\n", Step);
+            File << Line;
+            return false;
+        }
+
+        if ((Run.OutputInterval == 0 || Step % Run.OutputInterval != 0) && Step != Run.NumSteps)
+        {
+            continue;
+        }
+        const double InvCount = 1.0 / std::max<size_t>(Particles.size(), 1);
+        std::snprintf(Line, sizeof(Line), "%u %g %g %g %g %g\n", Step, Step * Run.DeltaTime, KineticEnergy * InvCount, CenterX * InvCount, CenterY * InvCount, std::sqrt(MaxSpeedSq));
+        File << Line;
+    }
+    return true;
+}
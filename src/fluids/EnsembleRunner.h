@@ -0,0 +1,84 @@
+#pragma once
+
+#include "fluids/IFluidSolver.h"
+#include "fluids/MPMSolver.h"
+#include "fluids/Plasticity.h"
+#include "util/3DMath.h"
+#include <atomic>
+#include <filesystem>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// One scene of a parameter sweep, stepped headless on the CPU MPM solver
+struct EnsembleRun
+{
+    // Names the output file, <OutputDirectory>/<Name>.txt
+    std::string Name;
+    int NumParticles = 4096;
+    // Lame parameters
+    float ElasticMu = 20.0f;
+    float ElasticLamda = 40.0f;
+    float DeltaTime = 0.002f;
+    MaterialModel Material = JellyMaterial;
+    uint32_t GridResolution = 64;
+    float GridSize = 1.0f;
+    // Box the particles start in, as fractions of GridSize
+    Math::Vec4 SpawnMin = Math::Vec4(0.3f, 0.1f, 0.5f);
+    Math::Vec4 SpawnMax = Math::Vec4(0.7f, 0.5f, 0.5f);
+    uint32_t NumSteps = 1000;
+    // Steps between lines of the output file, 0 only writes the last step
+    uint32_t OutputInterval = 10;
+};
+
+struct EnsembleParameters
+{
+    // Runs stepping at the same time, 0 uses one per hardware thread
+    uint32_t NumWorkers = 0;
+    // Pins worker i to core FirstCore + i so runs keep their caches
+    bool PinWorkers = true;
+    uint32_t FirstCore = 0;
+    std::filesystem::path OutputDirectory = ".";
+};
+
+// Steps many small scenes at once for parameter sweeps, where runs per hour matter more than the latency of one.
+// Every worker takes the next queued run and steps it on its own thread. With a worker on every hardware thread they
+// leave the thread pool alone so runs never wait on each other, with fewer they share its spare threads. A worker
+// reuses its particle buffer and the solver's arenas, grid, particle data and scratch, from one run to the next. Each
+// run streams "Step Time KineticEnergy CenterX CenterY MaxSpeed" lines to its output file and stops early once a run
+// turns unstable
+class EnsembleRunner
+{
+public:
+    EnsembleRunner(const EnsembleParameters& Params = EnsembleParameters());
+
+    void AddRun(const EnsembleRun& Run);
+    // Reads one run per line: Name NumParticles ElasticMu ElasticLamda DeltaTime NumSteps [jelly|snow|sand].
+    // Empty lines and lines starting with # are skipped. Returns false if the file can't be read or a line is malformed
+    bool LoadRuns(const std::filesystem::path& Path);
+
+    // Steps every queued run, returns once all are done
+    void RunAll();
+
+    uint32_t GetNumRuns() const;
+    // Runs stopped because their state turned to NaN or a particle moved more than a grid cell in one step, only valid
+    // after RunAll
+    uint32_t GetNumDiverged() const;
+
+private:
+    // Kept by a worker across its runs
+    struct WorkerMemory
+    {
+        std::vector<ParticleRenderData> Particles;
+        MPMSolverArenas Arenas;
+    };
+
+    void WorkerLoop(uint32_t Worker, bool Serial);
+    // Returns false if the run diverged
+    bool Simulate(const EnsembleRun& Run, WorkerMemory& Memory) const;
+
+    EnsembleParameters Params;
+    std::vector<EnsembleRun> Runs;
+    std::atomic<uint32_t> NextRun = 0;
+    std::atomic<uint32_t> NumDiverged = 0;
+};
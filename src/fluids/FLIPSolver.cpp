@@ -0,0 +1,605 @@
+#include "fluids/FLIPSolver.h"
+
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Particles per parallel G2P chunk
+#define PARTICLE_CHUNK_SIZE 1024
+// Face rows per parallel chunk
+#define ROW_CHUNK_SIZE 8
+// Fast sweeping rounds, each runs the four sweep directions
+#define REDISTANCE_ROUNDS 2
+
+FLIPSolver::FLIPSolver(int GridResolution, float GridSize, const FLIPParameters& Params)
+    : Params(Params), GridResolution(GridResolution), Size(GridSize), Dx(GridSize / GridResolution), InvDx(GridResolution / GridSize), PressureSolver(GridResolution, GridSize / GridResolution, Params.Pressure)
+{
+    size_t NumFaces = static_cast<size_t>(GridResolution + 1) * GridResolution;
+    for (std::vector<float>* Faces : {&U, &V, &SavedU, &SavedV, &WeightU, &WeightV, &ScratchU, &ScratchV})
+    {
+        Faces->resize(NumFaces, 0.0f);
+    }
+    for (std::vector<uint8_t>* Valid : {&ValidU, &ValidV, &ScratchValidU, &ScratchValidV})
+    {
+        Valid->resize(NumFaces, 0);
+    }
+    size_t NumCells = static_cast<size_t>(GridResolution) * GridResolution;
+    CellTypes.resize(NumCells, AirCell);
+    Divergence.resize(NumCells, 0.0f);
+    Pressure.resize(NumCells, 0.0f);
+    LevelSet.resize(NumCells, Size);
+    ScratchLevelSet.resize(NumCells, Size);
+    GridU.resize(NumFaces, 0.0f);
+    GridV.resize(NumFaces, 0.0f);
+    CellParticleCount.resize(NumCells, 0);
+    InterfaceCells.resize(NumCells, 0);
+}
+
+void FLIPSolver::Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList)
+{
+    // Every step rebuilds the grid from the particles, the owner restores those
+    std::fill(Pressure.begin(), Pressure.end(), 0.0f);
+    LastPressureIterations = 0;
+    std::fill(LevelSet.begin(), LevelSet.end(), Size);
+    HasGridState = false;
+}
+
+void FLIPSolver::CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler)
+{
+}
+
+void FLIPSolver::CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation)
+{
+}
+
+void FLIPSolver::GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer)
+{
+}
+
+uint32_t FLIPSolver::GetLastPressureIterations() const
+{
+    return LastPressureIterations;
+}
+
+void FLIPSolver::EnableNarrowBand(const NarrowBandParameters& BandParams)
+{
+    UseNarrowBand = true;
+    Band = BandParams;
+    std::fill(LevelSet.begin(), LevelSet.end(), Size);
+    HasGridState = false;
+}
+
+void FLIPSolver::SetParticleCapacity(uint32_t Capacity)
+{
+    ParticleCapacity = Capacity;
+}
+
+float FLIPSolver::Sample(const std::vector<float>& Faces, int NumX, int NumY, float OffsetX, float OffsetY, float X, float Y) const
+{
+    float GridX = X - OffsetX;
+    float GridY = Y - OffsetY;
+    int BaseX = std::clamp(static_cast<int>(std::floor(GridX)), 0, NumX - 2);
+    int BaseY = std::clamp(static_cast<int>(std::floor(GridY)), 0, NumY - 2);
+    float FracX = std::clamp(GridX - BaseX, 0.0f, 1.0f);
+    float FracY = std::clamp(GridY - BaseY, 0.0f, 1.0f);
+
+    const float* Row0 = &Faces[BaseX * NumY + BaseY];
+    const float* Row1 = Row0 + NumY;
+    return (1.0f - FracX) * ((1.0f - FracY) * Row0[0] + FracY * Row0[1]) + FracX * ((1.0f - FracY) * Row1[0] + FracY * Row1[1]);
+}
+
+Math::Vec4 FLIPSolver::SampleVelocity(const std::vector<float>& FacesU, const std::vector<float>& FacesV, const Math::Vec4& Position) const
+{
+    float X = Position.x * InvDx;
+    float Y = Position.y * InvDx;
+    return Math::Vec4(
+        Sample(FacesU, GridResolution + 1, GridResolution, 0.0f, 0.5f, X, Y),
+        Sample(FacesV, GridResolution, GridResolution + 1, 0.5f, 0.0f, X, Y),
+        0.0f,
+        0.0f);
+}
+
+void FLIPSolver::ParticleToGrid(const std::vector<ParticleRenderData>& Particles)
+{
+    std::fill(U.begin(), U.end(), 0.0f);
+    std::fill(V.begin(), V.end(), 0.0f);
+    std::fill(WeightU.begin(), WeightU.end(), 0.0f);
+    std::fill(WeightV.begin(), WeightV.end(), 0.0f);
+
+    const int Res = GridResolution;
+    auto Splat = [](std::vector<float>& Faces, std::vector<float>& Weights, int NumX, int NumY, float GridX, float GridY, float Value) {
+        int BaseX = std::clamp(static_cast<int>(std::floor(GridX)), 0, NumX - 2);
+        int BaseY = std::clamp(static_cast<int>(std::floor(GridY)), 0, NumY - 2);
+        float FracX = std::clamp(GridX - BaseX, 0.0f, 1.0f);
+        float FracY = std::clamp(GridY - BaseY, 0.0f, 1.0f);
+        const float Weight[4] = {(1.0f - FracX) * (1.0f - FracY), (1.0f - FracX) * FracY, FracX * (1.0f - FracY), FracX * FracY};
+        const int Index[4] = {BaseX * NumY + BaseY, BaseX * NumY + BaseY + 1, (BaseX + 1) * NumY + BaseY, (BaseX + 1) * NumY + BaseY + 1};
+        for (int i = 0; i < 4; i++)
+        {
+            Faces[Index[i]] += Weight[i] * Value;
+            Weights[Index[i]] += Weight[i];
+        }
+    };
+
+    for (const ParticleRenderData& Particle : Particles)
+    {
+        if (Particle.Position.w == 0.0f)
+        {
+            continue;
+        }
+        float X = Particle.Position.x * InvDx;
+        float Y = Particle.Position.y * InvDx;
+        Splat(U, WeightU, Res + 1, Res, X, Y - 0.5f, Particle.Velocity.x);
+        Splat(V, WeightV, Res, Res + 1, X - 0.5f, Y, Particle.Velocity.y);
+    }
+
+    for (size_t Face = 0; Face < U.size(); Face++)
+    {
+        U[Face] = WeightU[Face] > 0.0f ? U[Face] / WeightU[Face] : 0.0f;
+        V[Face] = WeightV[Face] > 0.0f ? V[Face] / WeightV[Face] : 0.0f;
+    }
+
+    // The interior has no particles in narrow band mode, its faces take the advected grid velocities instead
+    if (UseNarrowBand && HasGridState)
+    {
+        for (int X = 0; X <= Res; X++)
+        {
+            for (int Y = 0; Y < Res; Y++)
+            {
+                int Face = X * Res + Y;
+                bool Inside = (X > 0 && LevelSet[(X - 1) * Res + Y] < 0.0f) || (X < Res && LevelSet[X * Res + Y] < 0.0f);
+                if (WeightU[Face] == 0.0f && Inside)
+                {
+                    U[Face] = GridU[Face];
+                }
+            }
+        }
+        for (int X = 0; X < Res; X++)
+        {
+            for (int Y = 0; Y <= Res; Y++)
+            {
+                int Face = X * (Res + 1) + Y;
+                bool Inside = (Y > 0 && LevelSet[X * Res + Y - 1] < 0.0f) || (Y < Res && LevelSet[X * Res + Y] < 0.0f);
+                if (WeightV[Face] == 0.0f && Inside)
+                {
+                    V[Face] = GridV[Face];
+                }
+            }
+        }
+    }
+    SavedU = U;
+    SavedV = V;
+}
+
+void FLIPSolver::MarkCells(const std::vector<ParticleRenderData>& Particles)
+{
+    const int Res = GridResolution;
+    if (UseNarrowBand)
+    {
+        BuildLevelSet(Particles);
+        for (int X = 0; X < Res; X++)
+        {
+            for (int Y = 0; Y < Res; Y++)
+            {
+                bool Border = X == 0 || Y == 0 || X == Res - 1 || Y == Res - 1;
+                CellTypes[X * Res + Y] = Border ? SolidCell : (LevelSet[X * Res + Y] < 0.0f ? FluidCell : AirCell);
+            }
+        }
+        return;
+    }
+
+    // One layer of solid cells around the box, any cell holding a particle is fluid
+    for (int X = 0; X < Res; X++)
+    {
+        for (int Y = 0; Y < Res; Y++)
+        {
+            bool Border = X == 0 || Y == 0 || X == Res - 1 || Y == Res - 1;
+            CellTypes[X * Res + Y] = Border ? SolidCell : AirCell;
+        }
+    }
+    for (const ParticleRenderData& Particle : Particles)
+    {
+        if (Particle.Position.w == 0.0f)
+        {
+            continue;
+        }
+        int X = std::clamp(static_cast<int>(Particle.Position.x * InvDx), 0, Res - 1);
+        int Y = std::clamp(static_cast<int>(Particle.Position.y * InvDx), 0, Res - 1);
+        uint8_t& Type = CellTypes[X * Res + Y];
+        if (Type != SolidCell)
+        {
+            Type = FluidCell;
+        }
+    }
+}
+
+void FLIPSolver::ApplyBoundaries()
+{
+    const int Res = GridResolution;
+    // Faces touching a solid cell or the domain edge carry no flow
+    for (int X = 0; X <= Res; X++)
+    {
+        for (int Y = 0; Y < Res; Y++)
+        {
+            bool Blocked = X == 0 || X == Res || CellTypes[(X - 1) * Res + Y] == SolidCell || CellTypes[X * Res + Y] == SolidCell;
+            if (Blocked)
+            {
+                U[X * Res + Y] = 0.0f;
+            }
+        }
+    }
+    for (int X = 0; X < Res; X++)
+    {
+        for (int Y = 0; Y <= Res; Y++)
+        {
+            bool Blocked = Y == 0 || Y == Res || CellTypes[X * Res + Y - 1] == SolidCell || CellTypes[X * Res + Y] == SolidCell;
+            if (Blocked)
+            {
+                V[X * (Res + 1) + Y] = 0.0f;
+            }
+        }
+    }
+}
+
+void FLIPSolver::Project(float DeltaTime)
+{
+    const int Res = GridResolution;
+    // Solving for DeltaTime * pressure / density lets the gradient be subtracted from the velocities directly
+    for (int X = 0; X < Res; X++)
+    {
+        for (int Y = 0; Y < Res; Y++)
+        {
+            int Cell = X * Res + Y;
+            if (CellTypes[Cell] != FluidCell)
+            {
+                Divergence[Cell] = 0.0f;
+                continue;
+            }
+            float Div = U[(X + 1) * Res + Y] - U[X * Res + Y] + V[X * (Res + 1) + Y + 1] - V[X * (Res + 1) + Y];
+            Divergence[Cell] = -Div * InvDx;
+        }
+    }
+
+    LastPressureIterations = PressureSolver.Solve(CellTypes, Divergence, Pressure);
+
+    std::fill(ValidU.begin(), ValidU.end(), 0);
+    std::fill(ValidV.begin(), ValidV.end(), 0);
+    for (int X = 1; X < Res; X++)
+    {
+        for (int Y = 0; Y < Res; Y++)
+        {
+            uint8_t Left = CellTypes[(X - 1) * Res + Y], Right = CellTypes[X * Res + Y];
+            if (Left == SolidCell || Right == SolidCell || (Left != FluidCell && Right != FluidCell))
+            {
+                continue;
+            }
+            U[X * Res + Y] -= (Pressure[X * Res + Y] - Pressure[(X - 1) * Res + Y]) * InvDx;
+            ValidU[X * Res + Y] = 1;
+        }
+    }
+    for (int X = 0; X < Res; X++)
+    {
+        for (int Y = 1; Y < Res; Y++)
+        {
+            uint8_t Bottom = CellTypes[X * Res + Y - 1], Top = CellTypes[X * Res + Y];
+            if (Bottom == SolidCell || Top == SolidCell || (Bottom != FluidCell && Top != FluidCell))
+            {
+                continue;
+            }
+            V[X * (Res + 1) + Y] -= (Pressure[X * Res + Y] - Pressure[X * Res + Y - 1]) * InvDx;
+            ValidV[X * (Res + 1) + Y] = 1;
+        }
+    }
+}
+
+void FLIPSolver::ExtrapolateVelocities()
+{
+    // Each layer fills the faces next to valid ones with the average of their valid neighbours
+    auto ExtrapolateLayer = [](std::vector<float>& Faces, std::vector<uint8_t>& Valid, std::vector<float>& OutFaces, std::vector<uint8_t>& OutValid, int NumX, int NumY) {
+        ThreadPool::Run(NumX, ROW_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+            for (int X = Begin; X < static_cast<int>(End); X++)
+            {
+                for (int Y = 0; Y < NumY; Y++)
+                {
+                    int Face = X * NumY + Y;
+                    OutFaces[Face] = Faces[Face];
+                    OutValid[Face] = Valid[Face];
+                    if (Valid[Face])
+                    {
+                        continue;
+                    }
+                    float Sum = 0.0f;
+                    int Count = 0;
+                    const int Neighbours[4] = {X > 0 ? Face - NumY : -1, X < NumX - 1 ? Face + NumY : -1, Y > 0 ? Face - 1 : -1, Y < NumY - 1 ? Face + 1 : -1};
+                    for (int Neighbour : Neighbours)
+                    {
+                        if (Neighbour >= 0 && Valid[Neighbour])
+                        {
+                            Sum += Faces[Neighbour];
+                            Count++;
+                        }
+                    }
+                    if (Count > 0)
+                    {
+                        OutFaces[Face] = Sum / Count;
+                        OutValid[Face] = 1;
+                    }
+                }
+            }
+        });
+        Faces.swap(OutFaces);
+        Valid.swap(OutValid);
+    };
+
+    for (uint32_t Layer = 0; Layer < Params.ExtrapolationLayers; Layer++)
+    {
+        ExtrapolateLayer(U, ValidU, ScratchU, ScratchValidU, GridResolution + 1, GridResolution);
+        ExtrapolateLayer(V, ValidV, ScratchV, ScratchValidV, GridResolution, GridResolution + 1);
+    }
+}
+
+void FLIPSolver::GridToParticle(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    // Particles stay inside the non solid cells
+    const float MinPosition = Dx * 1.001f;
+    const float MaxPosition = Size - Dx * 1.001f;
+    const float FlipRatio = Params.FlipRatio;
+
+    ThreadPool::Run(static_cast<uint32_t>(Particles.size()), PARTICLE_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t i = Begin; i < End; i++)
+        {
+            ParticleRenderData& Particle = Particles[i];
+            if (Particle.Position.w == 0.0f)
+            {
+                continue;
+            }
+            Math::Vec4 Pic = SampleVelocity(U, V, Particle.Position);
+            Math::Vec4 Old = SampleVelocity(SavedU, SavedV, Particle.Position);
+            Particle.Velocity.x = (1.0f - FlipRatio) * Pic.x + FlipRatio * (Particle.Velocity.x + Pic.x - Old.x);
+            Particle.Velocity.y = (1.0f - FlipRatio) * Pic.y + FlipRatio * (Particle.Velocity.y + Pic.y - Old.y);
+
+            // Midpoint advection through the divergence free grid velocities
+            Math::Vec4 Midpoint = Particle.Position;
+            Midpoint.x += 0.5f * DeltaTime * Pic.x;
+            Midpoint.y += 0.5f * DeltaTime * Pic.y;
+            Math::Vec4 MidVelocity = SampleVelocity(U, V, Midpoint);
+            Particle.Position.x = std::clamp(Particle.Position.x + DeltaTime * MidVelocity.x, MinPosition, MaxPosition);
+            Particle.Position.y = std::clamp(Particle.Position.y + DeltaTime * MidVelocity.y, MinPosition, MaxPosition);
+        }
+    });
+}
+
+void FLIPSolver::AdvectGridState(float DeltaTime)
+{
+    if (!HasGridState)
+    {
+        return;
+    }
+
+    // Semi-Lagrangian advection of the level set and the velocities by the last step's velocities
+    const int Res = GridResolution;
+    ThreadPool::Run(Res + 1, ROW_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (int X = Begin; X < static_cast<int>(End); X++)
+        {
+            for (int Y = 0; Y <= Res; Y++)
+            {
+                if (X < Res && Y < Res)
+                {
+                    Math::Vec4 Position((X + 0.5f) * Dx, (Y + 0.5f) * Dx, 0.0f, 0.0f);
+                    Math::Vec4 Velocity = SampleVelocity(GridU, GridV, Position);
+                    ScratchLevelSet[X * Res + Y] = Sample(LevelSet, Res, Res, 0.5f, 0.5f, X + 0.5f - DeltaTime * Velocity.x * InvDx, Y + 0.5f - DeltaTime * Velocity.y * InvDx);
+                }
+                if (Y < Res)
+                {
+                    Math::Vec4 Position(X * Dx, (Y + 0.5f) * Dx, 0.0f, 0.0f);
+                    Math::Vec4 Velocity = SampleVelocity(GridU, GridV, Position);
+                    ScratchU[X * Res + Y] = Sample(GridU, Res + 1, Res, 0.0f, 0.5f, X - DeltaTime * Velocity.x * InvDx, Y + 0.5f - DeltaTime * Velocity.y * InvDx);
+                }
+                if (X < Res)
+                {
+                    Math::Vec4 Position((X + 0.5f) * Dx, Y * Dx, 0.0f, 0.0f);
+                    Math::Vec4 Velocity = SampleVelocity(GridU, GridV, Position);
+                    ScratchV[X * (Res + 1) + Y] = Sample(GridV, Res, Res + 1, 0.5f, 0.0f, X + 0.5f - DeltaTime * Velocity.x * InvDx, Y - DeltaTime * Velocity.y * InvDx);
+                }
+            }
+        }
+    });
+    LevelSet.swap(ScratchLevelSet);
+    GridU.swap(ScratchU);
+    GridV.swap(ScratchV);
+}
+
+void FLIPSolver::BuildLevelSet(const std::vector<ParticleRenderData>& Particles)
+{
+    const int Res = GridResolution;
+    // Particles are spheres of half a cell radius
+    std::fill(ScratchLevelSet.begin(), ScratchLevelSet.end(), Size);
+    for (const ParticleRenderData& Particle : Particles)
+    {
+        if (Particle.Position.w == 0.0f)
+        {
+            continue;
+        }
+        int BaseX = static_cast<int>(Particle.Position.x * InvDx);
+        int BaseY = static_cast<int>(Particle.Position.y * InvDx);
+        for (int X = std::max(BaseX - 1, 0); X <= std::min(BaseX + 1, Res - 1); X++)
+        {
+            for (int Y = std::max(BaseY - 1, 0); Y <= std::min(BaseY + 1, Res - 1); Y++)
+            {
+                float DistX = (X + 0.5f) * Dx - Particle.Position.x;
+                float DistY = (Y + 0.5f) * Dx - Particle.Position.y;
+                float Distance = std::sqrt(DistX * DistX + DistY * DistY) - 0.5f * Dx;
+                float& Cell = ScratchLevelSet[X * Res + Y];
+                Cell = std::min(Cell, Distance);
+            }
+        }
+    }
+
+    // Below the band the particles are gone and the advected level set holds the liquid, with one cell of overlap
+    const float GridDepth = -(Band.BandWidth - 1.0f) * Dx;
+    for (size_t Cell = 0; Cell < LevelSet.size(); Cell++)
+    {
+        bool Deep = HasGridState && LevelSet[Cell] < GridDepth;
+        LevelSet[Cell] = Deep ? std::min(ScratchLevelSet[Cell], LevelSet[Cell]) : ScratchLevelSet[Cell];
+    }
+    Redistance();
+}
+
+void FLIPSolver::Redistance()
+{
+    const int Res = GridResolution;
+    // Cells next to a sign change keep their distance, the rest is rebuilt by fast sweeping (Zhao 2005)
+    for (int X = 0; X < Res; X++)
+    {
+        for (int Y = 0; Y < Res; Y++)
+        {
+            int Cell = X * Res + Y;
+            bool Inside = LevelSet[Cell] < 0.0f;
+            bool Interface = (X > 0 && (LevelSet[Cell - Res] < 0.0f) != Inside) || (X < Res - 1 && (LevelSet[Cell + Res] < 0.0f) != Inside) || (Y > 0 && (LevelSet[Cell - 1] < 0.0f) != Inside) || (Y < Res - 1 && (LevelSet[Cell + 1] < 0.0f) != Inside);
+            ScratchLevelSet[Cell] = Interface ? std::abs(LevelSet[Cell]) : Size;
+            InterfaceCells[Cell] = Interface;
+        }
+    }
+
+    auto Update = [&](int X, int Y) {
+        int Cell = X * Res + Y;
+        if (InterfaceCells[Cell])
+        {
+            return;
+        }
+        float A = std::min(X > 0 ? ScratchLevelSet[Cell - Res] : Size, X < Res - 1 ? ScratchLevelSet[Cell + Res] : Size);
+        float B = std::min(Y > 0 ? ScratchLevelSet[Cell - 1] : Size, Y < Res - 1 ? ScratchLevelSet[Cell + 1] : Size);
+        float Distance = std::abs(A - B) >= Dx ? std::min(A, B) + Dx : 0.5f * (A + B + std::sqrt(2.0f * Dx * Dx - (A - B) * (A - B)));
+        ScratchLevelSet[Cell] = std::min(ScratchLevelSet[Cell], Distance);
+    };
+    for (int Sweep = 0; Sweep < 4 * REDISTANCE_ROUNDS; Sweep++)
+    {
+        bool ReverseX = Sweep & 1, ReverseY = Sweep & 2;
+        for (int i = 0; i < Res; i++)
+        {
+            for (int j = 0; j < Res; j++)
+            {
+                Update(ReverseX ? Res - 1 - i : i, ReverseY ? Res - 1 - j : j);
+            }
+        }
+    }
+
+    for (size_t Cell = 0; Cell < LevelSet.size(); Cell++)
+    {
+        LevelSet[Cell] = LevelSet[Cell] < 0.0f ? -ScratchLevelSet[Cell] : ScratchLevelSet[Cell];
+    }
+}
+
+void FLIPSolver::UpdateBand(std::vector<ParticleRenderData>& Particles)
+{
+    const int Res = GridResolution;
+    const float DeleteDepth = -Band.BandWidth * Dx;
+
+    // Drop the particles that sank below the band and count the rest per cell
+    std::fill(CellParticleCount.begin(), CellParticleCount.end(), 0);
+    uint32_t NumDead = 0;
+    for (ParticleRenderData& Particle : Particles)
+    {
+        if (Particle.Position.w == 0.0f)
+        {
+            NumDead++;
+            continue;
+        }
+        float X = Particle.Position.x * InvDx;
+        float Y = Particle.Position.y * InvDx;
+        if (Sample(LevelSet, Res, Res, 0.5f, 0.5f, X, Y) < DeleteDepth)
+        {
+            Particle.Position.w = 0.0f;
+            Particle.Velocity = Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+            NumDead++;
+            continue;
+        }
+        CellParticleCount[std::clamp(static_cast<int>(X), 0, Res - 1) * Res + std::clamp(static_cast<int>(Y), 0, Res - 1)]++;
+    }
+
+    // Top up the band cells, reusing dead slots before growing the array. Cells right at the surface are left alone,
+    // seeding into the particles' own radius would inflate the liquid every step
+    size_t NextSlot = 0;
+    auto AllocateSlot = [&]() -> ParticleRenderData* {
+        for (; NextSlot < Particles.size(); NextSlot++)
+        {
+            if (Particles[NextSlot].Position.w == 0.0f)
+            {
+                NumDead--;
+                return &Particles[NextSlot++];
+            }
+        }
+        if (Particles.size() < ParticleCapacity)
+        {
+            Particles.emplace_back();
+            NextSlot = Particles.size();
+            return &Particles.back();
+        }
+        return nullptr;
+    };
+    for (int X = 1; X < Res - 1; X++)
+    {
+        for (int Y = 1; Y < Res - 1; Y++)
+        {
+            int Cell = X * Res + Y;
+            if (LevelSet[Cell] >= -0.5f * Dx || LevelSet[Cell] < DeleteDepth + 0.5f * Dx)
+            {
+                continue;
+            }
+            for (uint32_t Count = CellParticleCount[Cell]; Count < Band.ParticlesPerCell; Count++)
+            {
+                Math::Vec4 Position(
+                    (X + static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)) * Dx,
+                    (Y + static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)) * Dx,
+                    0.5f * Size);
+                if (Sample(LevelSet, Res, Res, 0.5f, 0.5f, Position.x * InvDx, Position.y * InvDx) >= -0.25f * Dx)
+                {
+                    continue;
+                }
+                ParticleRenderData* Particle = AllocateSlot();
+                if (!Particle)
+                {
+                    break;
+                }
+                Particle->Position = Position;
+                Particle->Velocity = SampleVelocity(U, V, Position);
+            }
+        }
+    }
+
+    // Dead particles still cost a draw and a transfer, drop them once they pile up
+    if (NumDead > Particles.size() / 8)
+    {
+        Particles.erase(std::remove_if(Particles.begin(), Particles.end(), [](const ParticleRenderData& Particle) { return Particle.Position.w == 0.0f; }), Particles.end());
+    }
+}
+
+void FLIPSolver::CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    if (UseNarrowBand)
+    {
+        AdvectGridState(DeltaTime);
+    }
+    ParticleToGrid(Particles);
+    MarkCells(Particles);
+
+    for (float& Velocity : V)
+    {
+        Velocity -= 9.8f * DeltaTime;
+    }
+    ApplyBoundaries();
+    Project(DeltaTime);
+    ExtrapolateVelocities();
+    ApplyBoundaries();
+
+    GridToParticle(Particles, DeltaTime);
+
+    if (UseNarrowBand)
+    {
+        GridU = U;
+        GridV = V;
+        HasGridState = true;
+        UpdateBand(Particles);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "fluids/IFluidSolver.h"
+#include "fluids/MultigridPoisson.h"
+#include <stdint.h>
+#include <vector>
+
+struct FLIPParameters
+{
+    // Share of the FLIP (velocity change) update in the particle velocity, the rest is PIC
+    float FlipRatio = 0.95f;
+    // Layers of air faces that receive extrapolated velocities for particles near the surface
+    uint32_t ExtrapolationLayers = 2;
+    PressureSolveParameters Pressure;
+};
+
+struct NarrowBandParameters
+{
+    // Particles are only kept within this many cells of the liquid surface, deeper liquid lives in the grid level set
+    float BandWidth = 3.0f;
+    // Band cells with fewer particles are reseeded up to this count
+    uint32_t ParticlesPerCell = 4;
+};
+
+// Incompressible (2D) CPU fluid on the same particles and grid resolution as the MPM solver. Particle velocities are
+// splatted to a staggered (MAC) grid, made divergence free with a multigrid preconditioned pressure solve and blended
+// back as PIC/FLIP, instead of the MPM solver's elastic stresses
+class FLIPSolver : public IFluidSolver
+{
+public:
+    FLIPSolver(int GridResolution, float GridSize, const FLIPParameters& Params = FLIPParameters());
+
+    virtual void Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList) override;
+
+    virtual void CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime) override;
+    virtual void GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer) override;
+
+    // CPU only, there is nothing to create on the GPU
+    virtual void CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler) override;
+    virtual void CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation) override;
+
+    // Pressure iterations used by the last step, for tuning
+    uint32_t GetLastPressureIterations() const;
+
+    // Represents the deep interior with a level set and grid velocities, deleting the particles there and reseeding
+    // them as the band moves (Ferstl et al. 2016). Reseeding never grows the particle array past the capacity
+    void EnableNarrowBand(const NarrowBandParameters& BandParams);
+    void SetParticleCapacity(uint32_t Capacity);
+
+private:
+    void ParticleToGrid(const std::vector<ParticleRenderData>& Particles);
+    void MarkCells(const std::vector<ParticleRenderData>& Particles);
+    void ApplyBoundaries();
+    void Project(float DeltaTime);
+    void ExtrapolateVelocities();
+    void GridToParticle(std::vector<ParticleRenderData>& Particles, float DeltaTime);
+
+    // Narrow band
+    void AdvectGridState(float DeltaTime);
+    void BuildLevelSet(const std::vector<ParticleRenderData>& Particles);
+    void Redistance();
+    void UpdateBand(std::vector<ParticleRenderData>& Particles);
+
+    // Bilinear interpolation of a face grid with NumX x NumY samples, Offset is the position of sample (0, 0) in cells
+    float Sample(const std::vector<float>& Faces, int NumX, int NumY, float OffsetX, float OffsetY, float X, float Y) const;
+    Math::Vec4 SampleVelocity(const std::vector<float>& FacesU, const std::vector<float>& FacesV, const Math::Vec4& Position) const;
+
+    FLIPParameters Params;
+    int GridResolution;
+    float Size;
+    float Dx;
+    float InvDx;
+
+    // Staggered velocities, U lives on the (Res + 1) x Res x faces and V on the Res x (Res + 1) y faces.
+    // Both are indexed X * (faces along y) + Y
+    std::vector<float> U, V;
+    std::vector<float> SavedU, SavedV;
+    std::vector<float> WeightU, WeightV;
+    std::vector<uint8_t> ValidU, ValidV;
+    std::vector<float> ScratchU, ScratchV;
+    std::vector<uint8_t> ScratchValidU, ScratchValidV;
+
+    std::vector<uint8_t> CellTypes;
+    std::vector<float> Divergence;
+    std::vector<float> Pressure;
+    MultigridPoisson PressureSolver;
+    uint32_t LastPressureIterations = 0;
+
+    // Signed distance to the liquid surface at the cell centers (negative inside) and the velocities of the last step,
+    // carried forward for the interior that has no particles
+    bool UseNarrowBand = false;
+    NarrowBandParameters Band;
+    uint32_t ParticleCapacity = 0;
+    bool HasGridState = false;
+    std::vector<float> LevelSet, ScratchLevelSet;
+    std::vector<float> GridU, GridV;
+    std::vector<uint32_t> CellParticleCount;
+    std::vector<uint8_t> InterfaceCells;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "util/3DMath.h"
+#include <stdint.h>
+
+// Particle, grid and parameter layouts the CPU solvers share with the GPU buffers and GPUReferenceSolver. They only need
+// the math library, so code built without Direct3D can use them
+
+struct alignas(Math::Vec4) ParticleRenderData
+{
+    Math::Vec4 Position;
+    Math::Vec4 Velocity;
+};
+
+struct GridCell
+{
+    // xyz = Velocity, W = mass
+    Math::Vec4 VelocityMass;
+    uint32_t IntHolder1, IntHolder2, IntHolder3, IntHolder4;
+};
+
+// ParticlePhysicsData as MPMSolver.hlsl declares it, the GPU solver is 3D and always keeps full matrices. The defaults
+// are ParticlePhysicsData's
+struct alignas(Math::Vec4) GPUParticlePhysicsData
+{
+    Math::Matrix C;
+    Math::Matrix DeformGradient = Math::Identity;
+    float Mass = 4.0f;
+    float InitialVolume = 1.0f;
+    float J = 1.0f;
+    float PlasticJ = 1.0f;
+};
+
+// Constant buffer of the MPM shaders, also the parameters of every CPU MPM solver
+struct MPMFluidParameters
+{
+    int NumParticles;
+    uint32_t GridResolution;
+    uint32_t NumGridCells;
+    float Dx;
+    float InvDx;
+    // Lame parameters
+    float ElasticMu = 40.0f;
+    float ElasticLamda = 20.0f;
+    float DeltaTime;
+    float GridSize;
+    float Padding1, Padding2, Padding3;
+
+    MPMFluidParameters(int Num, uint32_t Resolution, float Lamda, float Mu, float Timestep, float Size)
+        : NumParticles(Num), GridResolution(Resolution), NumGridCells(Resolution * Resolution * Resolution), Dx(Size / float(Resolution)), InvDx(1 / Dx), ElasticMu(Mu), ElasticLamda(Lamda), DeltaTime(Timestep), GridSize(Size)
+    {
+    }
+};
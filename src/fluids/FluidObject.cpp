@@ -8,8 +8,15 @@
 #include "primitives/PrimitiveObject.h"
 #include "primitives/Sphere.h"
 
+#include "fluids/DecomposedMPMSolver.h"
+#include "fluids/FLIPSolver.h"
 #include "fluids/MPMSolver.h"
+#include "fluids/SPHSolver.h"
+#include "fluids/SharedMPMGrid.h"
+#include "fluids/SmokeSolver.h"
+#include "shaders/MPMConstants.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 
@@ -22,24 +29,71 @@ ShaderDesc FluidFragmentShader = {
     L"ps_6_0",
     L"main"};
 
-FluidObject::FluidObject(int NumParticles, float BoundingBoxSize, FluidSolver SolverType)
-    : NumParticles(NumParticles), BoundingBoxSize(BoundingBoxSize)
+FluidObject::FluidObject(int NumParticles, float BoundingBoxSize, FluidSolver SolverType, MaterialModel Material, uint32_t ParticleBudget, uint32_t ParticleCapacity)
+    : NumParticles(NumParticles), ParticleBudget(ParticleBudget), ParticleCapacity(std::max({ParticleCapacity, ParticleBudget, static_cast<uint32_t>(NumParticles)})), BoundingBoxSize(BoundingBoxSize)
 {
     ResetParticles();
     switch (SolverType)
     {
+    case FLIPCPUSolver:
+    {
+        UseCPU = true;
+        FLIPSolver* NewSolver = new FLIPSolver(64, BoundingBoxSize);
+        NewSolver->SetParticleCapacity(this->ParticleCapacity);
+        Solver = NewSolver;
+        break;
+    }
+    case SPHCPUSolver:
+    {
+        UseCPU = true;
+        SPHParameters Params;
+        Params.SupportRadius *= BoundingBoxSize;
+        Solver = new SPHSolver(Particles, BoundingBoxSize, Params);
+        break;
+    }
+    case SmokeCPUSolver:
+    {
+        UseCPU = true;
+        SmokeSolver* NewSolver = new SmokeSolver(Particles, 64, BoundingBoxSize);
+        NewSolver->SetParticleCapacity(this->ParticleCapacity);
+        Solver = NewSolver;
+        break;
+    }
+    case DecomposedCPUSolver:
+    {
+        UseCPU = true;
+        MPMSolver::FluidParameters Params = {NumParticles, 64, 40.0f, 20.0f, 0.0020f, BoundingBoxSize};
+        Solver = new DecomposedMPMSolver(Particles, Params, Material, DecompositionParameters());
+        break;
+    }
     case MPMCPUSolver:
         UseCPU = true;
     case MPMGPUSolver:
         // FluidParameters:              NumParticles, Resolution, Lambda, Mu, Timestep, Size
         MPMSolver::FluidParameters Params = {NumParticles, 64, 40.0f, 20.0f, 0.0020f, BoundingBoxSize};
-        Solver = new MPMSolver(Particles, Params);
+        MPMSolver* NewSolver = new MPMSolver(Particles, Params, Material);
+        if (UseCPU)
+        {
+            NewSolver->ReserveParticles(this->ParticleCapacity, Particles);
+        }
+        // Resampling changes the particle count, which only the CPU path can follow
+        if (UseCPU && ParticleBudget > 0)
+        {
+            ResamplingParameters Resampling;
+            Resampling.ParticleBudget = ParticleBudget;
+            NewSolver->EnableResampling(Resampling);
+        }
+        Solver = NewSolver;
         break;
     }
 }
 
 FluidObject::~FluidObject()
 {
+    if (SharedGrid)
+    {
+        SharedGrid->RemoveBody(static_cast<MPMSolver*>(Solver));
+    }
     delete Solver;
 }
 
@@ -57,14 +111,19 @@ Microsoft::WRL::ComPtr<ID3D12PipelineState> FluidObject::CreatePipelineStateObje
     return Builder.BuildGraphics(D3D12Device);
 }
 
-void FluidObject::RecompileShaders(ShaderCompiler& Compiler)
+void FluidObject::ApplyPipelineStates()
 {
-    Compiler.CompileShaderNonAsync(FluidVertexShader, true);
-    Compiler.CompileShaderNonAsync(FluidFragmentShader, true);
+    Solver->ApplyPipelineStates();
+}
+
+void FluidObject::GetShaders(std::vector<ShaderDesc>& Shaders) const
+{
+    Shaders.push_back(FluidVertexShader);
+    Shaders.push_back(FluidFragmentShader);
 
     if (!UseCPU)
     {
-        Solver->RecompileShaders(Compiler);
+        Solver->GetShaders(Shaders);
     }
 }
 
@@ -73,16 +132,19 @@ void FluidObject::ResetParticles()
     Particles.clear();
     int Rows = std::cbrt(NumParticles);
     int RowsSquared = Rows * Rows;
-    float Delta = (BoundingBoxSize - BoundingBoxSize * 0.1f) / float(Rows);
+    // Defaults to the box from 10% of the bounding box up to its far corner
+    Math::Vec4 Min = HasSpawnBox ? SpawnMin : Math::Vec4(BoundingBoxSize * 0.1f, BoundingBoxSize * 0.1f, BoundingBoxSize * 0.1f);
+    Math::Vec4 Max = HasSpawnBox ? SpawnMax : Math::Vec4(BoundingBoxSize, BoundingBoxSize, BoundingBoxSize);
+    Math::Vec4 Delta = Math::Vec4((Max.x - Min.x) / float(Rows), (Max.y - Min.y) / float(Rows), (Max.z - Min.z) / float(Rows));
     for (int i = 0; i < Rows; i++)
     {
         for (int j = 0; j < Rows; j++)
         {
             for (int k = 0; k < Rows; k++)
             {
-                float RandomOne = Delta * ((static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)) - 0.5f);
-                float RandomTwo = Delta * ((static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)) - 0.5f);
-                ParticleRenderData Vert = {Math::Vec4(i * Delta + BoundingBoxSize * 0.1f + RandomOne, j * Delta + BoundingBoxSize * 0.1f + RandomTwo, k * Delta + BoundingBoxSize * 0.1f + RandomOne), Math::Vec4()};
+                float RandomOne = ((static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)) - 0.5f);
+                float RandomTwo = ((static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)) - 0.5f);
+                ParticleRenderData Vert = {Math::Vec4(i * Delta.x + Min.x + RandomOne * Delta.x, j * Delta.y + Min.y + RandomTwo * Delta.y, k * Delta.z + Min.z + RandomOne * Delta.z), Math::Vec4()};
                 Particles.emplace_back(std::move(Vert));
             }
         }
@@ -118,6 +180,84 @@ void FluidObject::HandleKeyPress(uint64_t wParam, bool isRepeat)
     }
 }
 
+void FluidObject::SetSpawnBox(const Math::Vec4& Min, const Math::Vec4& Max)
+{
+    SpawnMin = Min;
+    SpawnMax = Max;
+    HasSpawnBox = true;
+    // Same particle count as before, so the solver's per particle data still lines up
+    ResetParticles();
+}
+
+bool FluidObject::JoinSharedGrid(SharedMPMGrid* Grid)
+{
+    MPMSolver* MPM = dynamic_cast<MPMSolver*>(Solver);
+    if (!UseCPU || !MPM || !Grid->AddBody(MPM, &Particles))
+    {
+        return false;
+    }
+    SharedGrid = Grid;
+    return true;
+}
+
+bool FluidObject::EnableImplicit(const ImplicitParameters& Params, float TimeStep)
+{
+    MPMSolver* MPM = dynamic_cast<MPMSolver*>(Solver);
+    if (!UseCPU || !MPM)
+    {
+        return false;
+    }
+    MPM->EnableImplicit(Params);
+    SolverTimeStep = TimeStep;
+    PendingTime = 0.0f;
+    return true;
+}
+
+bool FluidObject::EnableMultiRate(const MultiRateParameters& Params, float TimeStep)
+{
+    MPMSolver* MPM = dynamic_cast<MPMSolver*>(Solver);
+    if (!UseCPU || !MPM)
+    {
+        return false;
+    }
+    MPM->EnableMultiRate(Params);
+    SolverTimeStep = TimeStep;
+    PendingTime = 0.0f;
+    return true;
+}
+
+bool FluidObject::EnableAdaptiveGrid(const AdaptiveGridParameters& Params)
+{
+    MPMSolver* MPM = dynamic_cast<MPMSolver*>(Solver);
+    if (!UseCPU || !MPM)
+    {
+        return false;
+    }
+    MPM->EnableAdaptiveGrid(Params);
+    return true;
+}
+
+bool FluidObject::EnableNarrowBand(const NarrowBandParameters& Params)
+{
+    FLIPSolver* FLIP = dynamic_cast<FLIPSolver*>(Solver);
+    if (!FLIP)
+    {
+        return false;
+    }
+    FLIP->EnableNarrowBand(Params);
+    return true;
+}
+
+void FluidObject::AddEmitter(const ParticleEmitter& Emitter)
+{
+    Solver->AddEmitter(Emitter);
+}
+
+void FluidObject::AddSink(const ParticleSink& Sink)
+{
+    Solver->AddSink(Sink);
+}
+
 void FluidObject::CreateBuffers(Renderer* RenderEngineIn)
 {
     RenderEngine = RenderEngineIn;
@@ -127,11 +267,12 @@ void FluidObject::CreateBuffers(Renderer* RenderEngineIn)
 
     HeapAllocation = RenderEngine->GetAllocation();
     Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList = RenderEngine->GetCommandList();
-    RenderEngine->UploadDefaultBufferResource(CommandList, InstanceBuffer, InstanceUploadBuffer, Particles.size(), sizeof(decltype(Particles.back())), Particles.data(), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    // Size the instance buffer for the particle capacity so emitters and resampling never have to reallocate it
+    RenderEngine->UploadDefaultBufferResource(CommandList, InstanceBuffer, InstanceUploadBuffer, Particles.size(), sizeof(decltype(Particles.back())), Particles.data(), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, ParticleCapacity * sizeof(decltype(Particles.back())));
     RenderEngine->TransitionBarrier(CommandList, InstanceBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
     // Create the views
-    HeapAllocation->CreateBufferUAV(InstanceBuffer, Particles.size(), sizeof(decltype(Particles.back())));
+    HeapAllocation->CreateBufferUAV(InstanceBuffer, ParticleCapacity, sizeof(decltype(Particles.back())));
 
     if (!UseCPU)
     {
@@ -161,7 +302,34 @@ void FluidObject::Update(float DeltaTime)
     // CPU solve
     if (UseCPU)
     {
-        Solver->CPUSolve(Particles, DeltaTime);
+        Controller* ViewController = Controller::GetInstance();
+        if (ViewController && ViewController->IsRightMouseDown())
+        {
+            Math::Vec4 MousePosition = ViewController->GetProjectedMousePosition();
+            Math::Vec4 GrabExtent = Math::Vec4(MOUSE_GRAB_RADIUS, MOUSE_GRAB_RADIUS, MOUSE_GRAB_RADIUS);
+            Solver->DisturbRegion(MousePosition - GrabExtent, MousePosition + GrabExtent);
+        }
+
+        // With a fixed solver timestep, bank frame time until a whole step is due
+        if (SolverTimeStep > 0.0f)
+        {
+            PendingTime += DeltaTime;
+            if (PendingTime < SolverTimeStep)
+            {
+                return;
+            }
+            PendingTime -= SolverTimeStep;
+            DeltaTime = SolverTimeStep;
+        }
+
+        if (SharedGrid)
+        {
+            SharedGrid->Update(static_cast<MPMSolver*>(Solver), DeltaTime);
+        }
+        else
+        {
+            Solver->CPUSolve(Particles, DeltaTime);
+        }
         if (InstanceBuffer && InstanceUploadBuffer)
         {
             Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList = RenderEngine->GetCommandList();
@@ -1,6 +1,12 @@
 #pragma once
 
 #include "ObjectRenderer.h"
+#include "fluids/AdaptiveGrid.h"
+#include "fluids/FLIPSolver.h"
+#include "fluids/ImplicitGridSolver.h"
+#include "fluids/LocalTimeStepper.h"
+#include "fluids/ParticleSources.h"
+#include "fluids/Plasticity.h"
 #include <memory>
 #include <unordered_map>
 
@@ -11,18 +17,29 @@ class Sphere;
 class Allocation;
 
 class IFluidSolver;
+class SharedMPMGrid;
 struct ParticleRenderData;
 
 enum FluidSolver
 {
     MPMCPUSolver,
-    MPMGPUSolver
+    MPMGPUSolver,
+    // Incompressible PIC/FLIP fluid on the CPU, ignores the material model
+    FLIPCPUSolver,
+    // Weakly compressible SPH on the CPU, ignores the material model
+    SPHCPUSolver,
+    // Grid only smoke on the CPU, the particles seed the initial density and are replaced by one per smoky cell
+    SmokeCPUSolver,
+    // The CPU MPM solver split into slabs of grid columns, each stepped on its own thread with halo exchange
+    DecomposedCPUSolver
 };
 
 class FluidObject : public ObjectRenderer
 {
 public:
-    FluidObject(int NumParticles, float BoundingBoxSize, FluidSolver SolverType);
+    // A non zero ParticleBudget lets the CPU solver split and merge particles, up to that many in total.
+    // ParticleCapacity bounds how many particles emitters can add, it is raised to at least the budget
+    FluidObject(int NumParticles, float BoundingBoxSize, FluidSolver SolverType, MaterialModel Material = JellyMaterial, uint32_t ParticleBudget = 0, uint32_t ParticleCapacity = 0);
     ~FluidObject();
 
     void ResetParticles();
@@ -32,10 +49,32 @@ public:
     virtual void Draw(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, const Math::Matrix& ViewMatrix) override;
     virtual void Update(float DeltaTime) override;
     virtual Microsoft::WRL::ComPtr<ID3D12PipelineState> CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler) override;
-    virtual void RecompileShaders(ShaderCompiler& Compiler) override;
+    virtual void ApplyPipelineStates() override;
+    virtual void GetShaders(std::vector<ShaderDesc>& Shaders) const override;
 
     virtual void HandleKeyPress(uint64_t wParam, bool isRepeat) override;
 
+    // Seeds the particles inside the box instead of the default region, lets several bodies share a grid without overlapping
+    void SetSpawnBox(const Math::Vec4& Min, const Math::Vec4& Max);
+    // Steps this body together with the other bodies of the grid so they interact, CPU solver only
+    bool JoinSharedGrid(SharedMPMGrid* Grid);
+
+    // Backward Euler grid update for the CPU solver, stepping at TimeStep regardless of the update rate
+    bool EnableImplicit(const ImplicitParameters& Params, float TimeStep);
+
+    // Multi-rate time stepping for the CPU solver, TimeStep is the step of the fastest regions
+    bool EnableMultiRate(const MultiRateParameters& Params, float TimeStep);
+
+    // Quadtree grid for the CPU solver, fine near the surface and walls and coarse in the bulk
+    bool EnableAdaptiveGrid(const AdaptiveGridParameters& Params);
+
+    // Keeps particles only near the liquid surface, FLIP solver only
+    bool EnableNarrowBand(const NarrowBandParameters& Params);
+
+    // Only the CPU solver supports emitters and sinks
+    void AddEmitter(const ParticleEmitter& Emitter);
+    void AddSink(const ParticleSink& Sink);
+
 private:
     bool UseCPU = false;
     std::vector<ParticleRenderData> Particles;
@@ -44,6 +83,7 @@ private:
     Microsoft::WRL::ComPtr<ID3D12PipelineState> ComputePipelineState;
 
     IFluidSolver* Solver;
+    SharedMPMGrid* SharedGrid = nullptr;
 
     Renderer* RenderEngine;
 
@@ -52,5 +92,12 @@ private:
     D3D12_VERTEX_BUFFER_VIEW InstanceBufferView;
 
     int NumParticles;
+    uint32_t ParticleBudget;
+    uint32_t ParticleCapacity;
     float BoundingBoxSize;
+    float SolverTimeStep = 0.0f;
+    float PendingTime = 0.0f;
+    bool HasSpawnBox = false;
+    Math::Vec4 SpawnMin;
+    Math::Vec4 SpawnMax;
 };
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "fluids/GPUReferenceSolver.h"
+
+#include "shaders/MPMKernels.hlsli"
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+
+// Threads of one dispatch group, also the chunk a pool thread takes
+#define REFERENCE_GROUP_SIZE 64
+
+// The buffers are handed to the kernels as the shader's structs
+static_assert(sizeof(ParticleRenderData) == sizeof(MPMShaders::ParticleRenderData), "ParticleRenderData differs from MPMKernels.hlsli");
+static_assert(sizeof(GPUParticlePhysicsData) == sizeof(MPMShaders::ParticlePhysicsData), "GPUParticlePhysicsData differs from MPMKernels.hlsli");
+static_assert(sizeof(GridCell) == sizeof(MPMShaders::GridCell), "GridCell differs from MPMKernels.hlsli");
+static_assert(sizeof(MPMFluidParameters) == sizeof(MPMShaders::FluidParameters), "FluidParameters differs from MPMKernels.hlsli");
+
+GPUReferenceSolver::GPUReferenceSolver(const MPMFluidParameters& FluidParams)
+    : FluidValues(FluidParams)
+{
+    FluidValues.NumGridCells = FluidValues.GridResolution * FluidValues.GridResolution * FluidValues.GridResolution;
+    Grid = std::vector<GridCell>(FluidValues.NumGridCells);
+}
+
+void GPUReferenceSolver::Reset(const std::vector<ParticleRenderData>& InitialParticles)
+{
+    Particles = InitialParticles;
+    FluidValues.NumParticles = static_cast<int>(Particles.size());
+
+    ParticleData.assign(Particles.size(), GPUParticlePhysicsData());
+    // GridCell's Vec4 defaults to w = 1, which would read as mass
+    std::fill(Grid.begin(), Grid.end(), GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f), 0, 0, 0, 0});
+}
+
+void GPUReferenceSolver::Step()
+{
+    MPMShaders::ParticleRenderData* ParticleBuffer = reinterpret_cast<MPMShaders::ParticleRenderData*>(Particles.data());
+    MPMShaders::ParticlePhysicsData* ParticleDataBuffer = reinterpret_cast<MPMShaders::ParticlePhysicsData*>(ParticleData.data());
+    MPMShaders::GridCell* GridBuffer = reinterpret_cast<MPMShaders::GridCell*>(Grid.data());
+    const MPMShaders::FluidParameters Fluid = std::bit_cast<MPMShaders::FluidParameters>(FluidValues);
+    MPMShaders::SceneData Scene = {MPMShaders::float3(MousePosition.x, MousePosition.y, MousePosition.z), MouseDown};
+
+    const uint32_t NumCells = FluidValues.NumGridCells;
+    const uint32_t NumParticles = static_cast<uint32_t>(Particles.size());
+
+    // Same dispatches as GPUSolve, each one finishing before the next like the UAV barriers between them
+    ThreadPool::Run(NumCells, REFERENCE_GROUP_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t Index = Begin; Index < End; Index++)
+        {
+            MPMShaders::ClearGridKernel(Index, GridBuffer);
+        }
+    });
+    ThreadPool::Run(NumParticles, REFERENCE_GROUP_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t Index = Begin; Index < End; Index++)
+        {
+            MPMShaders::ParticleToGridKernel(Index, ParticleBuffer, ParticleDataBuffer, GridBuffer, Fluid);
+        }
+    });
+    ThreadPool::Run(NumCells, REFERENCE_GROUP_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t Index = Begin; Index < End; Index++)
+        {
+            MPMShaders::GridUpdateKernel(Index, GridBuffer, Fluid);
+        }
+    });
+    ThreadPool::Run(NumParticles, REFERENCE_GROUP_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t Index = Begin; Index < End; Index++)
+        {
+            MPMShaders::GridToParticleKernel(Index, ParticleBuffer, ParticleDataBuffer, GridBuffer, Fluid, Scene);
+        }
+    });
+}
+
+void GPUReferenceSolver::SetMouse(const Math::Vec4& Position, bool Down)
+{
+    MousePosition = Position;
+    MouseDown = Down;
+}
+
+const std::vector<ParticleRenderData>& GPUReferenceSolver::GetParticles() const
+{
+    return Particles;
+}
+
+const std::vector<GPUParticlePhysicsData>& GPUReferenceSolver::GetParticleData() const
+{
+    return ParticleData;
+}
+
+const std::vector<GridCell>& GPUReferenceSolver::GetGrid() const
+{
+    return Grid;
+}
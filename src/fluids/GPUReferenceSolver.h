@@ -0,0 +1,39 @@
+#pragma once
+
+#include "fluids/FluidData.h"
+#include "util/3DMath.h"
+#include <vector>
+
+// Runs the kernels of MPMSolver.hlsl on the CPU thread pool, one ParallelFor per dispatch in the order GPUSolve records
+// them. The kernel bodies are the shader's own (shaders/MPMKernels.hlsli compiled as C++), and P2G accumulates in
+// fixed point with atomics as on the GPU, so results don't depend on the thread count and a GPU readback of the same
+// scene can be checked against them on machines without a GPU. Needs neither Direct3D nor MPMSolver, so it builds
+// wherever the thread pool does
+class GPUReferenceSolver
+{
+public:
+    // NumParticles and NumGridCells are taken from the particles and the resolution, DeltaTime is used for every step
+    // as the GPU solver does
+    GPUReferenceSolver(const MPMFluidParameters& FluidParams);
+
+    // Starts over from the particles at rest with the default physics data, as MPMSolver::CreateBuffers uploads it
+    void Reset(const std::vector<ParticleRenderData>& InitialParticles);
+    void Step();
+
+    // The Scene constant buffer the shader reads the mouse from
+    void SetMouse(const Math::Vec4& Position, bool Down);
+
+    const std::vector<ParticleRenderData>& GetParticles() const;
+    const std::vector<GPUParticlePhysicsData>& GetParticleData() const;
+    // 3D grid, X major, with the fixed point sums of the last P2G kept in the integer fields
+    const std::vector<GridCell>& GetGrid() const;
+
+private:
+    MPMFluidParameters FluidValues;
+    Math::Vec4 MousePosition = Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    bool MouseDown = false;
+
+    std::vector<ParticleRenderData> Particles;
+    std::vector<GPUParticlePhysicsData> ParticleData;
+    std::vector<GridCell> Grid;
+};
@@ -0,0 +1,511 @@
+#include "fluids/HaloTransport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+// Ring size of every ordered pair of ranks, larger messages stream through in pieces
+#define HALO_CHANNEL_BYTES (1 << 20)
+// Bytes ahead of the rings, holding the number of ranks
+#define HALO_SEGMENT_HEADER 64
+// Bytes a read takes off a socket at most
+#define HALO_SOCKET_CHUNK_BYTES (1 << 16)
+// Pause between attempts to reach a rank that isn't listening yet
+#define HALO_CONNECT_RETRY_MS 50
+
+namespace
+{
+class LocalHaloTransport : public IHaloTransport
+{
+public:
+    LocalHaloTransport(LocalHaloHub* Hub, uint32_t Rank)
+        : Hub(Hub), Rank(Rank)
+    {
+    }
+
+    virtual uint32_t GetRank() const override
+    {
+        return Rank;
+    }
+
+    virtual uint32_t GetNumRanks() const override
+    {
+        return Hub->GetNumRanks();
+    }
+
+    virtual void Send(uint32_t Destination, HaloMessageTag Tag, const void* Data, size_t Size) override
+    {
+        Hub->Post(Rank, Destination, Tag, Data, Size);
+    }
+
+    virtual void Receive(uint32_t Source, HaloMessageTag Tag, std::vector<uint8_t>& Data) override
+    {
+        Hub->Wait(Source, Rank, Tag, Data);
+    }
+
+private:
+    LocalHaloHub* Hub;
+    uint32_t Rank;
+};
+}
+
+LocalHaloHub::LocalHaloHub(uint32_t NumRanks)
+{
+    for (uint32_t Rank = 0; Rank < NumRanks; Rank++)
+    {
+        Mailboxes.push_back(std::make_unique<Mailbox>());
+    }
+}
+
+std::unique_ptr<IHaloTransport> LocalHaloHub::CreateTransport(uint32_t Rank)
+{
+    return std::make_unique<LocalHaloTransport>(this, Rank);
+}
+
+uint32_t LocalHaloHub::GetNumRanks() const
+{
+    return static_cast<uint32_t>(Mailboxes.size());
+}
+
+void LocalHaloHub::Post(uint32_t Source, uint32_t Destination, HaloMessageTag Tag, const void* Data, size_t Size)
+{
+    const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+    Message NewMessage = {Source, Tag, std::vector<uint8_t>(Bytes, Bytes + Size)};
+
+    Mailbox& Box = *Mailboxes[Destination];
+    {
+        std::lock_guard<std::mutex> Lock(Box.Mutex);
+        Box.Messages.push_back(std::move(NewMessage));
+    }
+    Box.Arrived.notify_all();
+}
+
+void LocalHaloHub::Wait(uint32_t Source, uint32_t Destination, HaloMessageTag Tag, std::vector<uint8_t>& Data)
+{
+    Mailbox& Box = *Mailboxes[Destination];
+    std::unique_lock<std::mutex> Lock(Box.Mutex);
+    while (true)
+    {
+        // Oldest matching message first, keeping the order per sender and tag
+        auto Found = std::find_if(Box.Messages.begin(), Box.Messages.end(), [&](const Message& Entry)
+                                  { return Entry.Source == Source && Entry.Tag == Tag; });
+        if (Found != Box.Messages.end())
+        {
+            Data = std::move(Found->Data);
+            Box.Messages.erase(Found);
+            return;
+        }
+        Box.Arrived.wait(Lock);
+    }
+}
+
+
+namespace
+{
+struct MessageHeader
+{
+    uint32_t Tag;
+    uint32_t Padding;
+    uint64_t Size;
+};
+
+// Yields at first, then sleeps, so a rank waiting on a slow neighbour doesn't hold on to a core
+void Backoff(uint32_t IdleRounds)
+{
+    if (IdleRounds < 64)
+    {
+        std::this_thread::yield();
+    }
+    else
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+}
+
+StreamHaloTransport::StreamHaloTransport(uint32_t Rank, uint32_t NumRanks)
+    : Rank(Rank), NumRanks(NumRanks)
+{
+    Unsent.resize(NumRanks);
+    UnsentOffset.resize(NumRanks, 0);
+    Partial.resize(NumRanks);
+    Arrived.resize(NumRanks);
+}
+
+uint32_t StreamHaloTransport::GetRank() const
+{
+    return Rank;
+}
+
+uint32_t StreamHaloTransport::GetNumRanks() const
+{
+    return NumRanks;
+}
+
+void StreamHaloTransport::Send(uint32_t Destination, HaloMessageTag Tag, const void* Data, size_t Size)
+{
+    const MessageHeader Header = {static_cast<uint32_t>(Tag), 0, Size};
+    const uint8_t* HeaderBytes = reinterpret_cast<const uint8_t*>(&Header);
+    const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+    std::vector<uint8_t>& Queue = Unsent[Destination];
+    Queue.insert(Queue.end(), HeaderBytes, HeaderBytes + sizeof(Header));
+    Queue.insert(Queue.end(), Bytes, Bytes + Size);
+    Flush(Destination);
+}
+
+void StreamHaloTransport::Receive(uint32_t Source, HaloMessageTag Tag, std::vector<uint8_t>& Data)
+{
+    uint32_t IdleRounds = 0;
+    while (true)
+    {
+        // Oldest matching message first, keeping the order per sender and tag
+        std::deque<Message>& Messages = Arrived[Source];
+        auto Found = std::find_if(Messages.begin(), Messages.end(), [&](const Message& Entry)
+                                  { return Entry.Tag == Tag; });
+        if (Found != Messages.end())
+        {
+            Data = std::move(Found->Data);
+            Messages.erase(Found);
+            return;
+        }
+
+        // Our queued messages keep moving while we wait, the ranks they go to may be waiting on them
+        bool Moved = Poll(Source);
+        for (uint32_t Destination = 0; Destination < NumRanks; Destination++)
+        {
+            Moved = Flush(Destination) || Moved;
+        }
+        if (Moved)
+        {
+            IdleRounds = 0;
+        }
+        else
+        {
+            Backoff(IdleRounds++);
+        }
+    }
+}
+
+void StreamHaloTransport::FlushAll()
+{
+    for (uint32_t Destination = 0; Destination < NumRanks; Destination++)
+    {
+        uint32_t IdleRounds = 0;
+        while (UnsentOffset[Destination] < Unsent[Destination].size())
+        {
+            if (!Flush(Destination))
+            {
+                Backoff(IdleRounds++);
+            }
+        }
+    }
+}
+
+bool StreamHaloTransport::Flush(uint32_t Destination)
+{
+    std::vector<uint8_t>& Queue = Unsent[Destination];
+    size_t& Offset = UnsentOffset[Destination];
+    if (Offset == Queue.size())
+    {
+        return false;
+    }
+    const size_t Count = Write(Destination, Queue.data() + Offset, Queue.size() - Offset);
+    if (Count == 0)
+    {
+        return false;
+    }
+
+    Offset += Count;
+    if (Offset == Queue.size())
+    {
+        Queue.clear();
+        Offset = 0;
+    }
+    return true;
+}
+
+bool StreamHaloTransport::Poll(uint32_t Source)
+{
+    std::vector<uint8_t>& Bytes = Partial[Source];
+    if (!Read(Source, Bytes))
+    {
+        return false;
+    }
+
+    // Split off every message that is complete
+    size_t Offset = 0;
+    MessageHeader Header;
+    while (Bytes.size() - Offset >= sizeof(Header))
+    {
+        std::memcpy(&Header, Bytes.data() + Offset, sizeof(Header));
+        if (Bytes.size() - Offset - sizeof(Header) < Header.Size)
+        {
+            break;
+        }
+        const uint8_t* Payload = Bytes.data() + Offset + sizeof(Header);
+        Arrived[Source].push_back({static_cast<HaloMessageTag>(Header.Tag), std::vector<uint8_t>(Payload, Payload + Header.Size)});
+        Offset += sizeof(Header) + Header.Size;
+    }
+    Bytes.erase(Bytes.begin(), Bytes.begin() + Offset);
+    return true;
+}
+
+struct SharedMemoryHaloTransport::Channel
+{
+    // Running byte counts, only the writer moves Written and only the reader Read. Each on a line of its own
+    alignas(64) std::atomic<uint64_t> Written;
+    alignas(64) std::atomic<uint64_t> Read;
+    alignas(64) uint8_t Data[HALO_CHANNEL_BYTES];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The rings are shared between processes and can't take locks");
+
+size_t SharedMemoryHaloTransport::GetSegmentSize(uint32_t NumRanks)
+{
+    return HALO_SEGMENT_HEADER + sizeof(Channel) * NumRanks * NumRanks;
+}
+
+void SharedMemoryHaloTransport::InitializeSegment(void* Segment, uint32_t NumRanks)
+{
+    uint8_t* Bytes = static_cast<uint8_t*>(Segment);
+    std::memcpy(Bytes, &NumRanks, sizeof(NumRanks));
+    Channel* Channels = reinterpret_cast<Channel*>(Bytes + HALO_SEGMENT_HEADER);
+    for (uint32_t Index = 0; Index < NumRanks * NumRanks; Index++)
+    {
+        new (&Channels[Index].Written) std::atomic<uint64_t>(0);
+        new (&Channels[Index].Read) std::atomic<uint64_t>(0);
+    }
+}
+
+SharedMemoryHaloTransport::SharedMemoryHaloTransport(void* Segment, uint32_t Rank)
+    : StreamHaloTransport(Rank, *static_cast<const uint32_t*>(Segment)), Segment(static_cast<uint8_t*>(Segment))
+{
+}
+
+SharedMemoryHaloTransport::~SharedMemoryHaloTransport()
+{
+    FlushAll();
+}
+
+SharedMemoryHaloTransport::Channel& SharedMemoryHaloTransport::GetChannel(uint32_t Source, uint32_t Destination) const
+{
+    return reinterpret_cast<Channel*>(Segment + HALO_SEGMENT_HEADER)[Source * NumRanks + Destination];
+}
+
+size_t SharedMemoryHaloTransport::Write(uint32_t Destination, const uint8_t* Data, size_t Size)
+{
+    Channel& Ring = GetChannel(Rank, Destination);
+    const uint64_t Written = Ring.Written.load(std::memory_order_relaxed);
+    const uint64_t Free = HALO_CHANNEL_BYTES - (Written - Ring.Read.load(std::memory_order_acquire));
+    const size_t Count = static_cast<size_t>(std::min<uint64_t>(Free, Size));
+    if (Count == 0)
+    {
+        return 0;
+    }
+
+    const size_t Start = static_cast<size_t>(Written % HALO_CHANNEL_BYTES);
+    const size_t First = std::min<size_t>(Count, HALO_CHANNEL_BYTES - Start);
+    std::memcpy(Ring.Data + Start, Data, First);
+    std::memcpy(Ring.Data, Data + First, Count - First);
+    Ring.Written.store(Written + Count, std::memory_order_release);
+    return Count;
+}
+
+bool SharedMemoryHaloTransport::Read(uint32_t Source, std::vector<uint8_t>& Bytes)
+{
+    Channel& Ring = GetChannel(Source, Rank);
+    const uint64_t Read = Ring.Read.load(std::memory_order_relaxed);
+    const size_t Count = static_cast<size_t>(Ring.Written.load(std::memory_order_acquire) - Read);
+    if (Count == 0)
+    {
+        return false;
+    }
+
+    const size_t End = Bytes.size();
+    Bytes.resize(End + Count);
+    const size_t Start = static_cast<size_t>(Read % HALO_CHANNEL_BYTES);
+    const size_t First = std::min<size_t>(Count, HALO_CHANNEL_BYTES - Start);
+    std::memcpy(Bytes.data() + End, Ring.Data + Start, First);
+    std::memcpy(Bytes.data() + End + First, Ring.Data, Count - First);
+    Ring.Read.store(Read + Count, std::memory_order_release);
+    return true;
+}
+
+namespace
+{
+[[noreturn]] void LoseConnection(uint32_t Rank, uint32_t Other)
+{
+    fprintf(stderr, "Rank %u lost its connection to rank %u\n", Rank, Other);
+    std::exit(1);
+}
+
+bool SplitEndpoint(const std::string& Endpoint, std::string& Host, uint16_t& Port)
+{
+    const size_t Colon = Endpoint.rfind(':');
+    if (Colon == std::string::npos)
+    {
+        return false;
+    }
+    Host = Endpoint.substr(0, Colon);
+    const int Value = std::atoi(Endpoint.c_str() + Colon + 1);
+    Port = static_cast<uint16_t>(Value);
+    return Value > 0 && Value <= UINT16_MAX;
+}
+
+// The rank handshake goes over blocking sockets
+bool SendRank(Socket& Connection, uint32_t Rank)
+{
+    const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(&Rank);
+    for (size_t Offset = 0; Offset < sizeof(Rank);)
+    {
+        const ptrdiff_t Count = Connection.SendSome(Bytes + Offset, sizeof(Rank) - Offset);
+        if (Count < 0)
+        {
+            return false;
+        }
+        Offset += static_cast<size_t>(Count);
+    }
+    return true;
+}
+
+bool ReceiveRank(Socket& Connection, uint32_t& Rank)
+{
+    uint8_t* Bytes = reinterpret_cast<uint8_t*>(&Rank);
+    for (size_t Offset = 0; Offset < sizeof(Rank);)
+    {
+        const ptrdiff_t Count = Connection.ReceiveSome(Bytes + Offset, sizeof(Rank) - Offset);
+        if (Count < 0)
+        {
+            return false;
+        }
+        Offset += static_cast<size_t>(Count);
+    }
+    return true;
+}
+}
+
+std::unique_ptr<SocketHaloTransport> SocketHaloTransport::Connect(const std::vector<std::string>& Endpoints, uint32_t Rank, std::chrono::milliseconds Timeout)
+{
+    const uint32_t NumRanks = static_cast<uint32_t>(Endpoints.size());
+    std::string Host;
+    uint16_t Port;
+    Socket Listener;
+    if (Rank >= NumRanks || !SplitEndpoint(Endpoints[Rank], Host, Port) || !Listener.Listen(Port, static_cast<int>(NumRanks)) || !Listener.SetBlocking(false))
+    {
+        return nullptr;
+    }
+
+    const auto Deadline = std::chrono::steady_clock::now() + Timeout;
+    std::vector<Socket> Peers(NumRanks);
+    for (uint32_t Other = 0; Other < Rank; Other++)
+    {
+        if (!SplitEndpoint(Endpoints[Other], Host, Port))
+        {
+            return nullptr;
+        }
+        while (!Peers[Other].Connect(Host, Port))
+        {
+            if (std::chrono::steady_clock::now() > Deadline)
+            {
+                return nullptr;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(HALO_CONNECT_RETRY_MS));
+        }
+        if (!SendRank(Peers[Other], Rank))
+        {
+            return nullptr;
+        }
+    }
+
+    // The ranks after this one connect to it and say who they are
+    for (uint32_t NumAccepted = 0; NumAccepted < NumRanks - 1 - Rank;)
+    {
+        Socket Connection;
+        if (!Listener.Accept(Connection))
+        {
+            if (std::chrono::steady_clock::now() > Deadline)
+            {
+                return nullptr;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(HALO_CONNECT_RETRY_MS));
+            continue;
+        }
+        uint32_t Other;
+        if (!Connection.SetBlocking(true) || !ReceiveRank(Connection, Other) || Other <= Rank || Other >= NumRanks || Peers[Other].IsOpen())
+        {
+            return nullptr;
+        }
+        Peers[Other] = std::move(Connection);
+        NumAccepted++;
+    }
+
+    for (uint32_t Other = 0; Other < NumRanks; Other++)
+    {
+        if (Other != Rank && !Peers[Other].SetBlocking(false))
+        {
+            return nullptr;
+        }
+    }
+    return std::unique_ptr<SocketHaloTransport>(new SocketHaloTransport(std::move(Peers), Rank));
+}
+
+SocketHaloTransport::SocketHaloTransport(std::vector<Socket> Peers, uint32_t Rank)
+    : StreamHaloTransport(Rank, static_cast<uint32_t>(Peers.size())), Peers(std::move(Peers)), Chunk(HALO_SOCKET_CHUNK_BYTES)
+{
+}
+
+SocketHaloTransport::~SocketHaloTransport()
+{
+    FlushAll();
+    // Closing with bytes still unread would reset the connection and could throw away what we sent. So every rank
+    // shuts down sending and reads until the other end did the same
+    for (uint32_t Other = 0; Other < NumRanks; Other++)
+    {
+        if (Other != Rank)
+        {
+            Peers[Other].ShutdownSend();
+        }
+    }
+    for (uint32_t Other = 0; Other < NumRanks; Other++)
+    {
+        if (Other == Rank)
+        {
+            continue;
+        }
+        uint32_t IdleRounds = 0;
+        ptrdiff_t Count;
+        while ((Count = Peers[Other].ReceiveSome(Chunk.data(), Chunk.size())) >= 0)
+        {
+            if (Count == 0)
+            {
+                Backoff(IdleRounds++);
+            }
+        }
+    }
+}
+
+size_t SocketHaloTransport::Write(uint32_t Destination, const uint8_t* Data, size_t Size)
+{
+    const ptrdiff_t Count = Peers[Destination].SendSome(Data, Size);
+    if (Count < 0)
+    {
+        LoseConnection(Rank, Destination);
+    }
+    return static_cast<size_t>(Count);
+}
+
+bool SocketHaloTransport::Read(uint32_t Source, std::vector<uint8_t>& Bytes)
+{
+    const ptrdiff_t Count = Peers[Source].ReceiveSome(Chunk.data(), Chunk.size());
+    if (Count < 0)
+    {
+        LoseConnection(Rank, Source);
+    }
+    Bytes.insert(Bytes.end(), Chunk.data(), Chunk.data() + Count);
+    return Count > 0;
+}
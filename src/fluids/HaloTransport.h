@@ -0,0 +1,173 @@
+#pragma once
+
+#include "util/Socket.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Message kinds exchanged between the subdomains of a decomposed run
+enum HaloMessageTag
+{
+    // Partial grid mass and momentum of the columns past a subdomain's right edge
+    GhostMassTag,
+    // Updated grid velocities of a subdomain's first columns
+    GhostVelocityTag,
+    // Particles leaving a subdomain, render and physics data
+    MigrationTag,
+    // Particles per grid column, for rebalancing
+    HistogramTag,
+    // Initial particles handed to the rank owning their column, render data only
+    DistributionTag
+};
+
+// Point to point messaging between the ranks of a decomposed simulation. Messages between a pair of ranks with the
+// same tag arrive in the order they were sent. Implementations can be in process (LocalHaloHub), shared memory or
+// sockets, the subdomains only see this interface
+class IHaloTransport
+{
+public:
+    virtual ~IHaloTransport() = default;
+
+    virtual uint32_t GetRank() const = 0;
+    virtual uint32_t GetNumRanks() const = 0;
+
+    // Never blocks, the data is copied before returning
+    virtual void Send(uint32_t Destination, HaloMessageTag Tag, const void* Data, size_t Size) = 0;
+    // Blocks until a message with this tag arrives from Source
+    virtual void Receive(uint32_t Source, HaloMessageTag Tag, std::vector<uint8_t>& Data) = 0;
+};
+
+// Mailboxes for ranks running as threads of one process
+class LocalHaloHub
+{
+public:
+    LocalHaloHub(uint32_t NumRanks);
+
+    // The transport of one rank, the hub must outlive it
+    std::unique_ptr<IHaloTransport> CreateTransport(uint32_t Rank);
+
+    uint32_t GetNumRanks() const;
+
+    void Post(uint32_t Source, uint32_t Destination, HaloMessageTag Tag, const void* Data, size_t Size);
+    void Wait(uint32_t Source, uint32_t Destination, HaloMessageTag Tag, std::vector<uint8_t>& Data);
+
+private:
+    struct Message
+    {
+        uint32_t Source;
+        HaloMessageTag Tag;
+        std::vector<uint8_t> Data;
+    };
+
+    struct Mailbox
+    {
+        std::mutex Mutex;
+        std::condition_variable Arrived;
+        std::deque<Message> Messages;
+    };
+
+    std::vector<std::unique_ptr<Mailbox>> Mailboxes;
+};
+
+// Transport over a byte stream towards every other rank, which messages go through as a header and their bytes.
+// Whatever the stream towards a rank can't take yet is queued and moved on by later calls, so Send never blocks, and
+// Receive polls its source's stream
+class StreamHaloTransport : public IHaloTransport
+{
+public:
+    virtual uint32_t GetRank() const override;
+    virtual uint32_t GetNumRanks() const override;
+
+    virtual void Send(uint32_t Destination, HaloMessageTag Tag, const void* Data, size_t Size) override;
+    virtual void Receive(uint32_t Source, HaloMessageTag Tag, std::vector<uint8_t>& Data) override;
+
+protected:
+    StreamHaloTransport(uint32_t Rank, uint32_t NumRanks);
+
+    // Moves up to Size bytes into the stream towards Destination, returns how many did
+    virtual size_t Write(uint32_t Destination, const uint8_t* Data, size_t Size) = 0;
+    // Appends what arrived from Source to Bytes, returns false if nothing did
+    virtual bool Read(uint32_t Source, std::vector<uint8_t>& Bytes) = 0;
+    // Waits until everything sent is in the streams. Destructors call it while Write still works, the process may exit
+    // right after and what is still queued would be lost with it
+    void FlushAll();
+
+    uint32_t Rank;
+    uint32_t NumRanks;
+
+private:
+    struct Message
+    {
+        HaloMessageTag Tag;
+        std::vector<uint8_t> Data;
+    };
+
+    // Moves queued bytes into the stream towards Destination, returns false if none could move
+    bool Flush(uint32_t Destination);
+    // Takes what arrived from Source and splits it into messages, returns false if nothing arrived
+    bool Poll(uint32_t Source);
+
+    // Bytes per destination still to go into its stream, from UnsentOffset on
+    std::vector<std::vector<uint8_t>> Unsent;
+    std::vector<size_t> UnsentOffset;
+    // Bytes per source of a message still arriving, and the arrived messages not received yet
+    std::vector<std::vector<uint8_t>> Partial;
+    std::vector<std::deque<Message>> Arrived;
+};
+
+// Transport for ranks running as processes of one machine, e.g. started by LaunchDecomposedRun. The segment of shared
+// memory holds a ring buffer for every ordered pair of ranks
+class SharedMemoryHaloTransport : public StreamHaloTransport
+{
+public:
+    // Bytes of shared memory NumRanks ranks need
+    static size_t GetSegmentSize(uint32_t NumRanks);
+    // Prepares the segment, once before any rank uses it
+    static void InitializeSegment(void* Segment, uint32_t NumRanks);
+
+    // The segment must outlive the transport, whose destructor waits until everything sent is in the rings
+    SharedMemoryHaloTransport(void* Segment, uint32_t Rank);
+    virtual ~SharedMemoryHaloTransport() override;
+
+protected:
+    virtual size_t Write(uint32_t Destination, const uint8_t* Data, size_t Size) override;
+    virtual bool Read(uint32_t Source, std::vector<uint8_t>& Bytes) override;
+
+private:
+    struct Channel;
+
+    Channel& GetChannel(uint32_t Source, uint32_t Destination) const;
+
+    uint8_t* Segment;
+};
+
+// Transport for ranks spread over several machines, a TCP connection between every pair of ranks. A rank losing a
+// connection ends its process with exit code 1, the others would wait on it forever otherwise
+class SocketHaloTransport : public StreamHaloTransport
+{
+public:
+    // Connects rank Rank to the others, Endpoints holding "host:port" of every rank. Each rank listens on its own
+    // endpoint's port and connects to the ranks before it, which may start later, so it keeps trying for Timeout.
+    // Returns nullptr if some rank didn't show up by then
+    static std::unique_ptr<SocketHaloTransport> Connect(const std::vector<std::string>& Endpoints, uint32_t Rank, std::chrono::milliseconds Timeout);
+
+    // Waits until everything sent is out and every other rank is done sending too
+    virtual ~SocketHaloTransport() override;
+
+protected:
+    virtual size_t Write(uint32_t Destination, const uint8_t* Data, size_t Size) override;
+    virtual bool Read(uint32_t Source, std::vector<uint8_t>& Bytes) override;
+
+private:
+    SocketHaloTransport(std::vector<Socket> Peers, uint32_t Rank);
+
+    // The connection to every other rank, none to this one
+    std::vector<Socket> Peers;
+    // What a read takes off a socket at most
+    std::vector<uint8_t> Chunk;
+};
@@ -1,7 +1,12 @@
 #pragma once
 
+#include "fluids/FluidData.h"
+#include "fluids/ParticleSources.h"
 #include "util/3DMath.h"
 #include <vector>
+
+// Direct3D 12 only exists on Windows, elsewhere (the tests on Linux) solvers build with their CPU paths alone
+#ifdef _WIN32
 #ifndef NOMINMAX
 #define NOMINMAX
 #endif
@@ -11,23 +16,33 @@
 class Renderer;
 class ShaderCompiler;
 class Allocation;
+struct ShaderDesc;
 
 typedef Microsoft::WRL::ComPtr<ID3D12Device2> ID3D12DevicePtr;
-
-struct alignas(Math::Vec4) ParticleRenderData
-{
-    Math::Vec4 Position;
-    Math::Vec4 Velocity;
-};
+#endif
 
 class IFluidSolver
 {
 public:
+#ifdef _WIN32
     virtual void Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList) = 0;
+#endif
     virtual void CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime) = 0;
+#ifdef _WIN32
     virtual void GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer) = 0;
 
+    // Builds without replacing the pipeline states in use, see ObjectRenderer::CreatePipelineStateObject
     virtual void CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler) = 0;
-    virtual void RecompileShaders(ShaderCompiler& Compiler) = 0;
+    virtual void ApplyPipelineStates() {};
+    // CPU solvers have none
+    virtual void GetShaders(std::vector<ShaderDesc>& Shaders) const {};
     virtual void CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation) = 0;
-};
\ No newline at end of file
+#endif
+
+    // Notifies the solver that something external (a collider, the mouse) moved inside the box
+    virtual void DisturbRegion(const Math::Vec4& Min, const Math::Vec4& Max) {};
+
+    // Solvers that can change their particle count at runtime support these, others ignore them
+    virtual void AddEmitter(const ParticleEmitter& Emitter) {};
+    virtual void AddSink(const ParticleSink& Sink) {};
+};
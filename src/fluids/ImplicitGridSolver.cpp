@@ -0,0 +1,454 @@
+#include "fluids/ImplicitGridSolver.h"
+
+#include "fluids/MPMSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Sufficient decrease constant of the backtracking line search
+#define ARMIJO_CONSTANT 1e-4f
+#define MAX_LINE_SEARCH_STEPS 10
+
+ImplicitGridSolver::ImplicitGridSolver(int GridResolution, float Dx, float Mu, float Lamda, const ImplicitParameters& Params)
+    : Params(Params), GridResolution(GridResolution), Dx(Dx), InvDx(1.0f / Dx), Mu(Mu), Lamda(Lamda)
+{
+    // Stencils of particles against the far walls reach the padding past the last column, like the solver's grid
+    CellToNode = std::vector<int32_t>(GridResolution * GridResolution + CPU_GRID_PADDING(GridResolution), -1);
+}
+
+uint32_t ImplicitGridSolver::GetLastNewtonIterations() const
+{
+    return LastNewtonIterations;
+}
+
+uint32_t ImplicitGridSolver::GetLastCGIterations() const
+{
+    return LastCGIterations;
+}
+
+void ImplicitGridSolver::Solve(const std::vector<ParticleRenderData>& Particles, std::span<const ParticlePhysicsData> PhysicsData, const std::vector<uint32_t>& Indices, std::span<GridCell> Grid, float DeltaTime)
+{
+    LastNewtonIterations = 0;
+    LastCGIterations = 0;
+
+    BuildStencils(Particles, PhysicsData, Indices, Grid);
+    if (NodeCells.empty())
+    {
+        return;
+    }
+
+    size_t NumDofs = NodeCells.size() * 2;
+    for (std::vector<float>* Scratch : {&Velocity, &Trial, &Grad, &Step, &Residual, &Preconditioned, &Direction, &HessianDirection})
+    {
+        Scratch->resize(NumDofs);
+    }
+    BuildPreconditioner(DeltaTime);
+
+    // Start from v*, scaled back towards rest until no particle inverts. Zero velocity keeps F = Fn, which is always valid
+    float StartScale = 1.0f;
+    for (int Attempt = 0; Attempt <= MAX_LINE_SEARCH_STEPS; Attempt++)
+    {
+        if (Attempt == MAX_LINE_SEARCH_STEPS)
+        {
+            StartScale = 0.0f;
+        }
+        for (size_t i = 0; i < NumDofs; i++)
+        {
+            Velocity[i] = TargetVelocity[i] * StartScale;
+        }
+        if (UpdateDeformation(Velocity, DeltaTime))
+        {
+            break;
+        }
+        StartScale *= 0.5f;
+    }
+    double CurrentEnergy = Energy(Velocity);
+
+    for (uint32_t Iteration = 0; Iteration < Params.MaxNewtonIterations; Iteration++)
+    {
+        LastNewtonIterations++;
+        Gradient(Velocity, DeltaTime, Grad);
+
+        // Solve H * Step = -Grad with Jacobi preconditioned conjugate gradient
+        std::fill(Step.begin(), Step.end(), 0.0f);
+        for (size_t i = 0; i < NumDofs; i++)
+        {
+            Residual[i] = -Grad[i];
+            Preconditioned[i] = Residual[i] * InverseDiagonal[i];
+        }
+        Direction = Preconditioned;
+        float ResidualSq = Dot(Residual, Preconditioned);
+        float Threshold = ResidualSq * Params.CGTolerance * Params.CGTolerance;
+        if (ResidualSq <= 0.0f)
+        {
+            break;
+        }
+        for (uint32_t CGIteration = 0; CGIteration < Params.MaxCGIterations; CGIteration++)
+        {
+            LastCGIterations++;
+            HessianProduct(Direction, DeltaTime, HessianDirection);
+            float Curvature = Dot(Direction, HessianDirection);
+            if (Curvature <= 0.0f)
+            {
+                // Negative curvature, fall back to the steepest descent direction if nothing was found yet
+                if (CGIteration == 0)
+                {
+                    Step = Preconditioned;
+                }
+                break;
+            }
+
+            float Alpha = ResidualSq / Curvature;
+            for (size_t i = 0; i < NumDofs; i++)
+            {
+                Step[i] += Alpha * Direction[i];
+                Residual[i] -= Alpha * HessianDirection[i];
+                Preconditioned[i] = Residual[i] * InverseDiagonal[i];
+            }
+
+            float NewResidualSq = Dot(Residual, Preconditioned);
+            if (NewResidualSq <= Threshold)
+            {
+                break;
+            }
+            float Beta = NewResidualSq / ResidualSq;
+            for (size_t i = 0; i < NumDofs; i++)
+            {
+                Direction[i] = Preconditioned[i] + Beta * Direction[i];
+            }
+            ResidualSq = NewResidualSq;
+        }
+
+        float Slope = Dot(Grad, Step);
+        if (Slope >= 0.0f)
+        {
+            for (size_t i = 0; i < NumDofs; i++)
+            {
+                Step[i] = -Grad[i];
+            }
+            Slope = -Dot(Grad, Grad);
+        }
+
+        // Backtrack until the incremental potential decreases enough
+        float StepLength = 1.0f;
+        bool Accepted = false;
+        double TrialEnergy = 0.0;
+        for (int LineSearchStep = 0; LineSearchStep < MAX_LINE_SEARCH_STEPS; LineSearchStep++)
+        {
+            for (size_t i = 0; i < NumDofs; i++)
+            {
+                Trial[i] = Velocity[i] + StepLength * Step[i];
+            }
+            if (UpdateDeformation(Trial, DeltaTime))
+            {
+                TrialEnergy = Energy(Trial);
+                if (TrialEnergy <= CurrentEnergy + ARMIJO_CONSTANT * StepLength * Slope)
+                {
+                    Accepted = true;
+                    break;
+                }
+            }
+            StepLength *= 0.5f;
+        }
+        if (!Accepted)
+        {
+            break;
+        }
+
+        Velocity.swap(Trial);
+        CurrentEnergy = TrialEnergy;
+
+        float MaxChange = 0.0f;
+        for (float Value : Step)
+        {
+            MaxChange = std::max(MaxChange, std::abs(Value));
+        }
+        if (StepLength * MaxChange < Params.NewtonTolerance)
+        {
+            break;
+        }
+    }
+
+    for (size_t Node = 0; Node < NodeCells.size(); Node++)
+    {
+        GridCell& Cell = Grid[NodeCells[Node]];
+        Cell.VelocityMass.x = Velocity[Node * 2];
+        Cell.VelocityMass.y = Velocity[Node * 2 + 1];
+    }
+}
+
+void ImplicitGridSolver::BuildStencils(const std::vector<ParticleRenderData>& Particles, std::span<const ParticlePhysicsData> PhysicsData, const std::vector<uint32_t>& Indices, std::span<GridCell> Grid)
+{
+    for (uint32_t Cell : NodeCells)
+    {
+        CellToNode[Cell] = -1;
+    }
+    NodeCells.clear();
+    NodeMass.clear();
+    TargetVelocity.clear();
+    FreeMask.clear();
+    Stencils.resize(Indices.size());
+    Deform.resize(Indices.size());
+
+    Math::Vec2<float> Weights[3];
+    for (size_t k = 0; k < Indices.size(); k++)
+    {
+        const ParticleRenderData& Particle = Particles[Indices[k]];
+        const ParticlePhysicsData& Physics = PhysicsData[Indices[k]];
+        ParticleStencil& Stencil = Stencils[k];
+
+        Math::Vec2<int32_t> CellIndex = Math::Vec2<int32_t>(Particle.Position.x * InvDx - 0.5f, Particle.Position.y * InvDx - 0.5f);
+        Math::Vec2 CellDifference = Math::Vec2(Particle.Position.x * InvDx - CellIndex.x, Particle.Position.y * InvDx - CellIndex.y);
+
+        // Same quadratic weights as the transfers
+        Weights[0] = Math::Vec2(1.5f - CellDifference.x, 1.5f - CellDifference.y).Pow(2) * 0.5f;
+        Weights[1] = Math::Vec2(0.75f, 0.75f) - Math::Vec2(CellDifference.x - 1.0f, CellDifference.y - 1.0f).Pow(2);
+        Weights[2] = Math::Vec2(CellDifference.x - 0.5f, CellDifference.y - 0.5f).Pow(2) * 0.5f;
+
+        for (int x = 0; x < 3; x++)
+        {
+            for (int y = 0; y < 3; y++)
+            {
+                int Slot = x * 3 + y;
+                int X = CellIndex.x + x;
+                int Y = CellIndex.y + y;
+                uint32_t Cell = X * GridResolution + Y;
+
+                int32_t Node = CellToNode[Cell];
+                if (Node < 0)
+                {
+                    Node = static_cast<int32_t>(NodeCells.size());
+                    CellToNode[Cell] = Node;
+                    NodeCells.push_back(Cell);
+                    NodeMass.push_back(Grid[Cell].VelocityMass.w);
+                    TargetVelocity.push_back(Grid[Cell].VelocityMass.x);
+                    TargetVelocity.push_back(Grid[Cell].VelocityMass.y);
+                    // Matches the boundary conditions of the explicit grid update, nodes past the far walls are fixed
+                    FreeMask.push_back((X < 2 || X > GridResolution - 3) ? 0.0f : 1.0f);
+                    FreeMask.push_back((Y < 2 || Y > GridResolution - 3) ? 0.0f : 1.0f);
+                }
+
+                Stencil.Nodes[Slot] = Node;
+                Stencil.Weights[Slot] = Weights[x].x * Weights[y].y;
+                Stencil.DistanceX[Slot] = (x - CellDifference.x) * Dx;
+                Stencil.DistanceY[Slot] = (y - CellDifference.y) * Dx;
+            }
+        }
+
+        Stencil.InitialDeform = {Physics.DeformGradient.m11, Physics.DeformGradient.m12, Physics.DeformGradient.m21, Physics.DeformGradient.m22};
+        Stencil.Volume = Physics.InitialVolume;
+    }
+}
+
+void ImplicitGridSolver::BuildPreconditioner(float DeltaTime)
+{
+    // Approximates each diagonal entry of the Hessian with the node mass plus a (mu + lamda) stiffness per particle
+    InverseDiagonal.assign(NodeCells.size() * 2, 0.0f);
+    for (size_t Node = 0; Node < NodeCells.size(); Node++)
+    {
+        InverseDiagonal[Node * 2] = NodeMass[Node];
+        InverseDiagonal[Node * 2 + 1] = NodeMass[Node];
+    }
+
+    float Scale = 4.0f * InvDx * InvDx * DeltaTime;
+    for (const ParticleStencil& Stencil : Stencils)
+    {
+        const Matrix2& Fn = Stencil.InitialDeform;
+        float Stiffness = Stencil.Volume * Scale * Scale * (Mu + Lamda);
+        for (int Slot = 0; Slot < 9; Slot++)
+        {
+            // |Fn^T d|^2
+            float ProjectedX = Fn.xx * Stencil.DistanceX[Slot] + Fn.yx * Stencil.DistanceY[Slot];
+            float ProjectedY = Fn.xy * Stencil.DistanceX[Slot] + Fn.yy * Stencil.DistanceY[Slot];
+            float Entry = Stiffness * Stencil.Weights[Slot] * Stencil.Weights[Slot] * (ProjectedX * ProjectedX + ProjectedY * ProjectedY);
+            InverseDiagonal[Stencil.Nodes[Slot] * 2] += Entry;
+            InverseDiagonal[Stencil.Nodes[Slot] * 2 + 1] += Entry;
+        }
+    }
+
+    for (size_t i = 0; i < InverseDiagonal.size(); i++)
+    {
+        InverseDiagonal[i] = InverseDiagonal[i] > 0.0f ? FreeMask[i] / InverseDiagonal[i] : 0.0f;
+    }
+}
+
+bool ImplicitGridSolver::UpdateDeformation(const std::vector<float>& Velocity, float DeltaTime)
+{
+    float Scale = 4.0f * InvDx * InvDx * DeltaTime;
+    for (size_t k = 0; k < Stencils.size(); k++)
+    {
+        const ParticleStencil& Stencil = Stencils[k];
+
+        // dt * C, the APIC velocity gradient the grid to particle transfer will produce
+        Matrix2 Gradient;
+        for (int Slot = 0; Slot < 9; Slot++)
+        {
+            float VelocityX = Velocity[Stencil.Nodes[Slot] * 2] * Stencil.Weights[Slot];
+            float VelocityY = Velocity[Stencil.Nodes[Slot] * 2 + 1] * Stencil.Weights[Slot];
+            Gradient.xx += VelocityX * Stencil.DistanceX[Slot];
+            Gradient.xy += VelocityX * Stencil.DistanceY[Slot];
+            Gradient.yx += VelocityY * Stencil.DistanceX[Slot];
+            Gradient.yy += VelocityY * Stencil.DistanceY[Slot];
+        }
+
+        // F = (I + dt * C) * Fn
+        const Matrix2& Fn = Stencil.InitialDeform;
+        float Axx = 1.0f + Gradient.xx * Scale, Axy = Gradient.xy * Scale;
+        float Ayx = Gradient.yx * Scale, Ayy = 1.0f + Gradient.yy * Scale;
+        Matrix2& F = Deform[k];
+        F.xx = Axx * Fn.xx + Axy * Fn.yx;
+        F.xy = Axx * Fn.xy + Axy * Fn.yy;
+        F.yx = Ayx * Fn.xx + Ayy * Fn.yx;
+        F.yy = Ayx * Fn.xy + Ayy * Fn.yy;
+
+        if (F.xx * F.yy - F.xy * F.yx <= 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+double ImplicitGridSolver::Energy(const std::vector<float>& Velocity) const
+{
+    double Kinetic = 0.0;
+    for (size_t Node = 0; Node < NodeCells.size(); Node++)
+    {
+        float DifferenceX = Velocity[Node * 2] - TargetVelocity[Node * 2];
+        float DifferenceY = Velocity[Node * 2 + 1] - TargetVelocity[Node * 2 + 1];
+        Kinetic += 0.5 * NodeMass[Node] * (DifferenceX * DifferenceX + DifferenceY * DifferenceY);
+    }
+
+    // Neo-Hookean: mu/2 (tr(F^T F) - 2) - mu log J + lamda/2 log^2 J
+    double Elastic = 0.0;
+    for (size_t k = 0; k < Stencils.size(); k++)
+    {
+        const Matrix2& F = Deform[k];
+        float LogJ = std::log(F.xx * F.yy - F.xy * F.yx);
+        float FrobeniusSq = F.xx * F.xx + F.xy * F.xy + F.yx * F.yx + F.yy * F.yy;
+        Elastic += Stencils[k].Volume * (0.5f * Mu * (FrobeniusSq - 2.0f) - Mu * LogJ + 0.5f * Lamda * LogJ * LogJ);
+    }
+    return Kinetic + Elastic;
+}
+
+void ImplicitGridSolver::Gradient(const std::vector<float>& Velocity, float DeltaTime, std::vector<float>& Out) const
+{
+    for (size_t Node = 0; Node < NodeCells.size(); Node++)
+    {
+        Out[Node * 2] = NodeMass[Node] * (Velocity[Node * 2] - TargetVelocity[Node * 2]);
+        Out[Node * 2 + 1] = NodeMass[Node] * (Velocity[Node * 2 + 1] - TargetVelocity[Node * 2 + 1]);
+    }
+
+    float Scale = 4.0f * InvDx * InvDx * DeltaTime;
+    for (size_t k = 0; k < Stencils.size(); k++)
+    {
+        const ParticleStencil& Stencil = Stencils[k];
+        const Matrix2& F = Deform[k];
+        const Matrix2& Fn = Stencil.InitialDeform;
+
+        float J = F.xx * F.yy - F.xy * F.yx;
+        float LogJ = std::log(J);
+        // F^-T
+        Matrix2 InverseTranspose = {F.yy / J, -F.yx / J, -F.xy / J, F.xx / J};
+
+        // P = mu (F - F^-T) + lamda log J F^-T, then P * Fn^T
+        Matrix2 P = {Mu * (F.xx - InverseTranspose.xx) + Lamda * LogJ * InverseTranspose.xx,
+                     Mu * (F.xy - InverseTranspose.xy) + Lamda * LogJ * InverseTranspose.xy,
+                     Mu * (F.yx - InverseTranspose.yx) + Lamda * LogJ * InverseTranspose.yx,
+                     Mu * (F.yy - InverseTranspose.yy) + Lamda * LogJ * InverseTranspose.yy};
+        float Factor = Stencil.Volume * Scale;
+        Matrix2 Stress = {(P.xx * Fn.xx + P.xy * Fn.xy) * Factor, (P.xx * Fn.yx + P.xy * Fn.yy) * Factor,
+                          (P.yx * Fn.xx + P.yy * Fn.xy) * Factor, (P.yx * Fn.yx + P.yy * Fn.yy) * Factor};
+
+        for (int Slot = 0; Slot < 9; Slot++)
+        {
+            float Weight = Stencil.Weights[Slot];
+            int32_t Node = Stencil.Nodes[Slot];
+            Out[Node * 2] += Weight * (Stress.xx * Stencil.DistanceX[Slot] + Stress.xy * Stencil.DistanceY[Slot]);
+            Out[Node * 2 + 1] += Weight * (Stress.yx * Stencil.DistanceX[Slot] + Stress.yy * Stencil.DistanceY[Slot]);
+        }
+    }
+    Project(Out);
+}
+
+void ImplicitGridSolver::HessianProduct(const std::vector<float>& Direction, float DeltaTime, std::vector<float>& Out) const
+{
+    for (size_t Node = 0; Node < NodeCells.size(); Node++)
+    {
+        Out[Node * 2] = NodeMass[Node] * Direction[Node * 2];
+        Out[Node * 2 + 1] = NodeMass[Node] * Direction[Node * 2 + 1];
+    }
+
+    float Scale = 4.0f * InvDx * InvDx * DeltaTime;
+    for (size_t k = 0; k < Stencils.size(); k++)
+    {
+        const ParticleStencil& Stencil = Stencils[k];
+        const Matrix2& F = Deform[k];
+        const Matrix2& Fn = Stencil.InitialDeform;
+
+        // dF = dt * dC * Fn
+        Matrix2 DeltaGradient;
+        for (int Slot = 0; Slot < 9; Slot++)
+        {
+            float DirectionX = Direction[Stencil.Nodes[Slot] * 2] * Stencil.Weights[Slot];
+            float DirectionY = Direction[Stencil.Nodes[Slot] * 2 + 1] * Stencil.Weights[Slot];
+            DeltaGradient.xx += DirectionX * Stencil.DistanceX[Slot];
+            DeltaGradient.xy += DirectionX * Stencil.DistanceY[Slot];
+            DeltaGradient.yx += DirectionY * Stencil.DistanceX[Slot];
+            DeltaGradient.yy += DirectionY * Stencil.DistanceY[Slot];
+        }
+        Matrix2 DeltaF = {(DeltaGradient.xx * Fn.xx + DeltaGradient.xy * Fn.yx) * Scale, (DeltaGradient.xx * Fn.xy + DeltaGradient.xy * Fn.yy) * Scale,
+                          (DeltaGradient.yx * Fn.xx + DeltaGradient.yy * Fn.yx) * Scale, (DeltaGradient.yx * Fn.xy + DeltaGradient.yy * Fn.yy) * Scale};
+
+        float J = F.xx * F.yy - F.xy * F.yx;
+        float LogJ = std::log(J);
+        Matrix2 InverseTranspose = {F.yy / J, -F.yx / J, -F.xy / J, F.xx / J};
+
+        // dP = mu dF + (mu - lamda log J) F^-T dF^T F^-T + lamda tr(F^-1 dF) F^-T
+        // The middle coefficient is clamped at zero to keep the stretched regime closer to definite
+        float Coefficient = std::max(Mu - Lamda * LogJ, 0.0f);
+        // F^-T dF^T
+        Matrix2 Left = {InverseTranspose.xx * DeltaF.xx + InverseTranspose.xy * DeltaF.xy, InverseTranspose.xx * DeltaF.yx + InverseTranspose.xy * DeltaF.yy,
+                        InverseTranspose.yx * DeltaF.xx + InverseTranspose.yy * DeltaF.xy, InverseTranspose.yx * DeltaF.yx + InverseTranspose.yy * DeltaF.yy};
+        Matrix2 Middle = {Left.xx * InverseTranspose.xx + Left.xy * InverseTranspose.yx, Left.xx * InverseTranspose.xy + Left.xy * InverseTranspose.yy,
+                          Left.yx * InverseTranspose.xx + Left.yy * InverseTranspose.yx, Left.yx * InverseTranspose.xy + Left.yy * InverseTranspose.yy};
+        // tr(F^-1 dF) = F^-T : dF
+        float Trace = InverseTranspose.xx * DeltaF.xx + InverseTranspose.xy * DeltaF.xy + InverseTranspose.yx * DeltaF.yx + InverseTranspose.yy * DeltaF.yy;
+
+        Matrix2 DeltaP = {Mu * DeltaF.xx + Coefficient * Middle.xx + Lamda * Trace * InverseTranspose.xx,
+                          Mu * DeltaF.xy + Coefficient * Middle.xy + Lamda * Trace * InverseTranspose.xy,
+                          Mu * DeltaF.yx + Coefficient * Middle.yx + Lamda * Trace * InverseTranspose.yx,
+                          Mu * DeltaF.yy + Coefficient * Middle.yy + Lamda * Trace * InverseTranspose.yy};
+
+        float Factor = Stencil.Volume * Scale;
+        Matrix2 Stress = {(DeltaP.xx * Fn.xx + DeltaP.xy * Fn.xy) * Factor, (DeltaP.xx * Fn.yx + DeltaP.xy * Fn.yy) * Factor,
+                          (DeltaP.yx * Fn.xx + DeltaP.yy * Fn.xy) * Factor, (DeltaP.yx * Fn.yx + DeltaP.yy * Fn.yy) * Factor};
+
+        for (int Slot = 0; Slot < 9; Slot++)
+        {
+            float Weight = Stencil.Weights[Slot];
+            int32_t Node = Stencil.Nodes[Slot];
+            Out[Node * 2] += Weight * (Stress.xx * Stencil.DistanceX[Slot] + Stress.xy * Stencil.DistanceY[Slot]);
+            Out[Node * 2 + 1] += Weight * (Stress.yx * Stencil.DistanceX[Slot] + Stress.yy * Stencil.DistanceY[Slot]);
+        }
+    }
+    Project(Out);
+}
+
+void ImplicitGridSolver::Project(std::vector<float>& Vector) const
+{
+    for (size_t i = 0; i < Vector.size(); i++)
+    {
+        Vector[i] *= FreeMask[i];
+    }
+}
+
+float ImplicitGridSolver::Dot(const std::vector<float>& A, const std::vector<float>& B) const
+{
+    double Sum = 0.0;
+    for (size_t i = 0; i < A.size(); i++)
+    {
+        Sum += A[i] * B[i];
+    }
+    return static_cast<float>(Sum);
+}
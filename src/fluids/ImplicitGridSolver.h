@@ -0,0 +1,88 @@
+#pragma once
+
+#include "fluids/IFluidSolver.h"
+#include <span>
+#include <stdint.h>
+#include <vector>
+
+struct GridCell;
+struct ParticlePhysicsData;
+
+struct ImplicitParameters
+{
+    uint32_t MaxNewtonIterations = 4;
+    uint32_t MaxCGIterations = 100;
+    // CG stops once the residual dropped by this factor
+    float CGTolerance = 1e-2f;
+    // Newton stops once no grid velocity changes by more than this
+    float NewtonTolerance = 1e-4f;
+};
+
+// Backward Euler grid update for the (2D) CPU solver's neo-Hookean material. Minimizes the incremental potential
+// sum(m/2 |v - v*|^2) + sum(V0 * Psi(F(v))) over the grid velocities with Newton iterations, each solved by a
+// matrix free conjugate gradient on the grid nodes touched by the given particles
+class ImplicitGridSolver
+{
+public:
+    ImplicitGridSolver(int GridResolution, float Dx, float Mu, float Lamda, const ImplicitParameters& Params);
+
+    // Grid must hold the explicit velocities without elastic forces (v*), on return it holds the implicit ones
+    void Solve(const std::vector<ParticleRenderData>& Particles, std::span<const ParticlePhysicsData> PhysicsData, const std::vector<uint32_t>& Indices, std::span<GridCell> Grid, float DeltaTime);
+
+    // Iterations used by the last Solve, for tuning
+    uint32_t GetLastNewtonIterations() const;
+    uint32_t GetLastCGIterations() const;
+
+private:
+    struct Matrix2
+    {
+        float xx = 0.0f, xy = 0.0f, yx = 0.0f, yy = 0.0f;
+    };
+
+    void BuildStencils(const std::vector<ParticleRenderData>& Particles, std::span<const ParticlePhysicsData> PhysicsData, const std::vector<uint32_t>& Indices, std::span<GridCell> Grid);
+    void BuildPreconditioner(float DeltaTime);
+    // Deformation gradients at the given velocities, returns false if any of them inverted
+    bool UpdateDeformation(const std::vector<float>& Velocity, float DeltaTime);
+    double Energy(const std::vector<float>& Velocity) const;
+    void Gradient(const std::vector<float>& Velocity, float DeltaTime, std::vector<float>& Out) const;
+    void HessianProduct(const std::vector<float>& Direction, float DeltaTime, std::vector<float>& Out) const;
+    void Project(std::vector<float>& Vector) const;
+    float Dot(const std::vector<float>& A, const std::vector<float>& B) const;
+
+    struct ParticleStencil
+    {
+        int32_t Nodes[9];
+        float Weights[9];
+        // Node minus particle position, world units
+        float DistanceX[9];
+        float DistanceY[9];
+        Matrix2 InitialDeform;
+        float Volume;
+    };
+
+    ImplicitParameters Params;
+    int GridResolution;
+    float Dx;
+    float InvDx;
+    float Mu;
+    float Lamda;
+
+    std::vector<ParticleStencil> Stencils;
+    // Deformation gradient of every particle at the current Newton iterate
+    std::vector<Matrix2> Deform;
+
+    // Per node data, velocities are interleaved xy
+    std::vector<int32_t> CellToNode;
+    std::vector<uint32_t> NodeCells;
+    std::vector<float> NodeMass;
+    std::vector<float> TargetVelocity;
+    // 1 for free velocity components, 0 for the ones held by the boundary
+    std::vector<float> FreeMask;
+
+    // Solver scratch
+    std::vector<float> InverseDiagonal;
+    std::vector<float> Velocity, Trial, Grad, Step, Residual, Preconditioned, Direction, HessianDirection;
+
+    uint32_t LastNewtonIterations = 0;
+    uint32_t LastCGIterations = 0;
+};
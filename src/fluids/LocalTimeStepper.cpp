@@ -0,0 +1,92 @@
+#include "fluids/LocalTimeStepper.h"
+
+#include <algorithm>
+#include <cmath>
+
+LocalTimeStepper::LocalTimeStepper(int BlocksPerAxis, float Dx, const MultiRateParameters& Params)
+    : Params(Params), BlocksPerAxis(BlocksPerAxis), Dx(Dx)
+{
+    Reset();
+}
+
+void LocalTimeStepper::Reset()
+{
+    StepIndex = 0;
+    MaxSpeedSq.assign(BlocksPerAxis * BlocksPerAxis, 0.0f);
+    Levels.assign(BlocksPerAxis * BlocksPerAxis, 0);
+}
+
+bool LocalTimeStepper::IsDue(uint32_t Level) const
+{
+    uint64_t Mask = (uint64_t(1) << Level) - 1;
+    return ((StepIndex + 1) & Mask) == 0;
+}
+
+uint32_t LocalTimeStepper::GetNextLevel(int Block) const
+{
+    // The next step starts at StepIndex + 1, which must be a multiple of the level's step length
+    uint32_t Aligned = 0;
+    while (Aligned < Params.MaxLevel && ((StepIndex + 1) & ((uint64_t(2) << Aligned) - 1)) == 0)
+    {
+        Aligned++;
+    }
+    return std::min(Levels[Block], Aligned);
+}
+
+uint32_t LocalTimeStepper::GetMaxLevel() const
+{
+    return Params.MaxLevel;
+}
+
+void LocalTimeStepper::RecordSpeed(int Block, float SpeedSq)
+{
+    MaxSpeedSq[Block] = std::max(MaxSpeedSq[Block], SpeedSq);
+}
+
+void LocalTimeStepper::EndStep(float BaseDeltaTime)
+{
+    // Coarsest level that keeps both the advective CFL and the material's stability limit
+    for (size_t Block = 0; Block < Levels.size(); Block++)
+    {
+        float Speed = std::sqrt(MaxSpeedSq[Block]);
+        float MaxStep = Params.MaxDeltaTime;
+        if (Speed > 0.0f)
+        {
+            MaxStep = std::min(MaxStep, Params.CourantNumber * Dx / Speed);
+        }
+        uint32_t Level = 0;
+        while (Level < Params.MaxLevel && BaseDeltaTime * float(2u << Level) <= MaxStep)
+        {
+            Level++;
+        }
+        Levels[Block] = Level;
+        MaxSpeedSq[Block] = 0.0f;
+    }
+
+    // Limit neighbouring blocks to one level apart, relaxing from the finest blocks outwards
+    bool Changed = true;
+    while (Changed)
+    {
+        Changed = false;
+        for (int X = 0; X < BlocksPerAxis; X++)
+        {
+            for (int Y = 0; Y < BlocksPerAxis; Y++)
+            {
+                uint32_t& Level = Levels[X * BlocksPerAxis + Y];
+                for (int NeighbourX = std::max(X - 1, 0); NeighbourX <= std::min(X + 1, BlocksPerAxis - 1); NeighbourX++)
+                {
+                    for (int NeighbourY = std::max(Y - 1, 0); NeighbourY <= std::min(Y + 1, BlocksPerAxis - 1); NeighbourY++)
+                    {
+                        uint32_t Limit = Levels[NeighbourX * BlocksPerAxis + NeighbourY] + 1;
+                        if (Level > Limit)
+                        {
+                            Level = Limit;
+                            Changed = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    StepIndex++;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+struct MultiRateParameters
+{
+    // Blocks step at up to 2^MaxLevel times the base timestep
+    uint32_t MaxLevel = 3;
+    // Fraction of a cell the fastest particle of a block may cross per step of its level
+    float CourantNumber = 0.25f;
+    // Largest step the material stays stable at, explicit elasticity blows up past it regardless of speed
+    float MaxDeltaTime = 0.002f;
+};
+
+// Multi-rate time levels for the (2D) CPU solver's blocks. A block at level L steps every 2^L base steps with
+// 2^L times the base timestep, chosen from the speed of its particles. Neighbouring blocks differ by at most one level,
+// and since the steps of every level end on multiples of their length, all coarser levels due at a base step are in sync
+// with all finer ones there
+class LocalTimeStepper
+{
+public:
+    LocalTimeStepper(int BlocksPerAxis, float Dx, const MultiRateParameters& Params);
+
+    void Reset();
+
+    // Whether particles at Level take a step that ends with the current base step
+    bool IsDue(uint32_t Level) const;
+    // Level a particle takes after a step that ended in Block, limited to levels whose steps start at the next base step
+    uint32_t GetNextLevel(int Block) const;
+    uint32_t GetMaxLevel() const;
+
+    void RecordSpeed(int Block, float SpeedSq);
+    // Picks the block levels for the coming steps from the recorded speeds and advances the base step counter
+    void EndStep(float BaseDeltaTime);
+
+private:
+    MultiRateParameters Params;
+    int BlocksPerAxis;
+    float Dx;
+    uint64_t StepIndex = 0;
+    std::vector<float> MaxSpeedSq;
+    std::vector<uint32_t> Levels;
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+// MPM transfer and stress kernels specialized at compile time on dimension (2 or 3), B-spline order and scalar type.
+// Every loop over the stencil is unrolled by the compiler, so each combination comes out as straight-line code.
+// Positions are in grid cells, callers scale by Dx and its inverse
+namespace MPMKernels
+{
+    enum SplineOrder
+    {
+        LinearSpline = 1,
+        QuadraticSpline = 2,
+        CubicSpline = 3
+    };
+
+    template <int Order, typename Scalar>
+    struct BSpline;
+
+    // Tent function over two nodes. Its inertia tensor depends on the position, so APIC C has to come from the weight
+    // gradients instead of B * D^-1
+    template <typename Scalar>
+    struct BSpline<LinearSpline, Scalar>
+    {
+        static constexpr int Width = 2;
+        static constexpr bool HasConstantInertia = false;
+
+        static int Base(Scalar X)
+        {
+            return static_cast<int>(X);
+        }
+
+        // Fx is the position relative to the base node
+        static void Evaluate(Scalar Fx, Scalar (&Weights)[Width], Scalar (&Gradients)[Width])
+        {
+            Weights[0] = Scalar(1) - Fx;
+            Weights[1] = Fx;
+            Gradients[0] = Scalar(-1);
+            Gradients[1] = Scalar(1);
+        }
+    };
+
+    template <typename Scalar>
+    struct BSpline<QuadraticSpline, Scalar>
+    {
+        static constexpr int Width = 3;
+        static constexpr bool HasConstantInertia = true;
+        // D^-1 = 4 / Dx^2
+        static constexpr Scalar InverseInertia = Scalar(4);
+
+        static int Base(Scalar X)
+        {
+            return static_cast<int>(X - Scalar(0.5));
+        }
+
+        static void Evaluate(Scalar Fx, Scalar (&Weights)[Width], Scalar (&Gradients)[Width])
+        {
+            Weights[0] = (Scalar(1.5) - Fx) * (Scalar(1.5) - Fx) * Scalar(0.5);
+            Weights[1] = Scalar(0.75) - (Fx - Scalar(1)) * (Fx - Scalar(1));
+            Weights[2] = (Fx - Scalar(0.5)) * (Fx - Scalar(0.5)) * Scalar(0.5);
+            Gradients[0] = Fx - Scalar(1.5);
+            Gradients[1] = Scalar(-2) * (Fx - Scalar(1));
+            Gradients[2] = Fx - Scalar(0.5);
+        }
+    };
+
+    template <typename Scalar>
+    struct BSpline<CubicSpline, Scalar>
+    {
+        static constexpr int Width = 4;
+        static constexpr bool HasConstantInertia = true;
+        // D^-1 = 3 / Dx^2
+        static constexpr Scalar InverseInertia = Scalar(3);
+
+        static int Base(Scalar X)
+        {
+            return static_cast<int>(X) - 1;
+        }
+
+        static void Evaluate(Scalar Fx, Scalar (&Weights)[Width], Scalar (&Gradients)[Width])
+        {
+            // Distances to the nodes are Fx, Fx - 1, 2 - Fx and 3 - Fx, the outer two on the spline's outer piece
+            Scalar Outer0 = Scalar(2) - Fx;
+            Scalar Inner1 = Fx - Scalar(1);
+            Scalar Inner2 = Scalar(2) - Fx;
+            Scalar Outer3 = Fx - Scalar(1);
+            Weights[0] = Outer0 * Outer0 * Outer0 / Scalar(6);
+            Weights[1] = Scalar(0.5) * Inner1 * Inner1 * Inner1 - Inner1 * Inner1 + Scalar(2) / Scalar(3);
+            Weights[2] = Scalar(0.5) * Inner2 * Inner2 * Inner2 - Inner2 * Inner2 + Scalar(2) / Scalar(3);
+            Weights[3] = Outer3 * Outer3 * Outer3 / Scalar(6);
+            Gradients[0] = Scalar(-0.5) * Outer0 * Outer0;
+            Gradients[1] = Scalar(1.5) * Inner1 * Inner1 - Scalar(2) * Inner1;
+            Gradients[2] = Scalar(2) * Inner2 - Scalar(1.5) * Inner2 * Inner2;
+            Gradients[3] = Scalar(0.5) * Outer3 * Outer3;
+        }
+    };
+
+    // Dense Dim x Dim matrix, M[Row][Column]
+    template <int Dim, typename Scalar>
+    struct Matrix
+    {
+        Scalar M[Dim][Dim];
+
+        static Matrix Identity()
+        {
+            Matrix Result = {};
+            for (int i = 0; i < Dim; i++)
+            {
+                Result.M[i][i] = Scalar(1);
+            }
+            return Result;
+        }
+
+        Scalar Determinant() const
+        {
+            if constexpr (Dim == 2)
+            {
+                return M[0][0] * M[1][1] - M[0][1] * M[1][0];
+            }
+            else
+            {
+                return M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1]) - M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0]) + M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
+            }
+        }
+
+        // M * M^T
+        Matrix TimesTranspose() const
+        {
+            Matrix Result = {};
+            for (int Row = 0; Row < Dim; Row++)
+            {
+                for (int Column = 0; Column < Dim; Column++)
+                {
+                    for (int k = 0; k < Dim; k++)
+                    {
+                        Result.M[Row][Column] += M[Row][k] * M[Column][k];
+                    }
+                }
+            }
+            return Result;
+        }
+    };
+
+    template <int Dim, int Order, typename Scalar>
+    struct Kernel
+    {
+        static_assert(Dim == 2 || Dim == 3, "MPM kernels are 2D or 3D");
+        static_assert(std::is_floating_point_v<Scalar>, "MPM kernels need a floating point scalar");
+
+        typedef BSpline<Order, Scalar> Spline;
+        typedef MPMKernels::Matrix<Dim, Scalar> Matrix;
+        static constexpr int Width = Spline::Width;
+        // Nodes past its base node a particle writes to, and so the halo every tiling of the grid needs
+        static constexpr int Reach = Width - 1;
+        static constexpr int NumNodes = Dim == 2 ? Width * Width : Width * Width * Width;
+
+        // Per axis weights of one particle
+        struct Stencil
+        {
+            int Base[Dim];
+            Scalar Fx[Dim];
+            Scalar Weights[Dim][Width];
+            Scalar Gradients[Dim][Width];
+        };
+
+        // One node of the stencil. Distance is the node's offset from the particle and Gradient the gradient of the
+        // weight with respect to the particle's position, both in cells
+        struct Node
+        {
+            int Cell[Dim];
+            Scalar Weight;
+            Scalar Distance[Dim];
+            Scalar Gradient[Dim];
+        };
+
+        static Stencil BuildStencil(const Scalar (&Position)[Dim])
+        {
+            Stencil Result;
+            for (int Axis = 0; Axis < Dim; Axis++)
+            {
+                Result.Base[Axis] = Spline::Base(Position[Axis]);
+                Result.Fx[Axis] = Position[Axis] - Result.Base[Axis];
+                Spline::Evaluate(Result.Fx[Axis], Result.Weights[Axis], Result.Gradients[Axis]);
+            }
+            return Result;
+        }
+
+        // Calls Func(const Node&) for every node, the last axis varying fastest
+        template <typename F>
+        static void ForEachNode(const Stencil& Weights, F&& Func)
+        {
+            VisitNodes(Weights, Func, std::make_integer_sequence<int, NumNodes>());
+        }
+
+        // Kirchhoff stress of the neo-Hookean model, tau = P * F^T = Mu * (F * F^T - I) + Lamda * log(J) * I
+        static Matrix NeoHookeanKirchhoff(const Matrix& F, Scalar Mu, Scalar Lamda)
+        {
+            Matrix Tau = F.TimesTranspose();
+            Scalar Volume = Lamda * std::log(F.Determinant());
+            for (int Row = 0; Row < Dim; Row++)
+            {
+                for (int Column = 0; Column < Dim; Column++)
+                {
+                    Tau.M[Row][Column] = Mu * (Tau.M[Row][Column] - (Row == Column ? Scalar(1) : Scalar(0))) + (Row == Column ? Volume : Scalar(0));
+                }
+            }
+            return Tau;
+        }
+
+    private:
+        // Offset along Axis of stencil node Index
+        static constexpr int NodeOffset(int Index, int Axis)
+        {
+            for (int Later = Axis + 1; Later < Dim; Later++)
+            {
+                Index /= Width;
+            }
+            return Index % Width;
+        }
+
+        template <typename F, int... Index>
+        static void VisitNodes(const Stencil& Weights, F& Func, std::integer_sequence<int, Index...>)
+        {
+            (VisitNode<Index>(Weights, Func), ...);
+        }
+
+        template <int Index, typename F>
+        static void VisitNode(const Stencil& Weights, F& Func)
+        {
+            Node Entry;
+            Entry.Weight = Scalar(1);
+            for (int Axis = 0; Axis < Dim; Axis++)
+            {
+                const int Offset = NodeOffset(Index, Axis);
+                Entry.Cell[Axis] = Weights.Base[Axis] + Offset;
+                Entry.Distance[Axis] = Offset - Weights.Fx[Axis];
+                Entry.Weight *= Weights.Weights[Axis][Offset];
+            }
+            for (int Axis = 0; Axis < Dim; Axis++)
+            {
+                Entry.Gradient[Axis] = Weights.Gradients[Axis][NodeOffset(Index, Axis)];
+                for (int Other = 0; Other < Dim; Other++)
+                {
+                    if (Other != Axis)
+                    {
+                        Entry.Gradient[Axis] *= Weights.Weights[Other][NodeOffset(Index, Other)];
+                    }
+                }
+            }
+            Func(static_cast<const Node&>(Entry));
+        }
+    };
+}
@@ -1,13 +1,19 @@
 #include "MPMSolver.h"
 
+#include "shaders/MPMKernels.hlsli"
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+
+#ifdef _WIN32
 #include "DescriptorHeapAllocator.h"
 #include "PSOBuilder.h"
 #include "Renderer.h"
 #include "ShaderCompiler.h"
 
-#include <algorithm>
-#include <cmath>
-
 ShaderDesc MPMG2PComputeShader = {
     L"D:\\Dev\\Projects\\FluidSim2024\\shaders\\MPMSolver.hlsl",
     L"cs_6_0",
@@ -29,26 +35,49 @@ ShaderDesc MPMClearGridComputeShader = {
     L"ClearGrid"};
 
 #define GROUP_SIZE 64.0f
+#endif
+// Grid cells per side of a block of the block scheduled step, and of the tile its P2G writes into
+#define SCHEDULE_BLOCK_SIZE 8
+#define SCHEDULE_TILE_SIZE (SCHEDULE_BLOCK_SIZE + 2)
 
-MPMSolver::MPMSolver(std::vector<ParticleRenderData>& Particles, FluidParameters& FluidParams)
-    : GridResolution(FluidParams.GridResolution), NumParticles(Particles.size()), Size(FluidParams.GridSize), FluidValues(FluidParams)
+MPMSolver::MPMSolver(std::vector<ParticleRenderData>& Particles, FluidParameters& FluidParams, MaterialModel Model, MPMSolverArenas* BorrowedArenas)
+    : GridResolution(FluidParams.GridResolution), NumParticles(Particles.size()), InitialNumParticles(Particles.size()), Size(FluidParams.GridSize), FluidValues(FluidParams), RunArena(BorrowedArenas ? BorrowedArenas->RunArena : OwnArenas.RunArena), StepArena(BorrowedArenas ? BorrowedArenas->StepArena : OwnArenas.StepArena), Material(Model), OwnActivity(FluidParams.GridResolution, FluidParams.InvDx), Pool(Particles.size())
 {
-    Grid = std::vector<GridCell>(GridResolution * GridResolution * GridResolution);
-    ParticleData = std::vector<ParticlePhysicsData>(NumParticles);
+    ParticleData.resize(NumParticles);
+    ReserveStress(NumParticles);
 
     DX = FluidParams.Dx;
     InvDx = 1 / DX;
 }
 
+#ifdef _WIN32
 void MPMSolver::Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList)
 {
-    Grid = std::vector<GridCell>(GridResolution * GridResolution * GridResolution);
-    ParticleData = std::vector<ParticlePhysicsData>(NumParticles);
+    // Clear in place, the grid never changes size
+    std::fill(Grid.begin(), Grid.end(), GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+    // Resampling may have changed the particle count, the owner restores the original particles
+    NumParticles = InitialNumParticles;
+    // Assign rather than replace so the reserved capacity is kept. The run arena isn't rewound, the grid and particle
+    // data live in it, and it already holds stresses for every particle the pool allows
+    ParticleData.assign(NumParticles, ParticlePhysicsData());
+    StepsSinceResample = 0;
+    Pool.Reset();
+    for (EmitterState& Emitter : Emitters)
+    {
+        Emitter.Pending = 0.0f;
+    }
+    Activity->Reset();
+    SleepStateDirty = true;
+    if (MultiRate)
+    {
+        MultiRate->Reset();
+        ParticleLevels.clear();
+    }
     // We just need to copy from the original upload buffers as we have not touched them
     if (ParticleDataBuffer && ParticleDataUploadBuffer)
     {
         RenderEngine->TransitionBarrier(CommandList, ParticleDataBuffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
-        CommandList->CopyBufferRegion(ParticleDataBuffer.Get(), 0, ParticleDataUploadBuffer.Get(), 0, sizeof(decltype(ParticleData.back())) * ParticleData.size());
+        CommandList->CopyBufferRegion(ParticleDataBuffer.Get(), 0, ParticleDataUploadBuffer.Get(), 0, sizeof(GPUParticlePhysicsData) * ParticleData.size());
         RenderEngine->TransitionBarrier(CommandList, ParticleDataBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     }
     if (GridBuffer && GridUploadBuffer)
@@ -69,35 +98,51 @@ void MPMSolver::CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCom
 {
     PSOBuilder ComputeBuilder;
     ComputeBuilder.SetComputeShader(Compiler.GetShader(MPMClearGridComputeShader));
-    PipelineStates[0] = ComputeBuilder.BuildCompute(D3D12Device);
-    DispatchSizes[0] = static_cast<int>(ceil(Grid.size() / GROUP_SIZE));
+    PendingPipelineStates[0] = ComputeBuilder.BuildCompute(D3D12Device);
 
     ComputeBuilder.SetComputeShader(Compiler.GetShader(MPMP2GComputeShader));
-    PipelineStates[1] = ComputeBuilder.BuildCompute(D3D12Device);
-    DispatchSizes[1] = static_cast<int>(ceil(NumParticles / GROUP_SIZE));
+    PendingPipelineStates[1] = ComputeBuilder.BuildCompute(D3D12Device);
 
     ComputeBuilder.SetComputeShader(Compiler.GetShader(MPMGridUpdateComputeShader));
-    PipelineStates[2] = ComputeBuilder.BuildCompute(D3D12Device);
-    DispatchSizes[2] = static_cast<int>(ceil(Grid.size() / GROUP_SIZE));
+    PendingPipelineStates[2] = ComputeBuilder.BuildCompute(D3D12Device);
 
     ComputeBuilder.SetComputeShader(Compiler.GetShader(MPMG2PComputeShader));
-    PipelineStates[3] = ComputeBuilder.BuildCompute(D3D12Device);
+    PendingPipelineStates[3] = ComputeBuilder.BuildCompute(D3D12Device);
+}
+
+void MPMSolver::ApplyPipelineStates()
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (PendingPipelineStates[i])
+        {
+            PipelineStates[i] = std::move(PendingPipelineStates[i]);
+        }
+    }
+    const int NumCells = GridResolution * GridResolution * GridResolution;
+    DispatchSizes[0] = static_cast<int>(ceil(NumCells / GROUP_SIZE));
+    DispatchSizes[1] = static_cast<int>(ceil(NumParticles / GROUP_SIZE));
+    DispatchSizes[2] = static_cast<int>(ceil(NumCells / GROUP_SIZE));
     DispatchSizes[3] = static_cast<int>(ceil(NumParticles / GROUP_SIZE));
 }
 
-void MPMSolver::RecompileShaders(ShaderCompiler& Compiler)
+void MPMSolver::GetShaders(std::vector<ShaderDesc>& Shaders) const
 {
-    Compiler.CompileShaderNonAsync(MPMClearGridComputeShader, true);
-    Compiler.CompileShaderNonAsync(MPMG2PComputeShader, true);
-    Compiler.CompileShaderNonAsync(MPMP2GComputeShader, true);
-    Compiler.CompileShaderNonAsync(MPMGridUpdateComputeShader, true);
+    Shaders.insert(Shaders.end(), {MPMClearGridComputeShader, MPMG2PComputeShader, MPMP2GComputeShader, MPMGridUpdateComputeShader});
 }
 
 void MPMSolver::CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation)
 {
     HeapAllocation = FluidHeapAllocation;
+    AllocateGrid(GridResolution * GridResolution * GridResolution);
 
-    RenderEngine->UploadDefaultBufferResource(CommandList, ParticleDataBuffer, ParticleDataUploadBuffer, ParticleData.size(), sizeof(decltype(ParticleData.back())), ParticleData.data(), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    std::vector<GPUParticlePhysicsData> GPUParticleData(ParticleData.size());
+    for (size_t Index = 0; Index < ParticleData.size(); Index++)
+    {
+        const ParticlePhysicsData& PhysicsData = ParticleData[Index];
+        GPUParticleData[Index] = {PhysicsData.C, PhysicsData.DeformGradient, PhysicsData.Mass, PhysicsData.InitialVolume, PhysicsData.J, PhysicsData.PlasticJ};
+    }
+    RenderEngine->UploadDefaultBufferResource(CommandList, ParticleDataBuffer, ParticleDataUploadBuffer, GPUParticleData.size(), sizeof(GPUParticlePhysicsData), GPUParticleData.data(), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
     RenderEngine->TransitionBarrier(CommandList, ParticleDataBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
     RenderEngine->UploadDefaultBufferResource(CommandList, GridBuffer, GridUploadBuffer, Grid.size(), sizeof(decltype(Grid.back())), Grid.data(), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
@@ -106,7 +151,7 @@ void MPMSolver::CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3
     RenderEngine->UploadDefaultBufferResource(CommandList, FluidParamBuffer, FluidParamUploadBuffer, 1, sizeof(FluidParameters), &FluidValues, D3D12_RESOURCE_FLAG_NONE, 256);
     RenderEngine->TransitionBarrier(CommandList, FluidParamBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
 
-    HeapAllocation->CreateBufferUAV(ParticleDataBuffer, ParticleData.size(), sizeof(decltype(ParticleData.back())));
+    HeapAllocation->CreateBufferUAV(ParticleDataBuffer, ParticleData.size(), sizeof(GPUParticlePhysicsData));
     HeapAllocation->CreateBufferUAV(GridBuffer, Grid.size(), sizeof(decltype(Grid.back())));
     HeapAllocation->CreateBufferCBV(FluidParamBuffer, 256);
 }
@@ -123,147 +168,924 @@ void MPMSolver::GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12Gr
         RenderEngine->UAVBarrier(CommandList, ParticleBuffer.Get());
     }
 }
+#endif
 
 void MPMSolver::CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime)
 {
-    // Reset grid
-    for (GridCell& Cell : Grid)
+    BeginStep(Particles, DeltaTime);
+
+    if (UsesMultiRate())
+    {
+        MultiRateStep(Particles, DeltaTime);
+        SleepStateDirty = Activity->EndStep();
+        return;
+    }
+
+    if (UsesAdaptiveGrid())
+    {
+        AdaptiveStep(Particles, DeltaTime);
+        SleepStateDirty = Activity->EndStep();
+        return;
+    }
+
+    if (UsesBlockScheduling())
+    {
+        BlockScheduledStep(Particles, DeltaTime);
+        SleepStateDirty = Activity->EndStep();
+        return;
+    }
+
+    // The CPU solver is 2D and only touches the first GridResolution^2 cells and the padding
+    const int NumCells = GridResolution * GridResolution + CPU_GRID_PADDING(GridResolution);
+    AllocateGrid(NumCells);
+    std::fill(Grid.begin(), Grid.begin() + NumCells, GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+    ScatterToGrid(Particles, Grid, DeltaTime);
+    UpdateGrid(Grid, DeltaTime);
+    if (UsesImplicitUpdate())
+    {
+        // The grid now holds v* without elastic forces, solve for the end of step velocities
+        Implicit->Solve(Particles, ParticleData, ActiveParticles, Grid, DeltaTime);
+    }
+    GatherFromGrid(Particles, Grid, DeltaTime);
+
+    SleepStateDirty = Activity->EndStep();
+}
+
+void MPMSolver::BeginStep(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    if (!Emitters.empty() || !Sinks.empty())
     {
-        Cell.VelocityMass = Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+        UpdateSources(Particles, DeltaTime);
     }
 
-    ParticleToGrid(Particles, DeltaTime);
+    bool ResampleDue = Resampler && ++StepsSinceResample >= Resampler->GetParameters().Interval;
 
+    // The resampler expects dense arrays, otherwise only compact once enough holes piled up
+    if (Pool.GetNumHoles() > 0 && (ResampleDue || Pool.ShouldCompact(Particles.size())))
+    {
+        Pool.Compact(Particles, ParticleData);
+        SleepStateDirty = true;
+    }
+
+    if (ResampleDue)
+    {
+        StepsSinceResample = 0;
+        if (Resampler->Resample(Particles, ParticleData))
+        {
+            SleepStateDirty = true;
+        }
+    }
+
+    NumParticles = static_cast<int>(Particles.size());
+    ReserveStress(Particles.size());
+
+    if (SleepStateDirty || DeltaTime != SleepingDeltaTime)
+    {
+        UpdateSleepingParticles(Particles, DeltaTime);
+    }
+
+    if (UsesImplicitUpdate())
+    {
+        // Elastic forces come from the implicit solve instead of the transfer
+        for (uint32_t ParticleIndex : ActiveParticles)
+        {
+            ParticleStress[ParticleIndex] = Math::Matrix4x4();
+        }
+    }
+    else if (!UsesMultiRate() && !UsesBlockScheduling())
+    {
+        // Multi-rate and block scheduled steps compute the stresses of their particles themselves
+        ComputeStresses(Particles, ActiveParticles);
+    }
+}
+
+void MPMSolver::ScatterToGrid(const std::vector<ParticleRenderData>& Particles, std::span<GridCell> TargetGrid, float DeltaTime)
+{
+    ScatterToGrid(Particles, TargetGrid.data(), 0, GridResolution, DeltaTime);
+}
+
+void MPMSolver::ScatterToGrid(const std::vector<ParticleRenderData>& Particles, GridCell* TargetGrid, int OriginX, int NumColumns, float DeltaTime)
+{
+    // Add the cached contribution of the sleeping particles
+    if (!SleepingParticles.empty())
+    {
+        const GridCell* Sleeping = &SleepingGrid[OriginX * GridResolution];
+        for (int i = 0; i < NumColumns * GridResolution; i++)
+        {
+            TargetGrid[i].VelocityMass.w += Sleeping[i].VelocityMass.w;
+            TargetGrid[i].VelocityMass += Sleeping[i].VelocityMass;
+        }
+    }
+
+    ParticleToGrid(Particles, ActiveParticles, TargetGrid, OriginX, 0, GridResolution, DeltaTime);
+}
+
+void MPMSolver::UpdateGrid(std::span<GridCell> TargetGrid, float DeltaTime) const
+{
     // Grid Velocity update
     Math::Vec4 Gravity = Math::Vec4(0.0f, -9.8f * DeltaTime, 0.0f, 0.0f);
-    int i = 0;
-    for (GridCell& Cell : Grid)
+    for (int i = 0; i < GridResolution * GridResolution; i++)
+    {
+        UpdateGridCell(TargetGrid[i], i / GridResolution, i % GridResolution, Gravity);
+    }
+    // Nodes past the far walls are a wall at rest
+    const size_t NumCells = GridResolution * GridResolution;
+    std::fill(TargetGrid.begin() + NumCells, TargetGrid.begin() + std::min(TargetGrid.size(), NumCells + CPU_GRID_PADDING(GridResolution)), GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+}
+
+void MPMSolver::UpdateGridCell(GridCell& Cell, int X, int Y, const Math::Vec4& Gravity) const
+{
+    // Only sleeping particles can reach these cells, and they never gather from the grid
+    if (Activity->IsCellDormant(X, Y))
+    {
+        return;
+    }
+
+    if (Cell.VelocityMass.w > 0.00001)
+    {
+        Cell.VelocityMass.x /= Cell.VelocityMass.w;
+        Cell.VelocityMass.y /= Cell.VelocityMass.w;
+        Cell.VelocityMass.z /= Cell.VelocityMass.w;
+
+        // Apply Gravity
+        Cell.VelocityMass += Gravity;
+
+        // Apply Boundary Conditions
+        if (X < 2 || X > GridResolution - 3)
+        {
+            Cell.VelocityMass.x = 0.0f;
+        }
+
+        if (Y < 2 || Y > GridResolution - 3)
+        {
+            Cell.VelocityMass.y = 0.0f;
+        }
+    }
+}
+
+void MPMSolver::GatherFromGrid(std::vector<ParticleRenderData>& Particles, std::span<const GridCell> SourceGrid, float DeltaTime)
+{
+    GridToParticle(Particles, ActiveParticles, SourceGrid, DeltaTime);
+}
+
+void MPMSolver::GatherFromGrid(std::vector<ParticleRenderData>& Particles, const GridCell* SourceGrid, int OriginX, float DeltaTime)
+{
+    for (uint32_t ParticleIndex : ActiveParticles)
     {
-        if (Cell.VelocityMass.w > 0.00001)
+        GatherParticle(Particles[ParticleIndex], ParticleData[ParticleIndex], SourceGrid, OriginX);
+        AdvanceParticle(Particles[ParticleIndex], ParticleData[ParticleIndex], DeltaTime);
+        RecordActivity(Particles[ParticleIndex], ParticleData[ParticleIndex]);
+    }
+}
+
+void MPMSolver::ShareActivityTracker(ActivityTracker* Tracker)
+{
+    Activity = Tracker ? Tracker : &OwnActivity;
+    OnSharedGrid = Tracker != nullptr;
+    SleepStateDirty = true;
+}
+
+void MPMSolver::MarkSleepStateDirty()
+{
+    SleepStateDirty = true;
+}
+
+int MPMSolver::GetGridResolution() const
+{
+    return GridResolution;
+}
+
+float MPMSolver::GetGridSize() const
+{
+    return Size;
+}
+
+void MPMSolver::UpdateSleepingParticles(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    ActiveParticles.clear();
+    SleepingParticles.clear();
+    for (uint32_t Index = 0; Index < uint32_t(NumParticles); Index++)
+    {
+        if (!ParticlePool::IsAlive(Particles[Index]))
         {
-            Cell.VelocityMass.x /= Cell.VelocityMass.w;
-            Cell.VelocityMass.y /= Cell.VelocityMass.w;
-            Cell.VelocityMass.z /= Cell.VelocityMass.w;
+            continue;
+        }
+        if (Activity->IsAsleep(Activity->GetBlockIndex(Particles[Index].Position)))
+        {
+            // Sleeping particles are frozen in place
+            Particles[Index].Velocity = Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+            ParticleData[Index].C = Math::Matrix4x4();
+            SleepingParticles.push_back(Index);
+        }
+        else
+        {
+            ActiveParticles.push_back(Index);
+        }
+    }
+
+    // Their grid contribution (mass and elastic stress) is constant while asleep, so scatter it once
+    // GridCell's Vec4 defaults to w = 1, which would read as mass in every cell
+    SleepingGrid.assign(GridResolution * GridResolution + CPU_GRID_PADDING(GridResolution), {Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+    ComputeStresses(Particles, SleepingParticles);
+    ParticleToGrid(Particles, SleepingParticles, SleepingGrid, DeltaTime);
+
+    SleepingDeltaTime = DeltaTime;
+    SleepStateDirty = false;
+}
+
+void MPMSolver::DisturbRegion(const Math::Vec4& Min, const Math::Vec4& Max)
+{
+    Activity->Disturb(Min, Max);
+    SleepStateDirty = true;
+}
 
-            // Apply Gravity
-            Cell.VelocityMass += Gravity;
+void MPMSolver::ReserveParticles(uint32_t Capacity, std::vector<ParticleRenderData>& Particles)
+{
+    Pool.SetCapacity(Capacity, Particles, ParticleData);
+    ReserveStress(Pool.GetCapacity());
+}
 
-            // Apply Boundary Conditions
-            int X = i / GridResolution;
-            int Y = i % GridResolution;
+void MPMSolver::AddEmitter(const ParticleEmitter& Emitter)
+{
+    Emitters.push_back({Emitter});
+}
 
-            if (X < 2 || X > GridResolution - 3)
+void MPMSolver::AddSink(const ParticleSink& Sink)
+{
+    Sinks.push_back(Sink);
+}
+
+bool MPMSolver::InsertParticle(std::vector<ParticleRenderData>& Particles, const ParticleRenderData& Particle, const ParticlePhysicsData& PhysicsData)
+{
+    uint32_t Index = Pool.Allocate(Particles, ParticleData);
+    if (Index == UINT32_MAX)
+    {
+        return false;
+    }
+    Particles[Index] = Particle;
+    ParticleData[Index] = PhysicsData;
+    SleepStateDirty = true;
+    return true;
+}
+
+void MPMSolver::RemoveParticle(uint32_t Index, std::vector<ParticleRenderData>& Particles)
+{
+    Pool.Free(Index, Particles);
+    SleepStateDirty = true;
+}
+
+const ParticlePhysicsData& MPMSolver::GetParticleData(uint32_t Index) const
+{
+    return ParticleData[Index];
+}
+
+void MPMSolver::UpdateSources(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    // Drain particles inside any sink
+    uint32_t NumRemoved = 0;
+    if (!Sinks.empty())
+    {
+        for (uint32_t Index = 0; Index < uint32_t(Particles.size()); Index++)
+        {
+            const Math::Vec4& Position = Particles[Index].Position;
+            if (!ParticlePool::IsAlive(Particles[Index]))
+            {
+                continue;
+            }
+            for (const ParticleSink& Sink : Sinks)
+            {
+                if (Position.x >= Sink.Min.x && Position.y >= Sink.Min.y && Position.z >= Sink.Min.z && Position.x <= Sink.Max.x && Position.y <= Sink.Max.y && Position.z <= Sink.Max.z)
+                {
+                    Pool.Free(Index, Particles);
+                    NumRemoved++;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (NumRemoved > 0 && !SleepStateDirty)
+    {
+        size_t NumErased = std::erase_if(ActiveParticles, [&Particles](uint32_t Index)
+                                         { return !ParticlePool::IsAlive(Particles[Index]); });
+        // Draining a sleeping particle changes the cached sleeping grid
+        if (NumErased < NumRemoved)
+        {
+            SleepStateDirty = true;
+        }
+    }
+
+    // Spawn new particles from the emitters, reusing the holes left by the sinks first
+    for (EmitterState& Emitter : Emitters)
+    {
+        Emitter.Pending += Emitter.Desc.Rate * DeltaTime;
+        if (Emitter.Pending < 1.0f)
+        {
+            continue;
+        }
+
+        const ParticleEmitter& Desc = Emitter.Desc;
+        Math::Vec4 Extent = Math::Vec4(Desc.Radius + DX, Desc.Radius + DX, Desc.Radius + DX, 0.0f);
+        Activity->Disturb(Desc.Position - Extent, Desc.Position + Extent);
+
+        for (; Emitter.Pending >= 1.0f; Emitter.Pending -= 1.0f)
+        {
+            uint32_t Index = Pool.Allocate(Particles, ParticleData);
+            if (Index == UINT32_MAX)
             {
-                Cell.VelocityMass.x = 0.0f;
+                // Pool is full, drop the backlog rather than bursting once space frees up
+                Emitter.Pending = 0.0f;
+                break;
             }
 
-            if (Y < 2 || Y > GridResolution - 3)
+            // Uniform point on the disc
+            float Angle = 6.28318530718f * (static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX));
+            float Distance = Desc.Radius * std::sqrt(static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX));
+            Math::Vec4 Position = Math::Vec4(Desc.Position.x + Distance * std::cos(Angle), Desc.Position.y + Distance * std::sin(Angle), Desc.Position.z);
+            Position.x = std::min(std::max(Position.x, DX), Size - (DX));
+            Position.y = std::min(std::max(Position.y, DX), Size - (DX));
+
+            Particles[Index] = {Position, Math::Vec4(Desc.Velocity.x, Desc.Velocity.y, Desc.Velocity.z, 0.0f)};
+            ParticleData[Index] = ParticlePhysicsData();
+            if (!SleepStateDirty)
             {
-                Cell.VelocityMass.y = 0.0f;
+                ActiveParticles.push_back(Index);
             }
         }
-        i++;
     }
+}
+
+void MPMSolver::EnableMultiRate(const MultiRateParameters& Params)
+{
+    MultiRate = std::make_unique<LocalTimeStepper>((GridResolution + SLEEP_BLOCK_SIZE - 1) / SLEEP_BLOCK_SIZE, DX, Params);
+    ParticleLevels.clear();
+}
 
-    GridToParticle(Particles, DeltaTime);
+bool MPMSolver::UsesMultiRate() const
+{
+    return MultiRate && !OnSharedGrid && !UsesImplicitUpdate() && !Adaptive;
 }
 
-void MPMSolver::ParticleToGrid(const std::vector<ParticleRenderData>& Particles, float DeltaTime)
+void MPMSolver::MultiRateStep(std::vector<ParticleRenderData>& Particles, float DeltaTime)
 {
-    // Particle to Grid
-    Math::Vec2<float> Weights[3];
-    int ParticleIndex = 0;
-    for (const ParticleRenderData& Particle : Particles)
+    // New particles start at the finest level, which every step boundary is aligned with
+    ParticleLevels.resize(Particles.size(), 0);
+    const int BlocksPerAxis = (GridResolution + SLEEP_BLOCK_SIZE - 1) / SLEEP_BLOCK_SIZE;
+    const int NumCells = GridResolution * GridResolution + CPU_GRID_PADDING(GridResolution);
+    AllocateGrid(NumCells);
+
+    // Coarse levels first, so the finer passes see their neighbours' end of step positions
+    for (int Level = static_cast<int>(MultiRate->GetMaxLevel()); Level >= 0; Level--)
     {
+        if (!MultiRate->IsDue(Level))
+        {
+            continue;
+        }
+        LevelParticles.clear();
+        for (uint32_t ParticleIndex : ActiveParticles)
+        {
+            if (ParticleLevels[ParticleIndex] == Level)
+            {
+                LevelParticles.push_back(ParticleIndex);
+            }
+        }
+        if (LevelParticles.empty())
+        {
+            continue;
+        }
 
-        Math::Matrix4x4 Affine = NeoHookeanStress(Particle, ParticleData[ParticleIndex]) * DeltaTime + (ParticleData[ParticleIndex].C * ParticleData[ParticleIndex].Mass);
-        Math::Vec2<int32_t> CellIndex = Math::Vec2<int32_t>(Particle.Position.x * InvDx - 0.5f, Particle.Position.y * InvDx - 0.5f);
-        Math::Vec2 CellDifference = Math::Vec2(Particle.Position.x * InvDx - CellIndex.x, Particle.Position.y * InvDx - CellIndex.y);
+        // Particles of other levels in the surrounding blocks act as a moving boundary for this pass
+        PassBlocks.assign(BlocksPerAxis * BlocksPerAxis, 0);
+        for (uint32_t ParticleIndex : LevelParticles)
+        {
+            int Block = Activity->GetBlockIndex(Particles[ParticleIndex].Position);
+            int BlockX = Block / BlocksPerAxis, BlockY = Block % BlocksPerAxis;
+            for (int X = std::max(BlockX - 1, 0); X <= std::min(BlockX + 1, BlocksPerAxis - 1); X++)
+            {
+                for (int Y = std::max(BlockY - 1, 0); Y <= std::min(BlockY + 1, BlocksPerAxis - 1); Y++)
+                {
+                    PassBlocks[X * BlocksPerAxis + Y] = 1;
+                }
+            }
+        }
+        HaloParticles.clear();
+        for (uint32_t ParticleIndex : ActiveParticles)
+        {
+            if (ParticleLevels[ParticleIndex] != Level && PassBlocks[Activity->GetBlockIndex(Particles[ParticleIndex].Position)])
+            {
+                HaloParticles.push_back(ParticleIndex);
+            }
+        }
 
-        // Precalculate quadratic weight coefficients
-        Weights[0] = Math::Vec2(1.5f - CellDifference.x, 1.5f - CellDifference.y).Pow(2) * 0.5f;
-        Weights[1] = Math::Vec2(0.75f, 0.75f) - Math::Vec2(CellDifference.x - 1.0f, CellDifference.y - 1.0f).Pow(2);
-        Weights[2] = Math::Vec2(CellDifference.x - 0.5f, CellDifference.y - 0.5f).Pow(2) * 0.5f;
+        float LevelDeltaTime = DeltaTime * float(1u << Level);
+        ComputeStresses(Particles, LevelParticles);
+        ComputeStresses(Particles, HaloParticles);
 
-        for (int x = 0; x < 3; x++)
+        std::fill(Grid.begin(), Grid.begin() + NumCells, GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+        if (!SleepingParticles.empty())
         {
-            for (int y = 0; y < 3; y++)
+            // Sleeping particles are at rest, so their cached momentum is only the stress impulse and scales with the step
+            float Scale = LevelDeltaTime / SleepingDeltaTime;
+            for (int i = 0; i < GridResolution * GridResolution; i++)
             {
-                float Weight = Weights[x].x * Weights[y].y;
+                Grid[i].VelocityMass.w += SleepingGrid[i].VelocityMass.w;
+                Grid[i].VelocityMass += SleepingGrid[i].VelocityMass * Scale;
+            }
+        }
+        ParticleToGrid(Particles, LevelParticles, Grid, LevelDeltaTime);
+        ParticleToGrid(Particles, HaloParticles, Grid, LevelDeltaTime);
+        UpdateGrid(Grid, LevelDeltaTime);
+        GridToParticle(Particles, LevelParticles, Grid, LevelDeltaTime);
 
-                Math::Vec4 CellDistance = Math::Vec4(x - CellDifference.x, y - CellDifference.y, 0.0f, 0.0f) * DX;
+        for (uint32_t ParticleIndex : LevelParticles)
+        {
+            // Marks the particle as stepped for the activity pass below
+            ParticleLevels[ParticleIndex] = static_cast<uint8_t>(MultiRate->GetNextLevel(Activity->GetBlockIndex(Particles[ParticleIndex].Position))) | 0x80;
+        }
+    }
 
-                Math::Vec4 AffineByDistance = Affine * CellDistance;
+    for (uint32_t ParticleIndex : ActiveParticles)
+    {
+        const ParticleRenderData& Particle = Particles[ParticleIndex];
+        MultiRate->RecordSpeed(Activity->GetBlockIndex(Particle.Position), Particle.Velocity.Dot(Particle.Velocity));
+        if (ParticleLevels[ParticleIndex] & 0x80)
+        {
+            ParticleLevels[ParticleIndex] &= 0x7f;
+            continue;
+        }
+        // Particles between steps still count towards their block's activity
+        RecordActivity(Particle, ParticleData[ParticleIndex]);
+    }
+    MultiRate->EndStep(DeltaTime);
+}
 
-                Math::Vec4 Momentum = Particle.Velocity * ParticleData[ParticleIndex].Mass;
-                Momentum.w = 0.0f;
+void MPMSolver::EnableAdaptiveGrid(const AdaptiveGridParameters& Params)
+{
+    Adaptive = std::make_unique<AdaptiveGrid>(GridResolution, Size, Params);
+}
 
-                int Index = (CellIndex.x + x) * GridResolution + CellIndex.y + y;
+bool MPMSolver::UsesAdaptiveGrid() const
+{
+    return Adaptive && !OnSharedGrid && !UsesImplicitUpdate();
+}
+
+void MPMSolver::AdaptiveStep(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    // Sleeping particles keep the stresses from when they fell asleep. Their cached grid is the uniform one, so they
+    // are scattered again but never gathered
+    AdaptiveParticles = ActiveParticles;
+    AdaptiveParticles.insert(AdaptiveParticles.end(), SleepingParticles.begin(), SleepingParticles.end());
+    Adaptive->Build(Particles, AdaptiveParticles);
+
+    // ParticleStress holds -V0 * 4 / Dx^2 * P * F^T for the uniform grid's quadratic weights, the adaptive grid
+    // applies -V0 * P * F^T through the weight gradients instead
+    const float StressScale = 0.25f * DX * DX * DeltaTime;
+    AdaptiveStencil Stencil;
+    for (uint32_t ParticleIndex : AdaptiveParticles)
+    {
+        const ParticleRenderData& Particle = Particles[ParticleIndex];
+        const ParticlePhysicsData& PhysicsData = ParticleData[ParticleIndex];
+        Math::Matrix4x4 Stress = ParticleStress[ParticleIndex] * StressScale;
+        Math::Matrix4x4 Affine = Math::Matrix4x4(PhysicsData.C) * PhysicsData.Mass;
+        Math::Vec3 Momentum = Particle.Velocity.XYZ() * PhysicsData.Mass;
+
+        Adaptive->GetStencil(Particle.Position, Stencil);
+        for (uint32_t Entry = 0; Entry < Stencil.Count; Entry++)
+        {
+            Math::Vec3 NodeDistance = (Adaptive->GetNodePosition(Stencil.Nodes[Entry]) - Particle.Position).XYZ();
+            float Weight = Stencil.Weights[Entry];
+
+            Math::Vec4& Node = Adaptive->GetNode(Stencil.Nodes[Entry]);
+            Node.w += PhysicsData.Mass * Weight;
+            Node += (Momentum + Affine.TransformVector(NodeDistance)) * Weight;
+            Adaptive->GetNodeImpulse(Stencil.Nodes[Entry]) += Stress * Stencil.Gradients[Entry];
+        }
+    }
+
+    Adaptive->UpdateNodes(DeltaTime);
+
+    for (uint32_t ParticleIndex : ActiveParticles)
+    {
+        ParticleRenderData& Particle = Particles[ParticleIndex];
+        Particle.Velocity = Math::Vec4();
+
+        // The velocity gradient comes straight from the weight gradients, in the layout GridToParticle gives C
+        Math::Matrix4x4 C;
+        Adaptive->GetStencil(Particle.Position, Stencil);
+        for (uint32_t Entry = 0; Entry < Stencil.Count; Entry++)
+        {
+            const Math::Vec4& Node = Adaptive->GetNode(Stencil.Nodes[Entry]);
+            Math::Vec4 NodeVelocity(Node.x, Node.y, Node.z, 0.0f);
+            Particle.Velocity += NodeVelocity * Stencil.Weights[Entry];
+            C += Stencil.Gradients[Entry].OuterProduct(NodeVelocity);
+        }
+        ParticleData[ParticleIndex].C = C;
+
+        AdvanceParticle(Particle, ParticleData[ParticleIndex], DeltaTime);
+        RecordActivity(Particle, ParticleData[ParticleIndex]);
+    }
+}
+
+bool MPMSolver::UsesBlockScheduling() const
+{
+    return ThreadPool::GetAvailableThreads() > 1 && !OnSharedGrid && !UsesImplicitUpdate() && !UsesMultiRate() && !UsesAdaptiveGrid();
+}
+
+void MPMSolver::BuildBlockGraph()
+{
+    ScheduleBlocksPerAxis = (GridResolution + SCHEDULE_BLOCK_SIZE - 1) / SCHEDULE_BLOCK_SIZE;
+    const int NumBlocks = ScheduleBlocksPerAxis * ScheduleBlocksPerAxis;
 
-                GridCell& Cell = Grid[Index];
-                Cell.VelocityMass.w += ParticleData[ParticleIndex].Mass * Weight;
-                Cell.VelocityMass += (Momentum + AffineByDistance) * Weight;
+    // A column of blocks is one strip of the grid's memory, so give every node a run of whole columns
+    const uint32_t NumNodes = ThreadPool::GetInstance()->GetNumNodes();
+    const int TileCells = SCHEDULE_TILE_SIZE * SCHEDULE_TILE_SIZE;
+    BlockTiles.Reset(NumBlocks * TileCells);
+    BlockGrid.Reset(GridResolution * GridResolution + CPU_GRID_PADDING(GridResolution));
+    for (int BlockX = 0; BlockX < ScheduleBlocksPerAxis; BlockX++)
+    {
+        uint32_t Node = BlockX * NumNodes / ScheduleBlocksPerAxis;
+        int FirstRow = BlockX * SCHEDULE_BLOCK_SIZE;
+        BlockTiles.Place(BlockX * ScheduleBlocksPerAxis * TileCells, ScheduleBlocksPerAxis * TileCells, Node);
+        BlockGrid.Place(FirstRow * GridResolution, std::min(SCHEDULE_BLOCK_SIZE, GridResolution - FirstRow) * GridResolution, Node);
+    }
+    // No block updates the padding, it stays the zeroed wall at rest G2P reads past the last column
+    BlockGrid.Place(GridResolution * GridResolution, CPU_GRID_PADDING(GridResolution), NumNodes - 1);
+
+    // Tasks [0, NumBlocks) are the P2Gs, then the grid updates, then the G2Ps
+    for (int Task = 0; Task < 3 * NumBlocks; Task++)
+    {
+        BlockGraph.AddTask();
+        BlockGraph.SetTaskNode(Task, (Task % NumBlocks) / ScheduleBlocksPerAxis * NumNodes / ScheduleBlocksPerAxis);
+    }
+    for (int BlockX = 0; BlockX < ScheduleBlocksPerAxis; BlockX++)
+    {
+        for (int BlockY = 0; BlockY < ScheduleBlocksPerAxis; BlockY++)
+        {
+            int Block = BlockX * ScheduleBlocksPerAxis + BlockY;
+            for (int Offset = 0; Offset < 4; Offset++)
+            {
+                // The 3x3 stencils of a block's particles reach two cells into the blocks above, so a block's cells
+                // receive from itself and the blocks below and gather into itself and the blocks above
+                int BelowX = BlockX - (Offset >> 1), BelowY = BlockY - (Offset & 1);
+                if (BelowX >= 0 && BelowY >= 0)
+                {
+                    BlockGraph.AddDependency(BelowX * ScheduleBlocksPerAxis + BelowY, NumBlocks + Block);
+                }
+                int AboveX = BlockX + (Offset >> 1), AboveY = BlockY + (Offset & 1);
+                if (AboveX < ScheduleBlocksPerAxis && AboveY < ScheduleBlocksPerAxis)
+                {
+                    BlockGraph.AddDependency(NumBlocks + AboveX * ScheduleBlocksPerAxis + AboveY, 2 * NumBlocks + Block);
+                }
             }
         }
-        ParticleIndex++;
     }
 }
 
-void MPMSolver::GridToParticle(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+void MPMSolver::BlockScheduledStep(std::vector<ParticleRenderData>& Particles, float DeltaTime)
 {
-    // Grid to Particle
-    Math::Vec2<float> Weights[3];
-    int ParticleIndex = 0;
-    for (ParticleRenderData& Particle : Particles)
+    if (BlockGraph.GetNumTasks() == 0)
     {
-        Particle.Velocity = Math::Vec4();
+        BuildBlockGraph();
+    }
+    const int NumBlocks = ScheduleBlocksPerAxis * ScheduleBlocksPerAxis;
 
-        Math::Vec2<int32_t> CellIndex = Math::Vec2<int32_t>(Particle.Position.x * InvDx - 0.5f, Particle.Position.y * InvDx - 0.5f);
-        Math::Vec2 CellDifference = Math::Vec2(Particle.Position.x * InvDx - CellIndex.x, Particle.Position.y * InvDx - CellIndex.y);
+    // Bin by the first cell of the particle's stencil, which is what P2G and G2P index from. A counting sort into
+    // scratch memory keeps every block's particles in their order in ActiveParticles
+    const size_t NumActive = ActiveParticles.size();
+    StepArena.Reset();
+    BlockStart = StepArena.Allocate<uint32_t>(NumBlocks + 1);
+    BlockOrder = StepArena.Allocate<uint32_t>(NumActive);
+    uint32_t* ParticleBlocks = StepArena.Allocate<uint32_t>(NumActive);
+    uint32_t* BlockCursor = StepArena.Allocate<uint32_t>(NumBlocks);
+    std::fill(BlockStart, BlockStart + NumBlocks + 1, 0u);
+    for (size_t Active = 0; Active < NumActive; Active++)
+    {
+        const Math::Vec4& Position = Particles[ActiveParticles[Active]].Position;
+        int CellX = std::clamp(static_cast<int>(Position.x * InvDx - 0.5f), 0, GridResolution - 1);
+        int CellY = std::clamp(static_cast<int>(Position.y * InvDx - 0.5f), 0, GridResolution - 1);
+        ParticleBlocks[Active] = (CellX / SCHEDULE_BLOCK_SIZE) * ScheduleBlocksPerAxis + CellY / SCHEDULE_BLOCK_SIZE;
+        BlockStart[ParticleBlocks[Active] + 1]++;
+    }
+    for (int Block = 0; Block < NumBlocks; Block++)
+    {
+        BlockStart[Block + 1] += BlockStart[Block];
+        BlockCursor[Block] = BlockStart[Block];
+    }
+    for (size_t Active = 0; Active < NumActive; Active++)
+    {
+        BlockOrder[BlockCursor[ParticleBlocks[Active]]++] = ActiveParticles[Active];
+    }
 
-        // Precalculate quadratic weight coefficients
-        Weights[0] = Math::Vec2(1.5f - CellDifference.x, 1.5f - CellDifference.y).Pow(2) * 0.5f;
-        Weights[1] = Math::Vec2(0.75f, 0.75f) - Math::Vec2(CellDifference.x - 1.0f, CellDifference.y - 1.0f).Pow(2);
-        Weights[2] = Math::Vec2(CellDifference.x - 0.5f, CellDifference.y - 0.5f).Pow(2) * 0.5f;
-        Math::Matrix4x4 B;
-        for (int x = 0; x < 3; x++)
+    BlockGraph.Execute([&](uint32_t Task) {
+        int Block = Task % NumBlocks;
+        int Phase = Task / NumBlocks;
+        std::span<const uint32_t> Indices(BlockOrder + BlockStart[Block], BlockOrder + BlockStart[Block + 1]);
+        if (Phase == 0)
         {
-            for (int y = 0; y < 3; y++)
+            GridCell* Tile = BlockTiles.data() + Block * SCHEDULE_TILE_SIZE * SCHEDULE_TILE_SIZE;
+            std::fill(Tile, Tile + SCHEDULE_TILE_SIZE * SCHEDULE_TILE_SIZE, GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+            ComputeStresses(Particles, Indices);
+            int OriginX = (Block / ScheduleBlocksPerAxis) * SCHEDULE_BLOCK_SIZE;
+            int OriginY = (Block % ScheduleBlocksPerAxis) * SCHEDULE_BLOCK_SIZE;
+            ParticleToGrid(Particles, Indices, Tile, OriginX, OriginY, SCHEDULE_TILE_SIZE, DeltaTime);
+        }
+        else if (Phase == 1)
+        {
+            UpdateBlockGrid(Block, DeltaTime);
+        }
+        else
+        {
+            for (uint32_t ParticleIndex : Indices)
             {
-                float Weight = Weights[x].x * Weights[y].y;
-
-                Math::Vec2<int32_t> CurrentCell = Math::Vec2<int32_t>(x, y);
-                Math::Vec4 CellDistance = Math::Vec4(x - CellDifference.x, y - CellDifference.y, 0.0f, 0.0f) * DX;
+                GatherParticle(Particles[ParticleIndex], ParticleData[ParticleIndex], BlockGrid.data(), 0);
+                AdvanceParticle(Particles[ParticleIndex], ParticleData[ParticleIndex], DeltaTime);
+            }
+        }
+    });
 
-                int Index = (CellIndex.x + x) * GridResolution + CellIndex.y + y;
-                GridCell& Cell = Grid[Index];
-                Math::Vec4 WeightedVelocity(Cell.VelocityMass.x * Weight, Cell.VelocityMass.y * Weight, Cell.VelocityMass.z * Weight, 0.0f);
+    for (uint32_t ParticleIndex : ActiveParticles)
+    {
+        RecordActivity(Particles[ParticleIndex], ParticleData[ParticleIndex]);
+    }
+}
 
-                B += WeightedVelocity.OuterProduct(CellDistance) * InvDx;
+void MPMSolver::UpdateBlockGrid(int Block, float DeltaTime)
+{
+    Math::Vec4 Gravity = Math::Vec4(0.0f, -9.8f * DeltaTime, 0.0f, 0.0f);
+    int BlockX = Block / ScheduleBlocksPerAxis;
+    int BlockY = Block % ScheduleBlocksPerAxis;
+    int EndX = std::min((BlockX + 1) * SCHEDULE_BLOCK_SIZE, GridResolution);
+    int EndY = std::min((BlockY + 1) * SCHEDULE_BLOCK_SIZE, GridResolution);
+    for (int X = BlockX * SCHEDULE_BLOCK_SIZE; X < EndX; X++)
+    {
+        for (int Y = BlockY * SCHEDULE_BLOCK_SIZE; Y < EndY; Y++)
+        {
+            GridCell& Cell = BlockGrid[X * GridResolution + Y];
+            Cell.VelocityMass = SleepingParticles.empty() ? Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f) : SleepingGrid[X * GridResolution + Y].VelocityMass;
 
-                Particle.Velocity += WeightedVelocity;
+            // Sum the tiles of this block and the blocks below that reach the cell
+            for (int SourceX = std::max(BlockX - 1, 0); SourceX <= BlockX; SourceX++)
+            {
+                for (int SourceY = std::max(BlockY - 1, 0); SourceY <= BlockY; SourceY++)
+                {
+                    int TileX = X - SourceX * SCHEDULE_BLOCK_SIZE;
+                    int TileY = Y - SourceY * SCHEDULE_BLOCK_SIZE;
+                    if (TileX >= SCHEDULE_TILE_SIZE || TileY >= SCHEDULE_TILE_SIZE)
+                    {
+                        continue;
+                    }
+                    const GridCell& Source = BlockTiles[(SourceX * ScheduleBlocksPerAxis + SourceY) * SCHEDULE_TILE_SIZE * SCHEDULE_TILE_SIZE + TileX * SCHEDULE_TILE_SIZE + TileY];
+                    Cell.VelocityMass.w += Source.VelocityMass.w;
+                    Cell.VelocityMass += Source.VelocityMass;
+                }
             }
+            UpdateGridCell(Cell, X, Y, Gravity);
+        }
+    }
+}
+
+void MPMSolver::AllocateGrid(size_t NumCells)
+{
+    if (Grid.size() < NumCells)
+    {
+        Grid.resize(NumCells, GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+    }
+}
+
+void MPMSolver::ReserveStress(size_t Count)
+{
+    if (Count <= StressCapacity)
+    {
+        return;
+    }
+    // Double so a growing particle count leaves at most as much behind in the arena as it uses
+    size_t NewCapacity = std::max(Count, StressCapacity * 2);
+    Math::Matrix4x4* NewStress = RunArena.Allocate<Math::Matrix4x4>(NewCapacity);
+    std::uninitialized_copy(ParticleStress, ParticleStress + StressCapacity, NewStress);
+    std::uninitialized_fill(NewStress + StressCapacity, NewStress + NewCapacity, Math::Matrix4x4());
+    ParticleStress = NewStress;
+    StressCapacity = NewCapacity;
+}
+
+void MPMSolver::EnableImplicit(const ImplicitParameters& Params)
+{
+    Implicit = std::make_unique<ImplicitGridSolver>(GridResolution, DX, FluidValues.ElasticMu, FluidValues.ElasticLamda, Params);
+}
+
+bool MPMSolver::UsesImplicitUpdate() const
+{
+    // The shared grid steps its bodies one phase at a time and has no joint implicit solve
+    return Implicit && Material == JellyMaterial && !OnSharedGrid;
+}
+
+void MPMSolver::EnableResampling(const ResamplingParameters& Params)
+{
+    Resampler = std::make_unique<ParticleResampler>(GridResolution, DX, ParticlePhysicsData().Mass, Params);
+    StepsSinceResample = 0;
+}
+
+void MPMSolver::ComputeStresses(const std::vector<ParticleRenderData>& Particles, std::span<const uint32_t> Indices)
+{
+    int NumIndices = static_cast<int>(Indices.size());
+    if (Material == JellyMaterial)
+    {
+        for (uint32_t ParticleIndex : Indices)
+        {
+            ParticleStress[ParticleIndex] = NeoHookeanStress(Particles[ParticleIndex], ParticleData[ParticleIndex]);
         }
-        ParticleData[ParticleIndex].C = B * 4;
+        return;
+    }
 
-        Particle.Position += Particle.Velocity * DeltaTime;
+    // Plastic materials need an SVD of every deformation gradient, so process them SVD_BATCH_SIZE at a time
+    ParticlePhysicsData* Batch[SVD_BATCH_SIZE];
+    Math::Matrix4x4 Stresses[SVD_BATCH_SIZE];
+    for (int First = 0; First < NumIndices; First += SVD_BATCH_SIZE)
+    {
+        int Count = std::min(SVD_BATCH_SIZE, NumIndices - First);
+        for (int Lane = 0; Lane < Count; Lane++)
+        {
+            Batch[Lane] = &ParticleData[Indices[First + Lane]];
+        }
+        ReturnMapBatch(Batch, Count, Stresses);
+        for (int Lane = 0; Lane < Count; Lane++)
+        {
+            ParticleStress[Indices[First + Lane]] = Stresses[Lane];
+        }
+    }
+}
 
-        Particle.Position.x = std::min(std::max(Particle.Position.x, DX), Size - (DX));
-        Particle.Position.y = std::min(std::max(Particle.Position.y, DX), Size - (DX));
+void MPMSolver::ReturnMapBatch(ParticlePhysicsData* const* Batch, int Count, Math::Matrix4x4* Stresses) const
+{
+    Math::Matrix3x3Batch DeformBatch, StressBatch;
+    alignas(32) float PlasticJBatch[SVD_BATCH_SIZE];
+    for (int Lane = 0; Lane < SVD_BATCH_SIZE; Lane++)
+    {
+        if (Lane < Count)
+        {
+            DeformBatch.Load(Lane, Batch[Lane]->DeformGradient);
+            PlasticJBatch[Lane] = Batch[Lane]->PlasticJ;
+        }
+        else
+        {
+            // Pad the tail batch with rest state particles
+            DeformBatch.SetIdentity(Lane);
+            PlasticJBatch[Lane] = 1.0f;
+        }
+    }
+
+    Plasticity::ReturnMap(Material, PlasticParams, FluidValues.ElasticMu, FluidValues.ElasticLamda, DeformBatch, PlasticJBatch, StressBatch);
 
-        ParticleData[ParticleIndex].DeformGradient = (Math::Identity + (ParticleData[ParticleIndex].C * DeltaTime)) * ParticleData[ParticleIndex].DeformGradient;
-        ParticleIndex++;
+    for (int Lane = 0; Lane < Count; Lane++)
+    {
+        ParticlePhysicsData& PhysicsData = *Batch[Lane];
+        Math::Matrix4x4 DeformGradient = DeformBatch.Store(Lane);
+        DeformGradient.m44 = 1.0f;
+        PhysicsData.DeformGradient = DeformGradient;
+        PhysicsData.PlasticJ = PlasticJBatch[Lane];
+        Stresses[Lane] = StressBatch.Store(Lane) * -(PhysicsData.InitialVolume * 4 * InvDx * InvDx);
     }
 }
 
-Math::Matrix4x4 MPMSolver::NeoHookeanStress(const ParticleRenderData& Particle, const ParticlePhysicsData& PhysicsData)
+void MPMSolver::ParticleToGrid(const std::vector<ParticleRenderData>& Particles, const std::vector<uint32_t>& Indices, std::span<GridCell> TargetGrid, float DeltaTime)
+{
+    ParticleToGrid(Particles, Indices, TargetGrid.data(), 0, 0, GridResolution, DeltaTime);
+}
+
+void MPMSolver::ParticleToGrid(const std::vector<ParticleRenderData>& Particles, std::span<const uint32_t> Indices, GridCell* TargetGrid, int OriginX, int OriginY, int Stride, float DeltaTime)
 {
-    float Volume = PhysicsData.DeformGradient.Determinant();
+    for (uint32_t ParticleIndex : Indices)
+    {
+        ScatterParticle(Particles[ParticleIndex], ParticleData[ParticleIndex], ParticleStress[ParticleIndex], TargetGrid, OriginX, OriginY, Stride, DeltaTime);
+    }
+}
+
+void MPMSolver::ScatterParticle(const ParticleRenderData& Particle, const ParticlePhysicsData& PhysicsData, const Math::Matrix4x4& Stress, GridCell* TargetGrid, int OriginX, int OriginY, int Stride, float DeltaTime) const
+{
+    // Particle to Grid, each node through the GPU kernels' ParticleToNode
+    Math::Matrix4x4 Affine = Stress * DeltaTime + (Math::Matrix4x4(PhysicsData.C) * PhysicsData.Mass);
+    const MPMShaders::matrix ShaderAffine = std::bit_cast<MPMShaders::matrix>(Affine);
+    const MPMShaders::float4 Momentum = std::bit_cast<MPMShaders::float4>(Particle.Velocity * PhysicsData.Mass);
+
+    const float Position[2] = {Particle.Position.x * InvDx, Particle.Position.y * InvDx};
+    CPUKernel::ForEachNode(CPUKernel::BuildStencil(Position), [&](const CPUKernel::Node& Node) {
+        MPMShaders::float4 CellDistance(Node.Distance[0] * DX, Node.Distance[1] * DX, 0.0f, 0.0f);
 
-    Math::Matrix4x4 DeformTranspose = PhysicsData.DeformGradient.Transpose();
-    Math::Matrix4x4 DeformTransposeInverse = DeformTranspose.Inverse();
+        const MPMShaders::float4 Contribution = MPMShaders::ParticleToNode(ShaderAffine, Momentum, PhysicsData.Mass, CellDistance, Node.Weight);
 
-    Math::Matrix4x4 P = ((PhysicsData.DeformGradient - DeformTransposeInverse) * FluidValues.ElasticMu) + (DeformTransposeInverse * (FluidValues.ElasticLamda * std::log(Volume)));
+        // Math::Vec4 sums leave w alone, so the mass is added on its own
+        GridCell& Cell = TargetGrid[(Node.Cell[0] - OriginX) * Stride + Node.Cell[1] - OriginY];
+        Cell.VelocityMass += Math::Vec4(Contribution.x, Contribution.y, Contribution.z, 0.0f);
+        Cell.VelocityMass.w += Contribution.w;
+    });
+}
+
+void MPMSolver::ScatterParticles(const ParticleRenderData* Particles, ParticlePhysicsData* PhysicsData, uint32_t Count, GridCell* TargetGrid, float DeltaTime)
+{
+    if (Material == JellyMaterial)
+    {
+        for (uint32_t Index = 0; Index < Count; Index++)
+        {
+            ScatterParticle(Particles[Index], PhysicsData[Index], NeoHookeanStress(Particles[Index], PhysicsData[Index]), TargetGrid, 0, 0, GridResolution, DeltaTime);
+        }
+        return;
+    }
+
+    ParticlePhysicsData* Batch[SVD_BATCH_SIZE];
+    Math::Matrix4x4 Stresses[SVD_BATCH_SIZE];
+    for (uint32_t First = 0; First < Count; First += SVD_BATCH_SIZE)
+    {
+        int BatchCount = static_cast<int>(std::min<uint32_t>(SVD_BATCH_SIZE, Count - First));
+        for (int Lane = 0; Lane < BatchCount; Lane++)
+        {
+            Batch[Lane] = PhysicsData + First + Lane;
+        }
+        ReturnMapBatch(Batch, BatchCount, Stresses);
+        for (int Lane = 0; Lane < BatchCount; Lane++)
+        {
+            ScatterParticle(Particles[First + Lane], PhysicsData[First + Lane], Stresses[Lane], TargetGrid, 0, 0, GridResolution, DeltaTime);
+        }
+    }
+}
+
+void MPMSolver::UpdateGridColumns(GridCell* TargetGrid, int OriginX, int BeginX, int EndX, float DeltaTime) const
+{
+    Math::Vec4 Gravity = Math::Vec4(0.0f, -9.8f * DeltaTime, 0.0f, 0.0f);
+    for (int X = BeginX; X < EndX; X++)
+    {
+        for (int Y = 0; Y < GridResolution; Y++)
+        {
+            UpdateGridCell(TargetGrid[(X - OriginX) * GridResolution + Y], X, Y, Gravity);
+        }
+    }
+}
+
+void MPMSolver::StepParticle(ParticleRenderData& Particle, ParticlePhysicsData& PhysicsData, const GridCell* SourceGrid, float DeltaTime) const
+{
+    GatherParticle(Particle, PhysicsData, SourceGrid, 0);
+    AdvanceParticle(Particle, PhysicsData, DeltaTime);
+}
+
+void MPMSolver::GridToParticle(std::vector<ParticleRenderData>& Particles, const std::vector<uint32_t>& Indices, std::span<const GridCell> SourceGrid, float DeltaTime)
+{
+    for (uint32_t ParticleIndex : Indices)
+    {
+        GatherParticle(Particles[ParticleIndex], ParticleData[ParticleIndex], SourceGrid.data(), 0);
+        AdvanceParticle(Particles[ParticleIndex], ParticleData[ParticleIndex], DeltaTime);
+        RecordActivity(Particles[ParticleIndex], ParticleData[ParticleIndex]);
+    }
+}
+
+void MPMSolver::GatherParticle(ParticleRenderData& Particle, ParticlePhysicsData& PhysicsData, const GridCell* SourceGrid, int OriginX) const
+{
+    // Grid to Particle, each node through the GPU kernels' NodeToParticle
+    MPMShaders::float4 Velocity(0.0f, 0.0f, 0.0f, 0.0f);
+    MPMShaders::matrix B = std::bit_cast<MPMShaders::matrix>(Math::Matrix4x4());
+
+    const float Position[2] = {Particle.Position.x * InvDx, Particle.Position.y * InvDx};
+    CPUKernel::ForEachNode(CPUKernel::BuildStencil(Position), [&](const CPUKernel::Node& Node) {
+        MPMShaders::float4 CellDistance(Node.Distance[0] * DX, Node.Distance[1] * DX, 0.0f, 0.0f);
+
+        const Math::Vec4& CellVelocity = SourceGrid[(Node.Cell[0] - OriginX) * GridResolution + Node.Cell[1]].VelocityMass;
+        MPMShaders::float4 WeightedVelocity(CellVelocity.x * Node.Weight, CellVelocity.y * Node.Weight, CellVelocity.z * Node.Weight, 0.0f);
+        MPMShaders::NodeToParticle(WeightedVelocity, CellDistance, Velocity, B);
+    });
+    Particle.Velocity = std::bit_cast<Math::Vec4>(Velocity);
+    PhysicsData.C = std::bit_cast<Math::Matrix4x4>(B) * (CPUKernel::Spline::InverseInertia * InvDx * InvDx);
+}
+
+void MPMSolver::AdvanceParticle(ParticleRenderData& Particle, ParticlePhysicsData& PhysicsData, float DeltaTime) const
+{
+    Particle.Position += Particle.Velocity * DeltaTime;
+
+    Particle.Position.x = std::min(std::max(Particle.Position.x, DX), Size - (DX));
+    Particle.Position.y = std::min(std::max(Particle.Position.y, DX), Size - (DX));
+
+    PhysicsData.DeformGradient = (Math::Identity + (Math::Matrix4x4(PhysicsData.C) * DeltaTime)) * Math::Matrix4x4(PhysicsData.DeformGradient);
+}
+
+void MPMSolver::RecordActivity(const ParticleRenderData& Particle, const ParticlePhysicsData& PhysicsData)
+{
+    // Feed the sleep tracker with this particle's speed and strain rate
+    Math::Matrix4x4 C = PhysicsData.C;
+    float StrainRateSq = 0.0f;
+    for (int Element = 0; Element < 16; Element++)
+    {
+        StrainRateSq += C.m[Element] * C.m[Element];
+    }
+    Activity->RecordParticle(Activity->GetBlockIndex(Particle.Position), Particle.Velocity.Dot(Particle.Velocity), StrainRateSq);
+}
+
+Math::Matrix4x4 MPMSolver::NeoHookeanStress(const ParticleRenderData& Particle, const ParticlePhysicsData& PhysicsData)
+{
+    // The solver is 2D, F is the identity out of the plane
+    Math::Matrix4x4 DeformGradient = PhysicsData.DeformGradient;
+    CPUKernel::Matrix F = {{{DeformGradient.m11, DeformGradient.m12}, {DeformGradient.m21, DeformGradient.m22}}};
+    CPUKernel::Matrix Tau = CPUKernel::NeoHookeanKirchhoff(F, FluidValues.ElasticMu, FluidValues.ElasticLamda);
 
-    return (P * DeformTranspose) * -(PhysicsData.InitialVolume * 4 * InvDx * InvDx);
+    Math::Matrix4x4 Stress;
+    Stress.m11 = Tau.M[0][0];
+    Stress.m12 = Tau.M[0][1];
+    Stress.m21 = Tau.M[1][0];
+    Stress.m22 = Tau.M[1][1];
+    return Stress * -(PhysicsData.InitialVolume * CPUKernel::Spline::InverseInertia * InvDx * InvDx);
 }
\ No newline at end of file
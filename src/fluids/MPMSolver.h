@@ -1,64 +1,132 @@
 #pragma once
+#include <memory>
+#include <span>
 #include <vector>
 
+#include "fluids/ActivityTracker.h"
+#include "fluids/AdaptiveGrid.h"
 #include "fluids/IFluidSolver.h"
+#include "fluids/ImplicitGridSolver.h"
+#include "fluids/LocalTimeStepper.h"
+#include "fluids/MPMKernels.h"
+#include "fluids/ParticlePool.h"
+#include "fluids/ParticleStorage.h"
+#include "fluids/ParticleResampler.h"
+#include "fluids/Plasticity.h"
 #include "util/3DMath.h"
+#include "util/MemoryArena.h"
+#include "util/Numa.h"
+#include "util/TaskGraph.h"
 
 class Allocation;
 
-struct GridCell
-{
-    // xyz = Velocity, W = mass
-    Math::Vec4 VelocityMass;
-    uint32_t IntHolder1, IntHolder2, IntHolder3, IntHolder4;
-};
+// Cells the CPU grids keep past their last column. The stencil of a particle held against a far wall reaches a node past
+// the grid, along X that is the column after the last, along Y the first cell of the next column
+#define CPU_GRID_PADDING(Resolution) ((Resolution) + 1)
 
-struct alignas(Math::Vec4) ParticlePhysicsData
+// Matrices are kept in the layout PARTICLE_STORAGE selects, read them into a Math::Matrix4x4 to do math on them
+struct ParticlePhysicsData
 {
-    Math::Matrix C;
-    Math::Matrix DeformGradient = Math::Identity;
+    AffineStorage C;
+    DeformStorage DeformGradient = Math::Identity;
     float Mass = 4.0f;
     float InitialVolume = 1.0f;
     float J = 1.0f;
-    float Padding2;
+    // Plastic volume change, drives snow hardening
+    float PlasticJ = 1.0f;
+};
+
+// Arenas a solver can borrow in place of its own, so one run of a parameter sweep reuses the grid, particle data and
+// scratch memory of the run before. They have to outlive the solver, the owner rewinds them between solvers
+struct MPMSolverArenas
+{
+    MemoryArena RunArena;
+    MemoryArena StepArena;
 };
 
 class MPMSolver : public IFluidSolver
 {
 public:
-    struct FluidParameters
-    {
-        int NumParticles;
-        uint32_t GridResolution;
-        uint32_t NumGridCells;
-        float Dx;
-        float InvDx;
-        // Lame parameters
-        float ElasticMu = 40.0f;
-        float ElasticLamda = 20.0f;
-        float DeltaTime;
-        float GridSize;
-        float Padding1, Padding2, Padding3;
-
-        FluidParameters(int Num, uint32_t Resolution, float Lamda, float Mu, float Timestep, float Size)
-            : NumParticles(Num), ElasticMu(Mu), ElasticLamda(Lamda), GridResolution(Resolution), Dx(Size / float(Resolution)), InvDx(1 / Dx), GridSize(Size), DeltaTime(Timestep), NumGridCells(GridResolution * GridResolution * GridResolution)
-        {
-        }
-    };
+    typedef MPMFluidParameters FluidParameters;
 
-    MPMSolver(std::vector<ParticleRenderData>& Particles, FluidParameters& FluidParams);
+    MPMSolver(std::vector<ParticleRenderData>& Particles, FluidParameters& FluidParams, MaterialModel Model = JellyMaterial, MPMSolverArenas* BorrowedArenas = nullptr);
 
+#ifdef _WIN32
     virtual void Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList) override;
+#endif
 
     virtual void CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime) override;
+#ifdef _WIN32
     virtual void GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer) override;
+#endif
+
+    // Applies the material's return mapping and fills ParticleStress of the given particles for the coming P2G
+    void ComputeStresses(const std::vector<ParticleRenderData>& Particles, std::span<const uint32_t> Indices);
+    void ParticleToGrid(const std::vector<ParticleRenderData>& Particles, const std::vector<uint32_t>& Indices, std::span<GridCell> TargetGrid, float DeltaTime);
+    void GridToParticle(std::vector<ParticleRenderData>& Particles, const std::vector<uint32_t>& Indices, std::span<const GridCell> SourceGrid, float DeltaTime);
+
+    // Transfers of particles kept outside the solver, e.g. streamed from disk by OutOfCoreMPMSolver, on a grid of the
+    // solver's resolution. Scattering applies the material's return mapping first, StepParticle gathers and moves one
+    // particle. None of them touch the sleep tracker
+    void ScatterParticles(const ParticleRenderData* Particles, ParticlePhysicsData* PhysicsData, uint32_t Count, GridCell* TargetGrid, float DeltaTime);
+    // Updates columns [BeginX, EndX) of a grid whose first column is OriginX
+    void UpdateGridColumns(GridCell* TargetGrid, int OriginX, int BeginX, int EndX, float DeltaTime) const;
+    void StepParticle(ParticleRenderData& Particle, ParticlePhysicsData& PhysicsData, const GridCell* SourceGrid, float DeltaTime) const;
+
+    // CPUSolve split into its phases so several solvers can step on one shared grid, see SharedMPMGrid.
+    // BeginStep handles sources, resampling and sleep bookkeeping and computes the stresses of the awake particles
+    void BeginStep(std::vector<ParticleRenderData>& Particles, float DeltaTime);
+    // Adds this solver's particles to the grid, which must have been cleared by the caller
+    void ScatterToGrid(const std::vector<ParticleRenderData>& Particles, std::span<GridCell> TargetGrid, float DeltaTime);
+    void UpdateGrid(std::span<GridCell> TargetGrid, float DeltaTime) const;
+    void GatherFromGrid(std::vector<ParticleRenderData>& Particles, std::span<const GridCell> SourceGrid, float DeltaTime);
+    // The same on a window of NumColumns grid columns starting at OriginX, e.g. a subdomain's slab and halo. Every
+    // awake particle's stencil has to lie inside the window
+    void ScatterToGrid(const std::vector<ParticleRenderData>& Particles, GridCell* TargetGrid, int OriginX, int NumColumns, float DeltaTime);
+    void GatherFromGrid(std::vector<ParticleRenderData>& Particles, const GridCell* SourceGrid, int OriginX, float DeltaTime);
+
+    // Solvers sharing a grid must also share their sleep state, nullptr goes back to the solver's own tracker
+    void ShareActivityTracker(ActivityTracker* Tracker);
+    void MarkSleepStateDirty();
+
+    int GetGridResolution() const;
+    float GetGridSize() const;
+
+    // Wakes any sleeping region overlapping the box
+    virtual void DisturbRegion(const Math::Vec4& Min, const Math::Vec4& Max) override;
+
+    // Lets the particle arrays grow to Capacity on the CPU path, for emitters and resampling
+    void ReserveParticles(uint32_t Capacity, std::vector<ParticleRenderData>& Particles);
+    virtual void AddEmitter(const ParticleEmitter& Emitter) override;
+    virtual void AddSink(const ParticleSink& Sink) override;
+
+    // Moves single particles in and out of the solver, e.g. between the subdomains of a decomposed run. Inserting
+    // fails when the pool is full
+    bool InsertParticle(std::vector<ParticleRenderData>& Particles, const ParticleRenderData& Particle, const ParticlePhysicsData& PhysicsData);
+    void RemoveParticle(uint32_t Index, std::vector<ParticleRenderData>& Particles);
+    const ParticlePhysicsData& GetParticleData(uint32_t Index) const;
 
-    void ParticleToGrid(const std::vector<ParticleRenderData>& Particles, float DeltaTime);
-    void GridToParticle(std::vector<ParticleRenderData>& Particles, float DeltaTime);
+    // Switches the CPU grid update to backward Euler, allowing much larger timesteps for stiff jelly.
+    // Only the jelly (neo-Hookean) material on a solver's own grid uses it, others stay explicit
+    void EnableImplicit(const ImplicitParameters& Params);
 
+    // Steps slow regions of the CPU solver less often with proportionally larger timesteps, DeltaTime becomes the
+    // finest level's step. Only on a solver's own grid and with the explicit update
+    void EnableMultiRate(const MultiRateParameters& Params);
+
+    // Replaces the CPU solver's uniform grid with a quadtree, fine near the free surface and the walls and coarse in the
+    // bulk. Only on a solver's own grid and with the explicit update, and ahead of multi-rate stepping
+    void EnableAdaptiveGrid(const AdaptiveGridParameters& Params);
+
+    // Periodically merges and splits particles on the CPU path, keeping the count within Params.ParticleBudget
+    void EnableResampling(const ResamplingParameters& Params);
+
+#ifdef _WIN32
     virtual void CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler) override;
-    virtual void RecompileShaders(ShaderCompiler& Compiler) override;
+    virtual void ApplyPipelineStates() override;
+    virtual void GetShaders(std::vector<ShaderDesc>& Shaders) const override;
     virtual void CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation) override;
+#endif
 
     Math::Matrix4x4 NeoHookeanStress(const ParticleRenderData& Particle, const ParticlePhysicsData& PhysicsData);
 
@@ -71,9 +139,109 @@ private:
 
     // CPU data
     FluidParameters FluidValues;
-    std::vector<GridCell> Grid;
-    std::vector<ParticlePhysicsData> ParticleData;
+    // Arrays living as long as the solver come from RunArena, the grids and particle data included, per step scratch
+    // from StepArena, which every step rewinds. Both are OwnArenas unless the solver was given some
+    MPMSolverArenas OwnArenas;
+    MemoryArena& RunArena;
+    MemoryArena& StepArena;
+    // Grows the solver's own grid to NumCells. It is allocated on first use, subdomains and solvers on a shared grid
+    // step on another and never need it. The CPU paths use its first GridResolution^2 cells, the GPU all
+    // GridResolution^3
+    void AllocateGrid(size_t NumCells);
+    std::vector<GridCell, ArenaAllocator<GridCell>> Grid{ArenaAllocator<GridCell>(&RunArena)};
+    ParticlePhysicsArray ParticleData{ArenaAllocator<ParticlePhysicsData>(&RunArena)};
+    MaterialModel Material;
+
+    // Grows ParticleStress to hold at least Count particles
+    void ReserveStress(size_t Count);
+    Math::Matrix4x4* ParticleStress = nullptr;
+    size_t StressCapacity = 0;
+    PlasticityParameters PlasticParams;
+
+    // Sleeping regions
+    void UpdateSleepingParticles(std::vector<ParticleRenderData>& Particles, float DeltaTime);
+    ActivityTracker OwnActivity;
+    ActivityTracker* Activity = &OwnActivity;
+    bool SleepStateDirty = true;
+    float SleepingDeltaTime = 0.0f;
+    std::vector<uint32_t> ActiveParticles;
+    std::vector<uint32_t> SleepingParticles;
+    // Grid contribution of all sleeping particles, used in place of clearing the grid each step
+    std::vector<GridCell, ArenaAllocator<GridCell>> SleepingGrid{ArenaAllocator<GridCell>(&RunArena)};
+
+    // Emitters and sinks
+    void UpdateSources(std::vector<ParticleRenderData>& Particles, float DeltaTime);
+    struct EmitterState
+    {
+        ParticleEmitter Desc;
+        // Fractional particles carried over to the next step
+        float Pending = 0.0f;
+    };
+    ParticlePool Pool;
+    std::vector<EmitterState> Emitters;
+    std::vector<ParticleSink> Sinks;
+
+    // Implicit integration
+    bool UsesImplicitUpdate() const;
+    std::unique_ptr<ImplicitGridSolver> Implicit;
+    bool OnSharedGrid = false;
+
+    // Multi-rate time stepping
+    bool UsesMultiRate() const;
+    void MultiRateStep(std::vector<ParticleRenderData>& Particles, float DeltaTime);
+    std::unique_ptr<LocalTimeStepper> MultiRate;
+    // Time level of every particle's current step
+    std::vector<uint8_t> ParticleLevels;
+    std::vector<uint32_t> LevelParticles;
+    std::vector<uint32_t> HaloParticles;
+    std::vector<uint8_t> PassBlocks;
+
+    // Adaptive grid
+    bool UsesAdaptiveGrid() const;
+    void AdaptiveStep(std::vector<ParticleRenderData>& Particles, float DeltaTime);
+    std::unique_ptr<AdaptiveGrid> Adaptive;
+    std::vector<uint32_t> AdaptiveParticles;
+
+    // The CPU paths are 2D with quadratic weights, their block tiles, halos and wall clamping are sized for its reach
+    typedef MPMKernels::Kernel<2, MPMKernels::QuadraticSpline, float> CPUKernel;
+
+    // Transfer pieces shared by the CPU paths. The P2G overload writes into a Stride wide tile whose first cell is the
+    // grid cell (OriginX, OriginY)
+    void ParticleToGrid(const std::vector<ParticleRenderData>& Particles, std::span<const uint32_t> Indices, GridCell* TargetGrid, int OriginX, int OriginY, int Stride, float DeltaTime);
+    void ScatterParticle(const ParticleRenderData& Particle, const ParticlePhysicsData& PhysicsData, const Math::Matrix4x4& Stress, GridCell* TargetGrid, int OriginX, int OriginY, int Stride, float DeltaTime) const;
+    // Return mapping of up to SVD_BATCH_SIZE plastic particles, updates their F and PlasticJ
+    void ReturnMapBatch(ParticlePhysicsData* const* Batch, int Count, Math::Matrix4x4* Stresses) const;
+    void UpdateGridCell(GridCell& Cell, int X, int Y, const Math::Vec4& Gravity) const;
+    // Gathers from a grid whose first column is OriginX
+    void GatherParticle(ParticleRenderData& Particle, ParticlePhysicsData& PhysicsData, const GridCell* SourceGrid, int OriginX) const;
+    // Moves a particle after its velocity and C were gathered and updates F
+    void AdvanceParticle(ParticleRenderData& Particle, ParticlePhysicsData& PhysicsData, float DeltaTime) const;
+    // Reports a particle's motion to the sleep tracker, which is not thread safe
+    void RecordActivity(const ParticleRenderData& Particle, const ParticlePhysicsData& PhysicsData);
+
+    // Block scheduled step, the default CPU path when the thread pool has workers. P2G, grid update and G2P run per
+    // block and each starts once the blocks it reads from are through the previous phase, with no join between phases
+    bool UsesBlockScheduling() const;
+    void BuildBlockGraph();
+    void BlockScheduledStep(std::vector<ParticleRenderData>& Particles, float DeltaTime);
+    void UpdateBlockGrid(int Block, float DeltaTime);
+    TaskGraph BlockGraph;
+    int ScheduleBlocksPerAxis = 0;
+    // Active particles sorted by block, block i's are BlockOrder[BlockStart[i], BlockStart[i + 1]). Both live in
+    // StepArena
+    uint32_t* BlockStart = nullptr;
+    uint32_t* BlockOrder = nullptr;
+    // Every block's P2G writes into its own tile, the grid update of a block sums the tiles overlapping it into
+    // BlockGrid. Columns of blocks are split between the pool's NUMA nodes, their tasks, tiles and grid strip included
+    NumaArray<GridCell> BlockTiles;
+    NumaArray<GridCell> BlockGrid;
+
+    // Adaptive resampling
+    std::unique_ptr<ParticleResampler> Resampler;
+    uint32_t StepsSinceResample = 0;
+    int InitialNumParticles;
 
+#ifdef _WIN32
     // GPU data
     Microsoft::WRL::ComPtr<ID3D12Resource> FluidParamBuffer;
     Microsoft::WRL::ComPtr<ID3D12Resource> ParticleDataBuffer;
@@ -83,7 +251,10 @@ private:
     Microsoft::WRL::ComPtr<ID3D12Resource> FluidParamUploadBuffer;
     Allocation* HeapAllocation;
     Microsoft::WRL::ComPtr<ID3D12PipelineState> PipelineStates[4];
+    // Built by CreatePipelineStateObject, in use after ApplyPipelineStates
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> PendingPipelineStates[4];
     uint32_t DispatchSizes[4];
 
     static const float GRID_CLEAR[4];
+#endif
 };
\ No newline at end of file
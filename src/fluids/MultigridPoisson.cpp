@@ -0,0 +1,297 @@
+#include "fluids/MultigridPoisson.h"
+
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Grid rows per parallel chunk
+#define ROW_CHUNK_SIZE 8
+// Levels stop coarsening below this resolution
+#define COARSEST_RESOLUTION 4
+// Jacobi sweeps that stand in for an exact solve on the coarsest level
+#define COARSEST_SMOOTHING_ITERATIONS 16
+// Damping of the Jacobi smoother
+#define JACOBI_WEIGHT (2.0f / 3.0f)
+
+MultigridPoisson::MultigridPoisson(int Resolution, float Dx, const PressureSolveParameters& Params)
+    : Params(Params)
+{
+    int LevelResolution = Resolution;
+    float LevelDx = Dx;
+    while (true)
+    {
+        Level NewLevel;
+        NewLevel.Resolution = LevelResolution;
+        NewLevel.InvDxSq = 1.0f / (LevelDx * LevelDx);
+        size_t NumCells = static_cast<size_t>(LevelResolution) * LevelResolution;
+        NewLevel.Types.resize(NumCells, SolidCell);
+        NewLevel.Solution.resize(NumCells, 0.0f);
+        NewLevel.RightHandSide.resize(NumCells, 0.0f);
+        NewLevel.Residual.resize(NumCells, 0.0f);
+        Levels.push_back(std::move(NewLevel));
+
+        if (LevelResolution <= COARSEST_RESOLUTION)
+        {
+            break;
+        }
+        LevelResolution = (LevelResolution + 1) / 2;
+        LevelDx *= 2.0f;
+    }
+
+    size_t NumCells = static_cast<size_t>(Resolution) * Resolution;
+    Residual.resize(NumCells);
+    Preconditioned.resize(NumCells);
+    Direction.resize(NumCells);
+    OperatorDirection.resize(NumCells);
+}
+
+void MultigridPoisson::BuildLevels(const std::vector<uint8_t>& CellTypes)
+{
+    Levels[0].Types = CellTypes;
+    for (size_t LevelIndex = 1; LevelIndex < Levels.size(); LevelIndex++)
+    {
+        const Level& Fine = Levels[LevelIndex - 1];
+        Level& Coarse = Levels[LevelIndex];
+        // Air wins over fluid and fluid over solid, so the coarse problems keep the free surface (McAdams et al. 2010)
+        for (int X = 0; X < Coarse.Resolution; X++)
+        {
+            for (int Y = 0; Y < Coarse.Resolution; Y++)
+            {
+                bool HasAir = false, HasFluid = false;
+                for (int ChildX = 2 * X; ChildX < std::min(2 * X + 2, Fine.Resolution); ChildX++)
+                {
+                    for (int ChildY = 2 * Y; ChildY < std::min(2 * Y + 2, Fine.Resolution); ChildY++)
+                    {
+                        uint8_t Type = Fine.Types[ChildX * Fine.Resolution + ChildY];
+                        HasAir |= Type == AirCell;
+                        HasFluid |= Type == FluidCell;
+                    }
+                }
+                Coarse.Types[X * Coarse.Resolution + Y] = HasAir ? AirCell : (HasFluid ? FluidCell : SolidCell);
+            }
+        }
+    }
+}
+
+void MultigridPoisson::ApplyOperator(const Level& Grid, const std::vector<float>& In, std::vector<float>& Out) const
+{
+    const int Res = Grid.Resolution;
+    ThreadPool::Run(Res, ROW_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (int X = Begin; X < static_cast<int>(End); X++)
+        {
+            for (int Y = 0; Y < Res; Y++)
+            {
+                int Cell = X * Res + Y;
+                if (Grid.Types[Cell] != FluidCell)
+                {
+                    Out[Cell] = 0.0f;
+                    continue;
+                }
+                // Solid neighbours (and the domain edge) carry no flux, air neighbours hold zero
+                float Center = 0.0f, Neighbours = 0.0f;
+                const int NeighbourCells[4] = {X > 0 ? Cell - Res : -1, X < Res - 1 ? Cell + Res : -1, Y > 0 ? Cell - 1 : -1, Y < Res - 1 ? Cell + 1 : -1};
+                for (int Neighbour : NeighbourCells)
+                {
+                    if (Neighbour < 0 || Grid.Types[Neighbour] == SolidCell)
+                    {
+                        continue;
+                    }
+                    Center += 1.0f;
+                    if (Grid.Types[Neighbour] == FluidCell)
+                    {
+                        Neighbours += In[Neighbour];
+                    }
+                }
+                Out[Cell] = (Center * In[Cell] - Neighbours) * Grid.InvDxSq;
+            }
+        }
+    });
+}
+
+void MultigridPoisson::ComputeResidual(Level& Grid) const
+{
+    ApplyOperator(Grid, Grid.Solution, Grid.Residual);
+    ThreadPool::Run(static_cast<uint32_t>(Grid.Residual.size()), ROW_CHUNK_SIZE * Grid.Resolution, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t Cell = Begin; Cell < End; Cell++)
+        {
+            Grid.Residual[Cell] = Grid.Types[Cell] == FluidCell ? Grid.RightHandSide[Cell] - Grid.Residual[Cell] : 0.0f;
+        }
+    });
+}
+
+void MultigridPoisson::Smooth(Level& Grid, uint32_t Iterations) const
+{
+    const int Res = Grid.Resolution;
+    for (uint32_t Iteration = 0; Iteration < Iterations; Iteration++)
+    {
+        ComputeResidual(Grid);
+        ThreadPool::Run(Res, ROW_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+            for (int X = Begin; X < static_cast<int>(End); X++)
+            {
+                for (int Y = 0; Y < Res; Y++)
+                {
+                    int Cell = X * Res + Y;
+                    if (Grid.Types[Cell] != FluidCell)
+                    {
+                        continue;
+                    }
+                    int Open = 0;
+                    Open += X > 0 && Grid.Types[Cell - Res] != SolidCell;
+                    Open += X < Res - 1 && Grid.Types[Cell + Res] != SolidCell;
+                    Open += Y > 0 && Grid.Types[Cell - 1] != SolidCell;
+                    Open += Y < Res - 1 && Grid.Types[Cell + 1] != SolidCell;
+                    if (Open > 0)
+                    {
+                        Grid.Solution[Cell] += JACOBI_WEIGHT * Grid.Residual[Cell] / (Open * Grid.InvDxSq);
+                    }
+                }
+            }
+        });
+    }
+}
+
+void MultigridPoisson::VCycle(size_t LevelIndex)
+{
+    Level& Grid = Levels[LevelIndex];
+    std::fill(Grid.Solution.begin(), Grid.Solution.end(), 0.0f);
+    if (LevelIndex == Levels.size() - 1)
+    {
+        Smooth(Grid, COARSEST_SMOOTHING_ITERATIONS);
+        return;
+    }
+
+    Smooth(Grid, Params.SmoothingIterations);
+    ComputeResidual(Grid);
+
+    // Restrict the residual by averaging the children, the coarse operator is rediscretized at twice the spacing
+    Level& Coarse = Levels[LevelIndex + 1];
+    ThreadPool::Run(Coarse.Resolution, ROW_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (int X = Begin; X < static_cast<int>(End); X++)
+        {
+            for (int Y = 0; Y < Coarse.Resolution; Y++)
+            {
+                float Sum = 0.0f;
+                for (int ChildX = 2 * X; ChildX < std::min(2 * X + 2, Grid.Resolution); ChildX++)
+                {
+                    for (int ChildY = 2 * Y; ChildY < std::min(2 * Y + 2, Grid.Resolution); ChildY++)
+                    {
+                        Sum += Grid.Residual[ChildX * Grid.Resolution + ChildY];
+                    }
+                }
+                int Cell = X * Coarse.Resolution + Y;
+                Coarse.RightHandSide[Cell] = Coarse.Types[Cell] == FluidCell ? 0.25f * Sum : 0.0f;
+            }
+        }
+    });
+
+    VCycle(LevelIndex + 1);
+
+    // Piecewise constant prolongation of the correction
+    ThreadPool::Run(Grid.Resolution, ROW_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (int X = Begin; X < static_cast<int>(End); X++)
+        {
+            for (int Y = 0; Y < Grid.Resolution; Y++)
+            {
+                int Cell = X * Grid.Resolution + Y;
+                if (Grid.Types[Cell] == FluidCell)
+                {
+                    Grid.Solution[Cell] += Coarse.Solution[(X / 2) * Coarse.Resolution + Y / 2];
+                }
+            }
+        }
+    });
+
+    Smooth(Grid, Params.SmoothingIterations);
+}
+
+float MultigridPoisson::Dot(const std::vector<float>& A, const std::vector<float>& B) const
+{
+    const uint32_t Count = static_cast<uint32_t>(A.size());
+    const uint32_t ChunkSize = ROW_CHUNK_SIZE * Levels[0].Resolution;
+    std::vector<double> Partial((Count + ChunkSize - 1) / ChunkSize, 0.0);
+    ThreadPool::Run(Count, ChunkSize, [&](uint32_t Begin, uint32_t End) {
+        double Sum = 0.0;
+        for (uint32_t i = Begin; i < End; i++)
+        {
+            Sum += static_cast<double>(A[i]) * B[i];
+        }
+        Partial[Begin / ChunkSize] = Sum;
+    });
+    double Sum = 0.0;
+    for (double Value : Partial)
+    {
+        Sum += Value;
+    }
+    return static_cast<float>(Sum);
+}
+
+float MultigridPoisson::MaxAbs(const std::vector<float>& A) const
+{
+    float Max = 0.0f;
+    for (float Value : A)
+    {
+        Max = std::max(Max, std::abs(Value));
+    }
+    return Max;
+}
+
+uint32_t MultigridPoisson::Solve(const std::vector<uint8_t>& CellTypes, const std::vector<float>& RightHandSide, std::vector<float>& Solution)
+{
+    BuildLevels(CellTypes);
+    Level& Finest = Levels[0];
+    const size_t NumCells = CellTypes.size();
+
+    Solution.assign(NumCells, 0.0f);
+    for (size_t Cell = 0; Cell < NumCells; Cell++)
+    {
+        Residual[Cell] = CellTypes[Cell] == FluidCell ? RightHandSide[Cell] : 0.0f;
+    }
+    const float Threshold = Params.Tolerance * MaxAbs(Residual);
+    if (Threshold <= 0.0f)
+    {
+        return 0;
+    }
+
+    auto Precondition = [&]() {
+        Finest.RightHandSide = Residual;
+        VCycle(0);
+        Preconditioned = Finest.Solution;
+    };
+
+    Precondition();
+    Direction = Preconditioned;
+    float ResidualDotPreconditioned = Dot(Residual, Preconditioned);
+
+    uint32_t Iteration = 0;
+    while (Iteration < Params.MaxIterations)
+    {
+        Iteration++;
+        ApplyOperator(Finest, Direction, OperatorDirection);
+        float Curvature = Dot(Direction, OperatorDirection);
+        if (Curvature <= 0.0f)
+        {
+            break;
+        }
+        float Alpha = ResidualDotPreconditioned / Curvature;
+        for (size_t Cell = 0; Cell < NumCells; Cell++)
+        {
+            Solution[Cell] += Alpha * Direction[Cell];
+            Residual[Cell] -= Alpha * OperatorDirection[Cell];
+        }
+        if (MaxAbs(Residual) <= Threshold)
+        {
+            break;
+        }
+
+        Precondition();
+        float NewResidualDotPreconditioned = Dot(Residual, Preconditioned);
+        float Beta = NewResidualDotPreconditioned / ResidualDotPreconditioned;
+        ResidualDotPreconditioned = NewResidualDotPreconditioned;
+        for (size_t Cell = 0; Cell < NumCells; Cell++)
+        {
+            Direction[Cell] = Preconditioned[Cell] + Beta * Direction[Cell];
+        }
+    }
+    return Iteration;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum PressureCellType : uint8_t
+{
+    AirCell,
+    FluidCell,
+    SolidCell
+};
+
+struct PressureSolveParameters
+{
+    // Stops once the largest residual dropped below this fraction of the largest right hand side entry
+    float Tolerance = 1e-4f;
+    uint32_t MaxIterations = 50;
+    // Damped Jacobi sweeps before and after each coarse grid correction
+    uint32_t SmoothingIterations = 2;
+};
+
+// Solves the pressure Poisson equation of a (2D) cell grid, A x = b with A the negative 5 point Laplacian over fluid cells,
+// x = 0 in air cells and no flux into solid cells. Conjugate gradient preconditioned with a geometric multigrid V-cycle,
+// both matrix free and parallelized over grid rows
+class MultigridPoisson
+{
+public:
+    MultigridPoisson(int Resolution, float Dx, const PressureSolveParameters& Params = PressureSolveParameters());
+
+    // Cells are indexed X * Resolution + Y. Returns the number of CG iterations
+    uint32_t Solve(const std::vector<uint8_t>& CellTypes, const std::vector<float>& RightHandSide, std::vector<float>& Solution);
+
+private:
+    struct Level
+    {
+        int Resolution;
+        float InvDxSq;
+        std::vector<uint8_t> Types;
+        std::vector<float> Solution;
+        std::vector<float> RightHandSide;
+        std::vector<float> Residual;
+    };
+
+    void BuildLevels(const std::vector<uint8_t>& CellTypes);
+    void ApplyOperator(const Level& Grid, const std::vector<float>& In, std::vector<float>& Out) const;
+    void ComputeResidual(Level& Grid) const;
+    void Smooth(Level& Grid, uint32_t Iterations) const;
+    // Applies one V-cycle to the level's right hand side, starting from a zero guess
+    void VCycle(size_t LevelIndex);
+
+    float Dot(const std::vector<float>& A, const std::vector<float>& B) const;
+    float MaxAbs(const std::vector<float>& A) const;
+
+    PressureSolveParameters Params;
+    std::vector<Level> Levels;
+
+    // CG vectors on the finest level
+    std::vector<float> Residual, Preconditioned, Direction, OperatorDirection;
+};
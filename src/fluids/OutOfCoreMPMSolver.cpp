@@ -0,0 +1,341 @@
+#include "fluids/OutOfCoreMPMSolver.h"
+
+#include <algorithm>
+
+OutOfCoreMPMSolver::OutOfCoreMPMSolver(const MPMSolver::FluidParameters& FluidParams, MaterialModel Model, const OutOfCoreParameters& Params)
+    : FluidValues(FluidParams), Params(Params), InvDx(FluidParams.InvDx), GridResolution(FluidParams.GridResolution), Kernels(NoParticles, FluidValues, Model)
+{
+    this->Params.SlabColumns = std::max<uint32_t>(this->Params.SlabColumns, MIN_OUT_OF_CORE_SLAB_COLUMNS);
+    this->Params.ChunkParticles = std::max<uint32_t>(this->Params.ChunkParticles, 1);
+    Grid.resize(GridResolution * GridResolution + CPU_GRID_PADDING(GridResolution));
+    Slabs.resize((GridResolution + this->Params.SlabColumns - 1) / this->Params.SlabColumns);
+
+    // Views start on the allocation granularity, so chunks are a whole number of it
+    size_t Granularity = MappedFile::GetGranularity();
+    size_t DataBytes = size_t(this->Params.ChunkParticles) * (sizeof(ParticleRenderData) + sizeof(ParticlePhysicsData));
+    ChunkBytes = (DataBytes + Granularity - 1) / Granularity * Granularity;
+}
+
+OutOfCoreMPMSolver::~OutOfCoreMPMSolver()
+{
+    for (uint32_t Chunk = 0; Chunk < NumFileChunks; Chunk++)
+    {
+        UnmapChunk(Chunk);
+    }
+}
+
+bool OutOfCoreMPMSolver::Open()
+{
+    return File.Create(Params.FilePath) || Fail("Couldn't create the particle file");
+}
+
+bool OutOfCoreMPMSolver::AddParticles(const ParticleRenderData* Particles, uint32_t Count)
+{
+    for (uint32_t Index = 0; Index < Count; Index++)
+    {
+        Migrating.push_back({Particles[Index], ParticlePhysicsData(), GetSlab(Particles[Index].Position)});
+    }
+    NumParticles += Count;
+    return MigrateParticles();
+}
+
+bool OutOfCoreMPMSolver::Step(float DeltaTime)
+{
+    std::fill(Grid.begin(), Grid.end(), GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+    KineticEnergy = 0.0;
+
+    const uint32_t NumSlabs = static_cast<uint32_t>(Slabs.size());
+    for (uint32_t SlabIndex = 0; SlabIndex <= NumSlabs; SlabIndex++)
+    {
+        if (SlabIndex < NumSlabs)
+        {
+            // Already mapped if it was the slab ahead
+            SlabAhead = NO_OUT_OF_CORE_SLAB;
+            if (SlabIndex + 1 < NumSlabs)
+            {
+                MapSlabAhead(SlabIndex + 1);
+            }
+            if (!ScatterSlab(SlabIndex, DeltaTime))
+            {
+                return false;
+            }
+            int BeginX = SlabIndex * Params.SlabColumns;
+            Kernels.UpdateGridColumns(Grid.data(), 0, BeginX, std::min(BeginX + static_cast<int>(Params.SlabColumns), GridResolution), DeltaTime);
+            if (SlabIndex + 1 == NumSlabs)
+            {
+                // The last slab's particles scatter into the padding past the far wall, which has to read as a wall at rest
+                std::fill(Grid.end() - CPU_GRID_PADDING(GridResolution), Grid.end(), GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+            }
+        }
+        if (SlabIndex > 0)
+        {
+            SlabGathered = SlabIndex - 1;
+            if (!MapSlab(SlabIndex - 1))
+            {
+                return false;
+            }
+            GatherSlab(SlabIndex - 1, DeltaTime);
+            UnmapSlab(SlabIndex - 1);
+            SlabGathered = NO_OUT_OF_CORE_SLAB;
+        }
+    }
+    SlabAhead = NO_OUT_OF_CORE_SLAB;
+    return MigrateParticles();
+}
+
+const std::string& OutOfCoreMPMSolver::GetError() const
+{
+    return Error;
+}
+
+uint64_t OutOfCoreMPMSolver::GetNumParticles() const
+{
+    return NumParticles;
+}
+
+double OutOfCoreMPMSolver::GetKineticEnergy() const
+{
+    return KineticEnergy;
+}
+
+uint32_t OutOfCoreMPMSolver::GetSlab(const Math::Vec4& Position) const
+{
+    // The base column of the particle's stencil, as the transfers compute it
+    int Column = std::clamp(static_cast<int>(Position.x * InvDx - 0.5f), 0, GridResolution - 1);
+    return static_cast<uint32_t>(Column) / Params.SlabColumns;
+}
+
+ParticleRenderData* OutOfCoreMPMSolver::GetRenderData(uint32_t Chunk) const
+{
+    return reinterpret_cast<ParticleRenderData*>(ChunkViews[Chunk]);
+}
+
+ParticlePhysicsData* OutOfCoreMPMSolver::GetPhysicsData(uint32_t Chunk) const
+{
+    return reinterpret_cast<ParticlePhysicsData*>(ChunkViews[Chunk] + size_t(Params.ChunkParticles) * sizeof(ParticleRenderData));
+}
+
+bool OutOfCoreMPMSolver::AllocateChunk(uint32_t& Chunk)
+{
+    if (!FreeChunks.empty())
+    {
+        Chunk = FreeChunks.back();
+        FreeChunks.pop_back();
+        return true;
+    }
+    uint64_t Needed = uint64_t(NumFileChunks + 1) * ChunkBytes;
+    if (Needed > File.GetSize())
+    {
+        // Grow geometrically, every resize is a new file mapping. Close to a full disk settle for the one chunk
+        if (!File.Resize(std::max(Needed, File.GetSize() * 2)) && !File.Resize(Needed))
+        {
+            return Fail("Couldn't grow the particle file, the disk is full");
+        }
+    }
+    ChunkViews.push_back(nullptr);
+    Chunk = NumFileChunks++;
+    return true;
+}
+
+bool OutOfCoreMPMSolver::MapChunk(uint32_t Chunk)
+{
+    if (ChunkViews[Chunk])
+    {
+        return true;
+    }
+    ChunkViews[Chunk] = static_cast<uint8_t*>(File.Map(uint64_t(Chunk) * ChunkBytes, ChunkBytes));
+    if (!ChunkViews[Chunk] && SlabAhead != NO_OUT_OF_CORE_SLAB)
+    {
+        // The slabs being worked on need the address space more than the one read ahead
+        UnmapSlab(SlabAhead);
+        SlabAhead = NO_OUT_OF_CORE_SLAB;
+        MapAhead = false;
+        ChunkViews[Chunk] = static_cast<uint8_t*>(File.Map(uint64_t(Chunk) * ChunkBytes, ChunkBytes));
+    }
+    if (!ChunkViews[Chunk] && KeepScatteredSlab)
+    {
+        // Only the gathered slab has to stay mapped, a scattered one is mapped again for its gather
+        MapAhead = false;
+        KeepScatteredSlab = false;
+        for (uint32_t Mapped = 0; Mapped < NumFileChunks; Mapped++)
+        {
+            if (SlabGathered == NO_OUT_OF_CORE_SLAB || std::find(Slabs[SlabGathered].Chunks.begin(), Slabs[SlabGathered].Chunks.end(), Mapped) == Slabs[SlabGathered].Chunks.end())
+            {
+                UnmapChunk(Mapped);
+            }
+        }
+        ChunkViews[Chunk] = static_cast<uint8_t*>(File.Map(uint64_t(Chunk) * ChunkBytes, ChunkBytes));
+    }
+    return ChunkViews[Chunk] || Fail("Couldn't map a view of the particle file, the address space is used up");
+}
+
+void OutOfCoreMPMSolver::UnmapChunk(uint32_t Chunk)
+{
+    if (ChunkViews[Chunk])
+    {
+        File.Unmap(ChunkViews[Chunk]);
+        ChunkViews[Chunk] = nullptr;
+    }
+}
+
+bool OutOfCoreMPMSolver::MapSlab(uint32_t SlabIndex)
+{
+    for (uint32_t Chunk : Slabs[SlabIndex].Chunks)
+    {
+        if (!MapChunk(Chunk))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void OutOfCoreMPMSolver::MapSlabAhead(uint32_t SlabIndex)
+{
+    if (!MapAhead)
+    {
+        return;
+    }
+    for (uint32_t Chunk : Slabs[SlabIndex].Chunks)
+    {
+        if (!ChunkViews[Chunk])
+        {
+            ChunkViews[Chunk] = static_cast<uint8_t*>(File.Map(uint64_t(Chunk) * ChunkBytes, ChunkBytes));
+        }
+        if (!ChunkViews[Chunk])
+        {
+            // From now on slabs are read in when their turn comes
+            UnmapSlab(SlabIndex);
+            MapAhead = false;
+            return;
+        }
+        MappedFile::Prefetch(ChunkViews[Chunk], ChunkBytes);
+    }
+    SlabAhead = SlabIndex;
+}
+
+void OutOfCoreMPMSolver::UnmapSlab(uint32_t SlabIndex)
+{
+    for (uint32_t Chunk : Slabs[SlabIndex].Chunks)
+    {
+        UnmapChunk(Chunk);
+    }
+}
+
+bool OutOfCoreMPMSolver::Fail(const char* Message)
+{
+    Error = Message;
+    return false;
+}
+
+bool OutOfCoreMPMSolver::AppendParticles(uint32_t SlabIndex, const MigratingParticle* Particles, uint32_t Count)
+{
+    Slab& Entry = Slabs[SlabIndex];
+    for (uint32_t Index = 0; Index < Count; Index++)
+    {
+        uint32_t Offset = Entry.NumParticles % Params.ChunkParticles;
+        if (Offset == 0)
+        {
+            if (!Entry.Chunks.empty())
+            {
+                UnmapChunk(Entry.Chunks.back());
+            }
+            uint32_t NewChunk;
+            if (!AllocateChunk(NewChunk))
+            {
+                return false;
+            }
+            Entry.Chunks.push_back(NewChunk);
+        }
+        uint32_t Chunk = Entry.Chunks.back();
+        if (!MapChunk(Chunk))
+        {
+            return false;
+        }
+        GetRenderData(Chunk)[Offset] = Particles[Index].Render;
+        GetPhysicsData(Chunk)[Offset] = Particles[Index].Physics;
+        Entry.NumParticles++;
+    }
+    if (!Entry.Chunks.empty())
+    {
+        UnmapChunk(Entry.Chunks.back());
+    }
+    return true;
+}
+
+bool OutOfCoreMPMSolver::ScatterSlab(uint32_t SlabIndex, float DeltaTime)
+{
+    const Slab& Entry = Slabs[SlabIndex];
+    for (size_t Index = 0; Index < Entry.Chunks.size(); Index++)
+    {
+        uint32_t Chunk = Entry.Chunks[Index];
+        uint32_t Count = std::min<uint32_t>(Entry.NumParticles - static_cast<uint32_t>(Index) * Params.ChunkParticles, Params.ChunkParticles);
+        if (!MapChunk(Chunk))
+        {
+            return false;
+        }
+        Kernels.ScatterParticles(GetRenderData(Chunk), GetPhysicsData(Chunk), Count, Grid.data(), DeltaTime);
+        if (!KeepScatteredSlab)
+        {
+            UnmapChunk(Chunk);
+        }
+    }
+    return true;
+}
+
+void OutOfCoreMPMSolver::GatherSlab(uint32_t SlabIndex, float DeltaTime)
+{
+    Slab& Entry = Slabs[SlabIndex];
+    uint32_t Index = 0;
+    while (Index < Entry.NumParticles)
+    {
+        uint32_t Chunk = Entry.Chunks[Index / Params.ChunkParticles];
+        uint32_t Offset = Index % Params.ChunkParticles;
+        ParticleRenderData& Render = GetRenderData(Chunk)[Offset];
+        ParticlePhysicsData& Physics = GetPhysicsData(Chunk)[Offset];
+        Kernels.StepParticle(Render, Physics, Grid.data(), DeltaTime);
+        KineticEnergy += 0.5 * Render.Velocity.Dot(Render.Velocity);
+
+        uint32_t NewSlab = GetSlab(Render.Position);
+        if (NewSlab == SlabIndex)
+        {
+            Index++;
+            continue;
+        }
+
+        // Fill the hole with the slab's last particle, which hasn't been gathered yet
+        Migrating.push_back({Render, Physics, NewSlab});
+        uint32_t Last = --Entry.NumParticles;
+        uint32_t LastChunk = Entry.Chunks[Last / Params.ChunkParticles];
+        Render = GetRenderData(LastChunk)[Last % Params.ChunkParticles];
+        Physics = GetPhysicsData(LastChunk)[Last % Params.ChunkParticles];
+        if (Last % Params.ChunkParticles == 0)
+        {
+            UnmapChunk(LastChunk);
+            FreeChunks.push_back(LastChunk);
+            Entry.Chunks.pop_back();
+        }
+    }
+}
+
+bool OutOfCoreMPMSolver::MigrateParticles()
+{
+    std::sort(Migrating.begin(), Migrating.end(), [](const MigratingParticle& A, const MigratingParticle& B)
+              { return A.Slab < B.Slab; });
+    size_t First = 0;
+    while (First < Migrating.size())
+    {
+        size_t End = First;
+        while (End < Migrating.size() && Migrating[End].Slab == Migrating[First].Slab)
+        {
+            End++;
+        }
+        if (!AppendParticles(Migrating[First].Slab, Migrating.data() + First, static_cast<uint32_t>(End - First)))
+        {
+            return false;
+        }
+        First = End;
+    }
+    Migrating.clear();
+    return true;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "fluids/IFluidSolver.h"
+#include "fluids/MPMSolver.h"
+#include "util/MappedFile.h"
+#include <algorithm>
+#include <filesystem>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Particles write two columns past their base column, so a slab has to be at least that wide for the gather of the
+// previous slab to only need the columns of the current one
+#define MIN_OUT_OF_CORE_SLAB_COLUMNS 2
+#define NO_OUT_OF_CORE_SLAB UINT32_MAX
+
+struct OutOfCoreParameters
+{
+    // Holds the particles, replaced when the solver is opened
+    std::filesystem::path FilePath = "particles.bin";
+    // Grid columns per slab, the unit the step walks the domain in
+    uint32_t SlabColumns = 8;
+    // Particles per chunk of the file, every chunk belongs to one slab
+    uint32_t ChunkParticles = 16384;
+};
+
+// Steps the (2D) CPU MPM solver on particle sets larger than memory. The particles live in a memory mapped file, in
+// chunks sorted by the slab of grid columns they are in, and only the grid is kept in memory. A step walks the slabs
+// once. Slab s scatters into the grid, its columns are then complete since no later slab reaches them and get
+// updated, and slab s - 1 gathers, its stencils reaching at most two columns into slab s. So only three slabs are
+// mapped at a time, the two being worked on and the next one, which the OS reads in meanwhile. Every step reads and
+// writes the file once, a run too big for memory slows down to the disk's bandwidth instead of failing.
+// When views can't be mapped the solver first stops mapping ahead, then stops keeping the scattered slab mapped until
+// its gather, so only the gathered slab and one chunk are mapped at a time. If that still fails, or the file can't
+// grow, it stops: the call returns false and GetError says why, and the particles are left in an undefined state
+class OutOfCoreMPMSolver
+{
+public:
+    OutOfCoreMPMSolver(const MPMSolver::FluidParameters& FluidParams, MaterialModel Model = JellyMaterial, const OutOfCoreParameters& Params = OutOfCoreParameters());
+    ~OutOfCoreMPMSolver();
+
+    // Creates the particle file, returns false if it can't be created
+    bool Open();
+    // Adds particles at rest. Can be called in batches to build a scene that doesn't fit in memory at once
+    bool AddParticles(const ParticleRenderData* Particles, uint32_t Count);
+
+    bool Step(float DeltaTime);
+
+    // Why the last call that returned false failed
+    const std::string& GetError() const;
+
+    uint64_t GetNumParticles() const;
+    // 0.5 * |v|^2 summed over the particles of the last step
+    double GetKineticEnergy() const;
+
+    // Calls Func(const ParticleRenderData* Particles, uint32_t Count) for every chunk of particles, e.g. to write a
+    // frame out. Only one chunk is mapped at a time
+    template <typename F>
+    bool ForEachChunk(F&& Func)
+    {
+        for (const Slab& Entry : Slabs)
+        {
+            for (size_t Index = 0; Index < Entry.Chunks.size(); Index++)
+            {
+                uint32_t Count = std::min<uint32_t>(Entry.NumParticles - static_cast<uint32_t>(Index) * Params.ChunkParticles, Params.ChunkParticles);
+                if (!MapChunk(Entry.Chunks[Index]))
+                {
+                    return false;
+                }
+                Func(GetRenderData(Entry.Chunks[Index]), Count);
+                UnmapChunk(Entry.Chunks[Index]);
+            }
+        }
+        return true;
+    }
+
+private:
+    // Particles fill a slab's chunks in order, every chunk but the last is full
+    struct Slab
+    {
+        std::vector<uint32_t> Chunks;
+        uint32_t NumParticles = 0;
+    };
+
+    struct MigratingParticle
+    {
+        ParticleRenderData Render;
+        ParticlePhysicsData Physics;
+        uint32_t Slab;
+    };
+
+    uint32_t GetSlab(const Math::Vec4& Position) const;
+    // Each chunk holds ChunkParticles render records followed by as many physics records
+    ParticleRenderData* GetRenderData(uint32_t Chunk) const;
+    ParticlePhysicsData* GetPhysicsData(uint32_t Chunk) const;
+
+    // Grows the file if there is no free chunk. Returns false if the disk is full
+    bool AllocateChunk(uint32_t& Chunk);
+    // Frees views by giving up the look-ahead slab and then all but the gathered slab's if mapping fails
+    bool MapChunk(uint32_t Chunk);
+    void UnmapChunk(uint32_t Chunk);
+    bool MapSlab(uint32_t SlabIndex);
+    // Maps the next slab ahead and starts reading it in. Failing only turns the look-ahead off
+    void MapSlabAhead(uint32_t SlabIndex);
+    void UnmapSlab(uint32_t SlabIndex);
+    bool Fail(const char* Error);
+
+    // Appends to the end of a slab, mapping its chunks only while writing to them
+    bool AppendParticles(uint32_t SlabIndex, const MigratingParticle* Particles, uint32_t Count);
+    bool ScatterSlab(uint32_t SlabIndex, float DeltaTime);
+    // Gathers and moves the slab's particles, queueing the ones that left it in Migrating
+    void GatherSlab(uint32_t SlabIndex, float DeltaTime);
+    // Appends every queued particle to its slab
+    bool MigrateParticles();
+
+    MPMSolver::FluidParameters FluidValues;
+    OutOfCoreParameters Params;
+    float InvDx;
+    int GridResolution;
+
+    // Only used for its transfer kernels, it holds no particles itself
+    std::vector<ParticleRenderData> NoParticles;
+    MPMSolver Kernels;
+    std::vector<GridCell> Grid;
+
+    MappedFile File;
+    size_t ChunkBytes = 0;
+    uint32_t NumFileChunks = 0;
+    std::vector<uint32_t> FreeChunks;
+    // Mapped view of every chunk, nullptr while unmapped
+    std::vector<uint8_t*> ChunkViews;
+    std::vector<Slab> Slabs;
+    uint64_t NumParticles = 0;
+    double KineticEnergy = 0.0;
+
+    // Each turned off for good once mapping fails, see the class comment
+    bool MapAhead = true;
+    bool KeepScatteredSlab = true;
+    uint32_t SlabAhead = NO_OUT_OF_CORE_SLAB;
+    uint32_t SlabGathered = NO_OUT_OF_CORE_SLAB;
+    std::string Error;
+
+    // Particles waiting to be appended to their slab, filled by AddParticles and by the gathers of a step
+    std::vector<MigratingParticle> Migrating;
+};
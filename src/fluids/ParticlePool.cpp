@@ -0,0 +1,144 @@
+#include "fluids/ParticlePool.h"
+
+#include "fluids/MPMSolver.h"
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+
+// Particles per compaction chunk
+#define COMPACTION_CHUNK_SIZE 4096
+// Fraction of holes that triggers a compaction
+#define COMPACTION_THRESHOLD 0.125f
+
+ParticlePool::ParticlePool(uint32_t Capacity)
+    : Capacity(Capacity)
+{
+}
+
+void ParticlePool::SetCapacity(uint32_t NewCapacity, std::vector<ParticleRenderData>& Particles, ParticlePhysicsArray& PhysicsData)
+{
+    Capacity = std::max(NewCapacity, static_cast<uint32_t>(Particles.size()));
+    Particles.reserve(Capacity);
+    PhysicsData.reserve(Capacity);
+    ScratchParticles.reserve(Capacity);
+    ShareAllocator(PhysicsData);
+    ScratchPhysicsData.reserve(Capacity);
+    FreeList.reserve(Capacity);
+}
+
+void ParticlePool::Reset()
+{
+    FreeList.clear();
+}
+
+bool ParticlePool::IsAlive(const ParticleRenderData& Particle)
+{
+    return Particle.Position.w != 0.0f;
+}
+
+uint32_t ParticlePool::Allocate(std::vector<ParticleRenderData>& Particles, ParticlePhysicsArray& PhysicsData)
+{
+    if (!FreeList.empty())
+    {
+        uint32_t Index = FreeList.back();
+        FreeList.pop_back();
+        return Index;
+    }
+    if (Particles.size() >= Capacity)
+    {
+        return UINT32_MAX;
+    }
+    Particles.emplace_back();
+    PhysicsData.emplace_back();
+    return static_cast<uint32_t>(Particles.size() - 1);
+}
+
+void ParticlePool::Free(uint32_t Index, std::vector<ParticleRenderData>& Particles)
+{
+    Particles[Index].Position.w = 0.0f;
+    Particles[Index].Velocity = Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    FreeList.push_back(Index);
+}
+
+bool ParticlePool::ShouldCompact(size_t NumSlots) const
+{
+    return FreeList.size() > NumSlots * COMPACTION_THRESHOLD;
+}
+
+void ParticlePool::Compact(std::vector<ParticleRenderData>& Particles, ParticlePhysicsArray& PhysicsData)
+{
+    if (FreeList.empty())
+    {
+        return;
+    }
+
+    uint32_t NumSlots = static_cast<uint32_t>(Particles.size());
+    uint32_t NumChunks = (NumSlots + COMPACTION_CHUNK_SIZE - 1) / COMPACTION_CHUNK_SIZE;
+    ChunkOffsets.assign(NumChunks + 1, 0);
+
+    // Count the live particles of every chunk
+    ThreadPool::Run(NumChunks, 1, [&](uint32_t FirstChunk, uint32_t LastChunk)
+                    {
+        for (uint32_t Chunk = FirstChunk; Chunk < LastChunk; Chunk++)
+        {
+            uint32_t End = std::min((Chunk + 1) * COMPACTION_CHUNK_SIZE, NumSlots);
+            uint32_t Count = 0;
+            for (uint32_t i = Chunk * COMPACTION_CHUNK_SIZE; i < End; i++)
+            {
+                Count += IsAlive(Particles[i]);
+            }
+            ChunkOffsets[Chunk + 1] = Count;
+        } });
+
+    // Exclusive scan gives each chunk its output offset
+    for (uint32_t Chunk = 0; Chunk < NumChunks; Chunk++)
+    {
+        ChunkOffsets[Chunk + 1] += ChunkOffsets[Chunk];
+    }
+    uint32_t NumLive = ChunkOffsets[NumChunks];
+    ScratchParticles.resize(NumLive);
+    ShareAllocator(PhysicsData);
+    ScratchPhysicsData.resize(NumLive);
+
+    // Scatter the survivors
+    ThreadPool::Run(NumChunks, 1, [&](uint32_t FirstChunk, uint32_t LastChunk)
+                    {
+        for (uint32_t Chunk = FirstChunk; Chunk < LastChunk; Chunk++)
+        {
+            uint32_t End = std::min((Chunk + 1) * COMPACTION_CHUNK_SIZE, NumSlots);
+            uint32_t Write = ChunkOffsets[Chunk];
+            for (uint32_t i = Chunk * COMPACTION_CHUNK_SIZE; i < End; i++)
+            {
+                if (IsAlive(Particles[i]))
+                {
+                    ScratchParticles[Write] = Particles[i];
+                    ScratchPhysicsData[Write] = PhysicsData[i];
+                    Write++;
+                }
+            }
+        } });
+
+    // The old arrays become the scratch space for next time
+    Particles.swap(ScratchParticles);
+    PhysicsData.swap(ScratchPhysicsData);
+    FreeList.clear();
+}
+
+void ParticlePool::ShareAllocator(const ParticlePhysicsArray& PhysicsData)
+{
+    // Compact swaps the scratch with the physics data, keep both in the same arena
+    if (ScratchPhysicsData.get_allocator() != PhysicsData.get_allocator())
+    {
+        ScratchPhysicsData = ParticlePhysicsArray(PhysicsData.get_allocator());
+    }
+}
+
+uint32_t ParticlePool::GetCapacity() const
+{
+    return Capacity;
+}
+
+uint32_t ParticlePool::GetNumHoles() const
+{
+    return static_cast<uint32_t>(FreeList.size());
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "fluids/IFluidSolver.h"
+#include "util/MemoryArena.h"
+#include <stdint.h>
+#include <vector>
+
+struct ParticlePhysicsData;
+// The CPU solver's physics data lives in its run arena
+typedef std::vector<ParticlePhysicsData, ArenaAllocator<ParticlePhysicsData>> ParticlePhysicsArray;
+
+// Fixed capacity particle storage for the CPU solver. Removed particles leave a hole that is tracked on a free list
+// and reused by the next spawn, holes are squeezed out by an occasional parallel stream compaction.
+// Dead particles have Position.w = 0, which the vertex shader uses to hide them
+class ParticlePool
+{
+public:
+    ParticlePool(uint32_t Capacity = 0);
+
+    void SetCapacity(uint32_t NewCapacity, std::vector<ParticleRenderData>& Particles, ParticlePhysicsArray& PhysicsData);
+    // Forgets every hole, call after the particle arrays were rebuilt from scratch
+    void Reset();
+
+    static bool IsAlive(const ParticleRenderData& Particle);
+
+    // Returns the slot for a new particle, or UINT32_MAX when the pool is full. The caller fills in the slot
+    uint32_t Allocate(std::vector<ParticleRenderData>& Particles, ParticlePhysicsArray& PhysicsData);
+    void Free(uint32_t Index, std::vector<ParticleRenderData>& Particles);
+
+    // Compacts once holes make up more than this fraction of the arrays
+    bool ShouldCompact(size_t NumSlots) const;
+    // Moves every live particle to the front of the arrays, keeping their order
+    void Compact(std::vector<ParticleRenderData>& Particles, ParticlePhysicsArray& PhysicsData);
+
+    uint32_t GetCapacity() const;
+    uint32_t GetNumHoles() const;
+
+private:
+    void ShareAllocator(const ParticlePhysicsArray& PhysicsData);
+
+    uint32_t Capacity;
+    std::vector<uint32_t> FreeList;
+
+    // Compaction scratch, reserved to Capacity so compacting never allocates
+    std::vector<uint32_t> ChunkOffsets;
+    std::vector<ParticleRenderData> ScratchParticles;
+    ParticlePhysicsArray ScratchPhysicsData;
+};
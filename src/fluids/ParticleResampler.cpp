@@ -0,0 +1,192 @@
+#include "fluids/ParticleResampler.h"
+
+#include "fluids/MPMSolver.h"
+
+#include <algorithm>
+
+namespace
+{
+    float StrainRateSq(const ParticlePhysicsData& PhysicsData)
+    {
+        Math::Matrix4x4 C = PhysicsData.C;
+        float Sum = 0.0f;
+        for (int Element = 0; Element < 16; Element++)
+        {
+            Sum += C.m[Element] * C.m[Element];
+        }
+        return Sum;
+    }
+}
+
+ParticleResampler::ParticleResampler(int GridResolution, float Dx, float BaseMass, const ResamplingParameters& Params)
+    : Params(Params), GridResolution(GridResolution), Dx(Dx), InvDx(1.0f / Dx), MinMass(BaseMass * Params.MinMassRatio), MaxMass(BaseMass * Params.MaxMassRatio)
+{
+    CellCounts = std::vector<uint32_t>(GridResolution * GridResolution);
+    CellMergeCandidate = std::vector<int32_t>(GridResolution * GridResolution);
+}
+
+const ResamplingParameters& ParticleResampler::GetParameters() const
+{
+    return Params;
+}
+
+int ParticleResampler::GetCellIndex(const Math::Vec4& Position) const
+{
+    int X = std::clamp(int(Position.x * InvDx), 0, GridResolution - 1);
+    int Y = std::clamp(int(Position.y * InvDx), 0, GridResolution - 1);
+    return X * GridResolution + Y;
+}
+
+bool ParticleResampler::IsNearSurface(int CellIndex) const
+{
+    int X = CellIndex / GridResolution;
+    int Y = CellIndex % GridResolution;
+    for (int OffsetX = -1; OffsetX <= 1; OffsetX++)
+    {
+        for (int OffsetY = -1; OffsetY <= 1; OffsetY++)
+        {
+            int NeighbourX = std::clamp(X + OffsetX, 0, GridResolution - 1);
+            int NeighbourY = std::clamp(Y + OffsetY, 0, GridResolution - 1);
+            if (CellCounts[NeighbourX * GridResolution + NeighbourY] == 0)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool ParticleResampler::Resample(std::vector<ParticleRenderData>& Particles, ParticlePhysicsArray& PhysicsData)
+{
+    uint32_t NumParticles = static_cast<uint32_t>(Particles.size());
+
+    std::fill(CellCounts.begin(), CellCounts.end(), 0);
+    std::fill(CellMergeCandidate.begin(), CellMergeCandidate.end(), -1);
+    for (const ParticleRenderData& Particle : Particles)
+    {
+        CellCounts[GetCellIndex(Particle.Position)]++;
+    }
+
+    Removed = std::vector<uint8_t>(NumParticles, 0);
+    SplitCandidates.clear();
+    uint32_t NumRemoved = 0;
+
+    float MergeStrainRateSq = Params.MergeStrainRate * Params.MergeStrainRate;
+    float SplitStrainRateSq = Params.SplitStrainRate * Params.SplitStrainRate;
+
+    for (uint32_t i = 0; i < NumParticles; i++)
+    {
+        int Cell = GetCellIndex(Particles[i].Position);
+        bool NearSurface = IsNearSurface(Cell);
+        float StrainSq = StrainRateSq(PhysicsData[i]);
+
+        if (!NearSurface && StrainSq < MergeStrainRateSq)
+        {
+            // Pair calm interior particles sharing a cell
+            int32_t Partner = CellMergeCandidate[Cell];
+            if (Partner < 0)
+            {
+                CellMergeCandidate[Cell] = i;
+                continue;
+            }
+
+            ParticlePhysicsData& Kept = PhysicsData[Partner];
+            const ParticlePhysicsData& Absorbed = PhysicsData[i];
+            float Mass = Kept.Mass + Absorbed.Mass;
+            if (Mass > MaxMass)
+            {
+                CellMergeCandidate[Cell] = i;
+                continue;
+            }
+
+            // Mass weighted averages keep the center of mass and linear momentum unchanged
+            float KeptWeight = Kept.Mass / Mass;
+            float AbsorbedWeight = Absorbed.Mass / Mass;
+            Particles[Partner].Position = Particles[Partner].Position * KeptWeight + Particles[i].Position * AbsorbedWeight;
+            Particles[Partner].Velocity = Particles[Partner].Velocity * KeptWeight + Particles[i].Velocity * AbsorbedWeight;
+            Kept.C = Math::Matrix4x4(Kept.C) * KeptWeight + Math::Matrix4x4(Absorbed.C) * AbsorbedWeight;
+            Kept.DeformGradient = Math::Matrix4x4(Kept.DeformGradient) * KeptWeight + Math::Matrix4x4(Absorbed.DeformGradient) * AbsorbedWeight;
+            Kept.J = Kept.J * KeptWeight + Absorbed.J * AbsorbedWeight;
+            Kept.PlasticJ = Kept.PlasticJ * KeptWeight + Absorbed.PlasticJ * AbsorbedWeight;
+            Kept.InitialVolume += Absorbed.InitialVolume;
+            Kept.Mass = Mass;
+
+            Removed[i] = 1;
+            NumRemoved++;
+            CellMergeCandidate[Cell] = -1;
+        }
+        else if ((NearSurface || StrainSq > SplitStrainRateSq) && PhysicsData[i].Mass * 0.5f >= MinMass)
+        {
+            // Surface particles go first, then the most strained ones
+            SplitCandidates.push_back({i, (NearSurface ? SplitStrainRateSq : 0.0f) + StrainSq});
+        }
+    }
+
+    uint32_t Available = Params.ParticleBudget > NumParticles - NumRemoved ? Params.ParticleBudget - (NumParticles - NumRemoved) : 0;
+    if (SplitCandidates.size() > Available)
+    {
+        std::partial_sort(SplitCandidates.begin(), SplitCandidates.begin() + Available, SplitCandidates.end(), [](const SplitCandidate& A, const SplitCandidate& B)
+                          { return A.Priority > B.Priority; });
+        SplitCandidates.resize(Available);
+    }
+
+    float Size = GridResolution * Dx;
+    for (const SplitCandidate& Candidate : SplitCandidates)
+    {
+        uint32_t i = Candidate.Index;
+        if (Removed[i])
+        {
+            continue;
+        }
+
+        // Split along the most stretched axis, a quarter cell either side of the original position
+        ParticlePhysicsData& PhysicsA = PhysicsData[i];
+        Math::Matrix4x4 DeformGradient = PhysicsA.DeformGradient;
+        Math::Vec4 StretchX = DeformGradient.GetColumn(0);
+        Math::Vec4 StretchY = DeformGradient.GetColumn(1);
+        Math::Vec3 Offset = StretchX.Dot(StretchX) >= StretchY.Dot(StretchY) ? Math::Vec3(0.25f * Dx, 0.0f, 0.0f) : Math::Vec3(0.0f, 0.25f * Dx, 0.0f);
+
+        PhysicsA.Mass *= 0.5f;
+        PhysicsA.InitialVolume *= 0.5f;
+        ParticlePhysicsData PhysicsB = PhysicsA;
+
+        // Sample the particle's affine velocity field at the new positions, the two offsets cancel so momentum is conserved
+        Math::Vec3 VelocityOffset = Math::Matrix4x4(PhysicsA.C).TransformVector(Offset);
+
+        ParticleRenderData ParticleB = Particles[i];
+        ParticleB.Position = ParticleB.Position - Offset;
+        ParticleB.Velocity = ParticleB.Velocity - VelocityOffset;
+        Particles[i].Position += Offset;
+        Particles[i].Velocity += VelocityOffset;
+
+        for (ParticleRenderData* Particle : {&Particles[i], &ParticleB})
+        {
+            Particle->Position.x = std::min(std::max(Particle->Position.x, Dx), Size - Dx);
+            Particle->Position.y = std::min(std::max(Particle->Position.y, Dx), Size - Dx);
+        }
+
+        Particles.push_back(ParticleB);
+        PhysicsData.push_back(PhysicsB);
+        Removed.push_back(0);
+    }
+
+    if (NumRemoved == 0 && SplitCandidates.empty())
+    {
+        return false;
+    }
+
+    // Compact out the merged particles
+    size_t Write = 0;
+    for (size_t Read = 0; Read < Particles.size(); Read++)
+    {
+        if (!Removed[Read])
+        {
+            Particles[Write] = Particles[Read];
+            PhysicsData[Write] = PhysicsData[Read];
+            Write++;
+        }
+    }
+    Particles.resize(Write);
+    PhysicsData.resize(Write);
+    return true;
+}
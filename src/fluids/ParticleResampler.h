@@ -0,0 +1,57 @@
+#pragma once
+
+#include "fluids/IFluidSolver.h"
+#include "fluids/ParticlePool.h"
+#include <stdint.h>
+#include <vector>
+
+struct ResamplingParameters
+{
+    // Hard cap on the number of live particles, 0 disables resampling
+    uint32_t ParticleBudget = 0;
+    // Solver steps between resampling passes
+    uint32_t Interval = 20;
+    // Interior particles with a velocity gradient norm below this may merge
+    float MergeStrainRate = 0.5f;
+    // Particles with a velocity gradient norm above this split, as do particles near the free surface
+    float SplitStrainRate = 4.0f;
+    // Particle mass limits, relative to the mass particles were seeded with
+    float MinMassRatio = 0.25f;
+    float MaxMassRatio = 4.0f;
+};
+
+// Merges particles in calm interior regions and splits them near the free surface and in high strain zones,
+// conserving mass and linear momentum, so the particle count follows the detail of the scene.
+// Works on the 2D grid layout of the CPU solver
+class ParticleResampler
+{
+public:
+    ParticleResampler(int GridResolution, float Dx, float BaseMass, const ResamplingParameters& Params);
+
+    // Returns true if any particle was merged or split. Particle order is not preserved
+    bool Resample(std::vector<ParticleRenderData>& Particles, ParticlePhysicsArray& PhysicsData);
+
+    const ResamplingParameters& GetParameters() const;
+
+private:
+    int GetCellIndex(const Math::Vec4& Position) const;
+    bool IsNearSurface(int CellIndex) const;
+
+    struct SplitCandidate
+    {
+        uint32_t Index;
+        float Priority;
+    };
+
+    ResamplingParameters Params;
+    int GridResolution;
+    float Dx;
+    float InvDx;
+    float MinMass;
+    float MaxMass;
+
+    std::vector<uint32_t> CellCounts;
+    std::vector<int32_t> CellMergeCandidate;
+    std::vector<uint8_t> Removed;
+    std::vector<SplitCandidate> SplitCandidates;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "util/3DMath.h"
+
+// Inflow nozzle, a disc in the XY plane that spawns particles at a fixed rate
+struct ParticleEmitter
+{
+    Math::Vec4 Position;
+    Math::Vec4 Velocity = Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    float Radius = 0.05f;
+    // Particles per second
+    float Rate = 5000.0f;
+};
+
+// Drain or kill plane, particles entering the box are removed
+struct ParticleSink
+{
+    Math::Vec4 Min;
+    Math::Vec4 Max;
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "util/3DMath.h"
+#include <stdint.h>
+#include <string.h>
+
+// F16C converts four halfs an instruction, without it (ARM, x86 builds below AVX2) the scalar conversions are used.
+// GCC and Clang only define __F16C__ with -mf16c or a -march that has it, MSVC's /arch:AVX2 implies it
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define PARTICLE_STORAGE_F16C
+#include <immintrin.h>
+#endif
+
+// How the CPU solver stores the matrices of every particle, chosen at compile time. The full layout keeps C and F as
+// 4x4 floats, 144 bytes of physics data a particle. The compact layout keeps only what the 2D solver uses, the
+// in-plane block of C in half precision and of F in float, 44 bytes a particle. Math stays float either way, the
+// stored matrices widen to Math::Matrix4x4 when read
+#define PARTICLE_STORAGE_FULL 0
+#define PARTICLE_STORAGE_COMPACT 1
+#ifndef PARTICLE_STORAGE
+#define PARTICLE_STORAGE PARTICLE_STORAGE_COMPACT
+#endif
+
+// IEEE half precision conversions rounding to nearest even, bit for bit what F16C does
+inline uint16_t HalfFromFloat(float Value)
+{
+    uint32_t Bits;
+    memcpy(&Bits, &Value, sizeof(Bits));
+    uint16_t Sign = static_cast<uint16_t>((Bits >> 16) & 0x8000);
+    uint32_t Magnitude = Bits & 0x7fffffff;
+    if (Magnitude > 0x7f800000)
+    {
+        // NaN, quieted with the top of its payload kept
+        return Sign | 0x7e00 | static_cast<uint16_t>((Magnitude >> 13) & 0x3ff);
+    }
+    if (Magnitude >= 0x477ff000)
+    {
+        // Infinity, or past halfway from the largest half (65504) to the next power of two
+        return Sign | 0x7c00;
+    }
+
+    uint32_t Half, Remainder, Halfway;
+    if (Magnitude >= 0x38800000)
+    {
+        // Normal half, move the exponent bias from 127 to 15
+        uint32_t Rebiased = Magnitude - 0x38000000;
+        Half = Rebiased >> 13;
+        Remainder = Rebiased & 0x1fff;
+        Halfway = 0x1000;
+    }
+    else
+    {
+        // Subnormal half, anything at or below half of the smallest one (2^-25) rounds to zero
+        uint32_t Exponent = Magnitude >> 23;
+        if (Exponent < 102)
+        {
+            return Sign;
+        }
+        uint32_t Mantissa = (Magnitude & 0x7fffff) | 0x800000;
+        uint32_t Shift = 126 - Exponent;
+        Half = Mantissa >> Shift;
+        Remainder = Mantissa & ((1u << Shift) - 1);
+        Halfway = 1u << (Shift - 1);
+    }
+    // A carry out of the mantissa moves on to the next exponent, which is still the right value
+    if (Remainder > Halfway || (Remainder == Halfway && (Half & 1)))
+    {
+        Half++;
+    }
+    return Sign | static_cast<uint16_t>(Half);
+}
+
+inline float FloatFromHalf(uint16_t Half)
+{
+    uint32_t Sign = uint32_t(Half & 0x8000) << 16;
+    uint32_t Exponent = (Half >> 10) & 0x1f;
+    uint32_t Mantissa = Half & 0x3ff;
+    uint32_t Bits;
+    if (Exponent == 0x1f)
+    {
+        // Infinity, or a NaN that comes back quieted
+        Bits = Sign | 0x7f800000 | (Mantissa ? 0x400000 | (Mantissa << 13) : 0);
+    }
+    else if (Exponent == 0)
+    {
+        // Zero or subnormal, Mantissa * 2^-24 is exact in float
+        float Value = float(Mantissa) * 5.9604644775390625e-8f;
+        return Sign ? -Value : Value;
+    }
+    else
+    {
+        Bits = Sign | ((Exponent + 112) << 23) | (Mantissa << 13);
+    }
+    float Value;
+    memcpy(&Value, &Bits, sizeof(Value));
+    return Value;
+}
+
+// In-plane 2x2 block of a matrix that is zero elsewhere, as halfs. C only has in-plane entries and is rebuilt every
+// step, so its rounding never accumulates
+struct HalfPlanarMatrix
+{
+    uint16_t m11 = 0, m12 = 0, m21 = 0, m22 = 0;
+
+    HalfPlanarMatrix() = default;
+    HalfPlanarMatrix(const Math::Matrix4x4& M)
+    {
+#ifdef PARTICLE_STORAGE_F16C
+        __m128i Halfs = _mm_cvtps_ph(_mm_setr_ps(M.m11, M.m12, M.m21, M.m22), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&m11), Halfs);
+#else
+        m11 = HalfFromFloat(M.m11);
+        m12 = HalfFromFloat(M.m12);
+        m21 = HalfFromFloat(M.m21);
+        m22 = HalfFromFloat(M.m22);
+#endif
+    }
+
+    operator Math::Matrix4x4() const
+    {
+        Math::Matrix4x4 M;
+#ifdef PARTICLE_STORAGE_F16C
+        alignas(16) float Values[4];
+        _mm_store_ps(Values, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&m11))));
+        M.m11 = Values[0];
+        M.m12 = Values[1];
+        M.m21 = Values[2];
+        M.m22 = Values[3];
+#else
+        M.m11 = FloatFromHalf(m11);
+        M.m12 = FloatFromHalf(m12);
+        M.m21 = FloatFromHalf(m21);
+        M.m22 = FloatFromHalf(m22);
+#endif
+        return M;
+    }
+};
+
+// In-plane 2x2 block of a matrix and its out-of-plane stretch, the rest being that of the identity. F accumulates over
+// the whole run so it stays float. Plastic return mapping may change the out-of-plane stretch, nothing couples it back
+// into the plane
+struct PlanarMatrix
+{
+    float m11 = 1.0f, m12 = 0.0f, m21 = 0.0f, m22 = 1.0f, m33 = 1.0f;
+
+    PlanarMatrix() = default;
+    PlanarMatrix(const Math::Matrix4x4& M)
+        : m11(M.m11), m12(M.m12), m21(M.m21), m22(M.m22), m33(M.m33)
+    {
+    }
+
+    operator Math::Matrix4x4() const
+    {
+        Math::Matrix4x4 M = Math::Identity;
+        M.m11 = m11;
+        M.m12 = m12;
+        M.m21 = m21;
+        M.m22 = m22;
+        M.m33 = m33;
+        return M;
+    }
+};
+
+#if PARTICLE_STORAGE == PARTICLE_STORAGE_COMPACT
+typedef HalfPlanarMatrix AffineStorage;
+typedef PlanarMatrix DeformStorage;
+#else
+typedef Math::Matrix4x4 AffineStorage;
+typedef Math::Matrix4x4 DeformStorage;
+#endif
@@ -0,0 +1,120 @@
+#include "fluids/Plasticity.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Plasticity
+{
+    namespace
+    {
+        void ReturnMapSnow(const PlasticityParameters& Params, float Mu, float Lamda, Math::Vec3Batch& Sigma, float PlasticJ[SVD_BATCH_SIZE], Math::Vec3Batch& StressDiagonal)
+        {
+            for (int i = 0; i < SVD_BATCH_SIZE; i++)
+            {
+                float OldJ = Sigma.v[0][i] * Sigma.v[1][i] * Sigma.v[2][i];
+                for (int Axis = 0; Axis < 3; Axis++)
+                {
+                    Sigma.v[Axis][i] = std::clamp(Sigma.v[Axis][i], 1.0f - Params.CriticalCompression, 1.0f + Params.CriticalStretch);
+                }
+                float J = Sigma.v[0][i] * Sigma.v[1][i] * Sigma.v[2][i];
+                PlasticJ[i] *= OldJ / J;
+
+                float Hardening = std::clamp(std::exp(Params.HardeningCoefficient * (1.0f - PlasticJ[i])), 0.1f, 5.0f);
+                float HardenedMu = Mu * Hardening;
+                float HardenedLamda = Lamda * Hardening;
+
+                // Fixed-corotated: P * F^T = 2 * Mu * (F - R) * F^T + Lamda * (J - 1) * J * I
+                for (int Axis = 0; Axis < 3; Axis++)
+                {
+                    StressDiagonal.v[Axis][i] = 2.0f * HardenedMu * (Sigma.v[Axis][i] - 1.0f) * Sigma.v[Axis][i] + HardenedLamda * (J - 1.0f) * J;
+                }
+            }
+        }
+
+        void ReturnMapSand(const PlasticityParameters& Params, float Mu, float Lamda, Math::Vec3Batch& Sigma, float PlasticJ[SVD_BATCH_SIZE], Math::Vec3Batch& StressDiagonal)
+        {
+            float SinFriction = std::sin(Params.FrictionAngle * float(PI) / 180.0f);
+            float Alpha = std::sqrt(2.0f / 3.0f) * 2.0f * SinFriction / (3.0f - SinFriction);
+
+            for (int i = 0; i < SVD_BATCH_SIZE; i++)
+            {
+                float OldJ = Sigma.v[0][i] * Sigma.v[1][i] * Sigma.v[2][i];
+
+                float Strain[3];
+                for (int Axis = 0; Axis < 3; Axis++)
+                {
+                    Strain[Axis] = std::log(std::max(std::abs(Sigma.v[Axis][i]), 1e-4f));
+                }
+                float Trace = Strain[0] + Strain[1] + Strain[2];
+
+                if (Trace >= 0.0f)
+                {
+                    // Expansion, project to the tip of the cone
+                    Strain[0] = Strain[1] = Strain[2] = 0.0f;
+                }
+                else
+                {
+                    float Deviatoric[3] = {Strain[0] - Trace / 3.0f, Strain[1] - Trace / 3.0f, Strain[2] - Trace / 3.0f};
+                    float DeviatoricNorm = std::sqrt(Deviatoric[0] * Deviatoric[0] + Deviatoric[1] * Deviatoric[1] + Deviatoric[2] * Deviatoric[2]);
+                    float PlasticFlow = DeviatoricNorm + (3.0f * Lamda + 2.0f * Mu) / (2.0f * Mu) * Trace * Alpha;
+                    if (PlasticFlow > 0.0f && DeviatoricNorm > 1e-8f)
+                    {
+                        for (int Axis = 0; Axis < 3; Axis++)
+                        {
+                            Strain[Axis] -= PlasticFlow * Deviatoric[Axis] / DeviatoricNorm;
+                        }
+                    }
+                }
+
+                Trace = Strain[0] + Strain[1] + Strain[2];
+                for (int Axis = 0; Axis < 3; Axis++)
+                {
+                    Sigma.v[Axis][i] = std::exp(Strain[Axis]);
+                    // Hencky: P * F^T = U * (2 * Mu * Strain + Lamda * tr(Strain) * I) * U^T
+                    StressDiagonal.v[Axis][i] = 2.0f * Mu * Strain[Axis] + Lamda * Trace;
+                }
+                PlasticJ[i] *= OldJ / (Sigma.v[0][i] * Sigma.v[1][i] * Sigma.v[2][i]);
+            }
+        }
+    }
+
+    void ReturnMap(MaterialModel Model, const PlasticityParameters& Params, float Mu, float Lamda, Math::Matrix3x3Batch& F, float PlasticJ[SVD_BATCH_SIZE], Math::Matrix3x3Batch& Stress)
+    {
+        Math::Matrix3x3Batch U, V;
+        Math::Vec3Batch Sigma;
+        Math::Vec3Batch StressDiagonal = {};
+        Math::SVD3x3(F, U, Sigma, V);
+
+        switch (Model)
+        {
+        case SnowMaterial:
+            ReturnMapSnow(Params, Mu, Lamda, Sigma, PlasticJ, StressDiagonal);
+            break;
+        case SandMaterial:
+            ReturnMapSand(Params, Mu, Lamda, Sigma, PlasticJ, StressDiagonal);
+            break;
+        default:
+            break;
+        }
+
+        // Rebuild F = U * Sigma * V^T and Stress = U * StressDiagonal * U^T. The lane loop is innermost so it vectorizes
+        for (int Col = 0; Col < 3; Col++)
+        {
+            for (int Row = 0; Row < 3; Row++)
+            {
+                for (int i = 0; i < SVD_BATCH_SIZE; i++)
+                {
+                    float FValue = 0.0f;
+                    float StressValue = 0.0f;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        FValue += U.m[k * 3 + Row][i] * Sigma.v[k][i] * V.m[k * 3 + Col][i];
+                        StressValue += U.m[k * 3 + Row][i] * StressDiagonal.v[k][i] * U.m[k * 3 + Col][i];
+                    }
+                    F.m[Col * 3 + Row][i] = FValue;
+                    Stress.m[Col * 3 + Row][i] = StressValue;
+                }
+            }
+        }
+    }
+};
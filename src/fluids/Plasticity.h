@@ -0,0 +1,31 @@
+#pragma once
+
+#include "util/SVD.h"
+
+enum MaterialModel
+{
+    // Neo-hookean hyper-elastic solid with no plasticity
+    JellyMaterial,
+    // Fixed-corotated elasticity with clamped singular values and hardening (Stomakhin et al. 2013)
+    SnowMaterial,
+    // Hencky elasticity with Drucker-Prager yield surface (Klar et al. 2016)
+    SandMaterial
+};
+
+struct PlasticityParameters
+{
+    // Snow
+    float CriticalCompression = 2.5e-2f;
+    float CriticalStretch = 7.5e-3f;
+    float HardeningCoefficient = 10.0f;
+    // Sand, in degrees
+    float FrictionAngle = 30.0f;
+};
+
+namespace Plasticity
+{
+    // Projects every lane of F back onto the yield surface of Model, updating F and PlasticJ in place
+    // JellyMaterial has no yield surface and is evaluated with MPMSolver::NeoHookeanStress instead
+    // Stress receives the Kirchhoff stress (P * F^T) of the projected deformation gradient
+    void ReturnMap(MaterialModel Model, const PlasticityParameters& Params, float Mu, float Lamda, Math::Matrix3x3Batch& F, float PlasticJ[SVD_BATCH_SIZE], Math::Matrix3x3Batch& Stress);
+};
@@ -0,0 +1,277 @@
+#include "fluids/SPHSolver.h"
+
+#include "util/3DMath.h"
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Particles per parallel chunk
+#define PARTICLE_CHUNK_SIZE 1024
+
+SPHSolver::SPHSolver(std::vector<ParticleRenderData>& Particles, float GridSize, const SPHParameters& Params)
+    : Params(Params), Size(GridSize)
+{
+    Stiffness = Params.RestDensity * Params.SoundSpeed * Params.SoundSpeed / Params.TaitExponent;
+    // Normalization of the 2D cubic spline
+    KernelScale = 40.0f / (7.0f * float(PI) * Params.SupportRadius * Params.SupportRadius);
+    MinPosition = 0.5f * Params.SupportRadius;
+    MaxPosition = Size - 0.5f * Params.SupportRadius;
+
+    // Cells no smaller than the support radius, so the 3x3 cells around a particle hold all its neighbours
+    CellsPerSide = std::max(1, static_cast<int>(std::floor(Size / Params.SupportRadius)));
+    InvCellSize = CellsPerSide / Size;
+    CellStart.resize(CellsPerSide * CellsPerSide + 1, 0);
+
+    // Pick the particle mass so the densest part of the initial state sits at rest density. Without particles it stays
+    // at one
+    Mass = 1.0f;
+    SortParticles(Particles);
+    ComputeDensities(Particles);
+    float MaxDensity = Density.empty() ? 0.0f : *std::max_element(Density.begin(), Density.end());
+    Mass = MaxDensity > 0.0f ? Params.RestDensity / MaxDensity : 1.0f;
+}
+
+void SPHSolver::Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList)
+{
+    // The owner restores the particles, the mass from the initial state still applies
+    MaxSpeed = 0.0f;
+    LastSubsteps = 0;
+}
+
+void SPHSolver::CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler)
+{
+}
+
+void SPHSolver::CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation)
+{
+}
+
+void SPHSolver::GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer)
+{
+}
+
+uint32_t SPHSolver::GetLastSubsteps() const
+{
+    return LastSubsteps;
+}
+
+float SPHSolver::Kernel(float Distance) const
+{
+    float q = Distance / Params.SupportRadius;
+    if (q <= 0.5f)
+    {
+        return KernelScale * (6.0f * (q * q * q - q * q) + 1.0f);
+    }
+    if (q <= 1.0f)
+    {
+        float OneMinusQ = 1.0f - q;
+        return KernelScale * 2.0f * OneMinusQ * OneMinusQ * OneMinusQ;
+    }
+    return 0.0f;
+}
+
+float SPHSolver::KernelGradient(float Distance) const
+{
+    float q = Distance / Params.SupportRadius;
+    if (Distance <= 0.0f || q > 1.0f)
+    {
+        return 0.0f;
+    }
+    float Derivative;
+    if (q <= 0.5f)
+    {
+        Derivative = KernelScale * (18.0f * q * q - 12.0f * q) / Params.SupportRadius;
+    }
+    else
+    {
+        float OneMinusQ = 1.0f - q;
+        Derivative = -KernelScale * 6.0f * OneMinusQ * OneMinusQ / Params.SupportRadius;
+    }
+    return Derivative / Distance;
+}
+
+template <typename FuncType>
+void SPHSolver::ForEachNeighbour(const Math::Vec4& Position, FuncType&& Func) const
+{
+    int CellX = std::clamp(static_cast<int>(Position.x * InvCellSize), 0, CellsPerSide - 1);
+    int CellY = std::clamp(static_cast<int>(Position.y * InvCellSize), 0, CellsPerSide - 1);
+    for (int X = std::max(CellX - 1, 0); X <= std::min(CellX + 1, CellsPerSide - 1); X++)
+    {
+        // The cells of one column are contiguous, so the column's three cells are one range
+        int FirstCell = X * CellsPerSide + std::max(CellY - 1, 0);
+        int LastCell = X * CellsPerSide + std::min(CellY + 1, CellsPerSide - 1);
+        for (uint32_t j = CellStart[FirstCell]; j < CellStart[LastCell + 1]; j++)
+        {
+            Func(j);
+        }
+    }
+}
+
+void SPHSolver::SortParticles(std::vector<ParticleRenderData>& Particles)
+{
+    const uint32_t NumParticles = static_cast<uint32_t>(Particles.size());
+    ParticleCells.resize(NumParticles);
+    ThreadPool::Run(NumParticles, PARTICLE_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t i = Begin; i < End; i++)
+        {
+            int CellX = std::clamp(static_cast<int>(Particles[i].Position.x * InvCellSize), 0, CellsPerSide - 1);
+            int CellY = std::clamp(static_cast<int>(Particles[i].Position.y * InvCellSize), 0, CellsPerSide - 1);
+            ParticleCells[i] = CellX * CellsPerSide + CellY;
+        }
+    });
+
+    // Counting sort, CellStart[c] ends up as the first particle of cell c
+    std::fill(CellStart.begin(), CellStart.end(), 0);
+    for (uint32_t Cell : ParticleCells)
+    {
+        CellStart[Cell + 1]++;
+    }
+    for (size_t Cell = 1; Cell < CellStart.size(); Cell++)
+    {
+        CellStart[Cell] += CellStart[Cell - 1];
+    }
+    SortedParticles.resize(NumParticles);
+    for (uint32_t i = 0; i < NumParticles; i++)
+    {
+        SortedParticles[CellStart[ParticleCells[i]]++] = Particles[i];
+    }
+    // Scattering advanced every start to the next cell's, shift them back
+    for (size_t Cell = CellStart.size() - 1; Cell > 0; Cell--)
+    {
+        CellStart[Cell] = CellStart[Cell - 1];
+    }
+    CellStart[0] = 0;
+    Particles.swap(SortedParticles);
+}
+
+void SPHSolver::ComputeDensities(const std::vector<ParticleRenderData>& Particles)
+{
+    const uint32_t NumParticles = static_cast<uint32_t>(Particles.size());
+    Density.resize(NumParticles);
+    Pressure.resize(NumParticles);
+    const float RadiusSq = Params.SupportRadius * Params.SupportRadius;
+    ThreadPool::Run(NumParticles, PARTICLE_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t i = Begin; i < End; i++)
+        {
+            const Math::Vec4& Position = Particles[i].Position;
+            float Sum = 0.0f;
+            ForEachNeighbour(Position, [&](uint32_t j) {
+                float DistX = Position.x - Particles[j].Position.x;
+                float DistY = Position.y - Particles[j].Position.y;
+                float DistSq = DistX * DistX + DistY * DistY;
+                if (DistSq < RadiusSq)
+                {
+                    Sum += Kernel(std::sqrt(DistSq));
+                }
+            });
+            Density[i] = Mass * Sum;
+            // Tait equation, clamped at zero so the free surface does not pull particles into clumps
+            float Ratio = Density[i] / Params.RestDensity;
+            Pressure[i] = std::max(0.0f, Stiffness * (std::pow(Ratio, Params.TaitExponent) - 1.0f));
+        }
+    });
+}
+
+void SPHSolver::ComputeAccelerations(const std::vector<ParticleRenderData>& Particles)
+{
+    const uint32_t NumParticles = static_cast<uint32_t>(Particles.size());
+    Acceleration.resize(NumParticles);
+    const float RadiusSq = Params.SupportRadius * Params.SupportRadius;
+    const float Softening = 0.01f * RadiusSq;
+    ThreadPool::Run(NumParticles, PARTICLE_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t i = Begin; i < End; i++)
+        {
+            const ParticleRenderData& Particle = Particles[i];
+            float PressureTerm = Pressure[i] / (Density[i] * Density[i]);
+            float AccelX = 0.0f, AccelY = -9.8f;
+            ForEachNeighbour(Particle.Position, [&](uint32_t j) {
+                float DistX = Particle.Position.x - Particles[j].Position.x;
+                float DistY = Particle.Position.y - Particles[j].Position.y;
+                float DistSq = DistX * DistX + DistY * DistY;
+                if (j == i || DistSq >= RadiusSq)
+                {
+                    return;
+                }
+                float Gradient = KernelGradient(std::sqrt(DistSq));
+                float Term = PressureTerm + Pressure[j] / (Density[j] * Density[j]);
+
+                // Viscosity only acts on approaching pairs
+                float VelX = Particle.Velocity.x - Particles[j].Velocity.x;
+                float VelY = Particle.Velocity.y - Particles[j].Velocity.y;
+                float Approach = VelX * DistX + VelY * DistY;
+                if (Approach < 0.0f)
+                {
+                    float Nu = 2.0f * Params.Viscosity * Params.SupportRadius * Params.SoundSpeed / (Density[i] + Density[j]);
+                    Term -= Nu * Approach / (DistSq + Softening);
+                }
+
+                AccelX -= Mass * Term * Gradient * DistX;
+                AccelY -= Mass * Term * Gradient * DistY;
+            });
+            Acceleration[i] = Math::Vec4(AccelX, AccelY, 0.0f, 0.0f);
+        }
+    });
+}
+
+void SPHSolver::Integrate(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    const uint32_t NumParticles = static_cast<uint32_t>(Particles.size());
+    const uint32_t NumChunks = (NumParticles + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+    std::vector<float> ChunkMaxSpeedSq(NumChunks, 0.0f);
+    // Symplectic Euler, the walls remove the velocity into them
+    ThreadPool::Run(NumParticles, PARTICLE_CHUNK_SIZE, [&](uint32_t Begin, uint32_t End) {
+        float MaxSpeedSq = 0.0f;
+        for (uint32_t i = Begin; i < End; i++)
+        {
+            ParticleRenderData& Particle = Particles[i];
+            Particle.Velocity.x += DeltaTime * Acceleration[i].x;
+            Particle.Velocity.y += DeltaTime * Acceleration[i].y;
+            Particle.Position.x += DeltaTime * Particle.Velocity.x;
+            Particle.Position.y += DeltaTime * Particle.Velocity.y;
+            if (Particle.Position.x < MinPosition || Particle.Position.x > MaxPosition)
+            {
+                Particle.Position.x = std::clamp(Particle.Position.x, MinPosition, MaxPosition);
+                Particle.Velocity.x = 0.0f;
+            }
+            if (Particle.Position.y < MinPosition || Particle.Position.y > MaxPosition)
+            {
+                Particle.Position.y = std::clamp(Particle.Position.y, MinPosition, MaxPosition);
+                Particle.Velocity.y = 0.0f;
+            }
+            MaxSpeedSq = std::max(MaxSpeedSq, Particle.Velocity.x * Particle.Velocity.x + Particle.Velocity.y * Particle.Velocity.y);
+        }
+        ChunkMaxSpeedSq[Begin / PARTICLE_CHUNK_SIZE] = MaxSpeedSq;
+    });
+    MaxSpeed = std::sqrt(*std::max_element(ChunkMaxSpeedSq.begin(), ChunkMaxSpeedSq.end()));
+}
+
+void SPHSolver::CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    if (Particles.empty())
+    {
+        return;
+    }
+
+    // Substep at the CFL limit of the numerical speed of sound
+    LastSubsteps = 0;
+    float Remaining = DeltaTime;
+    while (Remaining > 0.0f)
+    {
+        float MaxStep = Params.CourantNumber * Params.SupportRadius / (Params.SoundSpeed + MaxSpeed);
+        float Step = std::min(Remaining, MaxStep);
+        // Avoid a sliver of a step at the end
+        if (Remaining - Step < 0.1f * MaxStep)
+        {
+            Step = Remaining;
+        }
+
+        SortParticles(Particles);
+        ComputeDensities(Particles);
+        ComputeAccelerations(Particles);
+        Integrate(Particles, Step);
+
+        Remaining -= Step;
+        LastSubsteps++;
+    }
+}
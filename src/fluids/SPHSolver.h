@@ -0,0 +1,75 @@
+#pragma once
+
+#include "fluids/IFluidSolver.h"
+#include <stdint.h>
+#include <vector>
+
+struct SPHParameters
+{
+    float RestDensity = 1000.0f;
+    // Kernel support radius, roughly twice the particle spacing
+    float SupportRadius = 0.01f;
+    // Numerical speed of sound, the Tait stiffness follows from it. About ten times the fastest expected flow keeps the
+    // density error near 1%
+    float SoundSpeed = 30.0f;
+    float TaitExponent = 7.0f;
+    // Artificial viscosity (Monaghan 1992)
+    float Viscosity = 0.05f;
+    // Substeps are limited to this fraction of the CFL timestep
+    float CourantNumber = 0.4f;
+};
+
+// Weakly compressible SPH (Becker and Teschner 2007) on the (2D) CPU path, as an alternative to the MPM and FLIP
+// solvers on the same scenes. Neighbours are found through a cell linked list with the cell size of the support
+// radius, rebuilt every substep by counting sort, which also reorders the particles by cell for locality
+class SPHSolver : public IFluidSolver
+{
+public:
+    SPHSolver(std::vector<ParticleRenderData>& Particles, float GridSize, const SPHParameters& Params = SPHParameters());
+
+    virtual void Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList) override;
+
+    virtual void CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime) override;
+    virtual void GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer) override;
+
+    // CPU only, there is nothing to create on the GPU
+    virtual void CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler) override;
+    virtual void CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation) override;
+
+    // Substeps taken by the last CPUSolve, for tuning
+    uint32_t GetLastSubsteps() const;
+
+private:
+    void SortParticles(std::vector<ParticleRenderData>& Particles);
+    void ComputeDensities(const std::vector<ParticleRenderData>& Particles);
+    void ComputeAccelerations(const std::vector<ParticleRenderData>& Particles);
+    void Integrate(std::vector<ParticleRenderData>& Particles, float DeltaTime);
+
+    // Calls Func(j) for every particle within the support radius cells of Position, including the particle itself
+    template <typename FuncType>
+    void ForEachNeighbour(const Math::Vec4& Position, FuncType&& Func) const;
+
+    float Kernel(float Distance) const;
+    // dW/dr divided by r, so the gradient is the returned value times the offset
+    float KernelGradient(float Distance) const;
+
+    SPHParameters Params;
+    float Size;
+    float Mass;
+    float Stiffness;
+    float KernelScale;
+    float MinPosition, MaxPosition;
+
+    // Cell linked list over a CellsPerSide^2 grid with cells the size of the support radius
+    int CellsPerSide;
+    float InvCellSize;
+    std::vector<uint32_t> ParticleCells;
+    std::vector<uint32_t> CellStart;
+    std::vector<ParticleRenderData> SortedParticles;
+
+    std::vector<float> Density;
+    std::vector<float> Pressure;
+    std::vector<Math::Vec4> Acceleration;
+    float MaxSpeed = 0.0f;
+    uint32_t LastSubsteps = 0;
+};
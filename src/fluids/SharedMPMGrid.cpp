@@ -0,0 +1,85 @@
+#include "fluids/SharedMPMGrid.h"
+
+#include <algorithm>
+
+SharedMPMGrid::SharedMPMGrid(int GridResolution, float GridSize)
+    : GridResolution(GridResolution), GridSize(GridSize), Activity(GridResolution, float(GridResolution) / GridSize)
+{
+    // The CPU solver is 2D and only touches the first GridResolution^2 cells, and the padding past the far wall
+    Grid = std::vector<GridCell>(GridResolution * GridResolution + CPU_GRID_PADDING(GridResolution));
+}
+
+SharedMPMGrid::~SharedMPMGrid()
+{
+    for (Body& Entry : Bodies)
+    {
+        Entry.Solver->ShareActivityTracker(nullptr);
+    }
+}
+
+bool SharedMPMGrid::AddBody(MPMSolver* Solver, std::vector<ParticleRenderData>* Particles)
+{
+    if (!Solver || Solver->GetGridResolution() != GridResolution || Solver->GetGridSize() != GridSize)
+    {
+        return false;
+    }
+    Solver->ShareActivityTracker(&Activity);
+    Bodies.push_back({Solver, Particles});
+    return true;
+}
+
+void SharedMPMGrid::RemoveBody(MPMSolver* Solver)
+{
+    std::erase_if(Bodies, [Solver](const Body& Entry)
+                  { return Entry.Solver == Solver; });
+    Solver->ShareActivityTracker(nullptr);
+    // Wake everything so the remaining bodies stop leaning on the removed body's cached grid
+    Activity.Reset();
+    for (Body& Entry : Bodies)
+    {
+        Entry.Solver->MarkSleepStateDirty();
+    }
+}
+
+void SharedMPMGrid::Update(MPMSolver* Caller, float DeltaTime)
+{
+    if (!Bodies.empty() && Bodies[0].Solver == Caller)
+    {
+        Solve(DeltaTime);
+    }
+}
+
+void SharedMPMGrid::Solve(float DeltaTime)
+{
+    if (Bodies.empty())
+    {
+        return;
+    }
+
+    for (Body& Entry : Bodies)
+    {
+        Entry.Solver->BeginStep(*Entry.Particles, DeltaTime);
+    }
+
+    std::fill(Grid.begin(), Grid.end(), GridCell{Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+    for (Body& Entry : Bodies)
+    {
+        Entry.Solver->ScatterToGrid(*Entry.Particles, Grid, DeltaTime);
+    }
+
+    // Gravity and boundaries are the same for every body, so any of them can run the update
+    Bodies[0].Solver->UpdateGrid(Grid, DeltaTime);
+
+    for (Body& Entry : Bodies)
+    {
+        Entry.Solver->GatherFromGrid(*Entry.Particles, Grid, DeltaTime);
+    }
+
+    if (Activity.EndStep())
+    {
+        for (Body& Entry : Bodies)
+        {
+            Entry.Solver->MarkSleepStateDirty();
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "fluids/ActivityTracker.h"
+#include "fluids/MPMSolver.h"
+#include <vector>
+
+// Steps several CPU MPM solvers on one grid so their bodies interact. Each solver keeps its own material,
+// particles and render buffers, only the transfers target the same grid and the grid update runs once
+class SharedMPMGrid
+{
+public:
+    SharedMPMGrid(int GridResolution, float GridSize);
+    ~SharedMPMGrid();
+
+    // Fails if the solver's grid resolution or size differ from the shared grid
+    bool AddBody(MPMSolver* Solver, std::vector<ParticleRenderData>* Particles);
+    void RemoveBody(MPMSolver* Solver);
+
+    // Called by every body once per frame, the first registered body advances all of them
+    void Update(MPMSolver* Caller, float DeltaTime);
+    void Solve(float DeltaTime);
+
+private:
+    struct Body
+    {
+        MPMSolver* Solver;
+        std::vector<ParticleRenderData>* Particles;
+    };
+
+    int GridResolution;
+    float GridSize;
+    std::vector<Body> Bodies;
+    std::vector<GridCell> Grid;
+    // Shared so a moving body wakes the sleeping regions of the others
+    ActivityTracker Activity;
+};
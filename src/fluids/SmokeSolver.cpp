@@ -0,0 +1,462 @@
+#include "fluids/SmokeSolver.h"
+
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Cells per side of an activity block
+#define SMOKE_BLOCK_SIZE 8
+// Emitter rates are in particles per second, smoke adds this much density and heat per particle
+#define SMOKE_EMITTER_DENSITY_SCALE 1e-3f
+
+SmokeSolver::SmokeSolver(const std::vector<ParticleRenderData>& Particles, int GridResolution, float GridSize, const SmokeParameters& Params)
+    : Params(Params), GridResolution(GridResolution), Size(GridSize), Dx(GridSize / GridResolution), InvDx(GridResolution / GridSize), PressureSolver(GridResolution, GridSize / GridResolution, Params.Pressure)
+{
+    size_t NumFaces = static_cast<size_t>(GridResolution + 1) * GridResolution;
+    for (std::vector<float>* Faces : {&U, &V, &ScratchU, &ScratchV})
+    {
+        Faces->resize(NumFaces, 0.0f);
+    }
+    size_t NumCells = static_cast<size_t>(GridResolution) * GridResolution;
+    for (std::vector<float>* Field : {&Density, &Temperature, &Forward, &Backward, &Scratch, &InitialDensity, &Divergence, &Pressure})
+    {
+        Field->resize(NumCells, 0.0f);
+    }
+    CellTypes.resize(NumCells, AirCell);
+
+    BlocksPerSide = (GridResolution + SMOKE_BLOCK_SIZE - 1) / SMOKE_BLOCK_SIZE;
+    Active.resize(BlocksPerSide * BlocksPerSide, 0);
+
+    SplatParticles(Particles);
+    Density = InitialDensity;
+    Temperature = InitialDensity;
+    std::fill(Active.begin(), Active.end(), 1);
+    UpdateActiveBlocks();
+}
+
+void SmokeSolver::Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList)
+{
+    for (std::vector<float>* Field : {&U, &V, &ScratchU, &ScratchV, &Forward, &Backward, &Scratch, &Pressure})
+    {
+        std::fill(Field->begin(), Field->end(), 0.0f);
+    }
+    Density = InitialDensity;
+    Temperature = InitialDensity;
+    std::fill(Active.begin(), Active.end(), 1);
+    UpdateActiveBlocks();
+}
+
+void SmokeSolver::CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler)
+{
+}
+
+void SmokeSolver::CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation)
+{
+}
+
+void SmokeSolver::GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer)
+{
+}
+
+void SmokeSolver::AddEmitter(const ParticleEmitter& Emitter)
+{
+    Emitters.push_back(Emitter);
+}
+
+void SmokeSolver::AddSink(const ParticleSink& Sink)
+{
+    Sinks.push_back(Sink);
+}
+
+void SmokeSolver::SetParticleCapacity(uint32_t Capacity)
+{
+    ParticleCapacity = Capacity;
+}
+
+uint32_t SmokeSolver::GetNumActiveBlocks() const
+{
+    return static_cast<uint32_t>(ActiveBlocks.size());
+}
+
+template <typename FuncType>
+void SmokeSolver::ForEachActiveBlock(FuncType&& Func) const
+{
+    ThreadPool::Run(static_cast<uint32_t>(ActiveBlocks.size()), 1, [&](uint32_t Begin, uint32_t End) {
+        for (uint32_t i = Begin; i < End; i++)
+        {
+            int BlockX = ActiveBlocks[i] / BlocksPerSide;
+            int BlockY = ActiveBlocks[i] % BlocksPerSide;
+            int BeginX = BlockX * SMOKE_BLOCK_SIZE;
+            int BeginY = BlockY * SMOKE_BLOCK_SIZE;
+            Func(BeginX, std::min(BeginX + SMOKE_BLOCK_SIZE, GridResolution), BeginY, std::min(BeginY + SMOKE_BLOCK_SIZE, GridResolution));
+        }
+    });
+}
+
+float SmokeSolver::Sample(const std::vector<float>& Field, int NumX, int NumY, float OffsetX, float OffsetY, float X, float Y) const
+{
+    float GridX = X - OffsetX;
+    float GridY = Y - OffsetY;
+    int BaseX = std::clamp(static_cast<int>(std::floor(GridX)), 0, NumX - 2);
+    int BaseY = std::clamp(static_cast<int>(std::floor(GridY)), 0, NumY - 2);
+    float FracX = std::clamp(GridX - BaseX, 0.0f, 1.0f);
+    float FracY = std::clamp(GridY - BaseY, 0.0f, 1.0f);
+
+    const float* Row0 = &Field[BaseX * NumY + BaseY];
+    const float* Row1 = Row0 + NumY;
+    return (1.0f - FracX) * ((1.0f - FracY) * Row0[0] + FracY * Row0[1]) + FracX * ((1.0f - FracY) * Row1[0] + FracY * Row1[1]);
+}
+
+void SmokeSolver::SampleVelocity(float X, float Y, float& OutU, float& OutV) const
+{
+    OutU = Sample(U, GridResolution + 1, GridResolution, 0.0f, 0.5f, X, Y);
+    OutV = Sample(V, GridResolution, GridResolution + 1, 0.5f, 0.0f, X, Y);
+}
+
+void SmokeSolver::SplatParticles(const std::vector<ParticleRenderData>& Particles)
+{
+    // Particle counts per cell, normalized so the densest cell holds one
+    std::fill(InitialDensity.begin(), InitialDensity.end(), 0.0f);
+    for (const ParticleRenderData& Particle : Particles)
+    {
+        int X = std::clamp(static_cast<int>(Particle.Position.x * InvDx), 1, GridResolution - 2);
+        int Y = std::clamp(static_cast<int>(Particle.Position.y * InvDx), 1, GridResolution - 2);
+        InitialDensity[X * GridResolution + Y] += 1.0f;
+    }
+    float MaxDensity = *std::max_element(InitialDensity.begin(), InitialDensity.end());
+    if (MaxDensity > 0.0f)
+    {
+        for (float& Cell : InitialDensity)
+        {
+            Cell /= MaxDensity;
+        }
+    }
+}
+
+void SmokeSolver::ApplySources(float DeltaTime)
+{
+    const int Res = GridResolution;
+    for (const ParticleEmitter& Emitter : Emitters)
+    {
+        int MinX = std::max(static_cast<int>((Emitter.Position.x - Emitter.Radius) * InvDx), 1);
+        int MaxX = std::min(static_cast<int>((Emitter.Position.x + Emitter.Radius) * InvDx), Res - 2);
+        int MinY = std::max(static_cast<int>((Emitter.Position.y - Emitter.Radius) * InvDx), 1);
+        int MaxY = std::min(static_cast<int>((Emitter.Position.y + Emitter.Radius) * InvDx), Res - 2);
+        float Amount = Emitter.Rate * SMOKE_EMITTER_DENSITY_SCALE * DeltaTime;
+        for (int X = MinX; X <= MaxX; X++)
+        {
+            for (int Y = MinY; Y <= MaxY; Y++)
+            {
+                float DistX = (X + 0.5f) * Dx - Emitter.Position.x;
+                float DistY = (Y + 0.5f) * Dx - Emitter.Position.y;
+                if (DistX * DistX + DistY * DistY > Emitter.Radius * Emitter.Radius)
+                {
+                    continue;
+                }
+                int Cell = X * Res + Y;
+                Density[Cell] += Amount;
+                Temperature[Cell] += Amount;
+                U[Cell] = U[Cell + Res] = Emitter.Velocity.x;
+                V[X * (Res + 1) + Y] = V[X * (Res + 1) + Y + 1] = Emitter.Velocity.y;
+                // Picked up by UpdateActiveBlocks
+                Active[(X / SMOKE_BLOCK_SIZE) * BlocksPerSide + Y / SMOKE_BLOCK_SIZE] = 1;
+            }
+        }
+    }
+
+    for (const ParticleSink& Sink : Sinks)
+    {
+        int MinX = std::max(static_cast<int>(Sink.Min.x * InvDx), 0);
+        int MaxX = std::min(static_cast<int>(Sink.Max.x * InvDx), Res - 1);
+        int MinY = std::max(static_cast<int>(Sink.Min.y * InvDx), 0);
+        int MaxY = std::min(static_cast<int>(Sink.Max.y * InvDx), Res - 1);
+        for (int X = MinX; X <= MaxX; X++)
+        {
+            for (int Y = MinY; Y <= MaxY; Y++)
+            {
+                Density[X * Res + Y] = 0.0f;
+                Temperature[X * Res + Y] = 0.0f;
+            }
+        }
+    }
+}
+
+void SmokeSolver::ClearBlock(int BlockX, int BlockY)
+{
+    const int Res = GridResolution;
+    int BeginX = BlockX * SMOKE_BLOCK_SIZE, EndX = std::min(BeginX + SMOKE_BLOCK_SIZE, Res);
+    int BeginY = BlockY * SMOKE_BLOCK_SIZE, EndY = std::min(BeginY + SMOKE_BLOCK_SIZE, Res);
+    // A block owns the faces on its low sides, plus the domain's far faces
+    for (int X = BeginX; X < EndX + (EndX == Res); X++)
+    {
+        for (int Y = BeginY; Y < EndY; Y++)
+        {
+            U[X * Res + Y] = ScratchU[X * Res + Y] = 0.0f;
+        }
+    }
+    for (int X = BeginX; X < EndX; X++)
+    {
+        for (int Y = BeginY; Y < EndY + (EndY == Res); Y++)
+        {
+            V[X * (Res + 1) + Y] = ScratchV[X * (Res + 1) + Y] = 0.0f;
+        }
+        for (int Y = BeginY; Y < EndY; Y++)
+        {
+            int Cell = X * Res + Y;
+            Density[Cell] = Temperature[Cell] = Forward[Cell] = Backward[Cell] = Scratch[Cell] = 0.0f;
+        }
+    }
+}
+
+void SmokeSolver::UpdateActiveBlocks()
+{
+    // Every field is zero outside the active blocks, so only flagged blocks can hold smoke
+    std::vector<uint8_t> NewActive(Active.size(), 0);
+    for (int BlockX = 0; BlockX < BlocksPerSide; BlockX++)
+    {
+        for (int BlockY = 0; BlockY < BlocksPerSide; BlockY++)
+        {
+            if (!Active[BlockX * BlocksPerSide + BlockY])
+            {
+                continue;
+            }
+            float MaxDensity = 0.0f;
+            for (int X = BlockX * SMOKE_BLOCK_SIZE; X < std::min((BlockX + 1) * SMOKE_BLOCK_SIZE, GridResolution); X++)
+            {
+                for (int Y = BlockY * SMOKE_BLOCK_SIZE; Y < std::min((BlockY + 1) * SMOKE_BLOCK_SIZE, GridResolution); Y++)
+                {
+                    MaxDensity = std::max(MaxDensity, Density[X * GridResolution + Y]);
+                }
+            }
+            if (MaxDensity < Params.ActiveThreshold)
+            {
+                continue;
+            }
+            // One block of margin so smoke never advects into an inactive block within a step
+            for (int NeighbourX = std::max(BlockX - 1, 0); NeighbourX <= std::min(BlockX + 1, BlocksPerSide - 1); NeighbourX++)
+            {
+                for (int NeighbourY = std::max(BlockY - 1, 0); NeighbourY <= std::min(BlockY + 1, BlocksPerSide - 1); NeighbourY++)
+                {
+                    NewActive[NeighbourX * BlocksPerSide + NeighbourY] = 1;
+                }
+            }
+        }
+    }
+
+    ActiveBlocks.clear();
+    for (int Block = 0; Block < static_cast<int>(Active.size()); Block++)
+    {
+        if (Active[Block] && !NewActive[Block])
+        {
+            ClearBlock(Block / BlocksPerSide, Block % BlocksPerSide);
+        }
+        if (NewActive[Block])
+        {
+            ActiveBlocks.push_back(Block);
+        }
+    }
+    Active.swap(NewActive);
+}
+
+void SmokeSolver::ApplyBuoyancy(float DeltaTime)
+{
+    const int Res = GridResolution;
+    ForEachActiveBlock([&](int BeginX, int EndX, int BeginY, int EndY) {
+        for (int X = BeginX; X < EndX; X++)
+        {
+            for (int Y = std::max(BeginY, 1); Y < EndY; Y++)
+            {
+                float FaceTemperature = 0.5f * (Temperature[X * Res + Y - 1] + Temperature[X * Res + Y]);
+                float FaceDensity = 0.5f * (Density[X * Res + Y - 1] + Density[X * Res + Y]);
+                V[X * (Res + 1) + Y] += DeltaTime * (Params.Buoyancy * FaceTemperature - Params.Weight * FaceDensity);
+            }
+        }
+    });
+}
+
+void SmokeSolver::AdvectVelocity(float DeltaTime)
+{
+    const int Res = GridResolution;
+    const float Step = DeltaTime * InvDx;
+    ForEachActiveBlock([&](int BeginX, int EndX, int BeginY, int EndY) {
+        for (int X = BeginX; X < EndX + (EndX == Res); X++)
+        {
+            for (int Y = BeginY; Y < EndY; Y++)
+            {
+                float FaceU, FaceV;
+                SampleVelocity(static_cast<float>(X), Y + 0.5f, FaceU, FaceV);
+                ScratchU[X * Res + Y] = Sample(U, Res + 1, Res, 0.0f, 0.5f, X - Step * FaceU, Y + 0.5f - Step * FaceV);
+            }
+        }
+        for (int X = BeginX; X < EndX; X++)
+        {
+            for (int Y = BeginY; Y < EndY + (EndY == Res); Y++)
+            {
+                float FaceU, FaceV;
+                SampleVelocity(X + 0.5f, static_cast<float>(Y), FaceU, FaceV);
+                ScratchV[X * (Res + 1) + Y] = Sample(V, Res, Res + 1, 0.5f, 0.0f, X + 0.5f - Step * FaceU, Y - Step * FaceV);
+            }
+        }
+    });
+    U.swap(ScratchU);
+    V.swap(ScratchV);
+}
+
+void SmokeSolver::Project()
+{
+    const int Res = GridResolution;
+    // Smoke fills the active blocks, beyond them is open air at zero pressure
+    for (int X = 0; X < Res; X++)
+    {
+        for (int Y = 0; Y < Res; Y++)
+        {
+            bool Border = X == 0 || Y == 0 || X == Res - 1 || Y == Res - 1;
+            bool InActiveBlock = Active[(X / SMOKE_BLOCK_SIZE) * BlocksPerSide + Y / SMOKE_BLOCK_SIZE];
+            CellTypes[X * Res + Y] = Border ? SolidCell : (InActiveBlock ? FluidCell : AirCell);
+        }
+    }
+
+    // Walls hold no flow
+    for (int i = 0; i < Res; i++)
+    {
+        U[i] = U[Res * Res + i] = 0.0f;
+        U[Res + i] = U[(Res - 1) * Res + i] = 0.0f;
+        V[i * (Res + 1)] = V[i * (Res + 1) + Res] = 0.0f;
+        V[i * (Res + 1) + 1] = V[i * (Res + 1) + Res - 1] = 0.0f;
+    }
+
+    ForEachActiveBlock([&](int BeginX, int EndX, int BeginY, int EndY) {
+        for (int X = BeginX; X < EndX; X++)
+        {
+            for (int Y = BeginY; Y < EndY; Y++)
+            {
+                int Cell = X * Res + Y;
+                float Div = U[(X + 1) * Res + Y] - U[Cell] + V[X * (Res + 1) + Y + 1] - V[X * (Res + 1) + Y];
+                Divergence[Cell] = CellTypes[Cell] == FluidCell ? -Div * InvDx : 0.0f;
+            }
+        }
+    });
+
+    PressureSolver.Solve(CellTypes, Divergence, Pressure);
+
+    // Each block updates the faces it owns, pressure is DeltaTime * p / density as in FLIPSolver
+    ForEachActiveBlock([&](int BeginX, int EndX, int BeginY, int EndY) {
+        for (int X = std::max(BeginX, 1); X < EndX; X++)
+        {
+            for (int Y = BeginY; Y < EndY; Y++)
+            {
+                uint8_t Left = CellTypes[(X - 1) * Res + Y], Right = CellTypes[X * Res + Y];
+                if (Left == SolidCell || Right == SolidCell || (Left != FluidCell && Right != FluidCell))
+                {
+                    continue;
+                }
+                U[X * Res + Y] -= (Pressure[X * Res + Y] - Pressure[(X - 1) * Res + Y]) * InvDx;
+            }
+        }
+        for (int X = BeginX; X < EndX; X++)
+        {
+            for (int Y = std::max(BeginY, 1); Y < EndY; Y++)
+            {
+                uint8_t Bottom = CellTypes[X * Res + Y - 1], Top = CellTypes[X * Res + Y];
+                if (Bottom == SolidCell || Top == SolidCell || (Bottom != FluidCell && Top != FluidCell))
+                {
+                    continue;
+                }
+                V[X * (Res + 1) + Y] -= (Pressure[X * Res + Y] - Pressure[X * Res + Y - 1]) * InvDx;
+            }
+        }
+    });
+}
+
+void SmokeSolver::AdvectScalar(std::vector<float>& Field, float Dissipation, float DeltaTime)
+{
+    const int Res = GridResolution;
+    const float Step = DeltaTime * InvDx;
+    const float Decay = std::max(0.0f, 1.0f - Dissipation * DeltaTime);
+
+    // MacCormack: a forward semi-Lagrangian pass, a backward one from its result, and half the round trip error as
+    // correction, falling back to the forward pass where the correction leaves the range of the sampled values
+    ForEachActiveBlock([&](int BeginX, int EndX, int BeginY, int EndY) {
+        for (int X = BeginX; X < EndX; X++)
+        {
+            for (int Y = BeginY; Y < EndY; Y++)
+            {
+                float CellU, CellV;
+                SampleVelocity(X + 0.5f, Y + 0.5f, CellU, CellV);
+                Forward[X * Res + Y] = Sample(Field, Res, Res, 0.5f, 0.5f, X + 0.5f - Step * CellU, Y + 0.5f - Step * CellV);
+            }
+        }
+    });
+    ForEachActiveBlock([&](int BeginX, int EndX, int BeginY, int EndY) {
+        for (int X = BeginX; X < EndX; X++)
+        {
+            for (int Y = BeginY; Y < EndY; Y++)
+            {
+                int Cell = X * Res + Y;
+                float CellU, CellV;
+                SampleVelocity(X + 0.5f, Y + 0.5f, CellU, CellV);
+                Backward[Cell] = Sample(Forward, Res, Res, 0.5f, 0.5f, X + 0.5f + Step * CellU, Y + 0.5f + Step * CellV);
+
+                float Corrected = Forward[Cell] + 0.5f * (Field[Cell] - Backward[Cell]);
+                float SourceX = X - Step * CellU, SourceY = Y - Step * CellV;
+                int BaseX = std::clamp(static_cast<int>(std::floor(SourceX)), 0, Res - 2);
+                int BaseY = std::clamp(static_cast<int>(std::floor(SourceY)), 0, Res - 2);
+                const float* Row0 = &Field[BaseX * Res + BaseY];
+                const float* Row1 = Row0 + Res;
+                float Min = std::min({Row0[0], Row0[1], Row1[0], Row1[1]});
+                float Max = std::max({Row0[0], Row0[1], Row1[0], Row1[1]});
+                if (Corrected < Min || Corrected > Max)
+                {
+                    Corrected = Forward[Cell];
+                }
+                Scratch[Cell] = Corrected * Decay;
+            }
+        }
+    });
+    Field.swap(Scratch);
+}
+
+void SmokeSolver::WriteRenderParticles(std::vector<ParticleRenderData>& Particles) const
+{
+    const int Res = GridResolution;
+    Particles.clear();
+    for (uint32_t Block : ActiveBlocks)
+    {
+        int BeginX = (Block / BlocksPerSide) * SMOKE_BLOCK_SIZE;
+        int BeginY = (Block % BlocksPerSide) * SMOKE_BLOCK_SIZE;
+        for (int X = BeginX; X < std::min(BeginX + SMOKE_BLOCK_SIZE, Res); X++)
+        {
+            for (int Y = BeginY; Y < std::min(BeginY + SMOKE_BLOCK_SIZE, Res); Y++)
+            {
+                float CellDensity = Density[X * Res + Y];
+                if (CellDensity < Params.RenderThreshold)
+                {
+                    continue;
+                }
+                if (ParticleCapacity > 0 && Particles.size() >= ParticleCapacity)
+                {
+                    return;
+                }
+                float CellU, CellV;
+                SampleVelocity(X + 0.5f, Y + 0.5f, CellU, CellV);
+                // W scales the drawn sphere
+                Particles.push_back({Math::Vec4((X + 0.5f) * Dx, (Y + 0.5f) * Dx, 0.5f * Size, std::min(CellDensity, 1.0f)), Math::Vec4(CellU, CellV, 0.0f, 0.0f)});
+            }
+        }
+    }
+}
+
+void SmokeSolver::CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime)
+{
+    ApplySources(DeltaTime);
+    UpdateActiveBlocks();
+
+    ApplyBuoyancy(DeltaTime);
+    AdvectVelocity(DeltaTime);
+    Project();
+    AdvectScalar(Density, Params.DensityDissipation, DeltaTime);
+    AdvectScalar(Temperature, Params.TemperatureDissipation, DeltaTime);
+
+    WriteRenderParticles(Particles);
+}
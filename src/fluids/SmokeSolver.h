@@ -0,0 +1,95 @@
+#pragma once
+
+#include "fluids/IFluidSolver.h"
+#include "fluids/MultigridPoisson.h"
+#include <stdint.h>
+#include <vector>
+
+struct SmokeParameters
+{
+    // Upward force per unit of temperature above ambient, and downward force per unit of density
+    float Buoyancy = 1.5f;
+    float Weight = 0.05f;
+    // Fraction of density and temperature lost per second
+    float DensityDissipation = 0.05f;
+    float TemperatureDissipation = 0.2f;
+    // Blocks whose density stays below this are dropped from the active set
+    float ActiveThreshold = 1e-3f;
+    // Cells with less density are not drawn
+    float RenderThreshold = 0.02f;
+    PressureSolveParameters Pressure;
+};
+
+// Grid only (2D) stable fluids smoke on the same grid resolution as the particle solvers (Stam 1999, Fedkiw et al. 2001).
+// Velocities are advected semi-Lagrangian and density and temperature with MacCormack, followed by buoyancy and the
+// multigrid pressure projection. Only blocks near smoke are touched, in parallel. The particle array of IFluidSolver
+// holds no state here: the initial particles are splatted into the density and every step writes one render particle
+// per smoky cell, scaled by its density
+class SmokeSolver : public IFluidSolver
+{
+public:
+    SmokeSolver(const std::vector<ParticleRenderData>& Particles, int GridResolution, float GridSize, const SmokeParameters& Params = SmokeParameters());
+
+    virtual void Reset(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList) override;
+
+    virtual void CPUSolve(std::vector<ParticleRenderData>& Particles, float DeltaTime) override;
+    virtual void GPUSolve(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Microsoft::WRL::ComPtr<ID3D12Resource> ParticleBuffer) override;
+
+    // CPU only, there is nothing to create on the GPU
+    virtual void CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler) override;
+    virtual void CreateBuffers(Renderer* RenderEngine, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList, Allocation* FluidHeapAllocation) override;
+
+    // Emitters add density and heat inside their disc and impose their velocity there, sinks clear their box
+    virtual void AddEmitter(const ParticleEmitter& Emitter) override;
+    virtual void AddSink(const ParticleSink& Sink) override;
+
+    // Upper bound on the render particles written per step
+    void SetParticleCapacity(uint32_t Capacity);
+
+    uint32_t GetNumActiveBlocks() const;
+
+private:
+    void SplatParticles(const std::vector<ParticleRenderData>& Particles);
+    void ApplySources(float DeltaTime);
+    void UpdateActiveBlocks();
+    void ClearBlock(int BlockX, int BlockY);
+    void ApplyBuoyancy(float DeltaTime);
+    void AdvectVelocity(float DeltaTime);
+    void Project();
+    void AdvectScalar(std::vector<float>& Field, float Dissipation, float DeltaTime);
+    void WriteRenderParticles(std::vector<ParticleRenderData>& Particles) const;
+
+    // Runs Func(BeginX, EndX, BeginY, EndY) over the cells of every active block in parallel
+    template <typename FuncType>
+    void ForEachActiveBlock(FuncType&& Func) const;
+
+    // Bilinear interpolation of a NumX x NumY field whose sample (0, 0) sits at Offset, positions in cells
+    float Sample(const std::vector<float>& Field, int NumX, int NumY, float OffsetX, float OffsetY, float X, float Y) const;
+    void SampleVelocity(float X, float Y, float& OutU, float& OutV) const;
+
+    SmokeParameters Params;
+    int GridResolution;
+    float Size;
+    float Dx;
+    float InvDx;
+
+    // Staggered velocities laid out like FLIPSolver's, cell centered density and temperature
+    std::vector<float> U, V, ScratchU, ScratchV;
+    std::vector<float> Density, Temperature;
+    std::vector<float> Forward, Backward, Scratch;
+    std::vector<float> InitialDensity;
+
+    // BlockSize^2 tiles of cells, Active holds 0/1 per block and ActiveBlocks their indices
+    int BlocksPerSide;
+    std::vector<uint8_t> Active;
+    std::vector<uint32_t> ActiveBlocks;
+
+    std::vector<uint8_t> CellTypes;
+    std::vector<float> Divergence;
+    std::vector<float> Pressure;
+    MultigridPoisson PressureSolver;
+
+    std::vector<ParticleEmitter> Emitters;
+    std::vector<ParticleSink> Sinks;
+    uint32_t ParticleCapacity = 0;
+};
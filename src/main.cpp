@@ -2,10 +2,16 @@
 #define _DEBUG
 
 #include <Windows.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <fstream>
 #include <hidusage.h>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
@@ -17,28 +23,23 @@
 #include "Scene.h"
 #include "ShaderCompiler.h"
 #include "View.h"
+#include "fluids/DecomposedRun.h"
+#include "fluids/EnsembleRunner.h"
 #include "fluids/FluidObject.h"
+#include "fluids/OutOfCoreMPMSolver.h"
 #include "primitives/Cube.h"
 #include "primitives/Plane.h"
 #include "primitives/PrimitiveObject.h"
 #include "primitives/Sphere.h"
 #include "util/FileWatcher.h"
 #include "util/RenderUtils.h"
+#include "util/ThreadPool.h"
 
 #ifdef _DEBUG
 const std::vector<LPTSTR> LiveCompileShaders = {
     TEXT("D:\\Dev\\Projects\\FluidSim2024\\shaders\\")};
 #endif
 
-ShaderDesc VertexShader = {
-    L"D:\\Dev\\Projects\\FluidSim2024\\shaders\\VertexShader.hlsl",
-    L"vs_6_0",
-    L"main"};
-ShaderDesc FragmentShader = {
-    L"D:\\Dev\\Projects\\FluidSim2024\\shaders\\FragmentShader.hlsl",
-    L"ps_6_0",
-    L"main"};
-
 // Window callback function.
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
@@ -197,8 +198,161 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     return DefWindowProcW(hwnd, uMsg, wParam, lParam);
 }
 
+// FluidSim --batch <runs file> [output directory] steps every run of the file headless and exits, see EnsembleRunner
+int RunBatch(const wchar_t* Args)
+{
+    std::wistringstream ArgStream(Args);
+    std::wstring RunsPath;
+    std::wstring OutputDirectory;
+    if (!(ArgStream >> RunsPath))
+    {
+        return 1;
+    }
+
+    EnsembleParameters Params;
+    if (ArgStream >> OutputDirectory)
+    {
+        Params.OutputDirectory = OutputDirectory;
+    }
+    EnsembleRunner Runner(Params);
+    if (!Runner.LoadRuns(RunsPath))
+    {
+        return 1;
+    }
+    // Lets the runs use the pool when there are fewer of them than cores, the workers opt out otherwise
+    ThreadPool::CreateInstance();
+    Runner.RunAll();
+    return Runner.GetNumDiverged() > 0 ? 2 : 0;
+}
+
+// Ends an out-of-core run that ran out of disk or address space with the solver's reason
+int StopOutOfCore(const OutOfCoreMPMSolver& Solver, std::ofstream& Output)
+{
+    std::string Message = "error: " + Solver.GetError() + "\n";
+    Output << Message;
+    OutputDebugStringA(Message.c_str());
+    return 3;
+}
+
+// FluidSim --outofcore <particle file> <particles> <steps> steps a block of jelly too big for memory headless, keeping
+// its particles in the file, and writes "Step KineticEnergy" lines to <particle file>.txt, see OutOfCoreMPMSolver.
+// If the disk or the address space runs out the run stops with an "error:" line and exit code 3
+int RunOutOfCore(const wchar_t* Args)
+{
+    std::wistringstream ArgStream(Args);
+    std::wstring FilePath;
+    uint64_t NumParticles;
+    uint32_t NumSteps;
+    if (!(ArgStream >> FilePath >> NumParticles >> NumSteps))
+    {
+        return 1;
+    }
+
+    OutOfCoreParameters Params;
+    Params.FilePath = FilePath;
+    const float DeltaTime = 0.002f;
+    // FluidParameters:              NumParticles, Resolution, Lambda, Mu, Timestep, Size
+    MPMSolver::FluidParameters FluidParams = {0, 64, 40.0f, 20.0f, DeltaTime, 1.0f};
+    OutOfCoreMPMSolver Solver(FluidParams, JellyMaterial, Params);
+    std::filesystem::path OutputPath = Params.FilePath;
+    OutputPath += ".txt";
+    std::ofstream Output(OutputPath);
+    if (!Solver.Open())
+    {
+        return StopOutOfCore(Solver, Output);
+    }
+
+    // Square lattice over the same box the batch runs spawn in, generated a batch at a time
+    const uint64_t Side = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(std::sqrt(double(NumParticles)))), 1);
+    std::vector<ParticleRenderData> Batch;
+    for (uint64_t First = 0; First < NumParticles; First += Batch.size())
+    {
+        Batch.clear();
+        for (uint64_t i = First; i < std::min<uint64_t>(First + (1 << 20), NumParticles); i++)
+        {
+            float U = (float(i % Side) + 0.5f) / float(Side);
+            float V = (float(i / Side) + 0.5f) / float(Side);
+            Batch.push_back({Math::Vec4(0.3f + 0.4f * U, 0.1f + 0.4f * V, 0.5f), Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+        }
+        if (!Solver.AddParticles(Batch.data(), static_cast<uint32_t>(Batch.size())))
+        {
+            return StopOutOfCore(Solver, Output);
+        }
+    }
+
+    for (uint32_t Step = 1; Step <= NumSteps; Step++)
+    {
+        if (!Solver.Step(DeltaTime))
+        {
+            return StopOutOfCore(Solver, Output);
+        }
+        Output << Step << " " << Solver.GetKineticEnergy() / double(std::max<uint64_t>(NumParticles, 1)) << "\n";
+    }
+    return 0;
+}
+
+// FluidSim --decomposed <ranks> <particles> <steps> <output file> [<host:port>,...] steps a block of jelly headless as
+// a decomposed run with one process per rank, talking through shared memory, or over TCP on the given endpoints, one
+// per rank. It writes the final particles to the file, see LaunchDecomposedRun. Returns 1 if any rank failed
+int RunDecomposed(const wchar_t* Args)
+{
+    std::wistringstream ArgStream(Args);
+    DecomposedRunParameters Params;
+    std::wstring OutputPath;
+    if (!(ArgStream >> Params.NumRanks >> Params.NumParticles >> Params.NumSteps >> OutputPath))
+    {
+        return 1;
+    }
+    Params.OutputPath = OutputPath;
+    std::wstring Endpoints;
+    if (ArgStream >> Endpoints)
+    {
+        std::wistringstream EndpointStream(Endpoints);
+        for (std::wstring Endpoint; std::getline(EndpointStream, Endpoint, L',');)
+        {
+            Params.Endpoints.push_back(std::filesystem::path(Endpoint).string());
+        }
+    }
+
+    wchar_t Executable[MAX_PATH];
+    GetModuleFileNameW(nullptr, Executable, MAX_PATH);
+    return LaunchDecomposedRun(Executable, Params) ? 0 : 1;
+}
+
+// One rank process of RunDecomposed. Started by hand on every machine of a run over TCP, with the arguments
+// GetDecomposedRankArguments gives
+int RunRankProcess(const wchar_t* Args)
+{
+    std::wistringstream ArgStream(Args);
+    std::vector<std::string> RankArgs;
+    std::wstring Arg;
+    while (ArgStream >> std::quoted(Arg))
+    {
+        RankArgs.push_back(std::filesystem::path(Arg).string());
+    }
+    return RunDecomposedRank(RankArgs);
+}
+
 int WINAPI wWinMain(HINSTANCE HInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow)
 {
+    if (wcsncmp(pCmdLine, L"--batch", 7) == 0)
+    {
+        return RunBatch(pCmdLine + 7);
+    }
+    if (wcsncmp(pCmdLine, L"--outofcore", 11) == 0)
+    {
+        return RunOutOfCore(pCmdLine + 11);
+    }
+    // Checked ahead of --decomposed, which it starts with
+    if (wcsncmp(pCmdLine, L"--decomposed-rank", 17) == 0)
+    {
+        return RunRankProcess(pCmdLine + 17);
+    }
+    if (wcsncmp(pCmdLine, L"--decomposed", 12) == 0)
+    {
+        return RunDecomposed(pCmdLine + 12);
+    }
+
     int ClientWidth = 1920;
     int ClientHeight = 1080;
 
@@ -243,6 +397,7 @@ int WINAPI wWinMain(HINSTANCE HInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     D3D12Renderer->SetComputeRootSignature(ComputeRootSignatureBuilder.BuildComputeRootSignature(D3D12Renderer->GetDevice()));
 
     Scene* MainScene = new Scene(D3D12Renderer->GetDevice(), Compiler);
+    ThreadPool::CreateInstance();
     Controller* ViewController = Controller::CreateInstance(D3D12Renderer);
     View* MainView = ViewController->GetCurrentView();
 
@@ -269,18 +424,20 @@ int WINAPI wWinMain(HINSTANCE HInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
 
     ShowWindow(HWnd, SW_SHOW);
 
-    bool ShadersUpdated = false;
+    // Set by the watcher thread, read by the main loop
+    std::atomic<bool> ShadersUpdated = false;
 #ifdef _DEBUG
-    auto LiveCompileLambda = [HWnd, KillThreadsEvent, &Compiler, &ShadersUpdated]()
+    auto LiveCompileLambda = [KillThreadsEvent, MainScene, &ShadersUpdated]()
     {
         FileWatcher::WatchAnyFiles(
             LiveCompileShaders,
-            [HWnd, &Compiler, &ShadersUpdated]()
+            [MainScene, &ShadersUpdated]()
             {
-                auto Callback = [&ShadersUpdated](bool DidCompile)
-                { ShadersUpdated = DidCompile; };
-                Compiler.CompileShader(VertexShader, Callback, false);
-                Compiler.CompileShader(FragmentShader, Callback, false);
+                // Only shaders that use a changed file are recompiled, their pipeline states are rebuilt here too
+                if (MainScene->ReloadChangedShaders())
+                {
+                    ShadersUpdated = true;
+                }
             },
             KillThreadsEvent);
     };
@@ -322,22 +479,24 @@ int WINAPI wWinMain(HINSTANCE HInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
             LastRender = Now;
             D3D12Renderer->Render();
         }
-        if (ShadersUpdated)
+        if (ShadersUpdated.exchange(false))
         {
+            // Frames in flight may still use the pipeline states being replaced
             D3D12Renderer->Flush();
-            MainScene->ReloadShaders();
-            ShadersUpdated = false;
+            MainScene->ApplyReloadedShaders();
         }
     }
 
-    delete D3D12Renderer;
-    delete MainScene;
-    delete UserData;
+    // The watcher reloads into the scene, so it stops first
     SetEvent(KillThreadsEvent);
-
 #ifdef _DEBUG
     LiveCompileThread.join();
 #endif
+
+    delete D3D12Renderer;
+    delete MainScene;
+    delete UserData;
+    ThreadPool::DestroyInstance();
     //_CrtDumpMemoryLeaks();
     return 0;
 }
\ No newline at end of file
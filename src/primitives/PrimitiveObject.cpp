@@ -39,10 +39,10 @@ void PrimitiveObject<T>::Draw(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>
 }
 
 template <typename T>
-void PrimitiveObject<T>::RecompileShaders(ShaderCompiler& Compiler)
+void PrimitiveObject<T>::GetShaders(std::vector<ShaderDesc>& Shaders) const
 {
-    Compiler.CompileShaderNonAsync(PrimitiveVertexShader, true);
-    Compiler.CompileShaderNonAsync(PrimitiveFragmentShader, true);
+    Shaders.push_back(PrimitiveVertexShader);
+    Shaders.push_back(PrimitiveFragmentShader);
 }
 
 template <typename T>
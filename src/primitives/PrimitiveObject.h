@@ -24,7 +24,7 @@ public:
     D3D12_INDEX_BUFFER_VIEW& GetIndexBufferView();
     virtual int GetNumVertices();
     virtual Microsoft::WRL::ComPtr<ID3D12PipelineState> CreatePipelineStateObject(ID3D12DevicePtr D3D12Device, ShaderCompiler& Compiler) override;
-    virtual void RecompileShaders(ShaderCompiler& Compiler) override;
+    virtual void GetShaders(std::vector<ShaderDesc>& Shaders) const override;
 
 private:
     bool BuffersInitialized = false;
@@ -1,13 +1,55 @@
 #ifndef MATH_H
 #define MATH_H
+#include <cmath>
+#include <stdint.h>
 #include <string>
+#include <type_traits>
+
+// Header only so every operator inlines into the solver loops. Everything that doesn't need trig or a square root is
+// constexpr, constant evaluation takes the scalar paths and run time takes SSE on x86 and NEON on ARM for the 4x4
+// matrix products and sums. Vectors and matrices keep their packed float layout, which the GPU buffers share, so the
+// SIMD paths load and store unaligned
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define MATH_SSE
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MATH_NEON
+#endif
+
 namespace Math
 {
 #define PI 3.14159265358979323846
+    struct Vec3;
     struct Vec4;
+    struct Matrix3x3;
     struct Matrix4x4;
     typedef Matrix4x4 Matrix;
+    typedef Matrix4x4 Mat4;
+    typedef Matrix3x3 Mat3;
     typedef Vec4 Vector4;
+
+    namespace Simd
+    {
+#if defined(MATH_SSE)
+        typedef __m128 Lanes;
+        inline Lanes Load(const float* Values) { return _mm_loadu_ps(Values); }
+        inline void Store(float* Values, Lanes V) { _mm_storeu_ps(Values, V); }
+        inline Lanes Splat(float Value) { return _mm_set1_ps(Value); }
+        inline Lanes Add(Lanes A, Lanes B) { return _mm_add_ps(A, B); }
+        inline Lanes Sub(Lanes A, Lanes B) { return _mm_sub_ps(A, B); }
+        inline Lanes Mul(Lanes A, Lanes B) { return _mm_mul_ps(A, B); }
+#elif defined(MATH_NEON)
+        typedef float32x4_t Lanes;
+        inline Lanes Load(const float* Values) { return vld1q_f32(Values); }
+        inline void Store(float* Values, Lanes V) { vst1q_f32(Values, V); }
+        inline Lanes Splat(float Value) { return vdupq_n_f32(Value); }
+        inline Lanes Add(Lanes A, Lanes B) { return vaddq_f32(A, B); }
+        inline Lanes Sub(Lanes A, Lanes B) { return vsubq_f32(A, B); }
+        inline Lanes Mul(Lanes A, Lanes B) { return vmulq_f32(A, B); }
+#endif
+    };
+
     struct alignas(float) Matrix4x4
     {
         union
@@ -26,27 +68,45 @@ namespace Math
         };
 
     public:
-        Matrix4x4();
-        Matrix4x4(float m[]);
-        Matrix4x4(float m11, float m21, float m31, float m41, float m12, float m22, float m32, float m42, float m13, float m23, float m33, float m43, float m14, float m24, float m34, float m44);
-        Matrix4x4 Mult(const Matrix4x4& B) const;
-        Matrix4x4 Inverse() const;
-        Matrix4x4 Transpose() const;
-        float Determinant() const;
-        Matrix4x4 operator+(const Matrix4x4& B) const;
-        Matrix4x4 operator-(const Matrix4x4& B) const;
-        Matrix4x4& operator+=(const Matrix4x4& B);
-        Matrix4x4 operator*(const Matrix4x4& B) const;
-        Matrix4x4 operator*(const float Scalar) const;
-        Vec4 operator*(const Vec4& B) const;
-        Vec4 GetRow(int I);
-        Vec4 GetColumn(int I);
+        constexpr Matrix4x4();
+        constexpr Matrix4x4(float m[]);
+        constexpr Matrix4x4(float m11, float m21, float m31, float m41, float m12, float m22, float m32, float m42, float m13, float m23, float m33, float m43, float m14, float m24, float m34, float m44);
+        constexpr Matrix4x4 Mult(const Matrix4x4& B) const;
+        constexpr Matrix4x4 Inverse() const;
+        constexpr Matrix4x4 Transpose() const;
+        constexpr float Determinant() const;
+        constexpr Matrix3x3 UpperLeft() const;
+        // Upper left 3x3 block times V, the matrix applied to a direction
+        constexpr Vec3 TransformVector(const Vec3& V) const;
+        constexpr Matrix4x4 operator+(const Matrix4x4& B) const;
+        constexpr Matrix4x4 operator-(const Matrix4x4& B) const;
+        constexpr Matrix4x4& operator+=(const Matrix4x4& B);
+        constexpr Matrix4x4 operator*(const Matrix4x4& B) const;
+        constexpr Matrix4x4 operator*(const float Scalar) const;
+        constexpr Vec4 operator*(const Vec4& B) const;
+        constexpr Vec4 GetRow(int I);
+        constexpr Vec4 GetColumn(int I);
+    };
+
+    // Column major like Matrix4x4, for math that has no use for the fourth row and column
+    struct Matrix3x3
+    {
+        float m11, m21, m31; // Column 1
+        float m12, m22, m32; // Column 2
+        float m13, m23, m33; // Column 3
+
+    public:
+        constexpr Matrix3x3();
+        constexpr Matrix3x3(float m11, float m21, float m31, float m12, float m22, float m32, float m13, float m23, float m33);
+        constexpr Matrix3x3 Mult(const Matrix3x3& B) const;
+        constexpr Matrix3x3 Transpose() const;
+        constexpr float Determinant() const;
+        constexpr Matrix3x3 operator+(const Matrix3x3& B) const;
+        constexpr Matrix3x3 operator-(const Matrix3x3& B) const;
+        constexpr Matrix3x3 operator*(const Matrix3x3& B) const;
+        constexpr Matrix3x3 operator*(const float Scalar) const;
+        constexpr Vec3 operator*(const Vec3& B) const;
     };
-    const Matrix4x4 Identity = {
-        1, 0, 0, 0,
-        0, 1, 0, 0,
-        0, 0, 1, 0,
-        0, 0, 0, 1};
 
     Matrix4x4 Multiply(const Matrix4x4& A, const Matrix4x4& B);
     Matrix4x4 ViewMatrix(const Vec4& Forward, const Vec4& Up, const Vec4& EyePosition);
@@ -54,30 +114,54 @@ namespace Math
     Matrix4x4 RotateAboutAxis(const Vec4& Axis, float Angle);
     Matrix4x4 Rotate(const float Roll, const float Pitch, const float Yaw);
     Matrix4x4 Translate(const Vec4& Translation);
-    Matrix4x4 Multiply(const Matrix4x4& A, const Matrix4x4& B);
     Matrix4x4 TransformationMatrix(const Matrix4x4& Rotation, const Vec4& Translation, const Vec4& Scale);
     Matrix4x4 TransformationMatrix(const Matrix4x4& Rotation, const Vec4& Translation);
 
+    // A direction or difference, it has no w to carry through the arithmetic
+    struct Vec3
+    {
+        float x, y, z;
+
+    public:
+        constexpr Vec3();
+        constexpr Vec3(float X, float Y, float Z);
+        Vec3& Normalize();
+        constexpr float Dot(const Vec3& B) const;
+        constexpr Vec3 Cross(const Vec3& B) const;
+        constexpr Vec3 operator-(const Vec3& B) const;
+        constexpr Vec3 operator+(const Vec3& B) const;
+        constexpr Vec3& operator+=(const Vec3& B);
+        constexpr Vec3 operator*(float Scalar) const;
+    };
+
+    // Positions and packed per node data. w is not part of the vector math, +, - and scaling keep the left hand side's,
+    // so particles keep their alive flag and grid nodes their mass. Math on xyz alone goes through Vec3
     struct alignas(float) Vec4
     {
         float x, y, z;
         float w = 1.0f;
 
     public:
-        Vec4();
-        Vec4(float X, float Y, float Z, float W);
-        Vec4(float X, float Y, float Z);
+        constexpr Vec4();
+        constexpr Vec4(float X, float Y, float Z, float W);
+        constexpr Vec4(float X, float Y, float Z);
+        constexpr Vec4(const Vec3& XYZ, float W);
+        constexpr Vec3 XYZ() const;
         Vec4& Normalize();
-        float Dot(const Vec4& B) const;
-        Vec4 Cross(const Vec4& B) const;
-        Matrix4x4 OuterProduct(const Vec4& B) const;
-        Vec4 Subtract(const Vec4& B) const;
-        Vec4 operator-(const Vec4& B) const;
-        Vec4 operator+(const Vec4& B) const;
-        Vec4& operator+=(const Vec4& B);
-        Vec4 operator*(const Matrix4x4& B) const;
-        Vec4 operator*(float Scalar) const;
-        Vec4& operator/=(float Scalar);
+        constexpr float Dot(const Vec4& B) const;
+        constexpr Vec4 Cross(const Vec4& B) const;
+        constexpr Matrix4x4 OuterProduct(const Vec4& B) const;
+        constexpr Vec4 Subtract(const Vec4& B) const;
+        constexpr Vec4 operator-(const Vec4& B) const;
+        constexpr Vec4 operator+(const Vec4& B) const;
+        constexpr Vec4& operator+=(const Vec4& B);
+        // Offsets by a direction, w is unchanged
+        constexpr Vec4 operator-(const Vec3& B) const;
+        constexpr Vec4 operator+(const Vec3& B) const;
+        constexpr Vec4& operator+=(const Vec3& B);
+        constexpr Vec4 operator*(const Matrix4x4& B) const;
+        constexpr Vec4 operator*(float Scalar) const;
+        constexpr Vec4& operator/=(float Scalar);
         operator std::string() const
         {
             return "(" + std::to_string(x) + ", " + std::to_string(y) + ", " + std::to_string(z) + ", " + std::to_string(w) + ")";
@@ -90,17 +174,676 @@ namespace Math
         T x, y;
 
     public:
-        Vec2();
-        Vec2(T X, T Y);
+        constexpr Vec2();
+        constexpr Vec2(T X, T Y);
         Vec2<T>& Normalize();
-        Vec2<T> Subtract(const Vec2<T>& B) const;
-        T Dot(const Vec2<T>& B) const;
-        Vec2<T>& Pow(const int Power);
-        Vec2<T> operator-(const Vec2<T>& B) const;
-        Vec2<T> operator+(const Vec2<T>& B) const;
-        Vec2<T>& operator+=(const Vec2<T>& B);
-        Vec2<T> operator*(T Scalar);
+        constexpr Vec2<T> Subtract(const Vec2<T>& B) const;
+        constexpr T Dot(const Vec2<T>& B) const;
+        constexpr Vec2<T>& Pow(const int Power);
+        constexpr Vec2<T> operator-(const Vec2<T>& B) const;
+        constexpr Vec2<T> operator+(const Vec2<T>& B) const;
+        constexpr Vec2<T>& operator+=(const Vec2<T>& B);
+        constexpr Vec2<T> operator*(T Scalar);
     };
 
+    constexpr Matrix4x4::Matrix4x4()
+        : m11(0), m21(0), m31(0), m41(0), m12(0), m22(0), m32(0), m42(0), m13(0), m23(0), m33(0), m43(0), m14(0), m24(0), m34(0), m44(0)
+    {
+    }
+
+    constexpr Matrix4x4::Matrix4x4(float m[])
+        : m11(m[0]), m21(m[1]), m31(m[2]), m41(m[3]), m12(m[4]), m22(m[5]), m32(m[6]), m42(m[7]), m13(m[8]), m23(m[9]), m33(m[10]), m43(m[11]), m14(m[12]), m24(m[13]), m34(m[14]), m44(m[15])
+    {
+    }
+
+    constexpr Matrix4x4::Matrix4x4(float m11, float m21, float m31, float m41, float m12, float m22, float m32, float m42, float m13, float m23, float m33, float m43, float m14, float m24, float m34, float m44)
+        : m11(m11), m21(m21), m31(m31), m41(m41), m12(m12), m22(m22), m32(m32), m42(m42), m13(m13), m23(m23), m33(m33), m43(m43), m14(m14), m24(m24), m34(m34), m44(m44)
+    {
+    }
+
+    inline constexpr Matrix4x4 Identity = {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0,
+        0, 0, 0, 1};
+
+    constexpr Matrix4x4 Matrix4x4::Mult(const Matrix4x4& B) const
+    {
+#if defined(MATH_SSE) || defined(MATH_NEON)
+        if (!std::is_constant_evaluated())
+        {
+            // Each column of the product is the columns of this matrix weighted by a column of B
+            const Simd::Lanes Column1 = Simd::Load(m);
+            const Simd::Lanes Column2 = Simd::Load(m + 4);
+            const Simd::Lanes Column3 = Simd::Load(m + 8);
+            const Simd::Lanes Column4 = Simd::Load(m + 12);
+            Matrix4x4 Result;
+            for (int Column = 0; Column < 16; Column += 4)
+            {
+                Simd::Lanes Sum = Simd::Mul(Column1, Simd::Splat(B.m[Column]));
+                Sum = Simd::Add(Sum, Simd::Mul(Column2, Simd::Splat(B.m[Column + 1])));
+                Sum = Simd::Add(Sum, Simd::Mul(Column3, Simd::Splat(B.m[Column + 2])));
+                Sum = Simd::Add(Sum, Simd::Mul(Column4, Simd::Splat(B.m[Column + 3])));
+                Simd::Store(Result.m + Column, Sum);
+            }
+            return Result;
+        }
+#endif
+        return {
+            m11 * B.m11 + m12 * B.m21 + m13 * B.m31 + m14 * B.m41,
+            m21 * B.m11 + m22 * B.m21 + m23 * B.m31 + m24 * B.m41,
+            m31 * B.m11 + m32 * B.m21 + m33 * B.m31 + m34 * B.m41,
+            m41 * B.m11 + m42 * B.m21 + m43 * B.m31 + m44 * B.m41, // End column 1
+            m11 * B.m12 + m12 * B.m22 + m13 * B.m32 + m14 * B.m42,
+            m21 * B.m12 + m22 * B.m22 + m23 * B.m32 + m24 * B.m42,
+            m31 * B.m12 + m32 * B.m22 + m33 * B.m32 + m34 * B.m42,
+            m41 * B.m12 + m42 * B.m22 + m43 * B.m32 + m44 * B.m42, // End column 2
+            m11 * B.m13 + m12 * B.m23 + m13 * B.m33 + m14 * B.m43,
+            m21 * B.m13 + m22 * B.m23 + m23 * B.m33 + m24 * B.m43,
+            m31 * B.m13 + m32 * B.m23 + m33 * B.m33 + m34 * B.m43,
+            m41 * B.m13 + m42 * B.m23 + m43 * B.m33 + m44 * B.m43, // End column 3
+            m11 * B.m14 + m12 * B.m24 + m13 * B.m34 + m14 * B.m44,
+            m21 * B.m14 + m22 * B.m24 + m23 * B.m34 + m24 * B.m44,
+            m31 * B.m14 + m32 * B.m24 + m33 * B.m34 + m34 * B.m44,
+            m41 * B.m14 + m42 * B.m24 + m43 * B.m34 + m44 * B.m44 // End column 4
+        };
+    }
+
+    // Singular matrices come back as infinities
+    constexpr Matrix4x4 Matrix4x4::Inverse() const
+    {
+        float A2323 = m33 * m44 - m34 * m43;
+        float A1323 = m32 * m44 - m34 * m42;
+        float A1223 = m32 * m43 - m33 * m42;
+        float A0323 = m31 * m44 - m34 * m41;
+        float A0223 = m31 * m43 - m33 * m41;
+        float A0123 = m31 * m42 - m32 * m41;
+        float A2313 = m23 * m44 - m24 * m43;
+        float A1313 = m22 * m44 - m24 * m42;
+        float A1213 = m22 * m43 - m23 * m42;
+        float A2312 = m23 * m34 - m24 * m33;
+        float A1312 = m22 * m34 - m24 * m32;
+        float A1212 = m22 * m33 - m23 * m32;
+        float A0313 = m21 * m44 - m24 * m41;
+        float A0213 = m21 * m43 - m23 * m41;
+        float A0312 = m21 * m34 - m24 * m31;
+        float A0212 = m21 * m33 - m23 * m31;
+        float A0113 = m21 * m42 - m22 * m41;
+        float A0112 = m21 * m32 - m22 * m31;
+
+        float det = m11 * (m22 * A2323 - m23 * A1323 + m24 * A1223) - m12 * (m21 * A2323 - m23 * A0323 + m24 * A0223) + m13 * (m21 * A1323 - m22 * A0323 + m24 * A0123) - m14 * (m21 * A1223 - m22 * A0223 + m23 * A0123);
+        det = 1 / det;
+
+        return {
+            det * (m22 * A2323 - m23 * A1323 + m24 * A1223),  // m11
+            det * -(m21 * A2323 - m23 * A0323 + m24 * A0223), // m21
+            det * (m21 * A1323 - m22 * A0323 + m24 * A0123),  // m31
+            det * -(m21 * A1223 - m22 * A0223 + m23 * A0123), // m41
+            det * -(m12 * A2323 - m13 * A1323 + m14 * A1223), // m12
+            det * (m11 * A2323 - m13 * A0323 + m14 * A0223),  // m22
+            det * -(m11 * A1323 - m12 * A0323 + m14 * A0123), // m32
+            det * (m11 * A1223 - m12 * A0223 + m13 * A0123),  // m42
+            det * (m12 * A2313 - m13 * A1313 + m14 * A1213),  // m13
+            det * -(m11 * A2313 - m13 * A0313 + m14 * A0213), // m23
+            det * (m11 * A1313 - m12 * A0313 + m14 * A0113),  // m33
+            det * -(m11 * A1213 - m12 * A0213 + m13 * A0113), // m43
+            det * -(m12 * A2312 - m13 * A1312 + m14 * A1212), // m14
+            det * (m11 * A2312 - m13 * A0312 + m14 * A0212),  // m24
+            det * -(m11 * A1312 - m12 * A0312 + m14 * A0112), // m34
+            det * (m11 * A1212 - m12 * A0212 + m13 * A0112)}; // m44
+    }
+
+    constexpr Matrix4x4 Matrix4x4::Transpose() const
+    {
+        return {
+            m11, m12, m13, m14,
+            m21, m22, m23, m24,
+            m31, m32, m33, m34,
+            m41, m42, m43, m44};
+    }
+
+    constexpr float Matrix4x4::Determinant() const
+    {
+        float A2323 = m33 * m44 - m34 * m43;
+        float A1323 = m32 * m44 - m34 * m42;
+        float A1223 = m32 * m43 - m33 * m42;
+        float A0323 = m31 * m44 - m34 * m41;
+        float A0223 = m31 * m43 - m33 * m41;
+        float A0123 = m31 * m42 - m32 * m41;
+        return m11 * (m22 * A2323 - m23 * A1323 + m24 * A1223) - m12 * (m21 * A2323 - m23 * A0323 + m24 * A0223) + m13 * (m21 * A1323 - m22 * A0323 + m24 * A0123) - m14 * (m21 * A1223 - m22 * A0223 + m23 * A0123);
+    }
+
+    constexpr Matrix3x3 Matrix4x4::UpperLeft() const
+    {
+        return {
+            m11, m21, m31,
+            m12, m22, m32,
+            m13, m23, m33};
+    }
+
+    constexpr Vec3 Matrix4x4::TransformVector(const Vec3& V) const
+    {
+        return {
+            m11 * V.x + m12 * V.y + m13 * V.z,
+            m21 * V.x + m22 * V.y + m23 * V.z,
+            m31 * V.x + m32 * V.y + m33 * V.z};
+    }
+
+    constexpr Matrix4x4 Matrix4x4::operator+(const Matrix4x4& B) const
+    {
+#if defined(MATH_SSE) || defined(MATH_NEON)
+        if (!std::is_constant_evaluated())
+        {
+            Matrix4x4 Result;
+            for (int i = 0; i < 16; i += 4)
+            {
+                Simd::Store(Result.m + i, Simd::Add(Simd::Load(m + i), Simd::Load(B.m + i)));
+            }
+            return Result;
+        }
+#endif
+        return {
+            m11 + B.m11, m21 + B.m21, m31 + B.m31, m41 + B.m41,
+            m12 + B.m12, m22 + B.m22, m32 + B.m32, m42 + B.m42,
+            m13 + B.m13, m23 + B.m23, m33 + B.m33, m43 + B.m43,
+            m14 + B.m14, m24 + B.m24, m34 + B.m34, m44 + B.m44};
+    }
+
+    constexpr Matrix4x4 Matrix4x4::operator-(const Matrix4x4& B) const
+    {
+#if defined(MATH_SSE) || defined(MATH_NEON)
+        if (!std::is_constant_evaluated())
+        {
+            Matrix4x4 Result;
+            for (int i = 0; i < 16; i += 4)
+            {
+                Simd::Store(Result.m + i, Simd::Sub(Simd::Load(m + i), Simd::Load(B.m + i)));
+            }
+            return Result;
+        }
+#endif
+        return {
+            m11 - B.m11, m21 - B.m21, m31 - B.m31, m41 - B.m41,
+            m12 - B.m12, m22 - B.m22, m32 - B.m32, m42 - B.m42,
+            m13 - B.m13, m23 - B.m23, m33 - B.m33, m43 - B.m43,
+            m14 - B.m14, m24 - B.m24, m34 - B.m34, m44 - B.m44};
+    }
+
+    constexpr Matrix4x4& Matrix4x4::operator+=(const Matrix4x4& B)
+    {
+        *this = *this + B;
+        return *this;
+    }
+
+    constexpr Matrix4x4 Matrix4x4::operator*(const Matrix4x4& B) const
+    {
+        return Mult(B);
+    }
+
+    constexpr Matrix4x4 Matrix4x4::operator*(const float Scalar) const
+    {
+#if defined(MATH_SSE) || defined(MATH_NEON)
+        if (!std::is_constant_evaluated())
+        {
+            const Simd::Lanes Scale = Simd::Splat(Scalar);
+            Matrix4x4 Result;
+            for (int i = 0; i < 16; i += 4)
+            {
+                Simd::Store(Result.m + i, Simd::Mul(Simd::Load(m + i), Scale));
+            }
+            return Result;
+        }
+#endif
+        return {
+            m11 * Scalar, m21 * Scalar, m31 * Scalar, m41 * Scalar,
+            m12 * Scalar, m22 * Scalar, m32 * Scalar, m42 * Scalar,
+            m13 * Scalar, m23 * Scalar, m33 * Scalar, m43 * Scalar,
+            m14 * Scalar, m24 * Scalar, m34 * Scalar, m44 * Scalar};
+    }
+
+    constexpr Vec4 Matrix4x4::operator*(const Vec4& B) const
+    {
+#if defined(MATH_SSE) || defined(MATH_NEON)
+        if (!std::is_constant_evaluated())
+        {
+            Simd::Lanes Sum = Simd::Mul(Simd::Load(m), Simd::Splat(B.x));
+            Sum = Simd::Add(Sum, Simd::Mul(Simd::Load(m + 4), Simd::Splat(B.y)));
+            Sum = Simd::Add(Sum, Simd::Mul(Simd::Load(m + 8), Simd::Splat(B.z)));
+            Sum = Simd::Add(Sum, Simd::Mul(Simd::Load(m + 12), Simd::Splat(B.w)));
+            float Result[4];
+            Simd::Store(Result, Sum);
+            return {Result[0], Result[1], Result[2], Result[3]};
+        }
+#endif
+        return {
+            m11 * B.x + m12 * B.y + m13 * B.z + m14 * B.w,
+            m21 * B.x + m22 * B.y + m23 * B.z + m24 * B.w,
+            m31 * B.x + m32 * B.y + m33 * B.z + m34 * B.w,
+            m41 * B.x + m42 * B.y + m43 * B.z + m44 * B.w,
+        };
+    }
+
+    constexpr Vec4 Matrix4x4::GetRow(int I)
+    {
+        return {m[I * 4], m[(I + 1) * 4], m[(I + 2) * 4], m[(I + 3) * 4]};
+    }
+
+    constexpr Vec4 Matrix4x4::GetColumn(int I)
+    {
+        return {m[I * 4], m[I * 4 + 1], m[I * 4 + 2], m[I * 4 + 3]};
+    }
+
+    constexpr Matrix3x3::Matrix3x3()
+        : m11(0), m21(0), m31(0), m12(0), m22(0), m32(0), m13(0), m23(0), m33(0)
+    {
+    }
+
+    constexpr Matrix3x3::Matrix3x3(float m11, float m21, float m31, float m12, float m22, float m32, float m13, float m23, float m33)
+        : m11(m11), m21(m21), m31(m31), m12(m12), m22(m22), m32(m32), m13(m13), m23(m23), m33(m33)
+    {
+    }
+
+    inline constexpr Matrix3x3 Identity3x3 = {
+        1, 0, 0,
+        0, 1, 0,
+        0, 0, 1};
+
+    constexpr Matrix3x3 Matrix3x3::Mult(const Matrix3x3& B) const
+    {
+        return {
+            m11 * B.m11 + m12 * B.m21 + m13 * B.m31,
+            m21 * B.m11 + m22 * B.m21 + m23 * B.m31,
+            m31 * B.m11 + m32 * B.m21 + m33 * B.m31, // End column 1
+            m11 * B.m12 + m12 * B.m22 + m13 * B.m32,
+            m21 * B.m12 + m22 * B.m22 + m23 * B.m32,
+            m31 * B.m12 + m32 * B.m22 + m33 * B.m32, // End column 2
+            m11 * B.m13 + m12 * B.m23 + m13 * B.m33,
+            m21 * B.m13 + m22 * B.m23 + m23 * B.m33,
+            m31 * B.m13 + m32 * B.m23 + m33 * B.m33 // End column 3
+        };
+    }
+
+    constexpr Matrix3x3 Matrix3x3::Transpose() const
+    {
+        return {
+            m11, m12, m13,
+            m21, m22, m23,
+            m31, m32, m33};
+    }
+
+    constexpr float Matrix3x3::Determinant() const
+    {
+        return m11 * (m22 * m33 - m23 * m32) - m12 * (m21 * m33 - m23 * m31) + m13 * (m21 * m32 - m22 * m31);
+    }
+
+    constexpr Matrix3x3 Matrix3x3::operator+(const Matrix3x3& B) const
+    {
+        return {
+            m11 + B.m11, m21 + B.m21, m31 + B.m31,
+            m12 + B.m12, m22 + B.m22, m32 + B.m32,
+            m13 + B.m13, m23 + B.m23, m33 + B.m33};
+    }
+
+    constexpr Matrix3x3 Matrix3x3::operator-(const Matrix3x3& B) const
+    {
+        return {
+            m11 - B.m11, m21 - B.m21, m31 - B.m31,
+            m12 - B.m12, m22 - B.m22, m32 - B.m32,
+            m13 - B.m13, m23 - B.m23, m33 - B.m33};
+    }
+
+    constexpr Matrix3x3 Matrix3x3::operator*(const Matrix3x3& B) const
+    {
+        return Mult(B);
+    }
+
+    constexpr Matrix3x3 Matrix3x3::operator*(const float Scalar) const
+    {
+        return {
+            m11 * Scalar, m21 * Scalar, m31 * Scalar,
+            m12 * Scalar, m22 * Scalar, m32 * Scalar,
+            m13 * Scalar, m23 * Scalar, m33 * Scalar};
+    }
+
+    constexpr Vec3 Matrix3x3::operator*(const Vec3& B) const
+    {
+        return {
+            m11 * B.x + m12 * B.y + m13 * B.z,
+            m21 * B.x + m22 * B.y + m23 * B.z,
+            m31 * B.x + m32 * B.y + m33 * B.z};
+    }
+
+    constexpr Vec3::Vec3()
+        : x(0), y(0), z(0) {}
+
+    constexpr Vec3::Vec3(float X, float Y, float Z)
+        : x(X), y(Y), z(Z) {}
+
+    inline Vec3& Vec3::Normalize()
+    {
+        float Magnitude = std::sqrt(x * x + y * y + z * z);
+        x = x / Magnitude;
+        y = y / Magnitude;
+        z = z / Magnitude;
+        return *this;
+    }
+
+    constexpr float Vec3::Dot(const Vec3& B) const
+    {
+        return x * B.x + y * B.y + z * B.z;
+    }
+
+    constexpr Vec3 Vec3::Cross(const Vec3& B) const
+    {
+        return {
+            y * B.z - z * B.y,
+            z * B.x - x * B.z,
+            x * B.y - y * B.x};
+    }
+
+    constexpr Vec3 Vec3::operator-(const Vec3& B) const
+    {
+        return {x - B.x, y - B.y, z - B.z};
+    }
+
+    constexpr Vec3 Vec3::operator+(const Vec3& B) const
+    {
+        return {x + B.x, y + B.y, z + B.z};
+    }
+
+    constexpr Vec3& Vec3::operator+=(const Vec3& B)
+    {
+        x += B.x;
+        y += B.y;
+        z += B.z;
+        return *this;
+    }
+
+    constexpr Vec3 Vec3::operator*(float Scalar) const
+    {
+        return {x * Scalar, y * Scalar, z * Scalar};
+    }
+
+    constexpr Vec4::Vec4()
+        : x(0), y(0), z(0), w(1) {}
+
+    constexpr Vec4::Vec4(float X, float Y, float Z, float W)
+        : x(X), y(Y), z(Z), w(W) {}
+
+    constexpr Vec4::Vec4(float X, float Y, float Z)
+        : x(X), y(Y), z(Z), w(1) {}
+
+    constexpr Vec4::Vec4(const Vec3& XYZ, float W)
+        : x(XYZ.x), y(XYZ.y), z(XYZ.z), w(W) {}
+
+    constexpr Vec3 Vec4::XYZ() const
+    {
+        return {x, y, z};
+    }
+
+    constexpr float Vec4::Dot(const Vec4& B) const
+    {
+        return x * B.x + y * B.y + z * B.z;
+    }
+
+    constexpr Vec4 Vec4::Cross(const Vec4& B) const
+    {
+        return {
+            y * B.z - z * B.y,
+            -1 * x * B.z + z * B.x,
+            x * B.y - y * B.x,
+            1.0f};
+    }
+
+    constexpr Matrix4x4 Vec4::OuterProduct(const Vec4& B) const
+    {
+        return {
+            x * B.x,
+            x * B.y,
+            x * B.z,
+            x * B.w,
+            y * B.x,
+            y * B.y,
+            y * B.z,
+            y * B.w,
+            z * B.x,
+            z * B.y,
+            z * B.z,
+            z * B.w,
+            w * B.x,
+            w * B.y,
+            w * B.z,
+            w * B.w,
+        };
+    }
+
+    inline Vec4& Vec4::Normalize()
+    {
+        float Magnitude = std::sqrt(x * x + y * y + z * z);
+        x = x / Magnitude;
+        y = y / Magnitude;
+        z = z / Magnitude;
+        return *this;
+    }
+
+    constexpr Vec4 Vec4::Subtract(const Vec4& B) const
+    {
+        return {x - B.x, y - B.y, z - B.z, w};
+    }
+
+    constexpr Vec4 Vec4::operator-(const Vec4& B) const
+    {
+        return Subtract(B);
+    }
+
+    constexpr Vec4 Vec4::operator+(const Vec4& B) const
+    {
+        return {x + B.x, y + B.y, z + B.z, w};
+    }
+
+    constexpr Vec4& Vec4::operator+=(const Vec4& B)
+    {
+        x += B.x;
+        y += B.y;
+        z += B.z;
+        return *this;
+    }
+
+    constexpr Vec4 Vec4::operator-(const Vec3& B) const
+    {
+        return {x - B.x, y - B.y, z - B.z, w};
+    }
+
+    constexpr Vec4 Vec4::operator+(const Vec3& B) const
+    {
+        return {x + B.x, y + B.y, z + B.z, w};
+    }
+
+    constexpr Vec4& Vec4::operator+=(const Vec3& B)
+    {
+        x += B.x;
+        y += B.y;
+        z += B.z;
+        return *this;
+    }
+
+    constexpr Vec4 Vec4::operator*(const Matrix4x4& B) const
+    {
+        return {
+            x * B.m11 + y * B.m21 + z * B.m31 + w * B.m41,
+            x * B.m12 + y * B.m22 + z * B.m32 + w * B.m42,
+            x * B.m13 + y * B.m23 + z * B.m33 + w * B.m43,
+            x * B.m14 + y * B.m24 + z * B.m34 + w * B.m44,
+        };
+    }
+
+    constexpr Vec4 Vec4::operator*(float Scalar) const
+    {
+        return {x * Scalar, y * Scalar, z * Scalar, w};
+    }
+
+    constexpr Vec4& Vec4::operator/=(float Scalar)
+    {
+        x /= Scalar;
+        y /= Scalar;
+        z /= Scalar;
+        w /= Scalar;
+        return *this;
+    }
+
+    inline Matrix4x4 Multiply(const Matrix4x4& A, const Matrix4x4& B)
+    {
+        return A.Mult(B);
+    }
+
+    inline Matrix4x4 ViewMatrix(const Vec4& Forward, const Vec4& Up, const Vec4& EyePosition)
+    {
+        Vec4 Right = Up.Cross(Forward).Normalize();
+        Vec4 ForcedUp = Forward.Cross(Right).Normalize();
+        return {
+            Right.x, ForcedUp.x, Forward.x, 0,
+            Right.y, ForcedUp.y, Forward.y, 0,
+            Right.z, ForcedUp.z, Forward.z, 0,
+            -1 * Right.Dot(EyePosition), -1 * ForcedUp.Dot(EyePosition), -1 * Forward.Dot(EyePosition), 1};
+    }
+
+    inline Matrix4x4 PerspectiveMatrix(float FOV, float AspectRatio, float NearZ, float FarZ)
+    {
+        float Theta = FOV * PI / 360;
+        float CotTheta = cos(Theta) / sin(Theta);
+        float ScaledFarDepth = FarZ / (FarZ - NearZ);
+        return {
+            CotTheta / AspectRatio, 0, 0, 0,
+            0, CotTheta, 0, 0,
+            0, 0, ScaledFarDepth, 1,
+            0, 0, -1 * NearZ * ScaledFarDepth, 0};
+    }
+
+    inline Matrix4x4 RotateAboutAxis(const Vec4& A, float Angle)
+    {
+        float Theta = Angle * PI / 180;
+        float C = cos(Theta);
+        float OMC = 1 - C;
+        float S = sin(Theta);
+        return {
+            C + A.x * A.x * OMC, A.y * A.x * OMC + A.z * S, A.z * A.x * OMC - A.y * S, 0,
+            A.x * A.y * OMC - A.z * S, C + A.y * A.y * OMC, A.y * A.z * OMC - A.x * S, 0,
+            A.x * A.z * OMC + A.y * S, A.y * A.z * OMC - A.x * S, C + A.z * A.z * OMC, 0,
+            0, 0, 0, 1};
+    }
+
+    inline Matrix4x4 Rotate(const float Roll, const float Pitch, const float Yaw)
+    {
+        float CR = cos(Roll * PI / 180);
+        float SR = sin(Roll * PI / 180);
+        float CP = cos(Pitch * PI / 180);
+        float SP = sin(Pitch * PI / 180);
+        float CY = cos(Yaw * PI / 180);
+        float SY = sin(Yaw * PI / 180);
+        return {
+            CP * CY, CP * SY, -SP, 0,
+            SR * SP * CY - CR * SY, SR * SP * SY + CR * CY, SR * CP, 0,
+            CR * SP * CY + SR * SY, CR * SP * SY - SR * CY, CR * CP, 0,
+            0, 0, 0, 1};
+    }
+
+    inline Matrix4x4 Translate(const Vec4& Translation)
+    {
+        return {
+            1, 0, 0, 0,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            Translation.x, Translation.y, Translation.z, 1};
+    }
+
+    inline Matrix4x4 TransformationMatrix(const Matrix4x4& Rotation, const Vec4& Translation, const Vec4& Scale)
+    {
+        return {
+            Rotation.m11 * Scale.x, Rotation.m21, Rotation.m31, Rotation.m41,
+            Rotation.m12, Rotation.m22 * Scale.y, Rotation.m32, Rotation.m42,
+            Rotation.m13, Rotation.m23, Rotation.m33 * Scale.z, Rotation.m43,
+            Translation.x, Translation.y, Translation.z, 1};
+    }
+
+    inline Matrix4x4 TransformationMatrix(const Matrix4x4& Rotation, const Vec4& Translation)
+    {
+        return {
+            Rotation.m11, Rotation.m21, Rotation.m31, Rotation.m41,
+            Rotation.m12, Rotation.m22, Rotation.m32, Rotation.m42,
+            Rotation.m13, Rotation.m23, Rotation.m33, Rotation.m43,
+            Translation.x, Translation.y, Translation.z, 1};
+    }
+
+    template <typename T>
+    constexpr Vec2<T>::Vec2()
+        : x(0), y(0)
+    {
+    }
+
+    template <typename T>
+    constexpr Vec2<T>::Vec2(T X, T Y)
+        : x(X), y(Y)
+    {
+    }
+
+    template <typename T>
+    Vec2<T>& Vec2<T>::Normalize()
+    {
+        float Magnitude = std::sqrt(x * x + y * y);
+        x = x / Magnitude;
+        y = y / Magnitude;
+        return *this;
+    }
+
+    template <typename T>
+    constexpr Vec2<T> Vec2<T>::Subtract(const Vec2<T>& B) const
+    {
+        return {x - B.x, y - B.y};
+    }
+
+    template <typename T>
+    constexpr T Vec2<T>::Dot(const Vec2<T>& B) const
+    {
+        return x * B.x + y * B.y;
+    }
+
+    template <typename T>
+    constexpr Vec2<T>& Vec2<T>::Pow(const int Power)
+    {
+        const T BaseX = x;
+        const T BaseY = y;
+        for (int i = 1; i < Power; i++)
+        {
+            x *= BaseX;
+            y *= BaseY;
+        }
+        return *this;
+    }
+
+    template <typename T>
+    constexpr Vec2<T> Vec2<T>::operator-(const Vec2<T>& B) const
+    {
+        return Subtract(B);
+    }
+
+    template <typename T>
+    constexpr Vec2<T> Vec2<T>::operator+(const Vec2<T>& B) const
+    {
+        return {x + B.x, y + B.y};
+    }
+
+    template <typename T>
+    constexpr Vec2<T>& Vec2<T>::operator+=(const Vec2<T>& B)
+    {
+        x += B.x;
+        y += B.y;
+        return *this;
+    }
+
+    template <typename T>
+    constexpr Vec2<T> Vec2<T>::operator*(T Scalar)
+    {
+        return {x * Scalar, y * Scalar};
+    }
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,128 @@
+#include "util/ChildProcess.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+ChildProcess::~ChildProcess()
+{
+    Kill();
+}
+
+#ifdef _WIN32
+bool ChildProcess::Start(const std::filesystem::path& Executable, const std::vector<std::string>& Arguments)
+{
+    // Arguments with spaces quoted, none of ours hold quotes themselves
+    std::wstring CommandLine = L"\"" + Executable.wstring() + L"\"";
+    for (const std::string& Argument : Arguments)
+    {
+        std::wstring Wide = std::filesystem::path(Argument).wstring();
+        CommandLine += Wide.empty() || Wide.find(L' ') != std::wstring::npos ? L" \"" + Wide + L"\"" : L" " + Wide;
+    }
+
+    STARTUPINFOW StartupInfo = {};
+    StartupInfo.cb = sizeof(StartupInfo);
+    PROCESS_INFORMATION Info = {};
+    if (!CreateProcessW(Executable.wstring().c_str(), CommandLine.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &StartupInfo, &Info))
+    {
+        return false;
+    }
+    CloseHandle(Info.hThread);
+    Process = reinterpret_cast<intptr_t>(Info.hProcess);
+    Running = true;
+    return true;
+}
+
+bool ChildProcess::HasExited(int& ExitCode)
+{
+    HANDLE Handle = reinterpret_cast<HANDLE>(Process);
+    if (!Running || WaitForSingleObject(Handle, 0) != WAIT_OBJECT_0)
+    {
+        return false;
+    }
+    DWORD Code = 0;
+    GetExitCodeProcess(Handle, &Code);
+    CloseHandle(Handle);
+    Running = false;
+    ExitCode = static_cast<int>(Code);
+    return true;
+}
+
+void ChildProcess::Kill()
+{
+    if (!Running)
+    {
+        return;
+    }
+    HANDLE Handle = reinterpret_cast<HANDLE>(Process);
+    TerminateProcess(Handle, 1);
+    WaitForSingleObject(Handle, INFINITE);
+    CloseHandle(Handle);
+    Running = false;
+}
+
+uint32_t ChildProcess::GetCurrentId()
+{
+    return GetCurrentProcessId();
+}
+#else
+bool ChildProcess::Start(const std::filesystem::path& Executable, const std::vector<std::string>& Arguments)
+{
+    std::string Path = Executable.string();
+    std::vector<char*> Argv = {Path.data()};
+    std::vector<std::string> Copies = Arguments;
+    for (std::string& Argument : Copies)
+    {
+        Argv.push_back(Argument.data());
+    }
+    Argv.push_back(nullptr);
+
+    pid_t Id;
+    if (posix_spawn(&Id, Path.c_str(), nullptr, nullptr, Argv.data(), environ) != 0)
+    {
+        return false;
+    }
+    Process = Id;
+    Running = true;
+    return true;
+}
+
+bool ChildProcess::HasExited(int& ExitCode)
+{
+    int Status;
+    if (!Running || waitpid(static_cast<pid_t>(Process), &Status, WNOHANG) != static_cast<pid_t>(Process))
+    {
+        return false;
+    }
+    Running = false;
+    // Killed by a signal counts as failed
+    ExitCode = WIFEXITED(Status) ? WEXITSTATUS(Status) : -1;
+    return true;
+}
+
+void ChildProcess::Kill()
+{
+    if (!Running)
+    {
+        return;
+    }
+    kill(static_cast<pid_t>(Process), SIGKILL);
+    waitpid(static_cast<pid_t>(Process), nullptr, 0);
+    Running = false;
+}
+
+uint32_t ChildProcess::GetCurrentId()
+{
+    return static_cast<uint32_t>(getpid());
+}
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Process started from an executable, e.g. one rank of a multi-process decomposed run. A process still running when
+// its ChildProcess is destroyed is killed
+class ChildProcess
+{
+public:
+    ChildProcess() = default;
+    ~ChildProcess();
+
+    ChildProcess(const ChildProcess&) = delete;
+    ChildProcess& operator=(const ChildProcess&) = delete;
+
+    // Returns false if the process can't be started
+    bool Start(const std::filesystem::path& Executable, const std::vector<std::string>& Arguments);
+    // Returns true, with the exit code, once the process exited. Doesn't wait
+    bool HasExited(int& ExitCode);
+    // Kills the process if it is still running and waits until it is gone
+    void Kill();
+
+    static uint32_t GetCurrentId();
+
+private:
+    bool Running = false;
+    // The process handle on Windows, the process id elsewhere
+    intptr_t Process = 0;
+};
@@ -0,0 +1,91 @@
+#include "util/MappedFile.h"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Create(const std::filesystem::path& Path)
+{
+    Close();
+    HANDLE Handle = CreateFileW(Path.wstring().c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (Handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    File = Handle;
+    return true;
+}
+
+bool MappedFile::Resize(uint64_t Bytes)
+{
+    if (!File || Bytes <= Size)
+    {
+        return File != nullptr;
+    }
+    // A mapping can't grow, but views keep their old mapping alive after its handle is closed
+    HANDLE NewMapping = CreateFileMappingW(File, nullptr, PAGE_READWRITE, static_cast<DWORD>(Bytes >> 32), static_cast<DWORD>(Bytes), nullptr);
+    if (!NewMapping)
+    {
+        return false;
+    }
+    if (Mapping)
+    {
+        CloseHandle(Mapping);
+    }
+    Mapping = NewMapping;
+    Size = Bytes;
+    return true;
+}
+
+uint64_t MappedFile::GetSize() const
+{
+    return Size;
+}
+
+void* MappedFile::Map(uint64_t Offset, size_t Bytes)
+{
+    if (!Mapping || Offset + Bytes > Size)
+    {
+        return nullptr;
+    }
+    return MapViewOfFile(Mapping, FILE_MAP_READ | FILE_MAP_WRITE, static_cast<DWORD>(Offset >> 32), static_cast<DWORD>(Offset), Bytes);
+}
+
+void MappedFile::Unmap(void* View)
+{
+    UnmapViewOfFile(View);
+}
+
+void MappedFile::Prefetch(void* Address, size_t Bytes)
+{
+    WIN32_MEMORY_RANGE_ENTRY Range = {Address, Bytes};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &Range, 0);
+}
+
+size_t MappedFile::GetGranularity()
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    return Info.dwAllocationGranularity;
+}
+
+void MappedFile::Close()
+{
+    if (Mapping)
+    {
+        CloseHandle(Mapping);
+        Mapping = nullptr;
+    }
+    if (File)
+    {
+        CloseHandle(File);
+        File = nullptr;
+    }
+    Size = 0;
+}
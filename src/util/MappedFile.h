@@ -0,0 +1,39 @@
+#pragma once
+
+#include <filesystem>
+#include <stddef.h>
+#include <stdint.h>
+
+// Read/write file accessed through mapped views, for data that doesn't fit in memory. Pages of a view are read on
+// first touch and written back by the OS after the view is unmapped, so only mapped views need to stay resident
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Creates the file, replacing any existing one. Returns false if it can't be created
+    bool Create(const std::filesystem::path& Path);
+    // Grows the file to Bytes, views mapped before stay valid. Returns false if the disk can't hold it, the file then
+    // keeps its old size
+    bool Resize(uint64_t Bytes);
+    uint64_t GetSize() const;
+
+    // Offset has to be a multiple of GetGranularity. Returns nullptr if the view can't be mapped, e.g. when the
+    // address space is used up
+    void* Map(uint64_t Offset, size_t Bytes);
+    void Unmap(void* View);
+    // Starts reading a mapped range in the background, so touching it later doesn't wait on the disk
+    static void Prefetch(void* Address, size_t Bytes);
+    static size_t GetGranularity();
+
+private:
+    void Close();
+
+    void* File = nullptr;
+    void* Mapping = nullptr;
+    uint64_t Size = 0;
+};
@@ -0,0 +1,152 @@
+#include "util/MemoryArena.h"
+
+#include <new>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+namespace
+{
+// Size of a large page, or 0 when they can't be used. Locking them takes SeLockMemoryPrivilege, which the account needs
+// to have been granted ("Lock pages in memory") and the process has to enable
+size_t GetLargePageSize()
+{
+    static const size_t PageSize = []() -> size_t
+    {
+        size_t Minimum = GetLargePageMinimum();
+        HANDLE Token;
+        if (Minimum == 0 || !OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &Token))
+        {
+            return 0;
+        }
+        TOKEN_PRIVILEGES Privileges = {};
+        Privileges.PrivilegeCount = 1;
+        Privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        // AdjustTokenPrivileges succeeds without granting anything when the account lacks the privilege
+        bool Enabled = LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &Privileges.Privileges[0].Luid) && AdjustTokenPrivileges(Token, FALSE, &Privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+        CloseHandle(Token);
+        return Enabled ? Minimum : 0;
+    }();
+    return PageSize;
+}
+}
+#else
+#include <sys/mman.h>
+#endif
+
+MemoryArena::MemoryArena(size_t BlockSize)
+    : BlockSize(BlockSize)
+{
+}
+
+MemoryArena::~MemoryArena()
+{
+    ReleaseBlocks();
+}
+
+void* MemoryArena::Allocate(size_t Bytes, size_t Alignment)
+{
+    if (!Blocks.empty())
+    {
+        // Blocks start on a page, so aligning the offset aligns the address
+        size_t Aligned = (Offset + Alignment - 1) & ~(Alignment - 1);
+        if (Aligned + Bytes <= Blocks.back().Size)
+        {
+            Offset = Aligned + Bytes;
+            return Blocks.back().Memory + Aligned;
+        }
+    }
+    AddBlock(Bytes);
+    Offset = Bytes;
+    return Blocks.back().Memory;
+}
+
+void MemoryArena::Reset()
+{
+    if (Blocks.size() > 1)
+    {
+        size_t Total = 0;
+        for (const Block& Entry : Blocks)
+        {
+            Total += Entry.Size;
+        }
+        ReleaseBlocks();
+        AddBlock(Total);
+    }
+    Offset = 0;
+}
+
+size_t MemoryArena::GetCapacity() const
+{
+    size_t Total = 0;
+    for (const Block& Entry : Blocks)
+    {
+        Total += Entry.Size;
+    }
+    return Total;
+}
+
+bool MemoryArena::UsesLargePages() const
+{
+    return std::any_of(Blocks.begin(), Blocks.end(), [](const Block& Entry)
+                       { return Entry.LargePages; });
+}
+
+#ifdef _WIN32
+void MemoryArena::AddBlock(size_t MinSize)
+{
+    size_t Size = std::max(MinSize, BlockSize);
+    if (size_t LargePage = GetLargePageSize())
+    {
+        size_t Rounded = (Size + LargePage - 1) / LargePage * LargePage;
+        if (void* Memory = VirtualAlloc(nullptr, Rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE))
+        {
+            Blocks.push_back({static_cast<uint8_t*>(Memory), Rounded, true});
+            return;
+        }
+    }
+    // Large pages fail once physical memory is fragmented, regular pages only once the commit limit is reached
+    void* Memory = VirtualAlloc(nullptr, Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!Memory)
+    {
+        throw std::bad_alloc();
+    }
+    Blocks.push_back({static_cast<uint8_t*>(Memory), Size, false});
+}
+
+void MemoryArena::ReleaseBlocks()
+{
+    for (const Block& Entry : Blocks)
+    {
+        VirtualFree(Entry.Memory, 0, MEM_RELEASE);
+    }
+    Blocks.clear();
+}
+#else
+void MemoryArena::AddBlock(size_t MinSize)
+{
+    // Nothing to lock here, the kernel backs the block with transparent huge pages where it can
+    size_t Size = std::max(MinSize, BlockSize);
+    void* Memory = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (Memory == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(Memory, Size, MADV_HUGEPAGE);
+#endif
+    Blocks.push_back({static_cast<uint8_t*>(Memory), Size, false});
+}
+
+void MemoryArena::ReleaseBlocks()
+{
+    for (const Block& Entry : Blocks)
+    {
+        munmap(Entry.Memory, Entry.Size);
+    }
+    Blocks.clear();
+}
+#endif
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Cache line alignment of every allocation, keeps arrays from sharing lines between threads
+#define ARENA_ALIGNMENT 64
+
+// Linear allocator over large blocks of memory, backed by 2 MB pages where the process is allowed to lock them, which
+// cuts TLB misses on big particle arrays. Allocations are never freed one by one, Reset rewinds the whole arena and
+// keeps its memory. A solver keeps one arena for arrays living as long as the run and one it resets every step for
+// scratch, so stepping makes no heap calls once the arenas have grown to the largest step. Nothing is constructed,
+// memory comes back zeroed only the first time
+class MemoryArena
+{
+public:
+    MemoryArena(size_t BlockSize = 2 * 1024 * 1024);
+    ~MemoryArena();
+
+    MemoryArena(const MemoryArena&) = delete;
+    MemoryArena& operator=(const MemoryArena&) = delete;
+
+    void* Allocate(size_t Bytes, size_t Alignment = ARENA_ALIGNMENT);
+    template <typename T>
+    T* Allocate(size_t Count)
+    {
+        return static_cast<T*>(Allocate(Count * sizeof(T), std::max<size_t>(alignof(T), ARENA_ALIGNMENT)));
+    }
+
+    // Rewinds every allocation. Blocks chained on since the last Reset are merged into one big enough for all of them,
+    // so an arena reset every step settles on a single block
+    void Reset();
+
+    size_t GetCapacity() const;
+    bool UsesLargePages() const;
+
+private:
+    struct Block
+    {
+        uint8_t* Memory;
+        size_t Size;
+        bool LargePages;
+    };
+
+    void AddBlock(size_t MinSize);
+    void ReleaseBlocks();
+
+    size_t BlockSize;
+    std::vector<Block> Blocks;
+    size_t Offset = 0;
+};
+
+// Allocator putting a container's elements in an arena, e.g. a solver's std::vector arrays living as long as the solver.
+// Freeing does nothing, so a container that grows leaves its old storage in the arena, reserve ahead where it matters.
+// Without an arena it falls back to the heap. Containers swapping or moving their contents take the arena along
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator(MemoryArena* Arena = nullptr)
+        : Arena(Arena)
+    {
+    }
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& Other)
+        : Arena(Other.GetArena())
+    {
+    }
+
+    T* allocate(size_t Count)
+    {
+        return Arena ? Arena->Allocate<T>(Count) : std::allocator<T>().allocate(Count);
+    }
+    void deallocate(T* Pointer, size_t Count)
+    {
+        if (!Arena)
+        {
+            std::allocator<T>().deallocate(Pointer, Count);
+        }
+    }
+
+    MemoryArena* GetArena() const { return Arena; }
+    bool operator==(const ArenaAllocator& Other) const { return Arena == Other.Arena; }
+
+private:
+    MemoryArena* Arena;
+};
@@ -0,0 +1,101 @@
+#include "util/Numa.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+namespace Numa
+{
+    uint32_t GetNumNodes()
+    {
+        ULONG HighestNode = 0;
+        if (!GetNumaHighestNodeNumber(&HighestNode))
+        {
+            return 1;
+        }
+        return static_cast<uint32_t>(HighestNode) + 1;
+    }
+
+    bool PinThreadToNode(uint32_t Node)
+    {
+        GROUP_AFFINITY Affinity = {};
+        if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(Node), &Affinity) || Affinity.Mask == 0)
+        {
+            return false;
+        }
+        return SetThreadGroupAffinity(GetCurrentThread(), &Affinity, nullptr) != 0;
+    }
+
+    void* Reserve(size_t Bytes)
+    {
+        return VirtualAlloc(nullptr, std::max<size_t>(Bytes, 1), MEM_RESERVE, PAGE_READWRITE);
+    }
+
+    void Commit(void* Address, size_t Bytes, uint32_t Node)
+    {
+        if (Bytes == 0)
+        {
+            return;
+        }
+        // A node that doesn't exist falls back to the default placement, on the node of the first thread to touch a page
+        if (!VirtualAllocExNuma(GetCurrentProcess(), Address, Bytes, MEM_COMMIT, PAGE_READWRITE, Node))
+        {
+            VirtualAlloc(Address, Bytes, MEM_COMMIT, PAGE_READWRITE);
+        }
+    }
+
+    void Release(void* Address)
+    {
+        VirtualFree(Address, 0, MEM_RELEASE);
+    }
+}
+
+#else
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Elsewhere a single node, with reservations as lazily backed anonymous mappings. Their first page holds the size for
+// Release
+namespace Numa
+{
+    uint32_t GetNumNodes()
+    {
+        return 1;
+    }
+
+    bool PinThreadToNode(uint32_t)
+    {
+        return false;
+    }
+
+    void* Reserve(size_t Bytes)
+    {
+        size_t PageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t Total = PageSize + std::max<size_t>(Bytes, 1);
+        void* Base = mmap(nullptr, Total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (Base == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        *static_cast<size_t*>(Base) = Total;
+        return static_cast<uint8_t*>(Base) + PageSize;
+    }
+
+    void Commit(void*, size_t, uint32_t)
+    {
+    }
+
+    void Release(void* Address)
+    {
+        uint8_t* Base = static_cast<uint8_t*>(Address) - sysconf(_SC_PAGESIZE);
+        munmap(Base, *reinterpret_cast<size_t*>(Base));
+    }
+}
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+namespace Numa
+{
+    // NUMA nodes of the machine, 1 on machines without NUMA
+    uint32_t GetNumNodes();
+    // Restricts the calling thread to the processors of Node
+    bool PinThreadToNode(uint32_t Node);
+
+    // Address space for Bytes without any memory behind it yet
+    void* Reserve(size_t Bytes);
+    // Backs [Address, Address + Bytes) of a reservation with memory on Node, rounded out to whole pages. Pages that are
+    // already backed keep their node. The memory reads as zero
+    void Commit(void* Address, size_t Bytes, uint32_t Node);
+    void Release(void* Address);
+}
+
+// Array whose pages are spread over NUMA nodes by its owner, e.g. the strips of a grid worked on by the threads of
+// each node. Elements start zeroed and are never constructed, so T has to be fine as all zero bytes
+template <typename T>
+class NumaArray
+{
+public:
+    NumaArray() = default;
+    ~NumaArray()
+    {
+        if (Elements)
+        {
+            Numa::Release(Elements);
+        }
+    }
+
+    NumaArray(const NumaArray&) = delete;
+    NumaArray& operator=(const NumaArray&) = delete;
+    NumaArray& operator=(NumaArray&& Other) noexcept
+    {
+        std::swap(Elements, Other.Elements);
+        std::swap(Count, Other.Count);
+        return *this;
+    }
+
+    // Drops the old contents and reserves Count elements, none of them placed yet
+    void Reset(size_t NewCount)
+    {
+        *this = NumaArray();
+        Elements = static_cast<T*>(Numa::Reserve(NewCount * sizeof(T)));
+        Count = NewCount;
+    }
+
+    // Every element has to be placed before it is used
+    void Place(size_t First, size_t NumElements, uint32_t Node)
+    {
+        Numa::Commit(Elements + First, NumElements * sizeof(T), Node);
+    }
+
+    T* data() { return Elements; }
+    const T* data() const { return Elements; }
+    size_t size() const { return Count; }
+    T& operator[](size_t Index) { return Elements[Index]; }
+    const T& operator[](size_t Index) const { return Elements[Index]; }
+
+private:
+    T* Elements = nullptr;
+    size_t Count = 0;
+};
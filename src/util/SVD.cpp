@@ -0,0 +1,303 @@
+#include "SVD.h"
+
+#include <cmath>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Math
+{
+    namespace
+    {
+        // The decomposition is written once against these lane types so the scalar and AVX2 paths
+        // run the exact same branch free instruction sequence
+        struct ScalarLane
+        {
+            typedef bool Mask;
+            float V;
+
+            ScalarLane() = default;
+            ScalarLane(float X) : V(X) {}
+
+            static ScalarLane Load(const float* Ptr) { return ScalarLane(*Ptr); }
+            void Store(float* Ptr) const { *Ptr = V; }
+
+            ScalarLane operator+(ScalarLane B) const { return V + B.V; }
+            ScalarLane operator-(ScalarLane B) const { return V - B.V; }
+            ScalarLane operator*(ScalarLane B) const { return V * B.V; }
+            ScalarLane operator/(ScalarLane B) const { return V / B.V; }
+            ScalarLane operator-() const { return -V; }
+        };
+
+        inline ScalarLane Sqrt(ScalarLane A) { return std::sqrt(A.V); }
+        inline ScalarLane Abs(ScalarLane A) { return std::abs(A.V); }
+        inline bool Less(ScalarLane A, ScalarLane B) { return A.V < B.V; }
+        inline ScalarLane Select(bool Condition, ScalarLane IfTrue, ScalarLane IfFalse) { return Condition ? IfTrue : IfFalse; }
+
+#if defined(__AVX2__)
+        struct AVXLane
+        {
+            typedef __m256 Mask;
+            __m256 V;
+
+            AVXLane() = default;
+            AVXLane(__m256 X) : V(X) {}
+            AVXLane(float X) : V(_mm256_set1_ps(X)) {}
+
+            static AVXLane Load(const float* Ptr) { return _mm256_load_ps(Ptr); }
+            void Store(float* Ptr) const { _mm256_store_ps(Ptr, V); }
+
+            AVXLane operator+(AVXLane B) const { return _mm256_add_ps(V, B.V); }
+            AVXLane operator-(AVXLane B) const { return _mm256_sub_ps(V, B.V); }
+            AVXLane operator*(AVXLane B) const { return _mm256_mul_ps(V, B.V); }
+            AVXLane operator/(AVXLane B) const { return _mm256_div_ps(V, B.V); }
+            AVXLane operator-() const { return _mm256_xor_ps(V, _mm256_set1_ps(-0.0f)); }
+        };
+
+        inline AVXLane Sqrt(AVXLane A) { return _mm256_sqrt_ps(A.V); }
+        inline AVXLane Abs(AVXLane A) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), A.V); }
+        inline __m256 Less(AVXLane A, AVXLane B) { return _mm256_cmp_ps(A.V, B.V, _CMP_LT_OQ); }
+        inline AVXLane Select(__m256 Condition, AVXLane IfTrue, AVXLane IfFalse) { return _mm256_blendv_ps(IfFalse.V, IfTrue.V, Condition); }
+#endif
+
+        // Keeps the Jacobi/Givens denominators away from zero without branching
+        constexpr float SVD_EPSILON = 1e-30f;
+
+        // One Jacobi rotation zeroing S[P][Q] of the symmetric matrix S, accumulated into the columns of V
+        template <typename T, int P, int Q, int R>
+        inline void JacobiRotate(T S[3][3], T V[3][3])
+        {
+            T Diff = S[Q][Q] - S[P][P];
+            T Off = S[P][Q];
+            T Sign = Select(Less(Diff, T(0.0f)), T(-1.0f), T(1.0f));
+            // tan of the rotation angle, written to stay finite for Off == 0 and Diff == 0
+            T Tan = (T(2.0f) * Off * Sign) / (Abs(Diff) + Sqrt(Diff * Diff + T(4.0f) * Off * Off) + T(SVD_EPSILON));
+            T Cos = T(1.0f) / Sqrt(T(1.0f) + Tan * Tan);
+            T Sin = Tan * Cos;
+
+            T SPR = S[P][R];
+            T SQR = S[Q][R];
+            S[P][P] = S[P][P] - Tan * Off;
+            S[Q][Q] = S[Q][Q] + Tan * Off;
+            S[P][Q] = S[Q][P] = T(0.0f);
+            S[P][R] = S[R][P] = Cos * SPR - Sin * SQR;
+            S[Q][R] = S[R][Q] = Sin * SPR + Cos * SQR;
+
+            for (int i = 0; i < 3; i++)
+            {
+                T VP = V[i][P];
+                T VQ = V[i][Q];
+                V[i][P] = Cos * VP - Sin * VQ;
+                V[i][Q] = Sin * VP + Cos * VQ;
+            }
+        }
+
+        // Swaps columns I and J of B and V if column I has the smaller norm. One of the columns is negated so V stays a rotation
+        template <typename T>
+        inline void SortColumns(T B[3][3], T V[3][3], T Norms[3], int I, int J)
+        {
+            auto Swap = Less(Norms[I], Norms[J]);
+            for (int Row = 0; Row < 3; Row++)
+            {
+                T BI = B[Row][I];
+                T BJ = B[Row][J];
+                B[Row][I] = Select(Swap, BJ, BI);
+                B[Row][J] = Select(Swap, -BI, BJ);
+
+                T VI = V[Row][I];
+                T VJ = V[Row][J];
+                V[Row][I] = Select(Swap, VJ, VI);
+                V[Row][J] = Select(Swap, -VI, VJ);
+            }
+            T NI = Norms[I];
+            Norms[I] = Select(Swap, Norms[J], NI);
+            Norms[J] = Select(Swap, NI, Norms[J]);
+        }
+
+        // Givens rotation on rows P and Q of B zeroing B[Q][Column], accumulated into the columns of U so that B_original = U * B
+        template <typename T>
+        inline void GivensQR(T B[3][3], T U[3][3], int P, int Q, int Column)
+        {
+            T A = B[P][Column];
+            T C = B[Q][Column];
+            T LengthSq = A * A + C * C;
+            auto Degenerate = Less(LengthSq, T(SVD_EPSILON));
+            T InvLength = T(1.0f) / Sqrt(LengthSq + T(SVD_EPSILON));
+            T Cos = Select(Degenerate, T(1.0f), A * InvLength);
+            T Sin = Select(Degenerate, T(0.0f), C * InvLength);
+
+            for (int i = 0; i < 3; i++)
+            {
+                T BP = B[P][i];
+                T BQ = B[Q][i];
+                B[P][i] = Cos * BP + Sin * BQ;
+                B[Q][i] = Cos * BQ - Sin * BP;
+
+                T UP = U[i][P];
+                T UQ = U[i][Q];
+                U[i][P] = Cos * UP + Sin * UQ;
+                U[i][Q] = Cos * UQ - Sin * UP;
+            }
+        }
+
+        // Fixed iteration SVD following McAdams et al. 2011: Jacobi eigen analysis of F^T F gives V,
+        // then a Givens QR of F * V gives U and the singular values
+        template <typename T>
+        void SVDKernel(const T F[3][3], T U[3][3], T Sigma[3], T V[3][3])
+        {
+            T S[3][3];
+            for (int Row = 0; Row < 3; Row++)
+            {
+                for (int Col = Row; Col < 3; Col++)
+                {
+                    S[Row][Col] = F[0][Row] * F[0][Col] + F[1][Row] * F[1][Col] + F[2][Row] * F[2][Col];
+                    S[Col][Row] = S[Row][Col];
+                }
+            }
+
+            for (int Row = 0; Row < 3; Row++)
+            {
+                for (int Col = 0; Col < 3; Col++)
+                {
+                    V[Row][Col] = T(Row == Col ? 1.0f : 0.0f);
+                    U[Row][Col] = T(Row == Col ? 1.0f : 0.0f);
+                }
+            }
+
+            for (int Sweep = 0; Sweep < SVD_JACOBI_SWEEPS; Sweep++)
+            {
+                JacobiRotate<T, 0, 1, 2>(S, V);
+                JacobiRotate<T, 0, 2, 1>(S, V);
+                JacobiRotate<T, 1, 2, 0>(S, V);
+            }
+
+            T B[3][3];
+            for (int Row = 0; Row < 3; Row++)
+            {
+                for (int Col = 0; Col < 3; Col++)
+                {
+                    B[Row][Col] = F[Row][0] * V[0][Col] + F[Row][1] * V[1][Col] + F[Row][2] * V[2][Col];
+                }
+            }
+
+            T Norms[3];
+            for (int Col = 0; Col < 3; Col++)
+            {
+                Norms[Col] = B[0][Col] * B[0][Col] + B[1][Col] * B[1][Col] + B[2][Col] * B[2][Col];
+            }
+            SortColumns(B, V, Norms, 0, 1);
+            SortColumns(B, V, Norms, 0, 2);
+            SortColumns(B, V, Norms, 1, 2);
+
+            GivensQR(B, U, 0, 1, 0);
+            GivensQR(B, U, 0, 2, 0);
+            GivensQR(B, U, 1, 2, 1);
+
+            Sigma[0] = B[0][0];
+            Sigma[1] = B[1][1];
+            Sigma[2] = B[2][2];
+        }
+
+        template <typename T>
+        void SVDBatch(const Matrix3x3Batch& F, Matrix3x3Batch& U, Vec3Batch& Sigma, Matrix3x3Batch& V, int Lane)
+        {
+            T FLanes[3][3], ULanes[3][3], VLanes[3][3], SigmaLanes[3];
+            for (int Row = 0; Row < 3; Row++)
+            {
+                for (int Col = 0; Col < 3; Col++)
+                {
+                    FLanes[Row][Col] = T::Load(&F.m[Col * 3 + Row][Lane]);
+                }
+            }
+
+            SVDKernel<T>(FLanes, ULanes, SigmaLanes, VLanes);
+
+            for (int Row = 0; Row < 3; Row++)
+            {
+                for (int Col = 0; Col < 3; Col++)
+                {
+                    ULanes[Row][Col].Store(&U.m[Col * 3 + Row][Lane]);
+                    VLanes[Row][Col].Store(&V.m[Col * 3 + Row][Lane]);
+                }
+                SigmaLanes[Row].Store(&Sigma.v[Row][Lane]);
+            }
+        }
+    }
+
+    void Matrix3x3Batch::Load(int I, const Matrix4x4& Matrix)
+    {
+        for (int Col = 0; Col < 3; Col++)
+        {
+            for (int Row = 0; Row < 3; Row++)
+            {
+                m[Col * 3 + Row][I] = Matrix.m[Col * 4 + Row];
+            }
+        }
+    }
+
+    Matrix4x4 Matrix3x3Batch::Store(int I) const
+    {
+        Matrix4x4 Result;
+        for (int Col = 0; Col < 3; Col++)
+        {
+            for (int Row = 0; Row < 3; Row++)
+            {
+                Result.m[Col * 4 + Row] = m[Col * 3 + Row][I];
+            }
+        }
+        return Result;
+    }
+
+    void Matrix3x3Batch::SetIdentity(int I)
+    {
+        for (int Col = 0; Col < 3; Col++)
+        {
+            for (int Row = 0; Row < 3; Row++)
+            {
+                m[Col * 3 + Row][I] = Row == Col ? 1.0f : 0.0f;
+            }
+        }
+    }
+
+    void SVD3x3(const Matrix4x4& F, Matrix4x4& U, Vec4& Sigma, Matrix4x4& V)
+    {
+        ScalarLane FLanes[3][3], ULanes[3][3], VLanes[3][3], SigmaLanes[3];
+        for (int Row = 0; Row < 3; Row++)
+        {
+            for (int Col = 0; Col < 3; Col++)
+            {
+                FLanes[Row][Col] = F.m[Col * 4 + Row];
+            }
+        }
+
+        SVDKernel<ScalarLane>(FLanes, ULanes, SigmaLanes, VLanes);
+
+        U = Matrix4x4();
+        V = Matrix4x4();
+        for (int Row = 0; Row < 3; Row++)
+        {
+            for (int Col = 0; Col < 3; Col++)
+            {
+                U.m[Col * 4 + Row] = ULanes[Row][Col].V;
+                V.m[Col * 4 + Row] = VLanes[Row][Col].V;
+            }
+        }
+        U.m44 = 1.0f;
+        V.m44 = 1.0f;
+        Sigma = Vec4(SigmaLanes[0].V, SigmaLanes[1].V, SigmaLanes[2].V, 1.0f);
+    }
+
+    void SVD3x3(const Matrix3x3Batch& F, Matrix3x3Batch& U, Vec3Batch& Sigma, Matrix3x3Batch& V)
+    {
+#if defined(__AVX2__)
+        SVDBatch<AVXLane>(F, U, Sigma, V, 0);
+#else
+        for (int Lane = 0; Lane < SVD_BATCH_SIZE; Lane++)
+        {
+            SVDBatch<ScalarLane>(F, U, Sigma, V, Lane);
+        }
+#endif
+    }
+};
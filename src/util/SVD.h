@@ -0,0 +1,36 @@
+#pragma once
+
+#include "util/3DMath.h"
+
+// Number of matrices decomposed per batched call. Matches one AVX2 register of floats
+#define SVD_BATCH_SIZE 8
+// Fixed number of cyclic Jacobi sweeps. 3x3 symmetric matrices converge to float precision in 4
+#define SVD_JACOBI_SWEEPS 4
+
+namespace Math
+{
+    // Structure-of-arrays block of SVD_BATCH_SIZE 3x3 matrices.
+    // Element (Row, Column) of matrix I is stored at m[Column * 3 + Row][I], matching the column major Matrix4x4
+    struct alignas(32) Matrix3x3Batch
+    {
+        float m[9][SVD_BATCH_SIZE];
+
+        // Copies the upper left 3x3 block of Matrix into lane I
+        void Load(int I, const Matrix4x4& Matrix);
+        // Expands lane I back into a Matrix4x4. The fourth row/column is left at zero
+        Matrix4x4 Store(int I) const;
+        void SetIdentity(int I);
+    };
+
+    struct alignas(32) Vec3Batch
+    {
+        float v[3][SVD_BATCH_SIZE];
+    };
+
+    // Computes F = U * diag(Sigma) * transpose(V) for the upper left 3x3 block of F.
+    // U and V are proper rotations, Sigma is sorted in descending order and only Sigma.z can be negative (inverted elements)
+    void SVD3x3(const Matrix4x4& F, Matrix4x4& U, Vec4& Sigma, Matrix4x4& V);
+
+    // Batched version of SVD3x3. Decomposes all SVD_BATCH_SIZE lanes of F at once, using AVX2 when available
+    void SVD3x3(const Matrix3x3Batch& F, Matrix3x3Batch& U, Vec3Batch& Sigma, Matrix3x3Batch& V);
+};
@@ -0,0 +1,168 @@
+#include "util/ShaderCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+// Compiled shaders and include lists
+#define SHADER_CACHE_BLOB_EXTENSION ".dxil"
+#define SHADER_CACHE_INCLUDES_EXTENSION ".includes"
+
+ShaderCache::ShaderCache(const std::filesystem::path& Directory, uint64_t MaxBytes)
+    : Directory(Directory), MaxBytes(MaxBytes)
+{
+    std::error_code Error;
+    std::filesystem::create_directories(Directory, Error);
+    for (const std::filesystem::directory_entry& Entry : std::filesystem::directory_iterator(Directory, Error))
+    {
+        if (Entry.path().extension() == SHADER_CACHE_BLOB_EXTENSION)
+        {
+            TotalBytes += Entry.file_size(Error);
+        }
+    }
+}
+
+bool ShaderCache::Load(uint64_t Key, std::vector<uint8_t>& Data)
+{
+    std::lock_guard<std::mutex> Lock(CacheMutex);
+    std::filesystem::path Path = GetPath(Key, SHADER_CACHE_BLOB_EXTENSION);
+    std::ifstream File(Path, std::ios::binary);
+    if (!File)
+    {
+        return false;
+    }
+    Data.assign(std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>());
+    if (Data.empty())
+    {
+        return false;
+    }
+    // The write time doubles as the last use
+    std::error_code Error;
+    std::filesystem::last_write_time(Path, std::filesystem::file_time_type::clock::now(), Error);
+    return true;
+}
+
+void ShaderCache::Store(uint64_t Key, const void* Data, size_t Size)
+{
+    std::lock_guard<std::mutex> Lock(CacheMutex);
+    std::filesystem::path Path = GetPath(Key, SHADER_CACHE_BLOB_EXTENSION);
+    std::error_code Error;
+    uint64_t Replaced = std::filesystem::exists(Path, Error) ? std::filesystem::file_size(Path, Error) : 0;
+    if (!WriteFile(Path, Data, Size))
+    {
+        return;
+    }
+    TotalBytes = TotalBytes - std::min(TotalBytes, Replaced) + Size;
+    if (TotalBytes > MaxBytes)
+    {
+        EvictLeastRecentlyUsed();
+    }
+}
+
+bool ShaderCache::LoadIncludes(uint64_t ShaderKey, std::vector<std::filesystem::path>& Includes)
+{
+    std::lock_guard<std::mutex> Lock(CacheMutex);
+    std::ifstream File(GetPath(ShaderKey, SHADER_CACHE_INCLUDES_EXTENSION), std::ios::binary);
+    if (!File)
+    {
+        return false;
+    }
+    Includes.clear();
+    std::string Line;
+    while (std::getline(File, Line))
+    {
+        if (!Line.empty())
+        {
+            Includes.push_back(std::filesystem::path(std::u8string(Line.begin(), Line.end())));
+        }
+    }
+    return true;
+}
+
+void ShaderCache::StoreIncludes(uint64_t ShaderKey, const std::vector<std::filesystem::path>& Includes)
+{
+    std::string Text;
+    for (const std::filesystem::path& Include : Includes)
+    {
+        Text += reinterpret_cast<const char*>(Include.u8string().c_str());
+        Text += '\n';
+    }
+    std::lock_guard<std::mutex> Lock(CacheMutex);
+    WriteFile(GetPath(ShaderKey, SHADER_CACHE_INCLUDES_EXTENSION), Text.data(), Text.size());
+}
+
+uint64_t ShaderCache::Hash(const void* Data, size_t Size, uint64_t Seed)
+{
+    const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+    uint64_t Result = Seed;
+    for (size_t Index = 0; Index < Size; Index++)
+    {
+        Result ^= Bytes[Index];
+        Result *= 1099511628211ull;
+    }
+    return Result;
+}
+
+std::filesystem::path ShaderCache::GetPath(uint64_t Key, const char* Extension) const
+{
+    char Name[32];
+    snprintf(Name, sizeof(Name), "%016llx%s", static_cast<unsigned long long>(Key), Extension);
+    return Directory / Name;
+}
+
+bool ShaderCache::WriteFile(const std::filesystem::path& Path, const void* Data, size_t Size)
+{
+    std::filesystem::path TempPath = Path;
+    TempPath += ".tmp";
+    {
+        std::ofstream File(TempPath, std::ios::binary | std::ios::trunc);
+        if (!File.write(static_cast<const char*>(Data), Size))
+        {
+            return false;
+        }
+    }
+    std::error_code Error;
+    std::filesystem::rename(TempPath, Path, Error);
+    if (Error)
+    {
+        std::filesystem::remove(TempPath, Error);
+        return false;
+    }
+    return true;
+}
+
+void ShaderCache::EvictLeastRecentlyUsed()
+{
+    struct CachedBlob
+    {
+        std::filesystem::path Path;
+        std::filesystem::file_time_type LastUse;
+        uint64_t Size;
+    };
+    std::vector<CachedBlob> Blobs;
+    std::error_code Error;
+    TotalBytes = 0;
+    for (const std::filesystem::directory_entry& Entry : std::filesystem::directory_iterator(Directory, Error))
+    {
+        if (Entry.path().extension() == SHADER_CACHE_BLOB_EXTENSION)
+        {
+            Blobs.push_back({Entry.path(), Entry.last_write_time(Error), Entry.file_size(Error)});
+            TotalBytes += Blobs.back().Size;
+        }
+    }
+    std::sort(Blobs.begin(), Blobs.end(), [](const CachedBlob& A, const CachedBlob& B)
+              { return A.LastUse < B.LastUse; });
+    for (const CachedBlob& Blob : Blobs)
+    {
+        if (TotalBytes <= MaxBytes)
+        {
+            break;
+        }
+        if (std::filesystem::remove(Blob.Path, Error))
+        {
+            TotalBytes -= Blob.Size;
+        }
+    }
+}
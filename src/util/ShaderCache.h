@@ -0,0 +1,43 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define SHADER_CACHE_DIRECTORY "shadercache"
+#define SHADER_CACHE_MAX_BYTES (64ull * 1024 * 1024)
+
+// On-disk store of compiled shaders, content addressed: a shader is stored under a hash of everything that went into
+// compiling it, so an entry never goes stale, it just stops being asked for. Entries are files in one directory and
+// the least recently used ones are deleted once they add up to more than the size cap.
+// Next to the compiled shaders it keeps the include list of the last compile of every shader, keyed by a hash of the
+// shader's file, entry point, target and arguments. That's what lets a key be computed without running the compiler
+class ShaderCache
+{
+public:
+    ShaderCache(const std::filesystem::path& Directory = SHADER_CACHE_DIRECTORY, uint64_t MaxBytes = SHADER_CACHE_MAX_BYTES);
+
+    // Returns false on a miss. A hit counts as a use for the eviction order
+    bool Load(uint64_t Key, std::vector<uint8_t>& Data);
+    void Store(uint64_t Key, const void* Data, size_t Size);
+
+    bool LoadIncludes(uint64_t ShaderKey, std::vector<std::filesystem::path>& Includes);
+    void StoreIncludes(uint64_t ShaderKey, const std::vector<std::filesystem::path>& Includes);
+
+    // 64 bit FNV-1a, chained through Seed
+    static uint64_t Hash(const void* Data, size_t Size, uint64_t Seed = 14695981039346656037ull);
+
+private:
+    std::filesystem::path GetPath(uint64_t Key, const char* Extension) const;
+    // Writes through a temporary file so a reader never sees half an entry
+    bool WriteFile(const std::filesystem::path& Path, const void* Data, size_t Size);
+    void EvictLeastRecentlyUsed();
+
+    std::filesystem::path Directory;
+    uint64_t MaxBytes;
+    // Size of the compiled shaders in the directory
+    uint64_t TotalBytes = 0;
+    std::mutex CacheMutex;
+};
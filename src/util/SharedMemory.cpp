@@ -0,0 +1,181 @@
+#include "util/SharedMemory.h"
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SharedMemory::~SharedMemory()
+{
+    Close();
+}
+
+#ifdef _WIN32
+namespace
+{
+std::string GetObjectName(const std::string& Name)
+{
+    // Visible to the processes of this session only
+    return "Local\\" + Name;
+}
+}
+
+bool SharedMemory::Create(const std::string& Name, size_t Bytes)
+{
+    Close();
+    const uint64_t Size64 = Bytes;
+    HANDLE Handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(Size64 >> 32), static_cast<DWORD>(Size64), GetObjectName(Name).c_str());
+    if (!Handle)
+    {
+        return false;
+    }
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(Handle);
+        return false;
+    }
+    Mapping = Handle;
+    Data = MapViewOfFile(Handle, FILE_MAP_ALL_ACCESS, 0, 0, Bytes);
+    if (!Data)
+    {
+        Close();
+        return false;
+    }
+    Size = Bytes;
+    return true;
+}
+
+bool SharedMemory::Open(const std::string& Name, size_t Bytes)
+{
+    Close();
+    HANDLE Handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, GetObjectName(Name).c_str());
+    if (!Handle)
+    {
+        return false;
+    }
+    Mapping = Handle;
+    // Fails if the mapping is smaller than Bytes
+    Data = MapViewOfFile(Handle, FILE_MAP_ALL_ACCESS, 0, 0, Bytes);
+    if (!Data)
+    {
+        Close();
+        return false;
+    }
+    Size = Bytes;
+    return true;
+}
+
+void SharedMemory::Close()
+{
+    if (Data)
+    {
+        UnmapViewOfFile(Data);
+    }
+    if (Mapping)
+    {
+        CloseHandle(Mapping);
+    }
+    Data = nullptr;
+    Mapping = nullptr;
+    Size = 0;
+}
+#else
+namespace
+{
+std::string GetObjectName(const std::string& Name)
+{
+    return "/" + Name;
+}
+
+void* MapDescriptor(int Descriptor, size_t Bytes)
+{
+    void* Memory = mmap(nullptr, Bytes, PROT_READ | PROT_WRITE, MAP_SHARED, Descriptor, 0);
+    close(Descriptor);
+    return Memory == MAP_FAILED ? nullptr : Memory;
+}
+}
+
+bool SharedMemory::Create(const std::string& Name, size_t Bytes)
+{
+    Close();
+    const std::string ObjectName = GetObjectName(Name);
+    int Descriptor = shm_open(ObjectName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (Descriptor < 0)
+    {
+        return false;
+    }
+    CreatedName = ObjectName;
+    // Grows the object with zeros
+    if (ftruncate(Descriptor, static_cast<off_t>(Bytes)) != 0)
+    {
+        close(Descriptor);
+        Close();
+        return false;
+    }
+    Data = MapDescriptor(Descriptor, Bytes);
+    if (!Data)
+    {
+        Close();
+        return false;
+    }
+    Size = Bytes;
+    return true;
+}
+
+bool SharedMemory::Open(const std::string& Name, size_t Bytes)
+{
+    Close();
+    int Descriptor = shm_open(GetObjectName(Name).c_str(), O_RDWR, 0);
+    if (Descriptor < 0)
+    {
+        return false;
+    }
+    struct stat Status;
+    if (fstat(Descriptor, &Status) != 0 || static_cast<size_t>(Status.st_size) < Bytes)
+    {
+        close(Descriptor);
+        return false;
+    }
+    Data = MapDescriptor(Descriptor, Bytes);
+    if (!Data)
+    {
+        return false;
+    }
+    Size = Bytes;
+    return true;
+}
+
+void SharedMemory::Close()
+{
+    if (Data)
+    {
+        munmap(Data, Size);
+    }
+    if (!CreatedName.empty())
+    {
+        shm_unlink(CreatedName.c_str());
+    }
+    Data = nullptr;
+    Size = 0;
+    CreatedName.clear();
+}
+#endif
+
+void* SharedMemory::GetData() const
+{
+    return Data;
+}
+
+size_t SharedMemory::GetSize() const
+{
+    return Size;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+// Named memory shared between the processes of one machine, e.g. the ranks of a multi-process decomposed run. One
+// process creates it, the others open it by name. It goes away once the creator and everyone who opened it closed it
+class SharedMemory
+{
+public:
+    SharedMemory() = default;
+    ~SharedMemory();
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    // Creates zeroed memory under a name no other shared memory has. Returns false if it can't be created
+    bool Create(const std::string& Name, size_t Bytes);
+    // Returns false if nothing of at least Bytes was created under the name
+    bool Open(const std::string& Name, size_t Bytes);
+
+    void* GetData() const;
+    size_t GetSize() const;
+
+private:
+    void Close();
+
+    void* Data = nullptr;
+    size_t Size = 0;
+    // The mapping handle on Windows
+    void* Mapping = nullptr;
+    // Created names are removed on close on POSIX systems, where opened memory stays valid without them
+    std::string CreatedName;
+};
@@ -0,0 +1,275 @@
+#include "util/Socket.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+typedef SOCKET NativeSocket;
+typedef int IOSize;
+
+bool StartSockets()
+{
+    // Once per process, the sockets live until it exits
+    static const bool Started = []()
+    {
+        WSADATA Data;
+        return WSAStartup(MAKEWORD(2, 2), &Data) == 0;
+    }();
+    return Started;
+}
+
+void CloseNative(NativeSocket Native)
+{
+    closesocket(Native);
+}
+
+bool LastCallWouldBlock()
+{
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+#else
+typedef int NativeSocket;
+typedef size_t IOSize;
+
+bool StartSockets()
+{
+    return true;
+}
+
+void CloseNative(NativeSocket Native)
+{
+    close(Native);
+}
+
+bool LastCallWouldBlock()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+#endif
+
+#ifdef MSG_NOSIGNAL
+// A peer that went away fails the send rather than raising SIGPIPE
+#define SOCKET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SOCKET_SEND_FLAGS 0
+#endif
+
+NativeSocket ToNative(intptr_t Handle)
+{
+    return static_cast<NativeSocket>(Handle);
+}
+
+intptr_t FromNative(NativeSocket Native)
+{
+    return Native == static_cast<NativeSocket>(-1) ? -1 : static_cast<intptr_t>(Native);
+}
+
+IOSize ClampSize(size_t Size)
+{
+    return static_cast<IOSize>(std::min<size_t>(Size, std::numeric_limits<int>::max()));
+}
+
+void DisableDelay(NativeSocket Native)
+{
+    int Enabled = 1;
+    setsockopt(Native, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&Enabled), sizeof(Enabled));
+#ifdef SO_NOSIGPIPE
+    setsockopt(Native, SOL_SOCKET, SO_NOSIGPIPE, &Enabled, sizeof(Enabled));
+#endif
+}
+}
+
+Socket::~Socket()
+{
+    Close();
+}
+
+Socket::Socket(Socket&& Other) noexcept
+    : Handle(std::exchange(Other.Handle, -1))
+{
+}
+
+Socket& Socket::operator=(Socket&& Other) noexcept
+{
+    if (this != &Other)
+    {
+        Close();
+        Handle = std::exchange(Other.Handle, -1);
+    }
+    return *this;
+}
+
+bool Socket::Listen(uint16_t Port, int Backlog)
+{
+    Close();
+    if (!StartSockets())
+    {
+        return false;
+    }
+    NativeSocket Native = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (FromNative(Native) < 0)
+    {
+        return false;
+    }
+    Handle = FromNative(Native);
+#ifndef _WIN32
+    // A rerun can take the port again while connections of the last one linger. Windows lets anyone share the port
+    // with this, so it is left out there
+    int Reuse = 1;
+    setsockopt(Native, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof(Reuse));
+#endif
+
+    sockaddr_in Address = {};
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_ANY);
+    Address.sin_port = htons(Port);
+    if (bind(Native, reinterpret_cast<const sockaddr*>(&Address), sizeof(Address)) != 0 || listen(Native, Backlog) != 0)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+uint16_t Socket::GetPort() const
+{
+    sockaddr_in Address = {};
+    socklen_t Length = sizeof(Address);
+    if (!IsOpen() || getsockname(ToNative(Handle), reinterpret_cast<sockaddr*>(&Address), &Length) != 0)
+    {
+        return 0;
+    }
+    return ntohs(Address.sin_port);
+}
+
+bool Socket::Accept(Socket& Connection)
+{
+    Connection.Close();
+    NativeSocket Native = accept(ToNative(Handle), nullptr, nullptr);
+    if (FromNative(Native) < 0)
+    {
+        return false;
+    }
+    DisableDelay(Native);
+    Connection.Handle = FromNative(Native);
+    return true;
+}
+
+bool Socket::Connect(const std::string& Host, uint16_t Port)
+{
+    Close();
+    if (!StartSockets())
+    {
+        return false;
+    }
+    addrinfo Hints = {};
+    Hints.ai_family = AF_INET;
+    Hints.ai_socktype = SOCK_STREAM;
+    Hints.ai_protocol = IPPROTO_TCP;
+    addrinfo* Addresses = nullptr;
+    if (getaddrinfo(Host.c_str(), std::to_string(Port).c_str(), &Hints, &Addresses) != 0)
+    {
+        return false;
+    }
+
+    for (addrinfo* Address = Addresses; Address && !IsOpen(); Address = Address->ai_next)
+    {
+        NativeSocket Native = socket(Address->ai_family, Address->ai_socktype, Address->ai_protocol);
+        if (FromNative(Native) < 0)
+        {
+            continue;
+        }
+        if (connect(Native, Address->ai_addr, static_cast<socklen_t>(Address->ai_addrlen)) != 0)
+        {
+            CloseNative(Native);
+            continue;
+        }
+        DisableDelay(Native);
+        Handle = FromNative(Native);
+    }
+    freeaddrinfo(Addresses);
+    return IsOpen();
+}
+
+bool Socket::SetBlocking(bool Blocking)
+{
+#ifdef _WIN32
+    u_long NonBlocking = Blocking ? 0 : 1;
+    return ioctlsocket(ToNative(Handle), FIONBIO, &NonBlocking) == 0;
+#else
+    int Flags = fcntl(ToNative(Handle), F_GETFL, 0);
+    if (Flags < 0)
+    {
+        return false;
+    }
+    Flags = Blocking ? (Flags & ~O_NONBLOCK) : (Flags | O_NONBLOCK);
+    return fcntl(ToNative(Handle), F_SETFL, Flags) == 0;
+#endif
+}
+
+ptrdiff_t Socket::SendSome(const void* Data, size_t Size)
+{
+    if (Size == 0)
+    {
+        return 0;
+    }
+    auto Sent = send(ToNative(Handle), static_cast<const char*>(Data), ClampSize(Size), SOCKET_SEND_FLAGS);
+    if (Sent < 0)
+    {
+        return LastCallWouldBlock() ? 0 : -1;
+    }
+    return static_cast<ptrdiff_t>(Sent);
+}
+
+ptrdiff_t Socket::ReceiveSome(void* Data, size_t Size)
+{
+    auto Received = recv(ToNative(Handle), static_cast<char*>(Data), ClampSize(Size), 0);
+    if (Received < 0)
+    {
+        return LastCallWouldBlock() ? 0 : -1;
+    }
+    // Zero bytes is the other end shutting down
+    return Received == 0 ? -1 : static_cast<ptrdiff_t>(Received);
+}
+
+void Socket::ShutdownSend()
+{
+#ifdef _WIN32
+    shutdown(ToNative(Handle), SD_SEND);
+#else
+    shutdown(ToNative(Handle), SHUT_WR);
+#endif
+}
+
+bool Socket::IsOpen() const
+{
+    return Handle >= 0;
+}
+
+void Socket::Close()
+{
+    if (IsOpen())
+    {
+        CloseNative(ToNative(Handle));
+    }
+    Handle = -1;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// IPv4 TCP socket, e.g. between the ranks of a decomposed run spread over several machines. Either listens for
+// connections or is one end of a connection. Connections start out blocking and go without Nagle's delay, small halo
+// messages go out as soon as they are sent
+class Socket
+{
+public:
+    Socket() = default;
+    ~Socket();
+
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+    Socket(Socket&& Other) noexcept;
+    Socket& operator=(Socket&& Other) noexcept;
+
+    // Listens on every interface, Port 0 lets the system pick a free one. Returns false if the port is taken
+    bool Listen(uint16_t Port, int Backlog);
+    // Port a listening socket ended up on
+    uint16_t GetPort() const;
+    // Waits for the next connection to a listening socket
+    bool Accept(Socket& Connection);
+    // Host is a name or a dotted address. Returns false if nothing listens there
+    bool Connect(const std::string& Host, uint16_t Port);
+
+    bool SetBlocking(bool Blocking);
+    // Bytes sent or received, 0 when a socket that doesn't block would have, and -1 once the connection failed or, on
+    // receiving, the other end shut down sending
+    ptrdiff_t SendSome(const void* Data, size_t Size);
+    ptrdiff_t ReceiveSome(void* Data, size_t Size);
+    // Tells the other end nothing more will be sent, what was sent still arrives
+    void ShutdownSend();
+
+    bool IsOpen() const;
+    void Close();
+
+private:
+    // The SOCKET on Windows, the descriptor elsewhere
+    intptr_t Handle = -1;
+};
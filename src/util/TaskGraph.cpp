@@ -0,0 +1,178 @@
+#include "util/TaskGraph.h"
+
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <thread>
+
+// Marks a ready slot nobody has filled yet
+#define NO_TASK 0xFFFFFFFFu
+
+uint32_t TaskGraph::AddTask()
+{
+    Successors.emplace_back();
+    NumDependencies.push_back(0);
+    TaskNodes.push_back(0);
+    return static_cast<uint32_t>(Successors.size() - 1);
+}
+
+void TaskGraph::AddDependency(uint32_t Before, uint32_t After)
+{
+    Successors[Before].push_back(After);
+    NumDependencies[After]++;
+}
+
+void TaskGraph::SetTaskNode(uint32_t Task, uint32_t Node)
+{
+    TaskNodes[Task] = Node;
+    NumNodes = std::max(NumNodes, Node + 1);
+}
+
+uint32_t TaskGraph::GetNumTasks() const
+{
+    return static_cast<uint32_t>(Successors.size());
+}
+
+void TaskGraph::ExecuteTasks(const TaskFunc& Func)
+{
+    const uint32_t NumTasks = GetNumTasks();
+    if (NumTasks == 0)
+    {
+        return;
+    }
+    if (AllocatedTasks != NumTasks)
+    {
+        Pending = std::make_unique<std::atomic<uint32_t>[]>(NumTasks);
+        ReadySlots = std::make_unique<std::atomic<uint32_t>[]>(NumTasks);
+        AllocatedTasks = NumTasks;
+    }
+
+    ThreadPool* Pool = ThreadPool::GetInstance();
+    uint32_t NumThreads = ThreadPool::GetAvailableThreads();
+    if (NumNodes > 1 && NumThreads > 1 && Pool->GetNumNodes() > 1)
+    {
+        if (NodeQueues.size() != NumNodes)
+        {
+            NodeQueues.clear();
+            for (uint32_t Node = 0; Node < NumNodes; Node++)
+            {
+                NodeQueues.push_back(std::make_unique<NodeQueue>());
+            }
+        }
+        for (uint32_t Task = 0; Task < NumTasks; Task++)
+        {
+            Pending[Task].store(NumDependencies[Task], std::memory_order_relaxed);
+            if (NumDependencies[Task] == 0)
+            {
+                PushReady(Task);
+            }
+        }
+        NumDone = 0;
+        ThreadPool::Run(NumThreads, 1, [&](uint32_t, uint32_t) {
+            RunTasksByNode(Func);
+        });
+        return;
+    }
+
+    for (uint32_t Task = 0; Task < NumTasks; Task++)
+    {
+        Pending[Task].store(NumDependencies[Task], std::memory_order_relaxed);
+        ReadySlots[Task].store(NO_TASK, std::memory_order_relaxed);
+    }
+    uint32_t NumReady = 0;
+    for (uint32_t Task = 0; Task < NumTasks; Task++)
+    {
+        if (NumDependencies[Task] == 0)
+        {
+            ReadySlots[NumReady++].store(Task, std::memory_order_relaxed);
+        }
+    }
+    NextReadySlot = NumReady;
+    NextClaim = 0;
+
+    // Every thread pulls tasks until all are claimed
+    ThreadPool::Run(NumThreads, 1, [&](uint32_t, uint32_t) {
+        RunTasks(Func);
+    });
+}
+
+void TaskGraph::RunTasks(const TaskFunc& Func)
+{
+    const uint32_t NumTasks = GetNumTasks();
+    while (true)
+    {
+        uint32_t Slot = NextClaim.fetch_add(1);
+        if (Slot >= NumTasks)
+        {
+            return;
+        }
+
+        // Every task becomes ready eventually, the slot may just not be filled yet while its predecessors run
+        uint32_t Task;
+        while ((Task = ReadySlots[Slot].load(std::memory_order_acquire)) == NO_TASK)
+        {
+            std::this_thread::yield();
+        }
+
+        Func(Task);
+
+        for (uint32_t Next : Successors[Task])
+        {
+            if (Pending[Next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                ReadySlots[NextReadySlot.fetch_add(1)].store(Next, std::memory_order_release);
+            }
+        }
+    }
+}
+
+void TaskGraph::RunTasksByNode(const TaskFunc& Func)
+{
+    const uint32_t NumTasks = GetNumTasks();
+    const uint32_t Home = ThreadPool::GetCurrentNode() % NumNodes;
+    while (NumDone.load(std::memory_order_acquire) < NumTasks)
+    {
+        // Own node first, then steal from the others
+        uint32_t Task = NO_TASK;
+        for (uint32_t Offset = 0; Offset < NumNodes && Task == NO_TASK; Offset++)
+        {
+            Task = PopReady((Home + Offset) % NumNodes);
+        }
+        if (Task == NO_TASK)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        Func(Task);
+
+        for (uint32_t Next : Successors[Task])
+        {
+            if (Pending[Next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                PushReady(Next);
+            }
+        }
+        NumDone.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void TaskGraph::PushReady(uint32_t Task)
+{
+    NodeQueue& Queue = *NodeQueues[TaskNodes[Task]];
+    std::lock_guard<std::mutex> Lock(Queue.Mutex);
+    Queue.Ready.push_back(Task);
+}
+
+uint32_t TaskGraph::PopReady(uint32_t Node)
+{
+    NodeQueue& Queue = *NodeQueues[Node];
+    std::lock_guard<std::mutex> Lock(Queue.Mutex);
+    if (Queue.Ready.empty())
+    {
+        return NO_TASK;
+    }
+    uint32_t Task = Queue.Ready.back();
+    Queue.Ready.pop_back();
+    return Task;
+}
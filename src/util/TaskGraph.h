@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+// Static set of tasks with dependencies, executed on the thread pool. A task starts as soon as every task it depends on
+// is done rather than at a join between phases, so there is no waiting for the slowest task of the previous phase.
+// The graph is built once and can be executed any number of times
+class TaskGraph
+{
+public:
+    // Returns the id of the new task, ids are consecutive from 0
+    uint32_t AddTask();
+    // After only starts once Before is done
+    void AddDependency(uint32_t Before, uint32_t After);
+    // The task prefers the pool threads pinned to this NUMA node, see ThreadPool. Threads take tasks of other nodes
+    // once their own node has none ready. Without a pool spread over several nodes this has no effect
+    void SetTaskNode(uint32_t Task, uint32_t Node);
+    uint32_t GetNumTasks() const;
+
+    // Runs Func(Task) for every task in dependency order, on the pool if one was created and on the calling thread
+    // otherwise. Returns once every task is done. Must not be called from inside a ParallelFor. Func is referenced
+    // rather than copied, so executing never allocates
+    template <typename F>
+    void Execute(F&& Func)
+    {
+        ExecuteTasks({const_cast<void*>(static_cast<const void*>(&Func)), [](void* Context, uint32_t Task)
+                      { (*static_cast<std::remove_reference_t<F>*>(Context))(Task); }});
+    }
+
+private:
+    // Non owning reference to the callable given to Execute
+    struct TaskFunc
+    {
+        void* Context;
+        void (*Call)(void* Context, uint32_t Task);
+
+        void operator()(uint32_t Task) const
+        {
+            Call(Context, Task);
+        }
+    };
+
+    void ExecuteTasks(const TaskFunc& Func);
+    void RunTasks(const TaskFunc& Func);
+    void RunTasksByNode(const TaskFunc& Func);
+    void PushReady(uint32_t Task);
+    uint32_t PopReady(uint32_t Node);
+
+    std::vector<std::vector<uint32_t>> Successors;
+    std::vector<uint32_t> NumDependencies;
+    std::vector<uint32_t> TaskNodes;
+    uint32_t NumNodes = 1;
+
+    // Execution state. Ready tasks are appended to ReadySlots and claimed in the same order
+    uint32_t AllocatedTasks = 0;
+    std::unique_ptr<std::atomic<uint32_t>[]> Pending;
+    std::unique_ptr<std::atomic<uint32_t>[]> ReadySlots;
+    std::atomic<uint32_t> NextReadySlot = 0;
+    std::atomic<uint32_t> NextClaim = 0;
+
+    // Node aware execution, ready tasks go to a list per node. Only a few hundred tasks run per step, so a lock per list
+    // costs nothing next to the tasks
+    struct NodeQueue
+    {
+        std::mutex Mutex;
+        std::vector<uint32_t> Ready;
+    };
+    std::vector<std::unique_ptr<NodeQueue>> NodeQueues;
+    std::atomic<uint32_t> NumDone = 0;
+};
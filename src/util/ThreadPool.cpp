@@ -0,0 +1,161 @@
+#include "util/ThreadPool.h"
+
+#include "util/Numa.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t NumThreads, bool PinToNumaNodes)
+{
+    NumThreads = std::max(NumThreads, 1u);
+    if (PinToNumaNodes)
+    {
+        NumNodes = std::clamp(Numa::GetNumNodes(), 1u, NumThreads);
+    }
+
+    // The calling thread always helps out, so spawn one less
+    for (uint32_t i = 1; i < NumThreads; i++)
+    {
+        // Contiguous groups, so neighbouring thread indices share a node
+        uint32_t Node = i * NumNodes / NumThreads;
+        WorkerThreads.emplace_back(std::thread(&ThreadPool::WorkerRunner, this, Node));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> Lock(StateMutex);
+        Stopping = true;
+    }
+    WorkCV.notify_all();
+    for (auto& Thread : WorkerThreads)
+    {
+        Thread.join();
+    }
+}
+
+uint32_t ThreadPool::GetNumThreads() const
+{
+    return static_cast<uint32_t>(WorkerThreads.size()) + 1;
+}
+
+uint32_t ThreadPool::GetNumNodes() const
+{
+    return NumNodes;
+}
+
+uint32_t ThreadPool::GetCurrentNode()
+{
+    return CurrentNode;
+}
+
+void ThreadPool::Run(uint32_t Count, uint32_t ChunkSize, const std::function<void(uint32_t, uint32_t)>& Func)
+{
+    ThreadPool* Pool = GetInstance();
+    if (Pool && !CallerSerial)
+    {
+        Pool->ParallelFor(Count, ChunkSize, Func);
+    }
+    else if (Count > 0)
+    {
+        Func(0, Count);
+    }
+}
+
+void ThreadPool::RunSerially(bool Serial)
+{
+    CallerSerial = Serial;
+}
+
+uint32_t ThreadPool::GetAvailableThreads()
+{
+    ThreadPool* Pool = GetInstance();
+    return Pool && !CallerSerial ? Pool->GetNumThreads() : 1;
+}
+
+void ThreadPool::ParallelFor(uint32_t Count, uint32_t ChunkSize, const std::function<void(uint32_t, uint32_t)>& Func)
+{
+    if (Count == 0)
+    {
+        return;
+    }
+    ChunkSize = std::max(ChunkSize, 1u);
+    if (WorkerThreads.empty() || Count <= ChunkSize)
+    {
+        Func(0, Count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> JobLock(JobMutex);
+    JobFunc = &Func;
+    JobCount = Count;
+    JobChunkSize = ChunkSize;
+    JobNumChunks = (Count + ChunkSize - 1) / ChunkSize;
+    NextChunk = 0;
+    DoneChunks = 0;
+    {
+        std::lock_guard<std::mutex> Lock(StateMutex);
+        JobGeneration++;
+    }
+    WorkCV.notify_all();
+
+    RunChunks();
+
+    // Wait for the stragglers, and for every worker to leave the job before it goes out of scope
+    std::unique_lock<std::mutex> Lock(StateMutex);
+    DoneCV.wait(Lock, [this]()
+                { return DoneChunks == JobNumChunks && BusyWorkers == 0; });
+    JobFunc = nullptr;
+}
+
+void ThreadPool::RunChunks()
+{
+    while (true)
+    {
+        uint32_t Chunk = NextChunk.fetch_add(1);
+        if (Chunk >= JobNumChunks)
+        {
+            return;
+        }
+        uint32_t Begin = Chunk * JobChunkSize;
+        (*JobFunc)(Begin, std::min(Begin + JobChunkSize, JobCount));
+        DoneChunks.fetch_add(1);
+    }
+}
+
+void ThreadPool::WorkerRunner(uint32_t Node)
+{
+    if (NumNodes > 1 && Numa::PinThreadToNode(Node))
+    {
+        CurrentNode = Node;
+    }
+
+    uint64_t SeenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> Lock(StateMutex);
+            WorkCV.wait(Lock, [this, SeenGeneration]()
+                        { return Stopping || JobGeneration != SeenGeneration; });
+            if (Stopping)
+            {
+                return;
+            }
+            SeenGeneration = JobGeneration;
+            // A job that already finished has JobFunc cleared, nothing to help with
+            if (!JobFunc)
+            {
+                continue;
+            }
+            BusyWorkers++;
+        }
+
+        RunChunks();
+
+        {
+            std::lock_guard<std::mutex> Lock(StateMutex);
+            BusyWorkers--;
+        }
+        DoneCV.notify_all();
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "util/Singleton.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel loops over particles and grid cells
+class ThreadPool : public Singleton<ThreadPool>
+{
+public:
+    // With PinToNumaNodes the workers are spread over the NUMA nodes in contiguous groups and pinned to their node, the
+    // calling thread counts as the first thread of node 0. Without NUMA this is a no-op
+    ThreadPool(uint32_t NumThreads = std::thread::hardware_concurrency(), bool PinToNumaNodes = true);
+    ~ThreadPool();
+
+    // Runs Func(Begin, End) over chunks of [0, Count) on the workers and the calling thread, returns once every chunk is done.
+    // Must not be called from inside another ParallelFor
+    void ParallelFor(uint32_t Count, uint32_t ChunkSize, const std::function<void(uint32_t, uint32_t)>& Func);
+
+    // Workers plus the calling thread
+    uint32_t GetNumThreads() const;
+    // NUMA nodes the threads are spread over, 1 unless pinned on a NUMA machine
+    uint32_t GetNumNodes() const;
+    // Node the calling thread is pinned to, 0 for threads outside the pool
+    static uint32_t GetCurrentNode();
+
+    // Uses the pool if one was created, runs on the calling thread otherwise
+    static void Run(uint32_t Count, uint32_t ChunkSize, const std::function<void(uint32_t, uint32_t)>& Func);
+    // Keeps Run on the calling thread even when there is a pool, for threads that are one of many independent units of
+    // work already (e.g. ensemble runs), which would otherwise queue up on the pool one job at a time
+    static void RunSerially(bool Serial);
+    // Threads Run spreads work over when called from this thread
+    static uint32_t GetAvailableThreads();
+
+private:
+    void WorkerRunner(uint32_t Node);
+    void RunChunks();
+
+    std::vector<std::thread> WorkerThreads;
+    std::mutex JobMutex;
+    std::mutex StateMutex;
+    std::condition_variable WorkCV;
+    std::condition_variable DoneCV;
+    bool Stopping = false;
+    uint64_t JobGeneration = 0;
+    uint32_t BusyWorkers = 0;
+    uint32_t NumNodes = 1;
+
+    // Current job, only written while no worker is inside RunChunks
+    const std::function<void(uint32_t, uint32_t)>* JobFunc = nullptr;
+    uint32_t JobCount = 0;
+    uint32_t JobChunkSize = 1;
+    uint32_t JobNumChunks = 0;
+    std::atomic<uint32_t> NextChunk = 0;
+    std::atomic<uint32_t> DoneChunks = 0;
+
+    static inline thread_local bool CallerSerial = false;
+    static inline thread_local uint32_t CurrentNode = 0;
+};
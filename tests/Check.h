@@ -0,0 +1,40 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+
+// Every test is an executable that returns non-zero when a check failed. Checks report and count failures, they don't
+// stop the test
+inline int& FailedChecks()
+{
+    static int Count = 0;
+    return Count;
+}
+
+#define CHECK(Condition)                                                                  \
+    do                                                                                    \
+    {                                                                                     \
+        if (!(Condition))                                                                 \
+        {                                                                                 \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #Condition); \
+            FailedChecks()++;                                                             \
+        }                                                                                 \
+    } while (0)
+
+// Fails on NaN as well
+#define CHECK_NEAR(Value, Expected, Tolerance)                                                                                                         \
+    do                                                                                                                                                 \
+    {                                                                                                                                                  \
+        double CheckedValue = (Value), CheckedExpected = (Expected);                                                                                   \
+        if (!(fabs(CheckedValue - CheckedExpected) <= (Tolerance)))                                                                                    \
+        {                                                                                                                                              \
+            fprintf(stderr, "%s:%d: %s is %g, expected %g within %g\n", __FILE__, __LINE__, #Value, CheckedValue, CheckedExpected, double(Tolerance)); \
+            FailedChecks()++;                                                                                                                          \
+        }                                                                                                                                              \
+    } while (0)
+
+inline int TestResult(const char* Name)
+{
+    printf("%s: %s\n", Name, FailedChecks() ? "FAILED" : "passed");
+    return FailedChecks() ? 1 : 0;
+}
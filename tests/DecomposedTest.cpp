@@ -0,0 +1,104 @@
+// Decomposed runs with one process per rank on SharedMemoryHaloTransport and on SocketHaloTransport over loopback. Each
+// rank creates only its strip of the scene. They have to match the same decomposition stepped by threads on a
+// LocalHaloHub bit for bit, keep every particle, and stay close to the undecomposed solver.
+// The test binary is also the rank executable, started again with DECOMPOSED_RANK_OPTION
+#include "Check.h"
+#include "fluids/DecomposedRun.h"
+#include "util/ChildProcess.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define NUM_PARTICLES 4000
+#define NUM_STEPS 200
+#define REBALANCE_INTERVAL 50
+
+static std::vector<ParticleRenderData> ReadParticles(const std::filesystem::path& Path)
+{
+    std::ifstream Input(Path, std::ios::binary);
+    std::vector<char> Bytes((std::istreambuf_iterator<char>(Input)), std::istreambuf_iterator<char>());
+    std::vector<ParticleRenderData> Particles(Bytes.size() / sizeof(ParticleRenderData));
+    memcpy(Particles.data(), Bytes.data(), Particles.size() * sizeof(ParticleRenderData));
+    return Particles;
+}
+
+static std::vector<ParticleRenderData> RunThreads(uint32_t NumRanks)
+{
+    std::vector<ParticleRenderData> Particles = CreateDecomposedScene(NUM_PARTICLES);
+    DecompositionParameters Params;
+    Params.NumSubdomains = NumRanks;
+    Params.RebalanceInterval = REBALANCE_INTERVAL;
+    DecomposedMPMSolver Solver(Particles, GetDecomposedFluidParameters(), JellyMaterial, Params);
+    for (int Step = 0; Step < NUM_STEPS; Step++)
+    {
+        Solver.CPUSolve(Particles, DECOMPOSED_RUN_TIMESTEP);
+    }
+    return Particles;
+}
+
+static Math::Vec4 GetCenter(const std::vector<ParticleRenderData>& Particles)
+{
+    Math::Vec4 Center(0.0f, 0.0f, 0.0f, 0.0f);
+    for (const ParticleRenderData& Particle : Particles)
+    {
+        Center += Particle.Position * (1.0f / Particles.size());
+    }
+    return Center;
+}
+
+static void CheckProcesses(const char* Executable, uint32_t NumRanks, bool OverSockets, const Math::Vec4& Undecomposed)
+{
+    DecomposedRunParameters Params;
+    Params.NumRanks = NumRanks;
+    if (OverSockets)
+    {
+        Params.Endpoints = GetLoopbackEndpoints(NumRanks);
+        CHECK(Params.Endpoints.size() == NumRanks);
+    }
+    Params.NumParticles = NUM_PARTICLES;
+    Params.NumSteps = NUM_STEPS;
+    Params.RebalanceInterval = REBALANCE_INTERVAL;
+    Params.OutputPath = std::filesystem::temp_directory_path() / ("DecomposedTest-" + std::to_string(ChildProcess::GetCurrentId()) + ".bin");
+    CHECK(LaunchDecomposedRun(Executable, Params));
+    std::vector<ParticleRenderData> Processes = ReadParticles(Params.OutputPath);
+    std::filesystem::remove(Params.OutputPath);
+
+    std::vector<ParticleRenderData> Threads = RunThreads(NumRanks);
+    CHECK(Processes.size() == NUM_PARTICLES);
+    CHECK(Threads.size() == NUM_PARTICLES);
+    CHECK(Processes.size() == Threads.size() && memcmp(Processes.data(), Threads.data(), Threads.size() * sizeof(ParticleRenderData)) == 0);
+
+    // Only the order particles and ghost mass are summed in differs from one grid
+    Math::Vec4 Center = GetCenter(Processes);
+    printf("%u ranks over %s: center of mass (%.6f, %.6f), undecomposed (%.6f, %.6f)\n", NumRanks, OverSockets ? "sockets" : "shared memory", Center.x, Center.y, Undecomposed.x, Undecomposed.y);
+    CHECK_NEAR(Center.x, Undecomposed.x, 1e-4);
+    CHECK_NEAR(Center.y, Undecomposed.y, 1e-4);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], DECOMPOSED_RANK_OPTION) == 0)
+    {
+        return RunDecomposedRank(std::vector<std::string>(argv + 2, argv + argc));
+    }
+
+    std::vector<ParticleRenderData> Particles = CreateDecomposedScene(NUM_PARTICLES);
+    MPMSolver::FluidParameters FluidParams = GetDecomposedFluidParameters();
+    FluidParams.NumParticles = NUM_PARTICLES;
+    MPMSolver Solver(Particles, FluidParams, JellyMaterial);
+    for (int Step = 0; Step < NUM_STEPS; Step++)
+    {
+        Solver.CPUSolve(Particles, DECOMPOSED_RUN_TIMESTEP);
+    }
+    const Math::Vec4 Undecomposed = GetCenter(Particles);
+    // The block has to have fallen for the comparison to mean anything
+    CHECK(Undecomposed.y < 0.28f);
+
+    CheckProcesses(argv[0], 1, false, Undecomposed);
+    CheckProcesses(argv[0], 3, false, Undecomposed);
+    CheckProcesses(argv[0], 3, true, Undecomposed);
+    return TestResult("DecomposedTest");
+}
@@ -0,0 +1,97 @@
+// GPUReferenceSolver, the compute shader kernels run as C++: a run on the thread pool has to match a serial one bit for
+// bit as the fixed point P2G promises, P2G has to conserve mass, and a block in free fall has to fall as it should
+#include "Check.h"
+#include "fluids/GPUReferenceSolver.h"
+#include "shaders/MPMKernels.hlsli"
+#include "util/ThreadPool.h"
+
+#include <string.h>
+#include <vector>
+
+#define GRID_RESOLUTION 32
+#define GRID_SIZE 1.0f
+#define TIMESTEP 0.002f
+#define NUM_STEPS 40
+#define BLOCK_SIDE 12
+
+static std::vector<ParticleRenderData> MakeBlock()
+{
+    // Two particles a cell along each axis, clear of the walls for the whole run
+    const float Spacing = GRID_SIZE / GRID_RESOLUTION * 0.5f;
+    std::vector<ParticleRenderData> Particles;
+    for (int i = 0; i < BLOCK_SIDE; i++)
+    {
+        for (int j = 0; j < BLOCK_SIDE; j++)
+        {
+            for (int k = 0; k < BLOCK_SIDE; k++)
+            {
+                Math::Vec4 Position(0.4f + i * Spacing, 0.6f + j * Spacing, 0.4f + k * Spacing, 1.0f);
+                Particles.push_back({Position, Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f)});
+            }
+        }
+    }
+    return Particles;
+}
+
+static GPUReferenceSolver RunBlock(bool Serial)
+{
+    // FluidParameters:       NumParticles, Resolution, Lambda, Mu, Timestep, Size
+    MPMFluidParameters Params = {0, GRID_RESOLUTION, 40.0f, 20.0f, TIMESTEP, GRID_SIZE};
+    GPUReferenceSolver Solver(Params);
+    Solver.Reset(MakeBlock());
+    ThreadPool::RunSerially(Serial);
+    for (int Step = 0; Step < NUM_STEPS; Step++)
+    {
+        Solver.Step();
+    }
+    ThreadPool::RunSerially(false);
+    return Solver;
+}
+
+template <typename T>
+static bool SameBits(const std::vector<T>& A, const std::vector<T>& B)
+{
+    return A.size() == B.size() && memcmp(A.data(), B.data(), A.size() * sizeof(T)) == 0;
+}
+
+int main()
+{
+    ThreadPool::CreateInstance(4u, false);
+
+    GPUReferenceSolver Pooled = RunBlock(false);
+    GPUReferenceSolver Serial = RunBlock(true);
+    CHECK(SameBits(Pooled.GetParticles(), Serial.GetParticles()));
+    CHECK(SameBits(Pooled.GetParticleData(), Serial.GetParticleData()));
+    CHECK(SameBits(Pooled.GetGrid(), Serial.GetGrid()));
+
+    // The grid keeps the fixed point sums of the last P2G. Every particle's weights sum to one, and truncating each of
+    // its 27 contributions loses less than a unit
+    const std::vector<ParticleRenderData>& Particles = Pooled.GetParticles();
+    const float ParticleMass = GPUParticlePhysicsData().Mass;
+    double FixedPointMass = 0.0;
+    for (const GridCell& Cell : Pooled.GetGrid())
+    {
+        FixedPointMass += static_cast<int32_t>(Cell.IntHolder4);
+    }
+    const double ExpectedMass = Particles.size() * ParticleMass;
+    CHECK_NEAR(FixedPointMass / GRID_FIXED_POINT_SCALE, ExpectedMass, Particles.size() * 27 / GRID_FIXED_POINT_SCALE);
+
+    // Nothing but gravity acts on the block as a whole
+    double MeanVelocityY = 0.0;
+    double MeanY = 0.0;
+    for (const ParticleRenderData& Particle : Particles)
+    {
+        MeanVelocityY += Particle.Velocity.y;
+        MeanY += Particle.Position.y;
+    }
+    MeanVelocityY /= Particles.size();
+    MeanY /= Particles.size();
+    const double FallTime = NUM_STEPS * TIMESTEP;
+    printf("Mean velocity %.6f, expected %.6f, mean height %.6f\n", MeanVelocityY, -9.8 * FallTime, MeanY);
+    CHECK_NEAR(MeanVelocityY, -9.8 * FallTime, 0.01 * 9.8 * FallTime);
+    const double StartY = 0.6 + (BLOCK_SIDE - 1) * GRID_SIZE / GRID_RESOLUTION * 0.25;
+    // Explicit Euler on the positions falls a step's worth further than the exact parabola
+    CHECK_NEAR(MeanY, StartY - 0.5 * 9.8 * FallTime * (FallTime + TIMESTEP), 0.01 * 9.8 * FallTime * FallTime);
+
+    return TestResult("GPUReferenceTest");
+}
@@ -0,0 +1,55 @@
+// MPMSolver with the implicit grid update, a jelly block thrown against the +x wall. Particles clamped next to the
+// wall have stencils reaching the nodes past the last column, which the solve has to treat as fixed wall nodes
+#include "Check.h"
+#include "fluids/MPMSolver.h"
+
+#include <algorithm>
+#include <vector>
+
+#define GRID_RESOLUTION 32
+#define GRID_SIZE 1.0f
+#define TIMESTEP 0.01f
+#define NUM_STEPS 40
+#define BLOCK_SIDE 12
+#define LAUNCH_VELOCITY 30.0f
+
+int main()
+{
+    // Two particles a cell along each axis, a cell from the +x wall
+    const float Dx = GRID_SIZE / GRID_RESOLUTION;
+    std::vector<ParticleRenderData> Particles;
+    for (int i = 0; i < BLOCK_SIDE; i++)
+    {
+        for (int j = 0; j < BLOCK_SIDE; j++)
+        {
+            Math::Vec4 Position(GRID_SIZE - 2.0f * Dx - i * Dx * 0.5f, 0.3f + j * Dx * 0.5f, 0.5f, 1.0f);
+            Particles.push_back({Position, Math::Vec4(LAUNCH_VELOCITY, 0.0f, 0.0f, 0.0f)});
+        }
+    }
+
+    // FluidParameters: NumParticles, Resolution, Lambda, Mu, Timestep, Size
+    MPMSolver::FluidParameters Params = {static_cast<int>(Particles.size()), GRID_RESOLUTION, 40.0f, 20.0f, TIMESTEP, GRID_SIZE};
+    MPMSolver Solver(Particles, Params, JellyMaterial);
+    Solver.EnableImplicit(ImplicitParameters());
+
+    float MaxX = 0.0f;
+    for (int Step = 0; Step < NUM_STEPS; Step++)
+    {
+        Solver.CPUSolve(Particles, TIMESTEP);
+        for (const ParticleRenderData& Particle : Particles)
+        {
+            MaxX = std::max(MaxX, Particle.Position.x);
+        }
+    }
+
+    // The block has to have been pressed against the wall, and stayed in the domain without blowing up
+    printf("Furthest particle at x %.6f, wall at %.6f\n", MaxX, GRID_SIZE - Dx);
+    CHECK(MaxX >= GRID_SIZE - 1.5f * Dx);
+    for (const ParticleRenderData& Particle : Particles)
+    {
+        CHECK(Particle.Position.x >= Dx && Particle.Position.x <= GRID_SIZE - Dx);
+        CHECK(Particle.Position.y >= Dx && Particle.Position.y <= GRID_SIZE - Dx);
+        CHECK(fabsf(Particle.Velocity.x) < LAUNCH_VELOCITY && fabsf(Particle.Velocity.y) < LAUNCH_VELOCITY);
+    }
+    return TestResult("ImplicitGridTest");
+}
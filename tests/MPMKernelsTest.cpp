@@ -0,0 +1,116 @@
+// MPMKernels for every dimension and B-spline order, at positions spread over a cell. The weights have to sum to one
+// with the distances to the nodes weighted to zero, the inertia tensor has to be the inverse of InverseInertia (the
+// linear spline's depends on the position), and each node's gradient has to match finite differences of its weight
+#include "Check.h"
+#include "fluids/MPMKernels.h"
+
+#define BASE_CELL 5.0f
+#define DIFFERENCE_STEP 1e-2f
+#define MOMENT_TOLERANCE 1e-5f
+#define GRADIENT_TOLERANCE 1e-3f
+
+// Fractions of a cell, away from the nodes and the cell centers where the linear and quadratic splines have kinks
+static const float Fractions[] = {0.07f, 0.19f, 0.31f, 0.43f, 0.57f, 0.69f, 0.81f, 0.93f};
+#define NUM_FRACTIONS (sizeof(Fractions) / sizeof(Fractions[0]))
+
+// Weight of Cell for a particle at Position, zero if the cell is outside its stencil
+template <typename K, int Dim>
+static float WeightOfCell(const float (&Position)[Dim], const int (&Cell)[Dim])
+{
+    float Result = 0.0f;
+    K::ForEachNode(K::BuildStencil(Position), [&](const typename K::Node& Node)
+    {
+        bool Same = true;
+        for (int Axis = 0; Axis < Dim; Axis++)
+        {
+            Same = Same && Node.Cell[Axis] == Cell[Axis];
+        }
+        if (Same)
+        {
+            Result = Node.Weight;
+        }
+    });
+    return Result;
+}
+
+template <int Dim, int Order>
+static void CheckKernel(const char* Name)
+{
+    typedef MPMKernels::Kernel<Dim, Order, float> K;
+    const int FailedBefore = FailedChecks();
+
+    for (size_t Sample = 0; Sample < NUM_FRACTIONS; Sample++)
+    {
+        // Each axis takes a different fraction so the axes don't mirror each other
+        float Position[Dim];
+        for (int Axis = 0; Axis < Dim; Axis++)
+        {
+            Position[Axis] = BASE_CELL + Fractions[(Sample + 3 * Axis) % NUM_FRACTIONS];
+        }
+
+        float Sum = 0.0f;
+        float FirstMoment[Dim] = {};
+        float SecondMoment[Dim][Dim] = {};
+        K::ForEachNode(K::BuildStencil(Position), [&](const typename K::Node& Node)
+        {
+            Sum += Node.Weight;
+            for (int Row = 0; Row < Dim; Row++)
+            {
+                FirstMoment[Row] += Node.Weight * Node.Distance[Row];
+                for (int Column = 0; Column < Dim; Column++)
+                {
+                    SecondMoment[Row][Column] += Node.Weight * Node.Distance[Row] * Node.Distance[Column];
+                }
+            }
+
+            // Central differences of this node's weight along each axis
+            for (int Axis = 0; Axis < Dim; Axis++)
+            {
+                float Forward[Dim], Backward[Dim];
+                for (int Other = 0; Other < Dim; Other++)
+                {
+                    Forward[Other] = Position[Other] + (Other == Axis ? DIFFERENCE_STEP : 0.0f);
+                    Backward[Other] = Position[Other] - (Other == Axis ? DIFFERENCE_STEP : 0.0f);
+                }
+                float Difference = (WeightOfCell<K, Dim>(Forward, Node.Cell) - WeightOfCell<K, Dim>(Backward, Node.Cell)) / (2.0f * DIFFERENCE_STEP);
+                CHECK_NEAR(Node.Gradient[Axis], Difference, GRADIENT_TOLERANCE);
+            }
+        });
+
+        CHECK_NEAR(Sum, 1.0f, MOMENT_TOLERANCE);
+        for (int Row = 0; Row < Dim; Row++)
+        {
+            CHECK_NEAR(FirstMoment[Row], 0.0f, MOMENT_TOLERANCE);
+            for (int Column = 0; Column < Dim; Column++)
+            {
+                float Expected = 0.0f;
+                if (Row == Column)
+                {
+                    if constexpr (K::Spline::HasConstantInertia)
+                    {
+                        Expected = 1.0f / K::Spline::InverseInertia;
+                    }
+                    else
+                    {
+                        // Fx * (1 - Fx) from the two nodes either side
+                        const float Fx = Position[Row] - BASE_CELL;
+                        Expected = Fx * (1.0f - Fx);
+                    }
+                }
+                CHECK_NEAR(SecondMoment[Row][Column], Expected, MOMENT_TOLERANCE);
+            }
+        }
+    }
+    printf("%s: %s\n", Name, FailedChecks() == FailedBefore ? "ok" : "failed");
+}
+
+int main()
+{
+    CheckKernel<2, MPMKernels::LinearSpline>("2D linear");
+    CheckKernel<2, MPMKernels::QuadraticSpline>("2D quadratic");
+    CheckKernel<2, MPMKernels::CubicSpline>("2D cubic");
+    CheckKernel<3, MPMKernels::LinearSpline>("3D linear");
+    CheckKernel<3, MPMKernels::QuadraticSpline>("3D quadratic");
+    CheckKernel<3, MPMKernels::CubicSpline>("3D cubic");
+    return TestResult("MPMKernelsTest");
+}
@@ -0,0 +1,223 @@
+// Compact particle storage against full float matrices. The half conversions are checked against known values and,
+// where the build has F16C, bit for bit against it. Then a jelly block is stepped once with each layout, with the CPU
+// solver's quadratic transfers and neo-Hookean stress, and the two runs have to agree
+#include "Check.h"
+#include "fluids/MPMKernels.h"
+#include "fluids/ParticleStorage.h"
+#include "util/3DMath.h"
+
+#include <algorithm>
+#include <vector>
+
+// Same scene and parameters as the CPU jelly, see FluidObject
+#define GRID_RESOLUTION 64
+#define GRID_SIZE 1.0f
+#define ELASTIC_LAMDA 40.0f
+#define ELASTIC_MU 20.0f
+#define TIMESTEP 0.002f
+#define NUM_STEPS 300
+
+typedef MPMKernels::Kernel<2, MPMKernels::QuadraticSpline, float> TestKernel;
+
+static uint32_t FloatBits(float Value)
+{
+    uint32_t Bits;
+    memcpy(&Bits, &Value, sizeof(Bits));
+    return Bits;
+}
+
+static float BitsFloat(uint32_t Bits)
+{
+    float Value;
+    memcpy(&Value, &Bits, sizeof(Value));
+    return Value;
+}
+
+static void CheckHalfConversions()
+{
+    CHECK(HalfFromFloat(0.0f) == 0x0000);
+    CHECK(HalfFromFloat(-0.0f) == 0x8000);
+    CHECK(HalfFromFloat(1.0f) == 0x3c00);
+    CHECK(HalfFromFloat(-2.0f) == 0xc000);
+    CHECK(HalfFromFloat(0.1f) == 0x2e66);
+    CHECK(HalfFromFloat(65504.0f) == 0x7bff);
+    // Halfway to the next power of two rounds to even, which is infinity
+    CHECK(HalfFromFloat(65519.0f) == 0x7bff);
+    CHECK(HalfFromFloat(65520.0f) == 0x7c00);
+    CHECK(HalfFromFloat(BitsFloat(0x7f800000)) == 0x7c00);
+    CHECK((HalfFromFloat(BitsFloat(0x7fc00000)) & 0x7e00) == 0x7e00);
+    // Smallest normal and subnormal, and the halfway point below the latter
+    CHECK(HalfFromFloat(6.103515625e-5f) == 0x0400);
+    CHECK(HalfFromFloat(5.9604644775390625e-8f) == 0x0001);
+    CHECK(HalfFromFloat(2.98023223876953125e-8f) == 0x0000);
+    CHECK(HalfFromFloat(3.0e-8f) == 0x0001);
+    // 1 + 2^-11 is halfway between 1 and the next half, even is 1
+    CHECK(HalfFromFloat(1.00048828125f) == 0x3c00);
+    CHECK(HalfFromFloat(1.00146484375f) == 0x3c02);
+
+    // Every finite half survives the round trip
+    for (uint32_t Half = 0; Half < 0x10000; Half++)
+    {
+        if ((Half & 0x7c00) != 0x7c00)
+        {
+            CHECK(HalfFromFloat(FloatFromHalf(static_cast<uint16_t>(Half))) == Half);
+        }
+    }
+    CHECK(FloatFromHalf(0x3555) == 0.333251953125f);
+    CHECK(FloatFromHalf(0x8001) == -5.9604644775390625e-8f);
+
+#ifdef PARTICLE_STORAGE_F16C
+    for (uint32_t Half = 0; Half < 0x10000; Half++)
+    {
+        float Expected = _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(static_cast<int>(Half))));
+        CHECK(FloatBits(FloatFromHalf(static_cast<uint16_t>(Half))) == FloatBits(Expected));
+    }
+    // A stride coprime to 2^32 visits floats of every exponent, with a mix of rounding cases
+    for (uint64_t Step = 0, Bits = 0; Step < (1u << 24); Step++, Bits = (Bits + 0x9e3779b1u) & 0xffffffffu)
+    {
+        float Value = BitsFloat(static_cast<uint32_t>(Bits));
+        int Expected = _mm_cvtsi128_si32(_mm_cvtps_ph(_mm_set_ss(Value), _MM_FROUND_TO_NEAREST_INT)) & 0xffff;
+        CHECK(HalfFromFloat(Value) == Expected);
+    }
+#else
+    printf("Built without F16C, checked the scalar conversions on their own\n");
+#endif
+}
+
+template <typename AffineType, typename DeformType>
+struct TestParticle
+{
+    Math::Vec4 Position;
+    Math::Vec4 Velocity;
+    AffineType C;
+    DeformType DeformGradient = Math::Identity;
+};
+
+struct RunResult
+{
+    double KineticEnergy = 0.0;
+    double CenterX = 0.0;
+    double CenterY = 0.0;
+};
+
+// MPMSolver's explicit CPU step for jelly, ScatterParticle, UpdateGridCell, GatherParticle and AdvanceParticle on
+// particles keeping C and F in the given types. Mass and volume are ParticlePhysicsData's defaults
+template <typename AffineType, typename DeformType>
+static RunResult RunJellyBlock()
+{
+    const float Dx = GRID_SIZE / GRID_RESOLUTION;
+    const float InvDx = 1.0f / Dx;
+    const float Mass = 4.0f;
+    const float InitialVolume = 1.0f;
+
+    std::vector<TestParticle<AffineType, DeformType>> Particles;
+    for (int i = 0; i < 100; i++)
+    {
+        for (int j = 0; j < 100; j++)
+        {
+            TestParticle<AffineType, DeformType> Particle;
+            Particle.Position = Math::Vec4(0.3f + i * 0.004f, 0.1f + j * 0.004f, 0.5f, 1.0f);
+            Particle.Velocity = Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+            Particles.push_back(Particle);
+        }
+    }
+
+    std::vector<Math::Vec4> Grid(GRID_RESOLUTION * GRID_RESOLUTION);
+    const Math::Vec4 Gravity(0.0f, -9.8f * TIMESTEP, 0.0f, 0.0f);
+    for (int Step = 0; Step < NUM_STEPS; Step++)
+    {
+        std::fill(Grid.begin(), Grid.end(), Math::Vec4(0.0f, 0.0f, 0.0f, 0.0f));
+        for (const auto& Particle : Particles)
+        {
+            Math::Matrix4x4 DeformGradient = Particle.DeformGradient;
+            TestKernel::Matrix F = {{{DeformGradient.m11, DeformGradient.m12}, {DeformGradient.m21, DeformGradient.m22}}};
+            TestKernel::Matrix Tau = TestKernel::NeoHookeanKirchhoff(F, ELASTIC_MU, ELASTIC_LAMDA);
+            Math::Matrix4x4 Stress;
+            Stress.m11 = Tau.M[0][0];
+            Stress.m12 = Tau.M[0][1];
+            Stress.m21 = Tau.M[1][0];
+            Stress.m22 = Tau.M[1][1];
+            Stress = Stress * -(InitialVolume * TestKernel::Spline::InverseInertia * InvDx * InvDx);
+
+            Math::Matrix4x4 Affine = Stress * TIMESTEP + (Math::Matrix4x4(Particle.C) * Mass);
+            Math::Vec3 Momentum = Particle.Velocity.XYZ() * Mass;
+            const float Position[2] = {Particle.Position.x * InvDx, Particle.Position.y * InvDx};
+            TestKernel::ForEachNode(TestKernel::BuildStencil(Position), [&](const TestKernel::Node& Node) {
+                Math::Vec3 CellDistance = Math::Vec3(Node.Distance[0], Node.Distance[1], 0.0f) * Dx;
+                Math::Vec4& Cell = Grid[Node.Cell[0] * GRID_RESOLUTION + Node.Cell[1]];
+                Cell.w += Mass * Node.Weight;
+                Cell += (Momentum + Affine.TransformVector(CellDistance)) * Node.Weight;
+            });
+        }
+
+        for (int Index = 0; Index < GRID_RESOLUTION * GRID_RESOLUTION; Index++)
+        {
+            Math::Vec4& Cell = Grid[Index];
+            if (Cell.w > 0.00001f)
+            {
+                Cell.x /= Cell.w;
+                Cell.y /= Cell.w;
+                Cell.z /= Cell.w;
+                Cell += Gravity;
+                int X = Index / GRID_RESOLUTION;
+                int Y = Index % GRID_RESOLUTION;
+                if (X < 2 || X > GRID_RESOLUTION - 3)
+                {
+                    Cell.x = 0.0f;
+                }
+                if (Y < 2 || Y > GRID_RESOLUTION - 3)
+                {
+                    Cell.y = 0.0f;
+                }
+            }
+        }
+
+        for (auto& Particle : Particles)
+        {
+            Particle.Velocity = Math::Vec4();
+            Math::Matrix4x4 B;
+            const float Position[2] = {Particle.Position.x * InvDx, Particle.Position.y * InvDx};
+            TestKernel::ForEachNode(TestKernel::BuildStencil(Position), [&](const TestKernel::Node& Node) {
+                Math::Vec4 CellDistance = Math::Vec4(Node.Distance[0], Node.Distance[1], 0.0f, 0.0f) * Dx;
+                const Math::Vec4& Cell = Grid[Node.Cell[0] * GRID_RESOLUTION + Node.Cell[1]];
+                Math::Vec4 WeightedVelocity(Cell.x * Node.Weight, Cell.y * Node.Weight, Cell.z * Node.Weight, 0.0f);
+                B += CellDistance.OuterProduct(WeightedVelocity) * InvDx;
+                Particle.Velocity += WeightedVelocity;
+            });
+            Particle.C = B * TestKernel::Spline::InverseInertia * InvDx;
+
+            Particle.Position += Particle.Velocity * TIMESTEP;
+            Particle.Position.x = std::min(std::max(Particle.Position.x, Dx), GRID_SIZE - Dx);
+            Particle.Position.y = std::min(std::max(Particle.Position.y, Dx), GRID_SIZE - Dx);
+            Particle.DeformGradient = (Math::Identity + (Math::Matrix4x4(Particle.C) * TIMESTEP)) * Math::Matrix4x4(Particle.DeformGradient);
+        }
+    }
+
+    RunResult Result;
+    for (const auto& Particle : Particles)
+    {
+        Result.KineticEnergy += 0.5 * Mass * Particle.Velocity.Dot(Particle.Velocity);
+        Result.CenterX += Particle.Position.x;
+        Result.CenterY += Particle.Position.y;
+    }
+    Result.CenterX /= Particles.size();
+    Result.CenterY /= Particles.size();
+    return Result;
+}
+
+int main()
+{
+    CheckHalfConversions();
+
+    RunResult Full = RunJellyBlock<Math::Matrix4x4, Math::Matrix4x4>();
+    RunResult Compact = RunJellyBlock<HalfPlanarMatrix, PlanarMatrix>();
+    printf("Kinetic energy %.9g full, %.9g compact, center of mass (%.7f, %.7f) full, (%.7f, %.7f) compact\n", Full.KineticEnergy, Compact.KineticEnergy, Full.CenterX, Full.CenterY, Compact.CenterX, Compact.CenterY);
+
+    // The block has to have fallen and be moving for the comparison to mean anything
+    CHECK(Full.KineticEnergy > 1.0);
+    CHECK(Full.CenterY < 0.29);
+    CHECK_NEAR(Compact.KineticEnergy, Full.KineticEnergy, 1e-3 * Full.KineticEnergy);
+    CHECK_NEAR(Compact.CenterX, Full.CenterX, 1e-5);
+    CHECK_NEAR(Compact.CenterY, Full.CenterY, 1e-5);
+    return TestResult("ParticleStorageTest");
+}